@@ -292,6 +292,8 @@ workspace("xenia")
   include("src/xenia/hid")
   include("src/xenia/hid/nop")
   include("src/xenia/kernel")
+  include("src/xenia/tools/aot-compiler")
+  include("src/xenia/tools/trace-decoder")
   include("src/xenia/ui")
   include("src/xenia/ui/vulkan")
   include("src/xenia/vfs")
@@ -524,9 +524,31 @@ void HIRBuilder::RemoveBlock(Block* block) {
   if (block == block_tail_) {
     block_tail_ = block->prev;
   }
+  if (block == current_block_) {
+    current_block_ = nullptr;
+  }
   block->next = block->prev = nullptr;
 }
 
+Block* HIRBuilder::InsertBlock(Block* next_block) {
+  Block* block = arena_->Alloc<Block>();
+  block->ordinal = UINT16_MAX;
+  block->incoming_values = nullptr;
+  block->arena = arena_;
+  block->next = next_block;
+  block->prev = next_block->prev;
+  if (block->prev) {
+    block->prev->next = block;
+  } else {
+    block_head_ = block;
+  }
+  next_block->prev = block;
+  block->label_head = block->label_tail = nullptr;
+  block->incoming_edge_head = block->outgoing_edge_head = nullptr;
+  block->instr_head = block->instr_tail = nullptr;
+  return block;
+}
+
 void HIRBuilder::MergeAdjacentBlocks(Block* left, Block* right) {
   assert_true(left->next == right && right->prev == left);
   assert_true(!right->incoming_edge_head ||
@@ -696,6 +718,11 @@ Instr* HIRBuilder::AppendInstr(const OpcodeInfo& opcode_info, uint16_t flags,
   return instr;
 }
 
+Instr* HIRBuilder::AppendOp(const OpcodeInfo& opcode, uint16_t flags,
+                            Value* dest) {
+  return AppendInstr(opcode, flags, dest);
+}
+
 Value* HIRBuilder::AllocValue(TypeName type) {
   Value* value = arena_->Alloc<Value>();
   value->ordinal = next_value_ordinal_++;
@@ -1203,20 +1230,22 @@ void HIRBuilder::ContextBarrier() {
   AppendInstr(OPCODE_CONTEXT_BARRIER_info, 0);
 }
 
-Value* HIRBuilder::LoadMmio(cpu::MMIORange* mmio_range, uint32_t address,
-                            TypeName type) {
-  Instr* i = AppendInstr(OPCODE_LOAD_MMIO_info, 0, AllocValue(type));
+Value* HIRBuilder::LoadMmio(cpu::MMIORange* mmio_range, Value* address,
+                            TypeName type, uint32_t load_flags) {
+  ASSERT_ADDRESS_TYPE(address);
+  Instr* i = AppendInstr(OPCODE_LOAD_MMIO_info, load_flags, AllocValue(type));
   i->src1.offset = reinterpret_cast<uint64_t>(mmio_range);
-  i->src2.offset = address;
+  i->set_src2(address);
   i->src3.value = NULL;
   return i->dest;
 }
 
-void HIRBuilder::StoreMmio(cpu::MMIORange* mmio_range, uint32_t address,
-                           Value* value) {
-  Instr* i = AppendInstr(OPCODE_STORE_MMIO_info, 0);
+void HIRBuilder::StoreMmio(cpu::MMIORange* mmio_range, Value* address,
+                           Value* value, uint32_t store_flags) {
+  ASSERT_ADDRESS_TYPE(address);
+  Instr* i = AppendInstr(OPCODE_STORE_MMIO_info, store_flags);
   i->src1.offset = reinterpret_cast<uint64_t>(mmio_range);
-  i->src2.offset = address;
+  i->set_src2(address);
   i->set_src3(value);
 }
 
@@ -1274,7 +1303,9 @@ void HIRBuilder::CacheControl(Value* address, size_t cache_line_size,
   i->src3.value = NULL;
 }
 
-void HIRBuilder::MemoryBarrier() { AppendInstr(OPCODE_MEMORY_BARRIER_info, 0); }
+void HIRBuilder::MemoryBarrier(MemoryBarrierType type) {
+  AppendInstr(OPCODE_MEMORY_BARRIER_info, uint32_t(type));
+}
 
 void HIRBuilder::SetRoundingMode(Value* value) {
   ASSERT_INTEGER_TYPE(value);
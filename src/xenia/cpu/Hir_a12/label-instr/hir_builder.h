@@ -26,6 +26,12 @@ namespace hir {
 
 enum FunctionAttributes {
   FUNCTION_ATTRIB_INLINE = (1 << 1),
+  // Holds code inlined from other guest functions, so it goes stale when
+  // any of them is overwritten.
+  FUNCTION_ATTRIB_INLINED_CALLS = (1 << 2),
+  // Holds values folded from guest read-only data, so it goes stale when
+  // that data is patched or unloaded.
+  FUNCTION_ATTRIB_READ_ONLY_DATA = (1 << 3),
 };
 
 class HIRBuilder {
@@ -62,6 +68,9 @@ class HIRBuilder {
   void RemoveEdge(Block* src, Block* dest);
   void RemoveEdge(Edge* edge);
   void RemoveBlock(Block* block);
+  // Links a new, empty block in ahead of next_block, so whatever fell through
+  // into next_block falls through into the new block instead.
+  Block* InsertBlock(Block* next_block);
   void MergeAdjacentBlocks(Block* left, Block* right);
 
   // static allocations:
@@ -108,6 +117,9 @@ class HIRBuilder {
 
   Value* AllocValue(TypeName type = INT64_TYPE);
   Value* CloneValue(Value* source);
+  // Appends an instruction of any opcode, for passes copying instructions
+  // generically. The sources are left for the caller to set.
+  Instr* AppendOp(const OpcodeInfo& opcode, uint16_t flags, Value* dest);
 
   // phi type_name, Block* b1, Value* v1, Block* b2, Value* v2, etc
   Value* Assign(Value* value);
@@ -155,8 +167,12 @@ class HIRBuilder {
   void StoreContext(size_t offset, Value* value);
   void ContextBarrier();
 
-  Value* LoadMmio(cpu::MMIORange* mmio_range, uint32_t address, TypeName type);
-  void StoreMmio(cpu::MMIORange* mmio_range, uint32_t address, Value* value);
+  // The address need not be constant; accesses that miss the range go to
+  // guest memory instead.
+  Value* LoadMmio(cpu::MMIORange* mmio_range, Value* address, TypeName type,
+                  uint32_t load_flags = 0);
+  void StoreMmio(cpu::MMIORange* mmio_range, Value* address, Value* value,
+                 uint32_t store_flags = 0);
 
   Value* LoadOffset(Value* address, Value* offset, TypeName type,
                     uint32_t load_flags = 0);
@@ -168,7 +184,7 @@ class HIRBuilder {
   void Memset(Value* address, Value* value, Value* length);
   void CacheControl(Value* address, size_t cache_line_size,
                     CacheControlType type);
-  void MemoryBarrier();
+  void MemoryBarrier(MemoryBarrierType type = MEMORY_BARRIER_TYPE_SYNC);
 
   void SetRoundingMode(Value* value);
   Value* Max(Value* value1, Value* value2);
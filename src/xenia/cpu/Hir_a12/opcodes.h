@@ -37,6 +37,15 @@ enum CacheControlType {
   CACHE_CONTROL_TYPE_DATA_STORE_AND_FLUSH,
 };
 
+// The PPC barrier a MEMORY_BARRIER came from. x86 is TSO, so only sync has
+// to order anything (stores before later loads); the others only keep the
+// compiler from moving memory accesses across them.
+enum MemoryBarrierType {
+  MEMORY_BARRIER_TYPE_SYNC,
+  MEMORY_BARRIER_TYPE_LWSYNC,
+  MEMORY_BARRIER_TYPE_EIEIO,
+};
+
 enum ArithmeticFlags {
   ARITHMETIC_UNSIGNED = (1 << 2),
   ARITHMETIC_SATURATE = (1 << 3),
@@ -322,6 +331,8 @@ enum OpcodeSignature {
   OPCODE_SIG_V_V = (OPCODE_SIG_TYPE_V) | (OPCODE_SIG_TYPE_V << 3),
   OPCODE_SIG_V_O_O =
       (OPCODE_SIG_TYPE_V) | (OPCODE_SIG_TYPE_O << 3) | (OPCODE_SIG_TYPE_O << 6),
+  OPCODE_SIG_V_O_V =
+      (OPCODE_SIG_TYPE_V) | (OPCODE_SIG_TYPE_O << 3) | (OPCODE_SIG_TYPE_V << 6),
   OPCODE_SIG_V_V_O =
       (OPCODE_SIG_TYPE_V) | (OPCODE_SIG_TYPE_V << 3) | (OPCODE_SIG_TYPE_O << 6),
   OPCODE_SIG_V_V_O_V = (OPCODE_SIG_TYPE_V) | (OPCODE_SIG_TYPE_V << 3) |
@@ -213,13 +213,13 @@ DEFINE_OPCODE(
 DEFINE_OPCODE(
     OPCODE_LOAD_MMIO,
     "load_mmio",
-    OPCODE_SIG_V_O_O,
+    OPCODE_SIG_V_O_V,
     OPCODE_FLAG_MEMORY)
 
 DEFINE_OPCODE(
     OPCODE_STORE_MMIO,
     "store_mmio",
-    OPCODE_SIG_X_O_O_V,
+    OPCODE_SIG_X_O_V_V,
     OPCODE_FLAG_MEMORY)
 
 DEFINE_OPCODE(
@@ -8,6 +8,7 @@
 #include "xenia/base/assert.h"
 #include "xenia/base/byte_order.h"
 #include "xenia/base/math.h"
+#include "xenia/cpu/hir/vector_ops.h"
 
 namespace xe {
 namespace cpu {
@@ -810,13 +811,16 @@ void Value::Extract(Value* vec, Value* index) {
   assert_true(vec->type == VEC128_TYPE);
   switch (type) {
     case INT8_TYPE:
-      constant.u8 = vec->constant.v128.u8[index->constant.u8 & 0x1F];
+      constant.u8 = uint8_t(
+          vector_ops::Extract(vec->constant.v128, index->constant.u8, 1));
       break;
     case INT16_TYPE:
-      constant.u16 = vec->constant.v128.u16[index->constant.u16 & 0x7];
+      constant.u16 = uint16_t(
+          vector_ops::Extract(vec->constant.v128, index->constant.u8, 2));
       break;
     case INT32_TYPE:
-      constant.u32 = vec->constant.v128.u32[index->constant.u32 & 0x3];
+      constant.u32 = uint32_t(
+          vector_ops::Extract(vec->constant.v128, index->constant.u8, 4));
       break;
     case INT64_TYPE:
       constant.u64 = vec->constant.v128.u64[index->constant.u64 & 0x1];
@@ -1070,19 +1074,16 @@ void Value::VectorShl(Value* other, TypeName type) {
   assert_true(this->type == VEC128_TYPE && other->type == VEC128_TYPE);
   switch (type) {
     case INT8_TYPE:
-      for (int i = 0; i < 16; i++) {
-        constant.v128.u8[i] <<= other->constant.v128.u8[i] & 0x7;
-      }
+      constant.v128 =
+          vector_ops::Shl<uint8_t>(constant.v128, other->constant.v128);
       break;
     case INT16_TYPE:
-      for (int i = 0; i < 8; i++) {
-        constant.v128.u16[i] <<= other->constant.v128.u16[i] & 0xF;
-      }
+      constant.v128 =
+          vector_ops::Shl<uint16_t>(constant.v128, other->constant.v128);
       break;
     case INT32_TYPE:
-      for (int i = 0; i < 4; i++) {
-        constant.v128.u32[i] <<= other->constant.v128.u32[i] & 0x1F;
-      }
+      constant.v128 =
+          vector_ops::Shl<uint32_t>(constant.v128, other->constant.v128);
       break;
     default:
       assert_unhandled_case(type);
@@ -1094,19 +1095,16 @@ void Value::VectorShr(Value* other, TypeName type) {
   assert_true(this->type == VEC128_TYPE && other->type == VEC128_TYPE);
   switch (type) {
     case INT8_TYPE:
-      for (int i = 0; i < 16; i++) {
-        constant.v128.u8[i] >>= other->constant.v128.u8[i] & 0x7;
-      }
+      constant.v128 =
+          vector_ops::Shr<uint8_t>(constant.v128, other->constant.v128);
       break;
     case INT16_TYPE:
-      for (int i = 0; i < 8; i++) {
-        constant.v128.u16[i] >>= other->constant.v128.u16[i] & 0xF;
-      }
+      constant.v128 =
+          vector_ops::Shr<uint16_t>(constant.v128, other->constant.v128);
       break;
     case INT32_TYPE:
-      for (int i = 0; i < 4; i++) {
-        constant.v128.u32[i] >>= other->constant.v128.u32[i] & 0x1F;
-      }
+      constant.v128 =
+          vector_ops::Shr<uint32_t>(constant.v128, other->constant.v128);
       break;
     default:
       assert_unhandled_case(type);
@@ -1118,22 +1116,16 @@ void Value::VectorRol(Value* other, TypeName type) {
   assert_true(this->type == VEC128_TYPE && other->type == VEC128_TYPE);
   switch (type) {
     case INT8_TYPE:
-      for (int i = 0; i < 16; i++) {
-        constant.v128.u8[i] = xe::rotate_left(constant.v128.u8[i],
-                                              other->constant.v128.i8[i] & 0x7);
-      }
+      constant.v128 =
+          vector_ops::RotateLeft<uint8_t>(constant.v128, other->constant.v128);
       break;
     case INT16_TYPE:
-      for (int i = 0; i < 8; i++) {
-        constant.v128.u16[i] = xe::rotate_left(
-            constant.v128.u16[i], other->constant.v128.u16[i] & 0xF);
-      }
+      constant.v128 =
+          vector_ops::RotateLeft<uint16_t>(constant.v128, other->constant.v128);
       break;
     case INT32_TYPE:
-      for (int i = 0; i < 4; i++) {
-        constant.v128.u32[i] = xe::rotate_left(
-            constant.v128.u32[i], other->constant.v128.u32[i] & 0x1F);
-      }
+      constant.v128 =
+          vector_ops::RotateLeft<uint32_t>(constant.v128, other->constant.v128);
       break;
     default:
       assert_unhandled_case(type);
@@ -1470,6 +1462,138 @@ void Value::VectorAverage(Value* other, TypeName type, bool is_unsigned,
   }
 }
 
+void Value::VectorSha(Value* other, TypeName type) {
+  assert_true(this->type == VEC128_TYPE && other->type == VEC128_TYPE);
+  switch (type) {
+    case INT8_TYPE:
+      constant.v128 =
+          vector_ops::Shr<int8_t>(constant.v128, other->constant.v128);
+      break;
+    case INT16_TYPE:
+      constant.v128 =
+          vector_ops::Shr<int16_t>(constant.v128, other->constant.v128);
+      break;
+    case INT32_TYPE:
+      constant.v128 =
+          vector_ops::Shr<int32_t>(constant.v128, other->constant.v128);
+      break;
+    default:
+      assert_unhandled_case(type);
+      break;
+  }
+}
+
+void Value::VectorMax(Value* other, TypeName type, bool is_unsigned) {
+  assert_true(this->type == VEC128_TYPE && other->type == VEC128_TYPE);
+  const vec128_t& a = constant.v128;
+  const vec128_t& b = other->constant.v128;
+  switch (type) {
+    case INT8_TYPE:
+      constant.v128 = is_unsigned ? vector_ops::Max<uint8_t>(a, b)
+                                  : vector_ops::Max<int8_t>(a, b);
+      break;
+    case INT16_TYPE:
+      constant.v128 = is_unsigned ? vector_ops::Max<uint16_t>(a, b)
+                                  : vector_ops::Max<int16_t>(a, b);
+      break;
+    case INT32_TYPE:
+      constant.v128 = is_unsigned ? vector_ops::Max<uint32_t>(a, b)
+                                  : vector_ops::Max<int32_t>(a, b);
+      break;
+    default:
+      assert_unhandled_case(type);
+      break;
+  }
+}
+
+void Value::VectorMin(Value* other, TypeName type, bool is_unsigned) {
+  assert_true(this->type == VEC128_TYPE && other->type == VEC128_TYPE);
+  const vec128_t& a = constant.v128;
+  const vec128_t& b = other->constant.v128;
+  switch (type) {
+    case INT8_TYPE:
+      constant.v128 = is_unsigned ? vector_ops::Min<uint8_t>(a, b)
+                                  : vector_ops::Min<int8_t>(a, b);
+      break;
+    case INT16_TYPE:
+      constant.v128 = is_unsigned ? vector_ops::Min<uint16_t>(a, b)
+                                  : vector_ops::Min<int16_t>(a, b);
+      break;
+    case INT32_TYPE:
+      constant.v128 = is_unsigned ? vector_ops::Min<uint32_t>(a, b)
+                                  : vector_ops::Min<int32_t>(a, b);
+      break;
+    default:
+      assert_unhandled_case(type);
+      break;
+  }
+}
+
+void Value::LoadVectorShl(Value* sh) {
+  assert_true(type == VEC128_TYPE && sh->type == INT8_TYPE);
+  constant.v128 = vector_ops::LoadVectorShl(sh->constant.u8);
+}
+
+void Value::LoadVectorShr(Value* sh) {
+  assert_true(type == VEC128_TYPE && sh->type == INT8_TYPE);
+  constant.v128 = vector_ops::LoadVectorShr(sh->constant.u8);
+}
+
+void Value::Insert(Value* index, Value* part) {
+  assert_true(type == VEC128_TYPE);
+  constant.v128 = vector_ops::Insert(constant.v128, index->constant.u8,
+                                     part->constant.u64,
+                                     GetTypeSize(part->type));
+}
+
+void Value::Permute(Value* ctrl, Value* value1, Value* value2,
+                    TypeName type) {
+  assert_true(this->type == VEC128_TYPE);
+  const vec128_t& a = value1->constant.v128;
+  const vec128_t& b = value2->constant.v128;
+  switch (type) {
+    case INT8_TYPE:
+      constant.v128 = vector_ops::PermuteBytes(ctrl->constant.v128, a, b);
+      break;
+    case INT16_TYPE:
+      constant.v128 = vector_ops::PermuteHalfwords(ctrl->constant.v128, a, b);
+      break;
+    case INT32_TYPE:
+      assert_true(ctrl->type == INT32_TYPE);
+      constant.v128 = vector_ops::PermuteWords(ctrl->constant.u32, a, b);
+      break;
+    default:
+      assert_unhandled_case(type);
+      break;
+  }
+}
+
+void Value::Swizzle(uint32_t swizzle_mask) {
+  assert_true(type == VEC128_TYPE);
+  constant.v128 = vector_ops::SwizzleWords(constant.v128, swizzle_mask);
+}
+
+bool Value::Pack(Value* value1, Value* value2, uint32_t pack_flags) {
+  assert_true(type == VEC128_TYPE);
+  vec128_t result;
+  if (!vector_ops::Pack(pack_flags, value1->constant.v128,
+                        value2->constant.v128, &result)) {
+    return false;
+  }
+  set_constant(result);
+  return true;
+}
+
+bool Value::Unpack(Value* value, uint32_t pack_flags) {
+  assert_true(type == VEC128_TYPE);
+  vec128_t result;
+  if (!vector_ops::Unpack(pack_flags, value->constant.v128, &result)) {
+    return false;
+  }
+  set_constant(result);
+  return true;
+}
+
 void Value::ByteSwap() {
   switch (type) {
     case INT8_TYPE:
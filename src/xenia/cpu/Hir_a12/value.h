@@ -529,6 +529,18 @@ class Value {
   void DotProduct4(Value* other);
   void VectorAverage(Value* other, TypeName type, bool is_unsigned,
                      bool saturate);
+  void VectorSha(Value* other, TypeName type);
+  void VectorMax(Value* other, TypeName type, bool is_unsigned);
+  void VectorMin(Value* other, TypeName type, bool is_unsigned);
+  void LoadVectorShl(Value* sh);
+  void LoadVectorShr(Value* sh);
+  void Insert(Value* index, Value* part);
+  void Permute(Value* ctrl, Value* value1, Value* value2, TypeName type);
+  void Swizzle(uint32_t swizzle_mask);
+  // Leave the value untouched and return false for modes the backend has no
+  // sequence for either.
+  bool Pack(Value* value1, Value* value2, uint32_t pack_flags);
+  bool Unpack(Value* value, uint32_t pack_flags);
   void ByteSwap();
   void CountLeadingZeros(const Value* other);
   bool Compare(Opcode opcode, Value* other);
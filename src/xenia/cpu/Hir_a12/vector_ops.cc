@@ -0,0 +1,369 @@
+#include "xenia/cpu/hir/vector_ops.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "xenia/cpu/hir/opcodes.h"
+
+#include "third_party/half/include/half.hpp"
+
+namespace xe {
+namespace cpu {
+namespace hir {
+namespace vector_ops {
+
+static float AsFloat(uint32_t bits) {
+  float value;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+// vmaxps against min then vminps against max, as the PACK sequences saturate:
+// NaN (and anything below min) packs as min.
+static uint32_t Saturate(const vec128_t& value, int n, uint32_t min,
+                         uint32_t max) {
+  uint32_t bits = value.f32[n] > AsFloat(min) ? value.u32[n] : min;
+  return AsFloat(bits) < AsFloat(max) ? bits : max;
+}
+
+// The UNPACK sequences build floats around 3.0 by adding the sign-extended
+// field to its bits, and return a quiet NaN for the one negative value that
+// would not fit.
+static uint32_t UnpackField(uint32_t field, int bits, uint32_t base,
+                            uint32_t overflow) {
+  int32_t extended = int32_t(field << (32 - bits)) >> (32 - bits);
+  uint32_t result = base + uint32_t(extended);
+  return result == overflow ? 0x7FC00000u : result;
+}
+
+static int32_t Clamp(int32_t value, int32_t min, int32_t max) {
+  return std::min(std::max(value, min), max);
+}
+
+vec128_t LoadVectorShl(uint8_t sh) {
+  vec128_t result;
+  sh &= 0xF;
+  for (int n = 0; n < 16; ++n) {
+    result.u8[n ^ 0x3] = uint8_t(sh + n);
+  }
+  return result;
+}
+
+vec128_t LoadVectorShr(uint8_t sh) {
+  vec128_t result;
+  sh &= 0xF;
+  for (int n = 0; n < 16; ++n) {
+    result.u8[n ^ 0x3] = uint8_t(16 - sh + n);
+  }
+  return result;
+}
+
+uint64_t Extract(const vec128_t& value, uint8_t index, size_t part_size) {
+  switch (part_size) {
+    case 1:
+      return value.u8[(index ^ 0x3) & 0xF];
+    case 2:
+      return value.u16[(index ^ 0x1) & 0x7];
+    default:
+      return value.u32[index & 0x3];
+  }
+}
+
+vec128_t Insert(const vec128_t& value, uint8_t index, uint64_t part,
+                size_t part_size) {
+  vec128_t result = value;
+  switch (part_size) {
+    case 1:
+      result.u8[(index ^ 0x3) & 0xF] = uint8_t(part);
+      break;
+    case 2:
+      result.u16[(index ^ 0x1) & 0x7] = uint16_t(part);
+      break;
+    default:
+      result.u32[index & 0x3] = uint32_t(part);
+      break;
+  }
+  return result;
+}
+
+vec128_t PermuteWords(uint32_t control, const vec128_t& value1,
+                      const vec128_t& value2) {
+  vec128_t result;
+  for (int n = 0; n < 4; ++n) {
+    uint32_t select = control >> (n * 8);
+    result.u32[n] = ((select & 0x4) ? value2 : value1).u32[select & 0x3];
+  }
+  return result;
+}
+
+vec128_t PermuteBytes(const vec128_t& control, const vec128_t& value1,
+                      const vec128_t& value2) {
+  vec128_t result;
+  for (int n = 0; n < 16; ++n) {
+    uint32_t index = (control.u8[n] ^ 0x3) & 0x1F;
+    result.u8[n] = (index & 0x10 ? value2 : value1).u8[index & 0xF];
+  }
+  return result;
+}
+
+vec128_t PermuteHalfwords(const vec128_t& control, const vec128_t& value1,
+                          const vec128_t& value2) {
+  vec128_t result;
+  for (int n = 0; n < 8; ++n) {
+    uint32_t index = (control.u16[n] ^ 0x1) & 0xF;
+    result.u16[n] = (index & 0x8 ? value2 : value1).u16[index & 0x7];
+  }
+  return result;
+}
+
+vec128_t SwizzleWords(const vec128_t& value, uint32_t swizzle_mask) {
+  vec128_t result;
+  for (int n = 0; n < 4; ++n) {
+    result.u32[n] = value.u32[(swizzle_mask >> (n * 2)) & 0x3];
+  }
+  return result;
+}
+
+vec128_t PackFloat16_2(const vec128_t& value) {
+  vec128_t result = {};
+  for (int n = 0; n < 2; ++n) {
+    result.u16[7 - n] =
+        half_float::detail::float2half<std::round_toward_zero>(value.f32[n]);
+  }
+  return result;
+}
+
+vec128_t PackFloat16_4(const vec128_t& value) {
+  vec128_t result = {};
+  for (int n = 0; n < 4; ++n) {
+    result.u16[7 - (n ^ 2)] =
+        half_float::detail::float2half<std::round_toward_zero>(value.f32[n]);
+  }
+  return result;
+}
+
+vec128_t UnpackFloat16_2(const vec128_t& value) {
+  vec128_t result;
+  for (int n = 0; n < 2; ++n) {
+    result.f32[n] = half_float::detail::half2float(value.u16[(6 + n) ^ 1]);
+  }
+  result.f32[2] = 0.0f;
+  result.f32[3] = 1.0f;
+  return result;
+}
+
+vec128_t UnpackFloat16_4(const vec128_t& value) {
+  vec128_t result;
+  for (int n = 0; n < 4; ++n) {
+    result.f32[n] = half_float::detail::half2float(value.u16[(4 + n) ^ 1]);
+  }
+  return result;
+}
+
+// Two halves of 8 bytes (or 4 halfwords) into one vector in guest order.
+static vec128_t Join8In16(const uint8_t (&parts)[16]) {
+  vec128_t result;
+  for (int n = 0; n < 16; ++n) {
+    result.u8[n] = parts[n ^ 0x2];
+  }
+  return result;
+}
+
+static vec128_t Join16In32(const uint16_t (&parts)[8]) {
+  vec128_t result;
+  for (int n = 0; n < 8; ++n) {
+    result.u16[n] = parts[n ^ 0x1];
+  }
+  return result;
+}
+
+bool Pack(uint32_t pack_flags, const vec128_t& value1, const vec128_t& value2,
+          vec128_t* result) {
+  vec128_t r = {};
+  switch (pack_flags & PACK_TYPE_MODE) {
+    case PACK_TYPE_D3DCOLOR: {
+      uint32_t t[4];
+      for (int n = 0; n < 4; ++n) {
+        t[n] = Saturate(value1, n, 0x40400000u, 0x404000FFu) & 0xFF;
+      }
+      // RGBA (XYZW) -> ARGB (WXYZ)
+      r.u32[3] = t[2] | (t[1] << 8) | (t[0] << 16) | (t[3] << 24);
+      break;
+    }
+    case PACK_TYPE_FLOAT16_2:
+      r = PackFloat16_2(value1);
+      break;
+    case PACK_TYPE_FLOAT16_4:
+      r = PackFloat16_4(value1);
+      break;
+    case PACK_TYPE_SHORT_2:
+    case PACK_TYPE_SHORT_4: {
+      uint32_t t[4];
+      for (int n = 0; n < 4; ++n) {
+        t[n] = Saturate(value1, n, 0x403F8001u, 0x40407FFFu) & 0xFFFF;
+      }
+      if ((pack_flags & PACK_TYPE_MODE) == PACK_TYPE_SHORT_2) {
+        r.u32[3] = t[1] | (t[0] << 16);
+      } else {
+        r.u32[2] = t[1] | (t[0] << 16);
+        r.u32[3] = t[3] | (t[2] << 16);
+      }
+      break;
+    }
+    case PACK_TYPE_UINT_2101010: {
+      uint32_t x = Saturate(value1, 0, 0x403FFE01u, 0x404001FFu) & 0x3FF;
+      uint32_t y = Saturate(value1, 1, 0x403FFE01u, 0x404001FFu) & 0x3FF;
+      uint32_t z = Saturate(value1, 2, 0x403FFE01u, 0x404001FFu) & 0x3FF;
+      uint32_t w = Saturate(value1, 3, 0x40400000u, 0x40400003u) & 0x3;
+      uint32_t packed = x | (y << 10) | (z << 20) | (w << 30);
+      for (int n = 0; n < 4; ++n) {
+        r.u32[n] = packed;
+      }
+      break;
+    }
+    case PACK_TYPE_ULONG_4202020: {
+      uint32_t x = Saturate(value1, 0, 0x40380001u, 0x4047FFFFu) & 0xFFFFF;
+      uint32_t y = Saturate(value1, 1, 0x40380001u, 0x4047FFFFu) & 0xFFFFF;
+      uint32_t z = Saturate(value1, 2, 0x40380001u, 0x4047FFFFu) & 0xFFFFF;
+      uint32_t w = Saturate(value1, 3, 0x40400000u, 0x4040000Fu) & 0xF;
+      r.u32[2] = ((y >> 12) & 0xFF) | (z << 8) | (w << 28);
+      r.u32[3] = x | (y << 20);
+      break;
+    }
+    case PACK_TYPE_8_IN_16: {
+      uint8_t parts[16];
+      for (int n = 0; n < 16; ++n) {
+        const vec128_t& value = n < 8 ? value1 : value2;
+        if (IsPackInUnsigned(pack_flags)) {
+          if (!IsPackOutUnsigned(pack_flags)) {
+            return false;
+          }
+          uint16_t part = value.u16[n & 0x7];
+          parts[n] = IsPackOutSaturate(pack_flags)
+                         ? uint8_t(std::min<uint16_t>(part, 0xFF))
+                         : uint8_t(part);
+        } else {
+          if (!IsPackOutSaturate(pack_flags)) {
+            return false;
+          }
+          int16_t part = value.i16[n & 0x7];
+          parts[n] = IsPackOutUnsigned(pack_flags)
+                         ? uint8_t(Clamp(part, 0, 255))
+                         : uint8_t(Clamp(part, -128, 127));
+        }
+      }
+      r = Join8In16(parts);
+      break;
+    }
+    case PACK_TYPE_16_IN_32: {
+      uint16_t parts[8];
+      for (int n = 0; n < 8; ++n) {
+        const vec128_t& value = n < 4 ? value1 : value2;
+        if (IsPackInUnsigned(pack_flags)) {
+          if (!IsPackOutUnsigned(pack_flags)) {
+            return false;
+          }
+          uint32_t part = value.u32[n & 0x3];
+          parts[n] = IsPackOutSaturate(pack_flags)
+                         ? uint16_t(std::min<uint32_t>(part, 0xFFFF))
+                         : uint16_t(part);
+        } else {
+          if (!IsPackOutSaturate(pack_flags)) {
+            return false;
+          }
+          int32_t part = value.i32[n & 0x3];
+          parts[n] = IsPackOutUnsigned(pack_flags)
+                         ? uint16_t(Clamp(part, 0, 65535))
+                         : uint16_t(Clamp(part, -32768, 32767));
+        }
+      }
+      r = Join16In32(parts);
+      break;
+    }
+    default:
+      return false;
+  }
+  *result = r;
+  return true;
+}
+
+bool Unpack(uint32_t pack_flags, const vec128_t& value, vec128_t* result) {
+  vec128_t r;
+  switch (pack_flags & PACK_TYPE_MODE) {
+    case PACK_TYPE_D3DCOLOR:
+      // ARGB (WXYZ) -> RGBA (XYZW), each byte in the mantissa of 1.0f.
+      r.u32[0] = 0x3F800000u | value.u8[14];
+      r.u32[1] = 0x3F800000u | value.u8[13];
+      r.u32[2] = 0x3F800000u | value.u8[12];
+      r.u32[3] = 0x3F800000u | value.u8[15];
+      break;
+    case PACK_TYPE_FLOAT16_2:
+      r = UnpackFloat16_2(value);
+      break;
+    case PACK_TYPE_FLOAT16_4:
+      r = UnpackFloat16_4(value);
+      break;
+    case PACK_TYPE_SHORT_2:
+      r.u32[0] = UnpackField(value.u16[7], 16, 0x40400000u, 0x403F8000u);
+      r.u32[1] = UnpackField(value.u16[6], 16, 0x40400000u, 0x403F8000u);
+      r.u32[2] = 0;
+      r.u32[3] = 0x3F800000u;
+      break;
+    case PACK_TYPE_SHORT_4:
+      for (int n = 0; n < 4; ++n) {
+        r.u32[n] = UnpackField(value.u16[(4 + n) ^ 1], 16, 0x40400000u,
+                               0x403F8000u);
+      }
+      break;
+    case PACK_TYPE_UINT_2101010: {
+      uint32_t packed = value.u32[3];
+      for (int n = 0; n < 3; ++n) {
+        r.u32[n] = UnpackField((packed >> (n * 10)) & 0x3FF, 10, 0x40400000u,
+                               0x403FFE00u);
+      }
+      r.u32[3] = 0x3F800000u + (packed >> 30);
+      break;
+    }
+    case PACK_TYPE_ULONG_4202020: {
+      uint32_t x = value.u32[3] & 0xFFFFF;
+      uint32_t y =
+          ((value.u32[3] >> 20) & 0xFFF) | (uint32_t(value.u8[8]) << 12);
+      uint32_t z = (value.u32[2] >> 8) & 0xFFFFF;
+      r.u32[0] = UnpackField(x, 20, 0x40400000u, 0x40380000u);
+      r.u32[1] = UnpackField(y, 20, 0x40400000u, 0x40380000u);
+      r.u32[2] = UnpackField(z, 20, 0x40400000u, 0x40380000u);
+      r.u32[3] = 0x3F800000u + (value.u32[2] >> 28);
+      break;
+    }
+    case PACK_TYPE_8_IN_16:
+      // Only signed -> signed without saturation.
+      if (IsPackInUnsigned(pack_flags) || IsPackOutUnsigned(pack_flags) ||
+          IsPackOutSaturate(pack_flags)) {
+        return false;
+      }
+      for (int n = 0; n < 8; ++n) {
+        int m = IsPackToLo(pack_flags) ? 8 + n : n;
+        r.i16[n] = int8_t(value.u8[m ^ 0x2]);
+      }
+      break;
+    case PACK_TYPE_16_IN_32:
+      if (IsPackInUnsigned(pack_flags) || IsPackOutUnsigned(pack_flags) ||
+          IsPackOutSaturate(pack_flags)) {
+        return false;
+      }
+      for (int n = 0; n < 4; ++n) {
+        int m = (IsPackToLo(pack_flags) ? 4 : 0) + (n ^ 0x1);
+        r.i32[n] = int16_t(value.u16[m]);
+      }
+      break;
+    default:
+      return false;
+  }
+  *result = r;
+  return true;
+}
+
+}  // namespace vector_ops
+}  // namespace hir
+}  // namespace cpu
+}  // namespace xe
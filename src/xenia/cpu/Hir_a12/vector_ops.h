@@ -0,0 +1,141 @@
+#ifndef XENIA_CPU_HIR_VECTOR_OPS_H_
+#define XENIA_CPU_HIR_VECTOR_OPS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#include "xenia/base/math.h"
+#include "xenia/base/vec128.h"
+
+namespace xe {
+namespace cpu {
+namespace hir {
+
+// Reference implementations of the vector opcodes, on vec128_t in the host
+// layout the backend keeps them in (guest element n of a byte vector is
+// u8[n ^ 3], of a halfword vector u16[n ^ 1]).
+//
+// ConstantPropagationPass folds with these, and the x64 backend calls the
+// same routines wherever it has no native sequence, so a folded result is
+// bit for bit what the emitted code would have produced. Anything a backend
+// sequence does natively has to match them too; the vector constant folding
+// tests run both and compare.
+namespace vector_ops {
+
+template <typename T, std::enable_if_t<std::is_integral<T>::value, int> = 0>
+vec128_t Shl(const vec128_t& value, const vec128_t& shamt) {
+  using U = std::make_unsigned_t<T>;
+  vec128_t result;
+  auto a = reinterpret_cast<const U*>(&value);
+  auto b = reinterpret_cast<const U*>(&shamt);
+  auto r = reinterpret_cast<U*>(&result);
+  for (size_t i = 0; i < 16 / sizeof(T); ++i) {
+    r[i] = U(a[i] << (b[i] & ((sizeof(T) * 8) - 1)));
+  }
+  return result;
+}
+
+// Logical for unsigned T, arithmetic for signed T (VECTOR_SHA).
+template <typename T, std::enable_if_t<std::is_integral<T>::value, int> = 0>
+vec128_t Shr(const vec128_t& value, const vec128_t& shamt) {
+  vec128_t result;
+  auto a = reinterpret_cast<const T*>(&value);
+  auto b = reinterpret_cast<const T*>(&shamt);
+  auto r = reinterpret_cast<T*>(&result);
+  for (size_t i = 0; i < 16 / sizeof(T); ++i) {
+    r[i] = T(a[i] >> (b[i] & ((sizeof(T) * 8) - 1)));
+  }
+  return result;
+}
+
+template <typename T, std::enable_if_t<std::is_integral<T>::value, int> = 0>
+vec128_t RotateLeft(const vec128_t& value, const vec128_t& shamt) {
+  using U = std::make_unsigned_t<T>;
+  vec128_t result;
+  auto a = reinterpret_cast<const U*>(&value);
+  auto b = reinterpret_cast<const U*>(&shamt);
+  auto r = reinterpret_cast<U*>(&result);
+  for (size_t i = 0; i < 16 / sizeof(T); ++i) {
+    r[i] = xe::rotate_left<U>(a[i], b[i] & ((sizeof(T) * 8) - 1));
+  }
+  return result;
+}
+
+// Rounds halves up; the sum is taken wide enough not to wrap.
+template <typename T, std::enable_if_t<std::is_integral<T>::value, int> = 0>
+vec128_t Average(const vec128_t& value1, const vec128_t& value2) {
+  vec128_t result;
+  auto a = reinterpret_cast<const T*>(&value1);
+  auto b = reinterpret_cast<const T*>(&value2);
+  auto r = reinterpret_cast<T*>(&result);
+  for (size_t i = 0; i < 16 / sizeof(T); ++i) {
+    r[i] = T((uint64_t(a[i]) + uint64_t(b[i]) + 1) / 2);
+  }
+  return result;
+}
+
+template <typename T, std::enable_if_t<std::is_integral<T>::value, int> = 0>
+vec128_t Max(const vec128_t& value1, const vec128_t& value2) {
+  vec128_t result;
+  auto a = reinterpret_cast<const T*>(&value1);
+  auto b = reinterpret_cast<const T*>(&value2);
+  auto r = reinterpret_cast<T*>(&result);
+  for (size_t i = 0; i < 16 / sizeof(T); ++i) {
+    r[i] = a[i] > b[i] ? a[i] : b[i];
+  }
+  return result;
+}
+
+template <typename T, std::enable_if_t<std::is_integral<T>::value, int> = 0>
+vec128_t Min(const vec128_t& value1, const vec128_t& value2) {
+  vec128_t result;
+  auto a = reinterpret_cast<const T*>(&value1);
+  auto b = reinterpret_cast<const T*>(&value2);
+  auto r = reinterpret_cast<T*>(&result);
+  for (size_t i = 0; i < 16 / sizeof(T); ++i) {
+    r[i] = a[i] < b[i] ? a[i] : b[i];
+  }
+  return result;
+}
+
+// lvsl/lvsr shift controls; only the low 4 bits of sh count.
+vec128_t LoadVectorShl(uint8_t sh);
+vec128_t LoadVectorShr(uint8_t sh);
+
+// Guest element index (byte, halfword or word for part sizes 1, 2 and 4).
+uint64_t Extract(const vec128_t& value, uint8_t index, size_t part_size);
+vec128_t Insert(const vec128_t& value, uint8_t index, uint64_t part,
+                size_t part_size);
+
+// PERMUTE with an INT32_TYPE control (MakePermuteMask).
+vec128_t PermuteWords(uint32_t control, const vec128_t& value1,
+                      const vec128_t& value2);
+// PERMUTE with a vector control: vperm for bytes, the halfword equivalent
+// for halfwords. Indices 0-15 (0-7) pick from value1, the next from value2.
+vec128_t PermuteBytes(const vec128_t& control, const vec128_t& value1,
+                      const vec128_t& value2);
+vec128_t PermuteHalfwords(const vec128_t& control, const vec128_t& value1,
+                          const vec128_t& value2);
+// SWIZZLE of words (MakeSwizzleMask).
+vec128_t SwizzleWords(const vec128_t& value, uint32_t swizzle_mask);
+
+// PACK and UNPACK in every mode and signedness the backend implements.
+// Return false, leaving result untouched, for the combinations it does not.
+bool Pack(uint32_t pack_flags, const vec128_t& value1, const vec128_t& value2,
+          vec128_t* result);
+bool Unpack(uint32_t pack_flags, const vec128_t& value, vec128_t* result);
+
+// The float16 conversions behind PACK/UNPACK FLOAT16_2/FLOAT16_4 (rounding
+// toward zero, as vcvtps2ph with imm 3 does).
+vec128_t PackFloat16_2(const vec128_t& value);
+vec128_t PackFloat16_4(const vec128_t& value);
+vec128_t UnpackFloat16_2(const vec128_t& value);
+vec128_t UnpackFloat16_4(const vec128_t& value);
+
+}  // namespace vector_ops
+}  // namespace hir
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_HIR_VECTOR_OPS_H_
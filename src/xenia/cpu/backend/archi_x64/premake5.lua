@@ -11,6 +11,7 @@ project("xenia-cpu-backend-x64")
     "fmt",
     "xenia-base",
     "xenia-cpu",
+    "xxhash",
   })
   defines({
     "CAPSTONE_X86_ATT_DISABLE",
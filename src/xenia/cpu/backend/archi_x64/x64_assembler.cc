@@ -1,6 +1,7 @@
 
 #include "xenia/cpu/backend/x64/x64_assembler.h"
 
+#include <chrono>
 #include <climits>
 
 #include "third_party/capstone/include/capstone/capstone.h"
@@ -8,6 +9,7 @@
 #include "xenia/base/profiling.h"
 #include "xenia/base/reset_scope.h"
 #include "xenia/base/string.h"
+#include "xenia/cpu/compiler/compile_profiler.h"
 #include "xenia/cpu/backend/x64/x64_backend.h"
 #include "xenia/cpu/backend/x64/x64_code_cache.h"
 #include "xenia/cpu/backend/x64/x64_emitter.h"
@@ -70,10 +72,26 @@ bool X64Assembler::Assemble(GuestFunction* function, HIRBuilder* builder,
   // Lower HIR -> x64.
   void* machine_code = nullptr;
   size_t code_size = 0;
+  bool profiling = compiler::CompileProfiler::is_enabled();
+  compiler::CompileProfiler::StageSample sample;
+  if (profiling) {
+    sample.name = "X64Emitter::Emit";
+    sample.before = compiler::CompileProfiler::MeasureHIR(builder);
+  }
+  auto start_time = std::chrono::steady_clock::now();
   if (!emitter_->Emit(function, builder, debug_info_flags, debug_info.get(),
                       &machine_code, &code_size, &function->source_map())) {
     return false;
   }
+  if (profiling) {
+    sample.duration_ns =
+        uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                     std::chrono::steady_clock::now() - start_time)
+                     .count());
+    // Emission doesn't change the HIR.
+    sample.after = sample.before;
+    compiler::CompileProfiler::RecordStage(sample);
+  }
 
   // Stash generated machine code.
   if (debug_info_flags & DebugInfoFlags::kDebugInfoDisasmMachineCode) {
@@ -5,15 +5,21 @@
 
 #include "third_party/capstone/include/capstone/capstone.h"
 #include "third_party/capstone/include/capstone/x86.h"
+#include "third_party/fmt/include/fmt/format.h"
+#include "third_party/xxhash/xxhash.h"
 
 #include "xenia/base/exception_handler.h"
+#include "xenia/base/filesystem.h"
 #include "xenia/base/logging.h"
+#include "xenia/base/mapped_memory.h"
 #include "xenia/cpu/backend/x64/x64_assembler.h"
 #include "xenia/cpu/backend/x64/x64_code_cache.h"
 #include "xenia/cpu/backend/x64/x64_emitter.h"
 #include "xenia/cpu/backend/x64/x64_function.h"
 #include "xenia/cpu/backend/x64/x64_sequences.h"
 #include "xenia/cpu/backend/x64/x64_stack_layout.h"
+#include "xenia/cpu/backend/x64/x64_trace_writer.h"
+#include "xenia/cpu/backend/x64/x64_tracers.h"
 #include "xenia/cpu/breakpoint.h"
 #include "xenia/cpu/processor.h"
 #include "xenia/cpu/stack_walker.h"
@@ -136,12 +142,45 @@ bool X64Backend::Initialize(Processor* processor) {
   // Allocate emitter constant data.
   emitter_data_ = X64Emitter::PlaceConstData();
 
+  RegisterHostHelpers(this);
+
   // Setup exception callback
   ExceptionHandler::Install(&ExceptionCallbackThunk, this);
 
+  if (IsTracingBinary()) {
+    trace_writer_ = X64TraceWriter::Create(
+        cvars::trace_binary_path, uint32_t(cvars::trace_binary_ring_size));
+    if (!trace_writer_) {
+      return false;
+    }
+  }
+
   return true;
 }
 
+void* X64Backend::AllocThreadData(uint32_t thread_id) {
+  return trace_writer_ ? trace_writer_->AllocRing(thread_id) : nullptr;
+}
+
+void X64Backend::FreeThreadData(void* thread_data) {
+  if (trace_writer_) {
+    trace_writer_->FreeRing(reinterpret_cast<TraceRing*>(thread_data));
+  }
+}
+
+void X64Backend::RegisterHostHelper(const void* fn,
+                                    HostHelperClobbers clobbers) {
+  // The spill slots are sized for the host ABI set.
+  assert_zero(clobbers.gprs & ~kHostAbiClobbers.gprs);
+  assert_zero(clobbers.xmms & ~kHostAbiClobbers.xmms);
+  host_helpers_[fn] = clobbers;
+}
+
+HostHelperClobbers X64Backend::LookupHostHelper(const void* fn) const {
+  auto it = host_helpers_.find(fn);
+  return it != host_helpers_.end() ? it->second : kHostAbiClobbers;
+}
+
 void X64Backend::CommitExecutableRange(uint32_t guest_low,
                                        uint32_t guest_high) {
   code_cache_->CommitExecutableRange(guest_low, guest_high);
@@ -156,6 +195,58 @@ std::unique_ptr<GuestFunction> X64Backend::CreateGuestFunction(
   return std::make_unique<X64Function>(module, address);
 }
 
+bool X64Backend::OpenPersistentCache(const std::filesystem::path& cache_root,
+                                     uint64_t module_hash, bool rebuild) {
+  // Host image relocations are stored relative to an anchor in this binary,
+  // so any rebuild of the executable invalidates the cache.
+  auto exe_mapping = MappedMemory::Open(xe::filesystem::GetExecutablePath(),
+                                        MappedMemory::Mode::kRead);
+  if (!exe_mapping) {
+    XELOGE("Unable to hash host executable; JIT code cache disabled");
+    return false;
+  }
+  uint64_t host_image_hash =
+      XXH3_64bits(exe_mapping->data(), exe_mapping->size());
+  exe_mapping.reset();
+
+  X64RelocationTargets relocation_targets;
+  relocation_targets.host_image_anchor = X64Emitter::host_image_anchor();
+  relocation_targets.host_to_guest_thunk =
+      reinterpret_cast<uintptr_t>(host_to_guest_thunk_);
+  relocation_targets.guest_to_host_thunk =
+      reinterpret_cast<uintptr_t>(guest_to_host_thunk_);
+  relocation_targets.resolve_function_thunk =
+      reinterpret_cast<uintptr_t>(resolve_function_thunk_);
+
+  return code_cache_->OpenPersistentCache(
+      cache_root / fmt::format("{:016X}.xjit", module_hash), module_hash,
+      X64Emitter::QueryFeatureFlags(Xbyak::util::Cpu()), host_image_hash,
+      emitter_data_, relocation_targets, rebuild);
+}
+
+bool X64Backend::LoadPersistedFunction(GuestFunction* function) {
+  if (function->behavior() != Function::Behavior::kDefault) {
+    return false;
+  }
+  void* machine_code = nullptr;
+  size_t code_size = 0;
+  if (!code_cache_->LoadPersistedGuestCode(function, machine_code,
+                                           code_size)) {
+    return false;
+  }
+  static_cast<X64Function*>(function)->Setup(
+      reinterpret_cast<uint8_t*>(machine_code), code_size);
+  return true;
+}
+
+void X64Backend::UnlinkFunction(GuestFunction* function) {
+  code_cache_->RemoveIndirection(function->address());
+  if (function->machine_code()) {
+    code_cache_->RemoveCallSites(function->machine_code(),
+                                 function->machine_code_length());
+  }
+}
+
 uint64_t ReadCapstoneReg(HostThreadContext* context, x86_reg reg) {
   switch (reg) {
     case X86_REG_RAX:
@@ -3,8 +3,10 @@
 #define XENIA_CPU_BACKEND_X64_X64_BACKEND_H_
 
 #include <memory>
+#include <unordered_map>
 
 #include "xenia/base/cvar.h"
+#include "xenia/base/platform.h"
 #include "xenia/cpu/backend/backend.h"
 
 DECLARE_int32(x64_extension_mask);
@@ -18,11 +20,29 @@ namespace backend {
 namespace x64 {
 
 class X64CodeCache;
+class X64TraceWriter;
 
 typedef void* (*HostToGuestThunk)(void* target, void* arg0, void* arg1);
 typedef void* (*GuestToHostThunk)(void* target, void* arg0, void* arg1);
 typedef void (*ResolveFunctionThunk)();
 
+// Registers a host function called from generated code may overwrite, as bit
+// masks over Xbyak register indices.
+struct HostHelperClobbers {
+  uint32_t gprs;
+  uint32_t xmms;
+};
+
+// The volatile registers of the host ABI. Nothing narrower can be assumed of
+// a function compiled from C++, so this is what unregistered helpers get.
+#if XE_PLATFORM_WIN32
+// rax, rcx, rdx, r8-r11; xmm0-5.
+constexpr HostHelperClobbers kHostAbiClobbers = {0x0F07, 0x003F};
+#else
+// rax, rcx, rdx, rsi, rdi, r8-r11; xmm0-15.
+constexpr HostHelperClobbers kHostAbiClobbers = {0x0FC7, 0xFFFF};
+#endif  // XE_PLATFORM_WIN32
+
 class X64Backend : public Backend {
  public:
   static const uint32_t kForceReturnAddress = 0x9FFF0000u;
@@ -41,9 +61,21 @@ class X64Backend : public Backend {
   ResolveFunctionThunk resolve_function_thunk() const {
     return resolve_function_thunk_;
   }
+  // With --trace_binary_path.
+  X64TraceWriter* trace_writer() const { return trace_writer_.get(); }
 
   bool Initialize(Processor* processor) override;
 
+  // The thread's TraceRing in binary tracing mode, otherwise nothing.
+  void* AllocThreadData(uint32_t thread_id) override;
+  void FreeThreadData(void* thread_data) override;
+
+  // Records the registers a host helper called through
+  // X64Emitter::CallHostHelper really clobbers, for helpers written to keep
+  // more than the host ABI requires. Must be done before any code is emitted.
+  void RegisterHostHelper(const void* fn, HostHelperClobbers clobbers);
+  HostHelperClobbers LookupHostHelper(const void* fn) const;
+
   void CommitExecutableRange(uint32_t guest_low, uint32_t guest_high) override;
 
   std::unique_ptr<Assembler> CreateAssembler() override;
@@ -54,6 +86,11 @@ class X64Backend : public Backend {
   uint64_t CalculateNextHostInstruction(ThreadDebugInfo* thread_info,
                                         uint64_t current_pc) override;
 
+  bool OpenPersistentCache(const std::filesystem::path& cache_root,
+                           uint64_t module_hash, bool rebuild) override;
+  bool LoadPersistedFunction(GuestFunction* function) override;
+  void UnlinkFunction(GuestFunction* function) override;
+
   void InstallBreakpoint(Breakpoint* breakpoint) override;
   void InstallBreakpoint(Breakpoint* breakpoint, Function* fn) override;
   void UninstallBreakpoint(Breakpoint* breakpoint) override;
@@ -70,6 +107,10 @@ class X64Backend : public Backend {
   HostToGuestThunk host_to_guest_thunk_;
   GuestToHostThunk guest_to_host_thunk_;
   ResolveFunctionThunk resolve_function_thunk_;
+
+  std::unordered_map<const void*, HostHelperClobbers> host_helpers_;
+
+  std::unique_ptr<X64TraceWriter> trace_writer_;
 };
 
 }  // namespace x64
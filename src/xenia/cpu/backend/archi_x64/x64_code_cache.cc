@@ -1,6 +1,7 @@
 
 #include "xenia/cpu/backend/x64/x64_code_cache.h"
 
+#include <algorithm>
 #include <cstdlib>
 #include <cstring>
 
@@ -10,14 +11,18 @@
 #endif
 
 #include "third_party/fmt/include/fmt/format.h"
+#include "third_party/xxhash/xxhash.h"
 #include "xenia/base/assert.h"
+#include "xenia/base/atomic.h"
 #include "xenia/base/clock.h"
 #include "xenia/base/literals.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
 #include "xenia/base/memory.h"
+#include "xenia/cpu/backend/x64/x64_code_cache_file.h"
 #include "xenia/cpu/function.h"
 #include "xenia/cpu/module.h"
+#include "xenia/memory.h"
 
 namespace xe {
 namespace cpu {
@@ -133,6 +138,121 @@ void X64CodeCache::AddIndirection(uint32_t guest_address,
   *indirection_slot = host_address;
 }
 
+void X64CodeCache::RemoveIndirection(uint32_t guest_address) {
+  if (!indirection_table_base_ || guest_address < kIndirectionTableBase ||
+      guest_address - kIndirectionTableBase >= kIndirectionTableSize) {
+    return;
+  }
+
+  auto global_lock = global_critical_region_.Acquire();
+  // Guest threads may be calling through the slot right now.
+  auto indirection_slot = reinterpret_cast<volatile uint32_t*>(
+      indirection_table_base_ + (guest_address - kIndirectionTableBase));
+  xe::atomic_exchange(indirection_default_value_, indirection_slot);
+
+  auto it = call_sites_.find(guest_address);
+  if (it != call_sites_.end()) {
+    for (const CallSite& site : it->second) {
+      PatchCallSite(site, guest_address, 0);
+      call_site_targets_.erase(site.patch_address);
+    }
+    call_sites_.erase(it);
+  }
+}
+
+uint32_t X64CodeCache::LookupIndirection(uint32_t guest_address) const {
+  // Only called for functions that have been placed, so the slot is
+  // committed.
+  if (!indirection_table_base_ || guest_address < kIndirectionTableBase ||
+      guest_address - kIndirectionTableBase >= kIndirectionTableSize) {
+    return 0;
+  }
+  return *reinterpret_cast<const volatile uint32_t*>(
+      indirection_table_base_ + (guest_address - kIndirectionTableBase));
+}
+
+uint32_t X64CodeCache::LinkCallSite(uint32_t guest_address, uint8_t* site_end,
+                                    uint32_t fallback) {
+  auto global_lock = global_critical_region_.Acquire();
+  uint32_t host_address = LookupIndirection(guest_address);
+  if (!host_address || host_address == indirection_default_value_) {
+    return fallback;
+  }
+  CallSite site;
+  site.patch_address = site_end - 4;
+  uint8_t* target =
+      site_end + *reinterpret_cast<const int32_t*>(site.patch_address);
+  if (target == reinterpret_cast<uint8_t*>(uint64_t(host_address))) {
+    // Another thread got through the stub and linked it first.
+    return host_address;
+  }
+  site.stub = target;
+  call_sites_[guest_address].push_back(site);
+  call_site_targets_[site.patch_address] = guest_address;
+  PatchCallSite(site, guest_address, host_address);
+  return host_address;
+}
+
+uint32_t X64CodeCache::LinkInlineCache(uint32_t guest_address,
+                                       uint64_t* cache, uint32_t fallback) {
+  auto global_lock = global_critical_region_.Acquire();
+  uint32_t host_address = LookupIndirection(guest_address);
+  if (!host_address || host_address == indirection_default_value_) {
+    return fallback;
+  }
+  if (*reinterpret_cast<volatile uint64_t*>(cache)) {
+    return host_address;
+  }
+  CallSite site;
+  site.patch_address = reinterpret_cast<uint8_t*>(cache);
+  site.stub = nullptr;
+  call_sites_[guest_address].push_back(site);
+  call_site_targets_[site.patch_address] = guest_address;
+  PatchCallSite(site, guest_address, host_address);
+  return host_address;
+}
+
+void X64CodeCache::RemoveCallSites(const void* code_execute_address,
+                                   size_t code_size) {
+  auto code_begin =
+      reinterpret_cast<uint8_t*>(const_cast<void*>(code_execute_address));
+  auto global_lock = global_critical_region_.Acquire();
+  auto it = call_site_targets_.lower_bound(code_begin);
+  while (it != call_site_targets_.end() &&
+         it->first < code_begin + code_size) {
+    auto& sites = call_sites_[it->second];
+    uint8_t* patch_address = it->first;
+    sites.erase(std::remove_if(sites.begin(), sites.end(),
+                               [patch_address](const CallSite& site) {
+                                 return site.patch_address == patch_address;
+                               }),
+                sites.end());
+    if (sites.empty()) {
+      call_sites_.erase(it->second);
+    }
+    it = call_site_targets_.erase(it);
+  }
+}
+
+void X64CodeCache::PatchCallSite(const CallSite& site, uint32_t guest_address,
+                                 uint32_t host_address) {
+  uint8_t* write_address = generated_code_write_base_ +
+                           (site.patch_address - generated_code_execute_base_);
+  if (site.stub) {
+    uint8_t* target = host_address
+                          ? reinterpret_cast<uint8_t*>(uint64_t(host_address))
+                          : site.stub;
+    auto displacement = int32_t(target - (site.patch_address + 4));
+    xe::atomic_exchange(uint32_t(displacement),
+                        reinterpret_cast<volatile uint32_t*>(write_address));
+  } else {
+    uint64_t value =
+        host_address ? (uint64_t(host_address) << 32) | guest_address : 0;
+    xe::atomic_exchange(value,
+                        reinterpret_cast<volatile uint64_t*>(write_address));
+  }
+}
+
 void X64CodeCache::CommitExecutableRange(uint32_t guest_low,
                                          uint32_t guest_high) {
   if (!indirection_table_base_) {
@@ -246,8 +366,8 @@ void X64CodeCache::PlaceGuestCode(uint32_t guest_address, void* machine_code,
                 static_cast<size_t>(end_write_address - tail_write_address));
 
     // Notify subclasses of placed code.
-    PlaceCode(guest_address, machine_code, func_info, code_execute_address,
-              unwind_reservation);
+    PlaceCode(guest_address, machine_code, func_info, function_info,
+              code_execute_address, unwind_reservation);
   }
 
 #if ENABLE_VTUNE
@@ -275,10 +395,22 @@ void X64CodeCache::PlaceGuestCode(uint32_t guest_address, void* machine_code,
   // Note that we do support code that doesn't have an indirection fixup, so
   // ignore those when we see them.
   if (guest_address && indirection_table_base_) {
-    uint32_t* indirection_slot = reinterpret_cast<uint32_t*>(
-        indirection_table_base_ + (guest_address - kIndirectionTableBase));
-    *indirection_slot =
+    auto global_lock = global_critical_region_.Acquire();
+    // Other threads may be calling through the slot if this replaces existing
+    // code (tier-up), so swap it atomically.
+    uint32_t host_address =
         uint32_t(reinterpret_cast<uint64_t>(code_execute_address));
+    auto indirection_slot = reinterpret_cast<volatile uint32_t*>(
+        indirection_table_base_ + (guest_address - kIndirectionTableBase));
+    xe::atomic_exchange(host_address, indirection_slot);
+
+    // Sites linked to the code being replaced move over as well.
+    auto it = call_sites_.find(guest_address);
+    if (it != call_sites_.end()) {
+      for (const CallSite& site : it->second) {
+        PatchCallSite(site, guest_address, host_address);
+      }
+    }
   }
 }
 
@@ -354,6 +486,124 @@ GuestFunction* X64CodeCache::LookupFunction(uint64_t host_pc) {
   }
 }
 
+bool X64CodeCache::OpenPersistentCache(
+    const std::filesystem::path& path, uint64_t module_hash,
+    uint32_t feature_flags, uint64_t host_image_hash, uintptr_t emitter_data,
+    const X64RelocationTargets& relocation_targets, bool rebuild) {
+  X64CodeCacheFile::Key key = {};
+  key.module_hash = module_hash;
+  key.host_image_hash = host_image_hash;
+  key.feature_flags = feature_flags;
+  key.backend_version = X64CodeCacheFile::kBackendVersion;
+  key.emitter_data = emitter_data;
+  persistent_cache_ = X64CodeCacheFile::Open(path, key, rebuild);
+  relocation_targets_ = relocation_targets;
+  return persistent_cache_ != nullptr;
+}
+
+// Hash of the guest instructions a function was generated from, so that code
+// for a patched or differently-loaded module is never reused.
+static uint64_t HashGuestCode(GuestFunction* function, uint32_t end_address) {
+  auto memory = function->module()->memory();
+  return XXH3_64bits(memory->TranslateVirtual(function->address()),
+                     end_address + 4 - function->address());
+}
+
+void X64CodeCache::PersistGuestCode(
+    GuestFunction* function, const void* machine_code,
+    const EmitFunctionInfo& func_info,
+    const std::vector<X64CodeRelocation>& relocations,
+    const std::vector<SourceMapEntry>& source_map) {
+  if (!persistent_cache_ || !function->has_end_address()) {
+    return;
+  }
+  X64CodeCacheFile::FunctionHeader header = {};
+  header.guest_address = function->address();
+  header.guest_end_address = function->end_address();
+  header.guest_hash = HashGuestCode(function, function->end_address());
+  header.code_size = uint32_t(func_info.code_size.total);
+  header.relocation_count = uint32_t(relocations.size());
+  header.source_map_count = uint32_t(source_map.size());
+  header.stack_size = uint32_t(func_info.stack_size);
+  header.prolog_size = uint32_t(func_info.code_size.prolog);
+  header.body_size = uint32_t(func_info.code_size.body);
+  header.epilog_size = uint32_t(func_info.code_size.epilog);
+  header.tail_size = uint32_t(func_info.code_size.tail);
+  header.prolog_stack_alloc_offset =
+      uint32_t(func_info.prolog_stack_alloc_offset);
+  persistent_cache_->Append(header, machine_code, relocations, source_map);
+}
+
+bool X64CodeCache::LoadPersistedGuestCode(GuestFunction* function,
+                                          void*& code_execute_address_out,
+                                          size_t& code_size_out) {
+  if (!persistent_cache_) {
+    return false;
+  }
+  auto record = persistent_cache_->Lookup(function->address());
+  if (!record) {
+    return false;
+  }
+  auto header = record->header;
+  if (header->guest_end_address < header->guest_address ||
+      HashGuestCode(function, header->guest_end_address) !=
+          header->guest_hash) {
+    return false;
+  }
+
+  // Patch a private copy; the record is in a read-only mapping.
+  std::vector<uint8_t> machine_code(record->code,
+                                    record->code + header->code_size);
+  for (uint32_t i = 0; i < header->relocation_count; ++i) {
+    const auto& relocation = record->relocations[i];
+    if (relocation.code_offset + sizeof(uint64_t) > header->code_size) {
+      XELOGE("JIT code cache: bad relocation in {:08X}",
+             header->guest_address);
+      return false;
+    }
+    uint64_t value;
+    switch (relocation.type) {
+      case X64CodeRelocation::Type::kHostImage:
+        value = relocation_targets_.host_image_anchor + relocation.value;
+        break;
+      case X64CodeRelocation::Type::kHostToGuestThunk:
+        value = relocation_targets_.host_to_guest_thunk;
+        break;
+      case X64CodeRelocation::Type::kGuestToHostThunk:
+        value = relocation_targets_.guest_to_host_thunk;
+        break;
+      case X64CodeRelocation::Type::kResolveFunctionThunk:
+        value = relocation_targets_.resolve_function_thunk;
+        break;
+      default:
+        XELOGE("JIT code cache: bad relocation in {:08X}",
+               header->guest_address);
+        return false;
+    }
+    std::memcpy(machine_code.data() + relocation.code_offset, &value,
+                sizeof(value));
+  }
+
+  EmitFunctionInfo func_info = {};
+  func_info.code_size.prolog = header->prolog_size;
+  func_info.code_size.body = header->body_size;
+  func_info.code_size.epilog = header->epilog_size;
+  func_info.code_size.tail = header->tail_size;
+  func_info.code_size.total = header->code_size;
+  func_info.prolog_stack_alloc_offset = header->prolog_stack_alloc_offset;
+  func_info.stack_size = header->stack_size;
+
+  function->set_end_address(header->guest_end_address);
+  function->source_map().assign(record->source_map,
+                                record->source_map + header->source_map_count);
+
+  void* code_write_address = nullptr;
+  PlaceGuestCode(function->address(), machine_code.data(), func_info, function,
+                 code_execute_address_out, code_write_address);
+  code_size_out = header->code_size;
+  return true;
+}
+
 }  // namespace x64
 }  // namespace backend
 }  // namespace cpu
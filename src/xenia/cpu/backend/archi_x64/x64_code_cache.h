@@ -5,8 +5,10 @@
 #include <atomic>
 #include <cstddef>
 #include <cstdint>
+#include <map>
 #include <memory>
 #include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -31,6 +33,34 @@ struct EmitFunctionInfo {
   size_t stack_size;
 };
 
+// An absolute 64-bit immediate embedded in emitted code that has to be
+// rewritten when the code is loaded from the persistent code cache in a later
+// session (see X64Emitter::MovHostAddress).
+struct X64CodeRelocation {
+  enum class Type : uint32_t {
+    // Address inside the host executable image. value is the offset from
+    // X64Emitter::host_image_anchor().
+    kHostImage = 0,
+    kHostToGuestThunk,
+    kGuestToHostThunk,
+    kResolveFunctionThunk,
+  };
+  Type type;
+  // Offset of the 8 byte immediate from the start of the function.
+  uint32_t code_offset;
+  uint64_t value;
+};
+
+// Current values for each X64CodeRelocation::Type, provided by the backend.
+struct X64RelocationTargets {
+  uintptr_t host_image_anchor;
+  uintptr_t host_to_guest_thunk;
+  uintptr_t guest_to_host_thunk;
+  uintptr_t resolve_function_thunk;
+};
+
+class X64CodeCacheFile;
+
 class X64CodeCache : public CodeCache {
  public:
   ~X64CodeCache() override;
@@ -52,6 +82,31 @@ class X64CodeCache : public CodeCache {
   bool has_indirection_table() { return indirection_table_base_ != nullptr; }
   void set_indirection_default(uint32_t default_value);
   void AddIndirection(uint32_t guest_address, uint32_t host_address);
+  // Points the slot back at the indirection default (the resolve thunk) and
+  // unlinks every call site linked to the function.
+  void RemoveIndirection(uint32_t guest_address);
+
+  // Call site patching. A direct call site is a rel32 call or jmp with a 4b
+  // aligned displacement that initially targets an out-of-line link stub. An
+  // indirect call site owns an 8b aligned inline cache holding the last guest
+  // target in the low dword and its code in the high one. Both are rewritten
+  // with a single aligned store, so guest threads running the site see either
+  // the old or the new target. Linked sites follow the callee when its code
+  // is replaced and revert to their initial state when it is removed.
+  //
+  // Points the direct call site whose displacement ends at site_end at the
+  // current code for guest_address and returns that code, or returns
+  // fallback if the function has none in the indirection table.
+  uint32_t LinkCallSite(uint32_t guest_address, uint8_t* site_end,
+                        uint32_t fallback);
+  // Fills an empty inline cache with guest_address and its current code and
+  // returns that code, or fallback as above. Caches already holding another
+  // target are left alone so polymorphic sites don't keep rewriting code.
+  uint32_t LinkInlineCache(uint32_t guest_address, uint64_t* cache,
+                           uint32_t fallback);
+  // Forgets the sites linked from the given code, which is no longer called,
+  // so they stop being patched.
+  void RemoveCallSites(const void* code_execute_address, size_t code_size);
 
   void CommitExecutableRange(uint32_t guest_low, uint32_t guest_high);
 
@@ -68,6 +123,28 @@ class X64CodeCache : public CodeCache {
 
   GuestFunction* LookupFunction(uint64_t host_pc) override;
 
+  // Opens (or creates) the on-disk cache of generated code at the given path.
+  // Existing contents are discarded if they were generated with a different
+  // key (module, host CPU features, backend version or host executable), or
+  // unconditionally with rebuild.
+  bool OpenPersistentCache(const std::filesystem::path& path,
+                           uint64_t module_hash, uint32_t feature_flags,
+                           uint64_t host_image_hash, uintptr_t emitter_data,
+                           const X64RelocationTargets& relocation_targets,
+                           bool rebuild);
+  bool has_persistent_cache() const { return persistent_cache_ != nullptr; }
+  // Writes freshly emitted, already placed code for a guest function to the
+  // persistent cache.
+  void PersistGuestCode(GuestFunction* function, const void* machine_code,
+                        const EmitFunctionInfo& func_info,
+                        const std::vector<X64CodeRelocation>& relocations,
+                        const std::vector<SourceMapEntry>& source_map);
+  // Places previously persisted code for the given function if its guest
+  // instructions are unchanged. Fills in the function source map.
+  bool LoadPersistedGuestCode(GuestFunction* function,
+                              void*& code_execute_address_out,
+                              size_t& code_size_out);
+
  protected:
   // All executable code falls within 0x80000000 to 0x9FFFFFFF, so we can
   // only map enough for lookups within that range.
@@ -95,11 +172,30 @@ class X64CodeCache : public CodeCache {
 
   X64CodeCache();
 
+  struct CallSite {
+    // Execute address of the rel32 displacement or the inline cache.
+    uint8_t* patch_address;
+    // Link stub the displacement initially targets; nullptr for inline
+    // caches.
+    uint8_t* stub;
+  };
+
+  // Current indirection slot value of a placed function, or 0 if the address
+  // has no slot.
+  uint32_t LookupIndirection(uint32_t guest_address) const;
+  // Points a linked site at host_address, or reverts it if 0. Must be called
+  // with the global critical region held.
+  void PatchCallSite(const CallSite& site, uint32_t guest_address,
+                     uint32_t host_address);
+
   virtual UnwindReservation RequestUnwindReservation(uint8_t* entry_address) {
     return UnwindReservation();
   }
+  // Called with the global critical region held once the code is copied.
+  // function_info is null for host code (thunks).
   virtual void PlaceCode(uint32_t guest_address, void* machine_code,
                          const EmitFunctionInfo& func_info,
+                         GuestFunction* function_info,
                          void* code_execute_address,
                          UnwindReservation unwind_reservation) {}
 
@@ -133,6 +229,16 @@ class X64CodeCache : public CodeCache {
   // This can be used to bsearch on host PC to find the guest function.
   // The key is [start address | end address].
   std::vector<std::pair<uint64_t, GuestFunction*>> generated_code_map_;
+
+  // Linked call sites by callee guest address. Guarded by the global critical
+  // region.
+  std::unordered_map<uint32_t, std::vector<CallSite>> call_sites_;
+  // Guest address each linked site targets, by patch address, to find the
+  // sites of a function.
+  std::map<uint8_t*, uint32_t> call_site_targets_;
+
+  std::unique_ptr<X64CodeCacheFile> persistent_cache_;
+  X64RelocationTargets relocation_targets_ = {};
 };
 
 }  // namespace x64
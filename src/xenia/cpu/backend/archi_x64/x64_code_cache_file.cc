@@ -0,0 +1,162 @@
+#include "xenia/cpu/backend/x64/x64_code_cache_file.h"
+
+#include <cstring>
+
+#include "xenia/base/assert.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/math.h"
+
+namespace xe {
+namespace cpu {
+namespace backend {
+namespace x64 {
+
+std::unique_ptr<X64CodeCacheFile> X64CodeCacheFile::Open(
+    const std::filesystem::path& path, const Key& key,
+    bool discard_existing) {
+  auto file = std::unique_ptr<X64CodeCacheFile>(new X64CodeCacheFile());
+
+  bool reuse = false;
+  if (!discard_existing && std::filesystem::exists(path)) {
+    file->mapping_ = MappedMemory::Open(path, MappedMemory::Mode::kRead);
+    if (file->mapping_ && file->mapping_->size() >= sizeof(Header)) {
+      auto header = reinterpret_cast<const Header*>(file->mapping_->data());
+      reuse = header->magic == kMagic &&
+              header->header_size == sizeof(Header) &&
+              !std::memcmp(&header->key, &key, sizeof(Key));
+    }
+    size_t valid_size = 0;
+    if (reuse) {
+      reuse = file->IndexRecords(&valid_size);
+    } else {
+      XELOGI("Discarding stale JIT code cache {}", xe::path_to_utf8(path));
+    }
+    if (reuse && valid_size < file->mapping_->size()) {
+      // Cut the file back to the last good record, otherwise new records
+      // would be appended after the bad one and never be indexed again. The
+      // mapping has to go first as a mapped file can't be truncated on
+      // Windows.
+      file->records_.clear();
+      file->mapping_.reset();
+      file->file_ = xe::filesystem::OpenFile(path, "r+b");
+      reuse = file->file_ &&
+              xe::filesystem::TruncateStdioFile(file->file_, valid_size) &&
+              xe::filesystem::Seek(file->file_, 0, SEEK_END);
+      if (reuse) {
+        file->mapping_ = MappedMemory::Open(path, MappedMemory::Mode::kRead);
+        reuse = file->mapping_ && file->IndexRecords(&valid_size);
+      }
+      if (!reuse && file->file_) {
+        fclose(file->file_);
+        file->file_ = nullptr;
+      }
+    }
+    if (!reuse) {
+      file->records_.clear();
+      file->mapping_.reset();
+    }
+  }
+
+  if (reuse) {
+    if (!file->file_) {
+      file->file_ = xe::filesystem::OpenFile(path, "ab");
+    }
+  } else {
+    xe::filesystem::CreateParentFolder(path);
+    file->file_ = xe::filesystem::OpenFile(path, "wb");
+    if (file->file_) {
+      Header header = {};
+      header.magic = kMagic;
+      header.header_size = sizeof(Header);
+      header.key = key;
+      fwrite(&header, sizeof(header), 1, file->file_);
+    }
+  }
+  if (!file->file_) {
+    XELOGE("Unable to open JIT code cache {}", xe::path_to_utf8(path));
+    return nullptr;
+  }
+
+  XELOGI("JIT code cache {}: {} functions", xe::path_to_utf8(path),
+         file->records_.size());
+  return file;
+}
+
+X64CodeCacheFile::~X64CodeCacheFile() {
+  if (file_) {
+    fclose(file_);
+    file_ = nullptr;
+  }
+}
+
+bool X64CodeCacheFile::IndexRecords(size_t* out_valid_size) {
+  const uint8_t* base = mapping_->data();
+  const size_t size = mapping_->size();
+  size_t offset = sizeof(Header);
+  while (offset + sizeof(FunctionHeader) <= size) {
+    auto header = reinterpret_cast<const FunctionHeader*>(base + offset);
+    size_t code_offset = offset + sizeof(FunctionHeader);
+    size_t relocations_offset =
+        code_offset + xe::round_up(size_t(header->code_size), size_t(8));
+    size_t source_map_offset =
+        relocations_offset +
+        header->relocation_count * sizeof(X64CodeRelocation);
+    size_t end_offset =
+        source_map_offset + xe::round_up(header->source_map_count *
+                                             sizeof(SourceMapEntry),
+                                         size_t(8));
+    if (end_offset > size || !header->code_size) {
+      // Cut off by a crash mid-write; everything before is still good.
+      XELOGW("JIT code cache truncated at offset {}", offset);
+      break;
+    }
+    FunctionRecord record;
+    record.header = header;
+    record.code = base + code_offset;
+    record.relocations =
+        reinterpret_cast<const X64CodeRelocation*>(base + relocations_offset);
+    record.source_map =
+        reinterpret_cast<const SourceMapEntry*>(base + source_map_offset);
+    records_[header->guest_address] = record;
+    offset = end_offset;
+  }
+  *out_valid_size = offset;
+  return true;
+}
+
+const X64CodeCacheFile::FunctionRecord* X64CodeCacheFile::Lookup(
+    uint32_t guest_address) const {
+  auto it = records_.find(guest_address);
+  return it != records_.end() ? &it->second : nullptr;
+}
+
+void X64CodeCacheFile::Append(
+    const FunctionHeader& header, const void* code,
+    const std::vector<X64CodeRelocation>& relocations,
+    const std::vector<SourceMapEntry>& source_map) {
+  assert_true(header.relocation_count == relocations.size());
+  assert_true(header.source_map_count == source_map.size());
+  static const uint8_t padding[8] = {0};
+
+  std::lock_guard<std::mutex> lock(write_mutex_);
+  fwrite(&header, sizeof(header), 1, file_);
+  fwrite(code, 1, header.code_size, file_);
+  fwrite(padding, 1, xe::round_up(header.code_size, 8u) - header.code_size,
+         file_);
+  if (!relocations.empty()) {
+    fwrite(relocations.data(), sizeof(X64CodeRelocation), relocations.size(),
+           file_);
+  }
+  if (!source_map.empty()) {
+    size_t source_map_size = source_map.size() * sizeof(SourceMapEntry);
+    fwrite(source_map.data(), 1, source_map_size, file_);
+    fwrite(padding, 1,
+           xe::round_up(source_map_size, size_t(8)) - source_map_size, file_);
+  }
+}
+
+}  // namespace x64
+}  // namespace backend
+}  // namespace cpu
+}  // namespace xe
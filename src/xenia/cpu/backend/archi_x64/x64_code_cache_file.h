@@ -0,0 +1,119 @@
+#ifndef XENIA_CPU_BACKEND_X64_X64_CODE_CACHE_FILE_H_
+#define XENIA_CPU_BACKEND_X64_X64_CODE_CACHE_FILE_H_
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "xenia/base/byte_order.h"
+#include "xenia/base/mapped_memory.h"
+#include "xenia/cpu/backend/x64/x64_code_cache.h"
+
+namespace xe {
+namespace cpu {
+namespace backend {
+namespace x64 {
+
+// Append-only file of generated guest function code that survives across
+// sessions.
+//
+// Layout:
+//   Header
+//   FunctionHeader, code (padded to 8b), X64CodeRelocation[],
+//       SourceMapEntry[] (padded to 8b)
+//   ... repeated per function.
+//
+// Records are only appended, so a function that is recompiled because its
+// guest code changed shadows the older record; the last one wins. A record cut
+// off by a crash is truncated away on the next Open.
+class X64CodeCacheFile {
+ public:
+  // Bump whenever code generation changes in a way that makes previously
+  // emitted code invalid (sequence changes, stack layout, thunk ABI, etc).
+  static const uint32_t kBackendVersion = 2;
+
+  struct Key {
+    // Hash of the XEX headers of the title module.
+    uint64_t module_hash;
+    // Hash of the host executable. Host image relocations are stored as
+    // offsets, which are only stable within one build.
+    uint64_t host_image_hash;
+    // X64EmitterFeatureFlags used to select sequences.
+    uint32_t feature_flags;
+    uint32_t backend_version;
+    // Constant table addresses are embedded as 32-bit displacements.
+    uint64_t emitter_data;
+  };
+
+  struct FunctionHeader {
+    uint32_t guest_address;
+    uint32_t guest_end_address;
+    // XXH3 of the guest instructions the code was generated from.
+    uint64_t guest_hash;
+    uint32_t code_size;
+    uint32_t relocation_count;
+    uint32_t source_map_count;
+    uint32_t stack_size;
+    uint32_t prolog_size;
+    uint32_t body_size;
+    uint32_t epilog_size;
+    uint32_t tail_size;
+    uint32_t prolog_stack_alloc_offset;
+    uint32_t reserved;
+  };
+
+  struct FunctionRecord {
+    const FunctionHeader* header;
+    const uint8_t* code;
+    const X64CodeRelocation* relocations;
+    const SourceMapEntry* source_map;
+  };
+
+  // Opens the file at path, keeping its records if they were written with the
+  // same key (unless discard_existing is set).
+  static std::unique_ptr<X64CodeCacheFile> Open(
+      const std::filesystem::path& path, const Key& key,
+      bool discard_existing = false);
+  ~X64CodeCacheFile();
+
+  // Number of functions available from previous sessions.
+  size_t record_count() const { return records_.size(); }
+
+  // Finds the most recent record for a guest function from a previous session.
+  const FunctionRecord* Lookup(uint32_t guest_address) const;
+
+  void Append(const FunctionHeader& header, const void* code,
+              const std::vector<X64CodeRelocation>& relocations,
+              const std::vector<SourceMapEntry>& source_map);
+
+ private:
+  struct Header {
+    uint32_t magic;
+    uint32_t header_size;
+    Key key;
+  };
+  static constexpr fourcc_t kMagic = make_fourcc("XJIT");
+
+  X64CodeCacheFile() = default;
+
+  // Indexes all complete records; out_valid_size receives the file offset
+  // just past the last one.
+  bool IndexRecords(size_t* out_valid_size);
+
+  std::unique_ptr<MappedMemory> mapping_;
+  std::unordered_map<uint32_t, FunctionRecord> records_;
+
+  std::mutex write_mutex_;
+  FILE* file_ = nullptr;
+};
+
+}  // namespace x64
+}  // namespace backend
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_BACKEND_X64_X64_CODE_CACHE_FILE_H_
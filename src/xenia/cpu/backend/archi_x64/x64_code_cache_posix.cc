@@ -1,11 +1,117 @@
-
 #include "xenia/cpu/backend/x64/x64_code_cache.h"
 
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "third_party/fmt/include/fmt/format.h"
+#include "xenia/base/assert.h"
+#include "xenia/base/cvar.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/math.h"
+#include "xenia/cpu/function.h"
+
+DEFINE_bool(jit_perf_map, false,
+            "Write /tmp/perf-<pid>.map naming every generated function, so "
+            "perf can symbolize samples in JIT code.",
+            "CPU");
+
+// Provided by libgcc (and libunwind): adds a .eh_frame section to the list the
+// unwinder searches, so debuggers, profilers and C++ exceptions can walk
+// through generated code.
+extern "C" void __register_frame(void* begin);
+extern "C" void __deregister_frame(void* begin);
+
 namespace xe {
 namespace cpu {
 namespace backend {
 namespace x64 {
 
+// The .eh_frame format; see "Exception Frames" in the LSB 5.0 Core spec.
+enum DwarfCallFrameOps : uint8_t {
+  DW_CFA_nop = 0x00,
+  DW_CFA_advance_loc1 = 0x02,
+  DW_CFA_advance_loc2 = 0x03,
+  DW_CFA_advance_loc4 = 0x04,
+  DW_CFA_remember_state = 0x0A,
+  DW_CFA_restore_state = 0x0B,
+  DW_CFA_def_cfa = 0x0C,
+  DW_CFA_def_cfa_offset = 0x0E,
+  DW_CFA_advance_loc = 0x40,  // delta in the low 6 bits
+  DW_CFA_offset = 0x80,       // register in the low 6 bits
+};
+
+// DWARF register numbers of the System V x86-64 ABI.
+static const uint8_t kDwarfRegRsp = 7;
+static const uint8_t kDwarfRegReturnAddress = 16;
+
+// A CIE followed by a single FDE and the zero terminator. Comfortably more
+// than the largest frame InitializeUnwindEntry writes.
+static const uint32_t kUnwindInfoSize = 128;
+
+class EhFrameWriter {
+ public:
+  explicit EhFrameWriter(uint8_t* base) : base_(base), ptr_(base) {}
+
+  size_t offset() const { return size_t(ptr_ - base_); }
+
+  void u8(uint8_t value) { *ptr_++ = value; }
+  void u32(uint32_t value) {
+    std::memcpy(ptr_, &value, sizeof(value));
+    ptr_ += sizeof(value);
+  }
+  void u64(uint64_t value) {
+    std::memcpy(ptr_, &value, sizeof(value));
+    ptr_ += sizeof(value);
+  }
+  void uleb128(uint64_t value) {
+    do {
+      uint8_t byte = value & 0x7F;
+      value >>= 7;
+      u8(value ? byte | 0x80 : byte);
+    } while (value);
+  }
+
+  void AdvanceLoc(size_t delta) {
+    if (delta < 0x40) {
+      u8(DW_CFA_advance_loc | uint8_t(delta));
+    } else if (delta <= UINT8_MAX) {
+      u8(DW_CFA_advance_loc1);
+      u8(uint8_t(delta));
+    } else if (delta <= UINT16_MAX) {
+      u8(DW_CFA_advance_loc2);
+      uint16_t value = uint16_t(delta);
+      std::memcpy(ptr_, &value, sizeof(value));
+      ptr_ += sizeof(value);
+    } else {
+      u8(DW_CFA_advance_loc4);
+      u32(uint32_t(delta));
+    }
+  }
+
+  // Starts a CIE or FDE; returns where its length goes.
+  uint8_t* BeginEntry() {
+    uint8_t* length_ptr = ptr_;
+    u32(0);
+    return length_ptr;
+  }
+  // Pads the entry to pointer alignment and fills in its length.
+  void EndEntry(uint8_t* length_ptr) {
+    while ((ptr_ - length_ptr) % 8) {
+      u8(DW_CFA_nop);
+    }
+    uint32_t length = uint32_t(ptr_ - length_ptr - sizeof(uint32_t));
+    std::memcpy(length_ptr, &length, sizeof(length));
+  }
+
+ private:
+  uint8_t* base_;
+  uint8_t* ptr_;
+};
+
 class PosixX64CodeCache : public X64CodeCache {
  public:
   PosixX64CodeCache();
@@ -13,19 +119,36 @@ class PosixX64CodeCache : public X64CodeCache {
 
   bool Initialize() override;
 
-  void* LookupUnwindInfo(uint64_t host_pc) override { return nullptr; }
+  // Returns the execute address of the FDE covering host_pc.
+  void* LookupUnwindInfo(uint64_t host_pc) override;
 
  private:
-  /*
+  // Execute offsets of a placed function and its .eh_frame data, kept in
+  // placement (and so address) order.
+  struct UnwindEntry {
+    uint32_t begin_offset;
+    uint32_t end_offset;
+    uint8_t* eh_frame;
+    uint8_t* fde;
+  };
+
   UnwindReservation RequestUnwindReservation(uint8_t* entry_address) override;
-  void PlaceCode(uint32_t guest_address, void* machine_code, size_t code_size,
-                 size_t stack_size, void* code_execute_address,
+  void PlaceCode(uint32_t guest_address, void* machine_code,
+                 const EmitFunctionInfo& func_info,
+                 GuestFunction* function_info, void* code_execute_address,
                  UnwindReservation unwind_reservation) override;
 
   void InitializeUnwindEntry(uint8_t* unwind_entry_address,
-                             size_t unwind_table_slot, void* code_address,
-                             size_t code_size, size_t stack_size);
-  */
+                             size_t unwind_table_slot,
+                             void* code_execute_address,
+                             const EmitFunctionInfo& func_info);
+  void WritePerfMapEntry(uint32_t guest_address, void* code_execute_address,
+                         size_t code_size, GuestFunction* function_info);
+
+  std::vector<UnwindEntry> unwind_table_;
+  std::atomic<uint32_t> unwind_table_count_ = {0};
+
+  FILE* perf_map_file_ = nullptr;
 };
 
 std::unique_ptr<X64CodeCache> X64CodeCache::Create() {
@@ -33,9 +156,181 @@ std::unique_ptr<X64CodeCache> X64CodeCache::Create() {
 }
 
 PosixX64CodeCache::PosixX64CodeCache() = default;
-PosixX64CodeCache::~PosixX64CodeCache() = default;
 
-bool PosixX64CodeCache::Initialize() { return X64CodeCache::Initialize(); }
+PosixX64CodeCache::~PosixX64CodeCache() {
+  for (uint32_t i = unwind_table_count_; i > 0; --i) {
+    if (unwind_table_[i - 1].eh_frame) {
+      __deregister_frame(unwind_table_[i - 1].eh_frame);
+    }
+  }
+  if (perf_map_file_) {
+    fclose(perf_map_file_);
+    perf_map_file_ = nullptr;
+  }
+}
+
+bool PosixX64CodeCache::Initialize() {
+  if (!X64CodeCache::Initialize()) {
+    return false;
+  }
+
+  // We don't support reallocing right now, so this should be high.
+  unwind_table_.resize(kMaximumFunctionCount);
+
+  if (cvars::jit_perf_map) {
+    auto path = fmt::format("/tmp/perf-{}.map", getpid());
+    perf_map_file_ = fopen(path.c_str(), "w");
+    if (!perf_map_file_) {
+      XELOGW("Unable to open {}; perf will not see JIT symbols", path);
+    }
+  }
+
+  return true;
+}
+
+PosixX64CodeCache::UnwindReservation
+PosixX64CodeCache::RequestUnwindReservation(uint8_t* entry_address) {
+  assert_false(unwind_table_count_ >= kMaximumFunctionCount);
+  UnwindReservation unwind_reservation;
+  unwind_reservation.data_size = xe::round_up(kUnwindInfoSize, 16);
+  unwind_reservation.table_slot = unwind_table_count_++;
+  unwind_reservation.entry_address = entry_address;
+  return unwind_reservation;
+}
+
+void PosixX64CodeCache::PlaceCode(uint32_t guest_address, void* machine_code,
+                                  const EmitFunctionInfo& func_info,
+                                  GuestFunction* function_info,
+                                  void* code_execute_address,
+                                  UnwindReservation unwind_reservation) {
+  InitializeUnwindEntry(unwind_reservation.entry_address,
+                        unwind_reservation.table_slot, code_execute_address,
+                        func_info);
+
+  if (perf_map_file_) {
+    WritePerfMapEntry(guest_address, code_execute_address,
+                      func_info.code_size.total, function_info);
+  }
+}
+
+void PosixX64CodeCache::InitializeUnwindEntry(
+    uint8_t* unwind_entry_address, size_t unwind_table_slot,
+    void* code_execute_address, const EmitFunctionInfo& func_info) {
+  // The unwinder reads the frame through the execute view; it is only written
+  // through the write view.
+  uint8_t* eh_frame_execute_address =
+      generated_code_execute_base_ +
+      (unwind_entry_address - generated_code_write_base_);
+  EhFrameWriter writer(unwind_entry_address);
+
+  // CIE: on entry the CFA is rsp + 8 and the return address is just below it.
+  uint8_t* cie_length = writer.BeginEntry();
+  writer.u32(0);  // CIE id
+  writer.u8(1);   // version
+  writer.u8('z');
+  writer.u8('R');
+  writer.u8(0);
+  writer.uleb128(1);  // code alignment factor
+  writer.u8(0x78);    // data alignment factor (sleb128 -8)
+  writer.u8(kDwarfRegReturnAddress);
+  writer.uleb128(1);  // augmentation data length
+  writer.u8(0x00);    // FDE pointer encoding: DW_EH_PE_absptr
+  writer.u8(DW_CFA_def_cfa);
+  writer.uleb128(kDwarfRegRsp);
+  writer.uleb128(8);
+  writer.u8(DW_CFA_offset | kDwarfRegReturnAddress);
+  writer.uleb128(1);  // cfa - 8
+  writer.EndEntry(cie_length);
+
+  // FDE. Mirrors the prolog/epilog form X64Emitter and the thunk emitters
+  // use: a single sub rsp at prolog_stack_alloc_offset, undone by the
+  // add rsp that starts the epilog. The tail holds out of line paths that
+  // run with the body's frame, call site link stubs included (see
+  // X64Emitter::EmitCallSiteStubs).
+  size_t fde_offset = writer.offset();
+  uint8_t* fde_length = writer.BeginEntry();
+  writer.u32(uint32_t(writer.offset()));  // CIE pointer, back to offset 0
+  writer.u64(reinterpret_cast<uint64_t>(code_execute_address));
+  writer.u64(func_info.code_size.total);
+  writer.uleb128(0);  // augmentation data length
+  if (func_info.stack_size) {
+    size_t epilog_offset =
+        func_info.code_size.prolog + func_info.code_size.body;
+    // add rsp, imm8 or add rsp, imm32.
+    size_t stack_free_offset =
+        epilog_offset + (func_info.stack_size < 0x80 ? 4 : 7);
+    size_t tail_offset = epilog_offset + func_info.code_size.epilog;
+    assert_true(func_info.prolog_stack_alloc_offset <= epilog_offset);
+    assert_true(stack_free_offset <= tail_offset);
+
+    writer.AdvanceLoc(func_info.prolog_stack_alloc_offset);
+    writer.u8(DW_CFA_def_cfa_offset);
+    writer.uleb128(func_info.stack_size + 8);
+    writer.AdvanceLoc(stack_free_offset - func_info.prolog_stack_alloc_offset);
+    writer.u8(DW_CFA_remember_state);
+    writer.u8(DW_CFA_def_cfa_offset);
+    writer.uleb128(8);
+    if (tail_offset < func_info.code_size.total) {
+      writer.AdvanceLoc(tail_offset - stack_free_offset);
+      writer.u8(DW_CFA_restore_state);
+    }
+  }
+  writer.EndEntry(fde_length);
+
+  // Zero length entry terminating the section.
+  writer.u32(0);
+  assert_true(writer.offset() <= kUnwindInfoSize);
+
+  auto& entry = unwind_table_[unwind_table_slot];
+  entry.begin_offset =
+      uint32_t(reinterpret_cast<uint8_t*>(code_execute_address) -
+               generated_code_execute_base_);
+  entry.end_offset = uint32_t(entry.begin_offset + func_info.code_size.total);
+  entry.eh_frame = eh_frame_execute_address;
+  entry.fde = eh_frame_execute_address + fde_offset;
+
+  // libgcc takes the whole section (libunwind before LLVM 13 wanted each FDE,
+  // which it can also find from the section start in newer releases).
+  __register_frame(entry.eh_frame);
+}
+
+void PosixX64CodeCache::WritePerfMapEntry(uint32_t guest_address,
+                                          void* code_execute_address,
+                                          size_t code_size,
+                                          GuestFunction* function_info) {
+  // The perf map format; see tools/perf/Documentation/jit-interface.txt in
+  // the Linux tree.
+  std::string name;
+  if (function_info && !function_info->name().empty()) {
+    name = fmt::format("{} ({:08X})", function_info->name(), guest_address);
+  } else if (guest_address) {
+    name = fmt::format("sub_{:08X}", guest_address);
+  } else {
+    name = "xenia_thunk";
+  }
+  fmt::print(perf_map_file_, "{:x} {:x} {}\n",
+             reinterpret_cast<uintptr_t>(code_execute_address), code_size,
+             name);
+  fflush(perf_map_file_);
+}
+
+void* PosixX64CodeCache::LookupUnwindInfo(uint64_t host_pc) {
+  auto entry = reinterpret_cast<UnwindEntry*>(std::bsearch(
+      &host_pc, unwind_table_.data(), unwind_table_count_, sizeof(UnwindEntry),
+      [](const void* key_ptr, const void* element_ptr) {
+        auto key = *reinterpret_cast<const uintptr_t*>(key_ptr) -
+                   kGeneratedCodeExecuteBase;
+        auto element = reinterpret_cast<const UnwindEntry*>(element_ptr);
+        if (key < element->begin_offset) {
+          return -1;
+        } else if (key >= element->end_offset) {
+          return 1;
+        } else {
+          return 0;
+        }
+      }));
+  return entry ? entry->fde : nullptr;
+}
 
 }  // namespace x64
 }  // namespace backend
@@ -3,6 +3,7 @@
 
 #include <stddef.h>
 
+#include <algorithm>
 #include <climits>
 #include <cstring>
 
@@ -21,6 +22,7 @@
 #include "xenia/cpu/backend/x64/x64_function.h"
 #include "xenia/cpu/backend/x64/x64_sequences.h"
 #include "xenia/cpu/backend/x64/x64_stack_layout.h"
+#include "xenia/cpu/backend/x64/x64_trace_writer.h"
 #include "xenia/cpu/cpu_flags.h"
 #include "xenia/cpu/function.h"
 #include "xenia/cpu/function_debug_info.h"
@@ -35,6 +37,11 @@ DEFINE_bool(ignore_undefined_externs, true,
 DEFINE_bool(emit_source_annotations, false,
             "Add extra movs and nops to make disassembly easier to read.",
             "CPU");
+DEFINE_bool(x64_lean_helper_calls, true,
+            "Call MMIO handlers and the clock directly, spilling only the "
+            "registers they clobber, instead of through the guest-to-host "
+            "thunk.",
+            "CPU");
 
 namespace xe {
 namespace cpu {
@@ -48,6 +55,13 @@ using namespace xe::literals;
 static const size_t kMaxCodeSize = 1_MiB;
 
 static const size_t kStashOffset = 32;
+
+// Instructions whose sequences go through X64Emitter::CallHostHelper.
+static bool CallsHostHelper(const Instr* instr) {
+  return instr->opcode == &hir::OPCODE_LOAD_CLOCK_info ||
+         instr->opcode == &hir::OPCODE_LOAD_MMIO_info ||
+         instr->opcode == &hir::OPCODE_STORE_MMIO_info;
+}
 // static const size_t kStashOffsetHigh = 32 + 32;
 
 const uint32_t X64Emitter::gpr_reg_map_[X64Emitter::GPR_COUNT] = {
@@ -73,9 +87,14 @@ X64Emitter::X64Emitter(X64Backend* backend, XbyakAllocator* allocator)
     return;
   }
 
+  feature_flags_ = QueryFeatureFlags(cpu_);
+}
+
+uint32_t X64Emitter::QueryFeatureFlags(const Xbyak::util::Cpu& cpu) {
+  uint32_t feature_flags = 0;
 #define TEST_EMIT_FEATURE(emit, ext)                \
   if ((cvars::x64_extension_mask & emit) == emit) { \
-    feature_flags_ |= (cpu_.has(ext) ? emit : 0);   \
+    feature_flags |= (cpu.has(ext) ? emit : 0);     \
   }
 
   TEST_EMIT_FEATURE(kX64EmitAVX2, Xbyak::util::Cpu::tAVX2);
@@ -93,6 +112,7 @@ X64Emitter::X64Emitter(X64Backend* backend, XbyakAllocator* allocator)
   TEST_EMIT_FEATURE(kX64EmitAVX512VBMI, Xbyak::util::Cpu::tAVX512_VBMI);
 
 #undef TEST_EMIT_FEATURE
+  return feature_flags;
 }
 
 X64Emitter::~X64Emitter() = default;
@@ -108,6 +128,29 @@ bool X64Emitter::Emit(GuestFunction* function, HIRBuilder* builder,
   debug_info_flags_ = debug_info_flags;
   trace_data_ = &function->trace_data();
   source_map_arena_.Reset();
+  call_targets_.clear();
+  relocations_.clear();
+  call_site_stubs_.clear();
+  inline_cache_stubs_.clear();
+  // Inlined callees and folded read-only data aren't covered by the cached
+  // code's guest hash.
+  persistable_ = !debug_info_flags_ &&
+                 !(builder->attributes() &
+                   (hir::FUNCTION_ATTRIB_INLINED_CALLS |
+                    hir::FUNCTION_ATTRIB_READ_ONLY_DATA));
+  guest_address_ = function->address();
+
+  // Baseline code counts its entries and asks for an optimized recompile once
+  // the counter runs out. The counter lives in the code cache, addressed
+  // through its writable view as the executable one may be read-only.
+  tier_up_counter_ = 0;
+  if (cvars::jit_tiered_compilation && !debug_info_flags_ &&
+      function->tier() == CompileTier::kBaseline) {
+    uint32_t threshold = uint32_t(std::max(1, cvars::jit_tier_up_threshold));
+    tier_up_counter_ = code_cache_->PlaceData(&threshold, sizeof(threshold));
+    // The counter address is per session.
+    MarkNotPersistable();
+  }
 
   // Fill the generator with code.
   EmitFunctionInfo func_info = {};
@@ -115,6 +158,16 @@ bool X64Emitter::Emit(GuestFunction* function, HIRBuilder* builder,
     return false;
   }
 
+  // Keep a copy of the code as emitted for the persistent cache: once placed,
+  // other threads may call into it and link its call sites to this session's
+  // addresses.
+  bool persist = persistable_ && code_cache_->has_persistent_cache() &&
+                 function->behavior() == Function::Behavior::kDefault;
+  std::vector<uint8_t> persisted_code;
+  if (persist) {
+    persisted_code.assign(getCode(), getCode() + getSize());
+  }
+
   // Copy the final code to the cache and relocate it.
   *out_code_size = getSize();
   *out_code_address = Emplace(func_info, function);
@@ -122,6 +175,16 @@ bool X64Emitter::Emit(GuestFunction* function, HIRBuilder* builder,
   // Stash source map.
   source_map_arena_.CloneContents(out_source_map);
 
+  if (persist) {
+    code_cache_->PersistGuestCode(function, persisted_code.data(), func_info,
+                                  relocations_, *out_source_map);
+  }
+
+  // Let the background compiler get a head start on our callees.
+  if (!call_targets_.empty() && processor_->compile_queue()) {
+    processor_->compile_queue()->Enqueue(call_targets_);
+  }
+
   return true;
 }
 
@@ -175,6 +238,41 @@ bool X64Emitter::Emit(HIRBuilder* builder, EmitFunctionInfo& func_info) {
   stack_offset -= StackLayout::GUEST_STACK_SIZE;
   stack_offset = xe::align(stack_offset, static_cast<size_t>(16));
 
+  // Find the registers values live in, and whether anything calls a helper.
+  used_gprs_ = 0;
+  used_xmms_ = 0;
+  bool calls_host_helper = false;
+  for (auto block = builder->first_block(); block; block = block->next) {
+    for (auto instr = block->instr_head; instr; instr = instr->next) {
+      calls_host_helper |= CallsHostHelper(instr);
+      auto dest = instr->dest;
+      if (!dest || !dest->reg.set) {
+        continue;
+      }
+      if (dest->reg.set->id == 0) {
+        used_gprs_ |= 1u << gpr_reg_map_[dest->reg.index];
+      } else {
+        used_xmms_ |= 1u << xmm_reg_map_[dest->reg.index];
+      }
+    }
+  }
+
+  // Spill slots for CallHostHelper, enough for every allocated register the
+  // host ABI lets a helper clobber. The xmm slots come first and must be 16b
+  // aligned; the body runs with rsp 16b aligned.
+  lean_helper_calls_ = calls_host_helper && cvars::x64_lean_helper_calls;
+  helper_spill_offset_ = 0;
+  if (lean_helper_calls_) {
+    size_t spill_size =
+        xe::bit_count(used_xmms_ & kHostAbiClobbers.xmms) * 16 +
+        xe::bit_count(used_gprs_ & kHostAbiClobbers.gprs) * 8;
+    helper_spill_offset_ = xe::align(
+        StackLayout::GUEST_STACK_SIZE + stack_offset, static_cast<size_t>(16));
+    stack_offset = xe::align(
+        helper_spill_offset_ + spill_size - StackLayout::GUEST_STACK_SIZE,
+        static_cast<size_t>(16));
+  }
+
   struct _code_offsets {
     size_t prolog;
     size_t prolog_stack_alloc;
@@ -206,6 +304,16 @@ bool X64Emitter::Emit(HIRBuilder* builder, EmitFunctionInfo& func_info) {
   mov(qword[rsp + StackLayout::GUEST_RET_ADDR], rcx);
   mov(qword[rsp + StackLayout::GUEST_CALL_RET_ADDR], 0);
 
+  Xbyak::Label tier_up_label;
+  Xbyak::Label tier_up_resume_label;
+  if (tier_up_counter_) {
+    // Above 2 GB, so it can't be a sign-extended 32-bit displacement.
+    mov(rax, uint64_t(tier_up_counter_));
+    sub(dword[rax], 1);
+    jz(tier_up_label, T_NEAR);
+    L(tier_up_resume_label);
+  }
+
   // Safe now to do some tracing.
   if (debug_info_flags_ & DebugInfoFlags::kDebugInfoTraceFunctions) {
     // We require 32-bit addresses.
@@ -279,6 +387,14 @@ bool X64Emitter::Emit(HIRBuilder* builder, EmitFunctionInfo& func_info) {
 
   code_offsets.tail = getSize();
 
+  // Out of line so the epilog keeps the exact form the unwinder expects.
+  if (tier_up_counter_) {
+    L(tier_up_label);
+    CallNative(TierUpCounterExpired, guest_address_);
+    jmp(tier_up_resume_label, T_NEAR);
+  }
+  EmitCallSiteStubs();
+
   if (cvars::emit_source_annotations) {
     nop();
     nop();
@@ -387,6 +503,13 @@ void X64Emitter::UnimplementedInstr(const hir::Instr* i) {
   assert_always();
 }
 
+// Called once from baseline code when its entry counter reaches zero.
+uint64_t TierUpCounterExpired(void* raw_context, uint64_t address) {
+  auto thread_state = *reinterpret_cast<ThreadState**>(raw_context);
+  thread_state->processor()->RequestTierUp(static_cast<uint32_t>(address));
+  return 0;
+}
+
 // This is used by the X64ThunkEmitter's ResolveFunctionThunk.
 uint64_t ResolveFunction(void* raw_context, uint64_t target_address) {
   auto thread_state = *reinterpret_cast<ThreadState**>(raw_context);
@@ -403,28 +526,72 @@ uint64_t ResolveFunction(void* raw_context, uint64_t target_address) {
   return addr;
 }
 
+// Called from the link stub of a direct call site until the site is linked.
+uint64_t LinkFunctionCall(void* raw_context, uint64_t target_address,
+                          uint64_t site_end) {
+  auto thread_state = *reinterpret_cast<ThreadState**>(raw_context);
+  auto processor = thread_state->processor();
+  uint32_t code = uint32_t(ResolveFunction(raw_context, target_address));
+  auto backend = static_cast<X64Backend*>(processor->backend());
+  return backend->code_cache()->LinkCallSite(
+      static_cast<uint32_t>(target_address),
+      reinterpret_cast<uint8_t*>(site_end), code);
+}
+
+// Called on an inline cache miss at an indirect call site whose cache is
+// still empty.
+uint64_t LinkIndirectCall(void* raw_context, uint64_t target_address,
+                          uint64_t cache) {
+  auto thread_state = *reinterpret_cast<ThreadState**>(raw_context);
+  auto processor = thread_state->processor();
+  uint32_t code = uint32_t(ResolveFunction(raw_context, target_address));
+  auto backend = static_cast<X64Backend*>(processor->backend());
+  return backend->code_cache()->LinkInlineCache(
+      static_cast<uint32_t>(target_address),
+      reinterpret_cast<uint64_t*>(cache), code);
+}
+
 void X64Emitter::Call(const hir::Instr* instr, GuestFunction* function) {
   assert_not_null(function);
   auto fn = static_cast<X64Function*>(function);
-  // Resolve address to the function to call and store in rax.
-  if (fn->machine_code()) {
-    // TODO(benvanik): is it worth it to do this? It removes the need for
-    // a ResolveFunction call, but makes the table less useful.
-    assert_zero(uint64_t(fn->machine_code()) & 0xFFFFFFFF00000000);
-    mov(eax, uint32_t(uint64_t(fn->machine_code())));
-  } else if (code_cache_->has_indirection_table()) {
-    // Load the pointer to the indirection table maintained in X64CodeCache.
-    // The target dword will either contain the address of the generated code
-    // or a thunk to ResolveAddress.
-    mov(ebx, function->address());
-    mov(eax, dword[ebx]);
-  } else {
-    // Old-style resolve.
-    // Not too important because indirection table is almost always available.
-    // TODO: Overwrite the call-site with a straight call.
-    CallNative(&ResolveFunction, function->address());
+  if (!fn->machine_code()) {
+    call_targets_.push_back(function->address());
   }
 
+  if (code_cache_->has_indirection_table()) {
+    // Direct rel32 call (or jmp for tail calls). It goes through a link stub
+    // the first time, which points it straight at the callee.
+    auto site = std::make_unique<CallSiteStub>();
+    site->guest_address = function->address();
+    site->is_tail = (instr->flags & hir::CALL_TAIL) != 0;
+    if (site->is_tail) {
+      // Since we skip the prolog we need to mark the return here.
+      EmitTraceUserCallReturn();
+
+      // Pass the callers return address over.
+      mov(rcx, qword[rsp + StackLayout::GUEST_RET_ADDR]);
+
+      add(rsp, static_cast<uint32_t>(stack_size()));
+    } else {
+      // Return address is from the previous SET_RETURN_ADDRESS.
+      mov(rcx, qword[rsp + StackLayout::GUEST_CALL_RET_ADDR]);
+    }
+    // The displacement must be 4b aligned to be patched atomically.
+    nop((4 - ((getSize() + 1) & 3)) & 3);
+    if (site->is_tail) {
+      jmp(site->stub_label, T_NEAR);
+    } else {
+      call(site->stub_label);
+    }
+    L(site->site_end_label);
+    call_site_stubs_.push_back(std::move(site));
+    return;
+  }
+
+  // Old-style resolve.
+  // Not too important because indirection table is almost always available.
+  CallNative(&ResolveFunction, function->address());
+
   // Actually jump/call to rax.
   if (instr->flags & hir::CALL_TAIL) {
     // Since we skip the prolog we need to mark the return here.
@@ -451,19 +618,25 @@ void X64Emitter::CallIndirect(const hir::Instr* instr,
     je(epilog_label(), CodeGenerator::T_NEAR);
   }
 
-  // Load the pointer to the indirection table maintained in X64CodeCache.
-  // The target dword will either contain the address of the generated code
-  // or a thunk to ResolveAddress.
   if (code_cache_->has_indirection_table()) {
     if (reg.cvt32() != ebx) {
       mov(ebx, reg.cvt32());
     }
-    mov(eax, dword[ebx]);
+    // Inline cache of the last target: guest address in the low dword, its
+    // code in the high one. Misses fall back to the indirection table, which
+    // holds either the generated code or the ResolveFunction thunk.
+    auto cache = std::make_unique<InlineCacheStub>();
+    mov(rax, qword[rip + cache->cache_label]);
+    cmp(eax, ebx);
+    jne(cache->miss_label, T_NEAR);
+    shr(rax, 32);
+    L(cache->resume_label);
+    inline_cache_stubs_.push_back(std::move(cache));
   } else {
     // Old-style resolve.
     // Not too important because indirection table is almost always available.
     mov(edx, reg.cvt32());
-    mov(rax, reinterpret_cast<uint64_t>(ResolveFunction));
+    MovHostAddress(rax, reinterpret_cast<void*>(ResolveFunction));
     mov(rcx, GetContextReg());
     call(rax);
   }
@@ -486,6 +659,62 @@ void X64Emitter::CallIndirect(const hir::Instr* instr,
   }
 }
 
+void X64Emitter::EmitCallSiteStubs() {
+  // Like the rest of the tail, the stubs run LinkFunctionCall with the body's
+  // frame in place, which is what the unwind info describes there. Only the
+  // first instruction of each stub and the final jmp of the tail call one see
+  // a different rsp.
+  for (auto& site : call_site_stubs_) {
+    L(site->stub_label);
+    if (site->is_tail) {
+      // Entered with the frame already gone; put it back around the native
+      // call. The guest return address is still in its slot.
+      sub(rsp, static_cast<uint32_t>(stack_size()));
+      mov(qword[rsp + StackLayout::GUEST_RET_ADDR], rcx);
+      mov(GetNativeParam(0), site->guest_address);
+      lea(GetNativeParam(1), ptr[rip + site->site_end_label]);
+      CallNativeSafe(reinterpret_cast<void*>(LinkFunctionCall));
+      mov(rcx, qword[rsp + StackLayout::GUEST_RET_ADDR]);
+      add(rsp, static_cast<uint32_t>(stack_size()));
+      jmp(rax);
+    } else {
+      // Entered through the call; drop its return address and make the call
+      // from here instead, returning to the site afterwards.
+      add(rsp, 8);
+      mov(GetNativeParam(0), site->guest_address);
+      lea(GetNativeParam(1), ptr[rip + site->site_end_label]);
+      CallNativeSafe(reinterpret_cast<void*>(LinkFunctionCall));
+      mov(rcx, qword[rsp + StackLayout::GUEST_CALL_RET_ADDR]);
+      call(rax);
+      jmp(site->site_end_label, T_NEAR);
+    }
+  }
+  call_site_stubs_.clear();
+
+  for (auto& cache : inline_cache_stubs_) {
+    Xbyak::Label fill_label;
+    L(cache->miss_label);
+    // rax still holds the cache; only an empty one gets filled.
+    test(eax, eax);
+    jz(fill_label);
+    mov(eax, dword[ebx]);
+    jmp(cache->resume_label, T_NEAR);
+    L(fill_label);
+    mov(GetNativeParam(0).cvt32(), ebx);
+    lea(GetNativeParam(1), ptr[rip + cache->cache_label]);
+    CallNativeSafe(reinterpret_cast<void*>(LinkIndirectCall));
+    jmp(cache->resume_label, T_NEAR);
+  }
+  if (!inline_cache_stubs_.empty()) {
+    align(8);
+    for (auto& cache : inline_cache_stubs_) {
+      L(cache->cache_label);
+      dq(0);
+    }
+  }
+  inline_cache_stubs_.clear();
+}
+
 uint64_t UndefinedCallExtern(void* raw_context, uint64_t function_ptr) {
   auto function = reinterpret_cast<Function*>(function_ptr);
   if (!cvars::ignore_undefined_externs) {
@@ -507,6 +736,8 @@ void X64Emitter::CallExtern(const hir::Instr* instr, const Function* function) {
       // rdx = arg0
       // r8  = arg1
       // r9  = arg2
+      // Handler args are per-session heap objects.
+      MarkNotPersistable();
       auto thunk = backend()->guest_to_host_thunk();
       mov(rax, reinterpret_cast<uint64_t>(thunk));
       mov(rcx, reinterpret_cast<uint64_t>(builtin_function->handler()));
@@ -523,9 +754,9 @@ void X64Emitter::CallExtern(const hir::Instr* instr, const Function* function) {
       // rdx = arg0
       // r8  = arg1
       // r9  = arg2
-      auto thunk = backend()->guest_to_host_thunk();
-      mov(rax, reinterpret_cast<uint64_t>(thunk));
-      mov(rcx, reinterpret_cast<uint64_t>(extern_function->extern_handler()));
+      MovThunkAddress(rax, X64CodeRelocation::Type::kGuestToHostThunk);
+      MovHostAddress(
+          rcx, reinterpret_cast<void*>(extern_function->extern_handler()));
       mov(rdx,
           qword[GetContextReg() + offsetof(ppc::PPCContext, kernel_state)]);
       call(rax);
@@ -533,6 +764,7 @@ void X64Emitter::CallExtern(const hir::Instr* instr, const Function* function) {
     }
   }
   if (undefined) {
+    MarkNotPersistable();
     CallNative(UndefinedCallExtern, reinterpret_cast<uint64_t>(function));
   }
 }
@@ -558,11 +790,216 @@ void X64Emitter::CallNativeSafe(void* fn) {
   // rdx = arg0
   // r8  = arg1
   // r9  = arg2
-  auto thunk = backend()->guest_to_host_thunk();
-  mov(rax, reinterpret_cast<uint64_t>(thunk));
-  mov(rcx, reinterpret_cast<uint64_t>(fn));
+  MovThunkAddress(rax, X64CodeRelocation::Type::kGuestToHostThunk);
+  MovHostAddress(rcx, fn);
+  call(rax);
+  // rax = host return
+}
+
+void X64Emitter::CallHostHelper(const void* fn) {
+  if (!lean_helper_calls_) {
+    CallNativeSafe(const_cast<void*>(fn));
+    return;
+  }
+  auto clobbers = backend()->LookupHostHelper(fn);
+  uint32_t spill_xmms = clobbers.xmms & used_xmms_;
+  uint32_t spill_gprs = clobbers.gprs & used_gprs_;
+  // The context and membase registers are volatile on SysV; they are cheaper
+  // to reload than to spill.
+  bool reload_context = (clobbers.gprs >> GetContextReg().getIdx()) & 1;
+  bool reload_membase = (clobbers.gprs >> GetMembaseReg().getIdx()) & 1;
+  spill_gprs &= ~((1u << GetContextReg().getIdx()) |
+                  (1u << GetMembaseReg().getIdx()));
+
+  size_t offset = helper_spill_offset_;
+  for (uint32_t i = 0; i < 16; ++i) {
+    if (spill_xmms & (1u << i)) {
+      vmovaps(ptr[rsp + offset], Xbyak::Xmm(i));
+      offset += 16;
+    }
+  }
+  for (uint32_t i = 0; i < 16; ++i) {
+    if (spill_gprs & (1u << i)) {
+      mov(qword[rsp + offset], Xbyak::Reg64(i));
+      offset += 8;
+    }
+  }
+
+  // Same convention the guest-to-host thunk calls with. rsp is 16b aligned
+  // here and the arg temp area doubles as the Win64 home space.
+  // rdx = arg0
+  // r8  = arg1
+  // r9  = arg2
+  mov(rcx, GetContextReg());
+  MovHostAddress(rax, fn);
   call(rax);
   // rax = host return
+
+  offset = helper_spill_offset_;
+  for (uint32_t i = 0; i < 16; ++i) {
+    if (spill_xmms & (1u << i)) {
+      vmovaps(Xbyak::Xmm(i), ptr[rsp + offset]);
+      offset += 16;
+    }
+  }
+  for (uint32_t i = 0; i < 16; ++i) {
+    if (spill_gprs & (1u << i)) {
+      mov(Xbyak::Reg64(i), qword[rsp + offset]);
+      offset += 8;
+    }
+  }
+  if (reload_context) {
+    ReloadContext();
+  }
+  if (reload_membase) {
+    ReloadMembase();
+  }
+}
+
+uintptr_t X64Emitter::host_image_anchor() {
+  return reinterpret_cast<uintptr_t>(&X64Emitter::host_image_anchor);
+}
+
+void X64Emitter::MovHostAddress(const Xbyak::Reg64& reg, const void* address) {
+  MovImm64(reg, reinterpret_cast<uint64_t>(address),
+           X64CodeRelocation::Type::kHostImage,
+           reinterpret_cast<uint64_t>(address) - host_image_anchor());
+}
+
+void X64Emitter::MovThunkAddress(const Xbyak::Reg64& reg,
+                                 X64CodeRelocation::Type type) {
+  uint64_t address;
+  switch (type) {
+    case X64CodeRelocation::Type::kHostToGuestThunk:
+      address = reinterpret_cast<uint64_t>(backend()->host_to_guest_thunk());
+      break;
+    case X64CodeRelocation::Type::kGuestToHostThunk:
+      address = reinterpret_cast<uint64_t>(backend()->guest_to_host_thunk());
+      break;
+    case X64CodeRelocation::Type::kResolveFunctionThunk:
+      address = reinterpret_cast<uint64_t>(backend()->resolve_function_thunk());
+      break;
+    default:
+      assert_unhandled_case(type);
+      return;
+  }
+  MovImm64(reg, address, type, 0);
+}
+
+void X64Emitter::MovImm64(const Xbyak::Reg64& reg, uint64_t value,
+                          X64CodeRelocation::Type type,
+                          uint64_t relocation_value) {
+  // mov r64, imm64 by hand; xbyak would pick a shorter encoding when the
+  // value happens to fit and leave nothing to patch.
+  db(0x48 | (reg.getIdx() >= 8 ? 0x01 : 0x00));
+  db(0xB8 | (reg.getIdx() & 7));
+  relocations_.push_back({type, uint32_t(getSize()), relocation_value});
+  dq(value);
+}
+
+void X64Emitter::EmitTraceRecord(TraceRecordType type, uint32_t extra) {
+  // The ring is the backend data of the ThreadState.
+  mov(rax, qword[GetContextReg() + offsetof(ppc::PPCContext, thread_state)]);
+  mov(rax, qword[rax + ThreadState::backend_data_offset()]);
+  mov(rcx, qword[rax + offsetof(TraceRing, write_index)]);
+  mov(rdx, qword[rax + offsetof(TraceRing, index_mask)]);
+  and_(rdx, rcx);
+  shl(rdx, kTraceRecordShift);
+  add(rdx, qword[rax + offsetof(TraceRing, records)]);
+  mov(dword[rdx + offsetof(TraceRecord, type)], uint32_t(type));
+  mov(dword[rdx + offsetof(TraceRecord, key)], r9d);
+  if (extra) {
+    mov(qword[rdx + offsetof(TraceRecord, extra)], extra);
+  }
+  vmovups(ptr[rdx + offsetof(TraceRecord, value)], xmm0);
+  // Published after the record; stores are not reordered on x64.
+  inc(rcx);
+  mov(qword[rax + offsetof(TraceRing, write_index)], rcx);
+}
+
+// Reads the value a record of the type carries from memory into xmm0.
+static void LoadTraceValue(X64Emitter& e, TraceRecordType type,
+                           const Xbyak::RegExp& addr) {
+  switch (GetTraceRecordValueSize(type)) {
+    case 1:
+      e.movzx(e.r8d, e.byte[addr]);
+      e.vmovd(e.xmm0, e.r8d);
+      break;
+    case 2:
+      e.movzx(e.r8d, e.word[addr]);
+      e.vmovd(e.xmm0, e.r8d);
+      break;
+    case 4:
+      e.vmovd(e.xmm0, e.dword[addr]);
+      break;
+    case 8:
+      e.vmovq(e.xmm0, e.qword[addr]);
+      break;
+    case 16:
+      e.vmovups(e.xmm0, e.ptr[addr]);
+      break;
+    default:
+      assert_unhandled_case(type);
+      break;
+  }
+}
+
+void X64Emitter::TraceContextAccess(TraceRecordType type, size_t offset) {
+  LoadTraceValue(*this, type, GetContextReg() + offset);
+  mov(r9d, uint32_t(offset));
+  EmitTraceRecord(type);
+}
+
+void X64Emitter::MovTraceMemoryKey(const Xbyak::RegExp& addr) {
+  lea(r9, ptr[addr]);
+  sub(r9, GetMembaseReg());
+}
+
+void X64Emitter::TraceMemoryLoad(TraceRecordType type,
+                                 const Xbyak::Reg& value) {
+  // Memory may have changed since the load, so the loaded register is
+  // recorded rather than memory read again.
+  if (value.isXMM()) {
+    Xbyak::Xmm xmm(value.getIdx());
+    switch (GetTraceRecordValueSize(type)) {
+      case 4:
+        vmovd(r8d, xmm);
+        vmovd(xmm0, r8d);
+        break;
+      case 8:
+        vmovq(xmm0, xmm);
+        break;
+      default:
+        vmovaps(xmm0, xmm);
+        break;
+    }
+  } else {
+    switch (GetTraceRecordValueSize(type)) {
+      case 1:
+        movzx(r8d, value.cvt8());
+        vmovd(xmm0, r8d);
+        break;
+      case 2:
+        movzx(r8d, value.cvt16());
+        vmovd(xmm0, r8d);
+        break;
+      case 4:
+        vmovd(xmm0, value.cvt32());
+        break;
+      default:
+        vmovq(xmm0, value.cvt64());
+        break;
+    }
+  }
+  EmitTraceRecord(type);
+}
+
+void X64Emitter::TraceMemoryStore(TraceRecordType type,
+                                  const Xbyak::RegExp& addr) {
+  // addr may be based on rax, which the record itself needs.
+  LoadTraceValue(*this, type, addr);
+  MovTraceMemoryKey(addr);
+  EmitTraceRecord(type);
 }
 
 void X64Emitter::SetReturnAddress(uint64_t value) {
@@ -754,6 +1191,15 @@ static const vec128_t xmm_consts[] = {
     /* XMMQNaN                */ vec128i(0x7FC00000u),
     /* XMMInt127              */ vec128i(0x7Fu),
     /* XMM2To32               */ vec128f(0x1.0p32f),
+    /* XMMShiftMaskPI16       */ vec128i(0x000F000Fu),
+    /* XMMLowByteMaskPI16     */ vec128i(0x00FF00FFu),
+    /* XMMByteMask01          */ vec128b(0x01),
+    /* XMMByteMask03          */ vec128b(0x03),
+    /* XMMByteMask0F          */ vec128b(0x0F),
+    /* XMMByteMask3F          */ vec128b(0x3F),
+    /* XMMByteMask7F          */ vec128b(0x7F),
+    /* XMMByteMaskF0          */ vec128b(0xF0),
+    /* XMMByteMaskFC          */ vec128b(0xFC),
 };
 
 // First location to try and place constants.
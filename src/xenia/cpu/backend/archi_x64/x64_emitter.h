@@ -2,9 +2,13 @@
 #ifndef XENIA_CPU_BACKEND_X64_X64_EMITTER_H_
 #define XENIA_CPU_BACKEND_X64_X64_EMITTER_H_
 
+#include <memory>
 #include <vector>
 
 #include "xenia/base/arena.h"
+#include "xenia/base/cvar.h"
+#include "xenia/cpu/backend/x64/x64_code_cache.h"
+#include "xenia/cpu/backend/x64/x64_tracers.h"
 #include "xenia/cpu/function.h"
 #include "xenia/cpu/function_trace_data.h"
 #include "xenia/cpu/hir/hir_builder.h"
@@ -16,6 +20,8 @@
 #include "third_party/xbyak/xbyak/xbyak.h"
 #include "third_party/xbyak/xbyak/xbyak_util.h"
 
+DECLARE_bool(x64_lean_helper_calls);
+
 namespace xe {
 namespace cpu {
 class Processor;
@@ -108,6 +114,15 @@ enum XmmConst {
   XMMQNaN,
   XMMInt127,
   XMM2To32,
+  XMMShiftMaskPI16,
+  XMMLowByteMaskPI16,
+  XMMByteMask01,
+  XMMByteMask03,
+  XMMByteMask0F,
+  XMMByteMask3F,
+  XMMByteMask7F,
+  XMMByteMaskF0,
+  XMMByteMaskFC,
 };
 
 // Unfortunately due to the design of xbyak we have to pass this to the ctor.
@@ -201,8 +216,44 @@ class X64Emitter : public Xbyak::CodeGenerator {
   void CallNative(uint64_t (*fn)(void* raw_context, uint64_t arg0),
                   uint64_t arg0);
   void CallNativeSafe(void* fn);
+  // Calls a host helper directly rather than through the guest-to-host thunk.
+  // Only the registers the helper clobbers (see
+  // X64Backend::RegisterHostHelper) that this function has allocated are
+  // spilled around the call. Arguments and result as for CallNativeSafe.
+  void CallHostHelper(const void* fn);
   void SetReturnAddress(uint64_t value);
 
+  // Binary tracing. Appends a record to the thread's TraceRing with the key
+  // in r9d and the value in xmm0, clobbering rax, rcx, rdx and the flags.
+  void EmitTraceRecord(TraceRecordType type, uint32_t extra = 0);
+  // Records the value at the context offset.
+  void TraceContextAccess(TraceRecordType type, size_t offset);
+  // Moves the guest address of addr into r9d, the key of a memory record.
+  // Emitted ahead of a load, which may overwrite the registers addr uses.
+  void MovTraceMemoryKey(const Xbyak::RegExp& addr);
+  // Records value, the result of a load, with the key MovTraceMemoryKey put
+  // in r9d.
+  void TraceMemoryLoad(TraceRecordType type, const Xbyak::Reg& value);
+  // Records the value at addr after a store, with the guest address as key.
+  void TraceMemoryStore(TraceRecordType type, const Xbyak::RegExp& addr);
+
+  // Moves the address of a function or static table in the host executable
+  // into reg. Always encoded as a 64-bit immediate and recorded as a
+  // relocation so the code can be reused from the persistent code cache.
+  void MovHostAddress(const Xbyak::Reg64& reg, const void* address);
+  // Moves the address of one of the backend thunks into reg.
+  void MovThunkAddress(const Xbyak::Reg64& reg, X64CodeRelocation::Type type);
+  // Flags the function being emitted as embedding per-session host pointers
+  // (heap objects, trace buffers), which keeps it out of the persistent code
+  // cache.
+  void MarkNotPersistable() { persistable_ = false; }
+
+  // Reference point for X64CodeRelocation::Type::kHostImage values.
+  static uintptr_t host_image_anchor();
+  // Feature flags the emitter would use on the given CPU, honoring
+  // --x64_extension_mask.
+  static uint32_t QueryFeatureFlags(const Xbyak::util::Cpu& cpu);
+
   Xbyak::Reg64 GetNativeParam(uint32_t param);
 
   Xbyak::Reg64 GetContextReg();
@@ -225,6 +276,7 @@ class X64Emitter : public Xbyak::CodeGenerator {
   Xbyak::Address StashConstantXmm(int index, double v);
   Xbyak::Address StashConstantXmm(int index, const vec128_t& v);
 
+  uint32_t feature_flags() const { return feature_flags_; }
   bool IsFeatureEnabled(uint32_t feature_flag) const {
     return (feature_flags_ & feature_flag) == feature_flag;
   }
@@ -239,6 +291,9 @@ class X64Emitter : public Xbyak::CodeGenerator {
   bool Emit(hir::HIRBuilder* builder, EmitFunctionInfo& func_info);
   void EmitGetCurrentThreadId();
   void EmitTraceUserCallReturn();
+  void EmitCallSiteStubs();
+  void MovImm64(const Xbyak::Reg64& reg, uint64_t value,
+                X64CodeRelocation::Type type, uint64_t relocation_value);
 
  protected:
   Processor* processor_ = nullptr;
@@ -259,6 +314,45 @@ class X64Emitter : public Xbyak::CodeGenerator {
 
   size_t stack_size_ = 0;
 
+  // Xbyak indices of the registers the current function allocates values to.
+  uint32_t used_gprs_ = 0;
+  uint32_t used_xmms_ = 0;
+  // Whether CallHostHelper skips the thunk, and the frame offset of the
+  // slots it spills to.
+  bool lean_helper_calls_ = false;
+  size_t helper_spill_offset_ = 0;
+
+  // Guest addresses of direct call targets that had no machine code yet when
+  // the current function was emitted. Handed to the compile queue afterwards.
+  std::vector<uint32_t> call_targets_;
+
+  // Absolute addresses in the current function that must be patched when it
+  // is loaded from the persistent code cache.
+  std::vector<X64CodeRelocation> relocations_;
+  bool persistable_ = true;
+
+  // Guest address of the function being emitted.
+  uint32_t guest_address_ = 0;
+  // Address of the entry counter of baseline code, or 0 if not counting.
+  uint32_t tier_up_counter_ = 0;
+
+  // Out-of-line code for the call sites of the current function, emitted
+  // after the epilog. See X64CodeCache::LinkCallSite.
+  struct CallSiteStub {
+    Xbyak::Label stub_label;
+    // Right after the rel32 displacement, i.e. the return address.
+    Xbyak::Label site_end_label;
+    uint32_t guest_address;
+    bool is_tail;
+  };
+  struct InlineCacheStub {
+    Xbyak::Label miss_label;
+    Xbyak::Label resume_label;
+    Xbyak::Label cache_label;
+  };
+  std::vector<std::unique_ptr<CallSiteStub>> call_site_stubs_;
+  std::vector<std::unique_ptr<InlineCacheStub>> inline_cache_stubs_;
+
   static const uint32_t gpr_reg_map_[GPR_COUNT];
   static const uint32_t xmm_reg_map_[XMM_COUNT];
 };
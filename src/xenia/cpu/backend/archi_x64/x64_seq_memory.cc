@@ -326,7 +326,9 @@ struct LOAD_CONTEXT_I8
   static void Emit(X64Emitter& e, const EmitArgType& i) {
     auto addr = ComputeContextAddress(e, i.src1);
     e.mov(i.dest, e.byte[addr]);
-    if (IsTracingData()) {
+    if (IsTracingBinary()) {
+      e.TraceContextAccess(TraceRecordType::kContextLoadI8, i.src1.value);
+    } else if (IsTracingData()) {
       e.mov(e.GetNativeParam(0), i.src1.value);
       e.mov(e.GetNativeParam(1), e.byte[addr]);
       e.CallNative(reinterpret_cast<void*>(TraceContextLoadI8));
@@ -338,7 +340,9 @@ struct LOAD_CONTEXT_I16
   static void Emit(X64Emitter& e, const EmitArgType& i) {
     auto addr = ComputeContextAddress(e, i.src1);
     e.mov(i.dest, e.word[addr]);
-    if (IsTracingData()) {
+    if (IsTracingBinary()) {
+      e.TraceContextAccess(TraceRecordType::kContextLoadI16, i.src1.value);
+    } else if (IsTracingData()) {
       e.mov(e.GetNativeParam(1), e.word[addr]);
       e.mov(e.GetNativeParam(0), i.src1.value);
       e.CallNative(reinterpret_cast<void*>(TraceContextLoadI16));
@@ -350,7 +354,9 @@ struct LOAD_CONTEXT_I32
   static void Emit(X64Emitter& e, const EmitArgType& i) {
     auto addr = ComputeContextAddress(e, i.src1);
     e.mov(i.dest, e.dword[addr]);
-    if (IsTracingData()) {
+    if (IsTracingBinary()) {
+      e.TraceContextAccess(TraceRecordType::kContextLoadI32, i.src1.value);
+    } else if (IsTracingData()) {
       e.mov(e.GetNativeParam(1), e.dword[addr]);
       e.mov(e.GetNativeParam(0), i.src1.value);
       e.CallNative(reinterpret_cast<void*>(TraceContextLoadI32));
@@ -362,7 +368,9 @@ struct LOAD_CONTEXT_I64
   static void Emit(X64Emitter& e, const EmitArgType& i) {
     auto addr = ComputeContextAddress(e, i.src1);
     e.mov(i.dest, e.qword[addr]);
-    if (IsTracingData()) {
+    if (IsTracingBinary()) {
+      e.TraceContextAccess(TraceRecordType::kContextLoadI64, i.src1.value);
+    } else if (IsTracingData()) {
       e.mov(e.GetNativeParam(1), e.qword[addr]);
       e.mov(e.GetNativeParam(0), i.src1.value);
       e.CallNative(reinterpret_cast<void*>(TraceContextLoadI64));
@@ -374,7 +382,9 @@ struct LOAD_CONTEXT_F32
   static void Emit(X64Emitter& e, const EmitArgType& i) {
     auto addr = ComputeContextAddress(e, i.src1);
     e.vmovss(i.dest, e.dword[addr]);
-    if (IsTracingData()) {
+    if (IsTracingBinary()) {
+      e.TraceContextAccess(TraceRecordType::kContextLoadF32, i.src1.value);
+    } else if (IsTracingData()) {
       e.lea(e.GetNativeParam(1), e.dword[addr]);
       e.mov(e.GetNativeParam(0), i.src1.value);
       e.CallNative(reinterpret_cast<void*>(TraceContextLoadF32));
@@ -386,7 +396,9 @@ struct LOAD_CONTEXT_F64
   static void Emit(X64Emitter& e, const EmitArgType& i) {
     auto addr = ComputeContextAddress(e, i.src1);
     e.vmovsd(i.dest, e.qword[addr]);
-    if (IsTracingData()) {
+    if (IsTracingBinary()) {
+      e.TraceContextAccess(TraceRecordType::kContextLoadF64, i.src1.value);
+    } else if (IsTracingData()) {
       e.lea(e.GetNativeParam(1), e.qword[addr]);
       e.mov(e.GetNativeParam(0), i.src1.value);
       e.CallNative(reinterpret_cast<void*>(TraceContextLoadF64));
@@ -398,7 +410,9 @@ struct LOAD_CONTEXT_V128
   static void Emit(X64Emitter& e, const EmitArgType& i) {
     auto addr = ComputeContextAddress(e, i.src1);
     e.vmovaps(i.dest, e.ptr[addr]);
-    if (IsTracingData()) {
+    if (IsTracingBinary()) {
+      e.TraceContextAccess(TraceRecordType::kContextLoadV128, i.src1.value);
+    } else if (IsTracingData()) {
       e.lea(e.GetNativeParam(1), e.ptr[addr]);
       e.mov(e.GetNativeParam(0), i.src1.value);
       e.CallNative(reinterpret_cast<void*>(TraceContextLoadV128));
@@ -423,7 +437,9 @@ struct STORE_CONTEXT_I8
     } else {
       e.mov(e.byte[addr], i.src2);
     }
-    if (IsTracingData()) {
+    if (IsTracingBinary()) {
+      e.TraceContextAccess(TraceRecordType::kContextStoreI8, i.src1.value);
+    } else if (IsTracingData()) {
       e.mov(e.GetNativeParam(1), e.byte[addr]);
       e.mov(e.GetNativeParam(0), i.src1.value);
       e.CallNative(reinterpret_cast<void*>(TraceContextStoreI8));
@@ -440,7 +456,9 @@ struct STORE_CONTEXT_I16
     } else {
       e.mov(e.word[addr], i.src2);
     }
-    if (IsTracingData()) {
+    if (IsTracingBinary()) {
+      e.TraceContextAccess(TraceRecordType::kContextStoreI16, i.src1.value);
+    } else if (IsTracingData()) {
       e.mov(e.GetNativeParam(1), e.word[addr]);
       e.mov(e.GetNativeParam(0), i.src1.value);
       e.CallNative(reinterpret_cast<void*>(TraceContextStoreI16));
@@ -457,7 +475,9 @@ struct STORE_CONTEXT_I32
     } else {
       e.mov(e.dword[addr], i.src2);
     }
-    if (IsTracingData()) {
+    if (IsTracingBinary()) {
+      e.TraceContextAccess(TraceRecordType::kContextStoreI32, i.src1.value);
+    } else if (IsTracingData()) {
       e.mov(e.GetNativeParam(1), e.dword[addr]);
       e.mov(e.GetNativeParam(0), i.src1.value);
       e.CallNative(reinterpret_cast<void*>(TraceContextStoreI32));
@@ -474,7 +494,9 @@ struct STORE_CONTEXT_I64
     } else {
       e.mov(e.qword[addr], i.src2);
     }
-    if (IsTracingData()) {
+    if (IsTracingBinary()) {
+      e.TraceContextAccess(TraceRecordType::kContextStoreI64, i.src1.value);
+    } else if (IsTracingData()) {
       e.mov(e.GetNativeParam(1), e.qword[addr]);
       e.mov(e.GetNativeParam(0), i.src1.value);
       e.CallNative(reinterpret_cast<void*>(TraceContextStoreI64));
@@ -491,7 +513,9 @@ struct STORE_CONTEXT_F32
     } else {
       e.vmovss(e.dword[addr], i.src2);
     }
-    if (IsTracingData()) {
+    if (IsTracingBinary()) {
+      e.TraceContextAccess(TraceRecordType::kContextStoreF32, i.src1.value);
+    } else if (IsTracingData()) {
       e.lea(e.GetNativeParam(1), e.dword[addr]);
       e.mov(e.GetNativeParam(0), i.src1.value);
       e.CallNative(reinterpret_cast<void*>(TraceContextStoreF32));
@@ -508,7 +532,9 @@ struct STORE_CONTEXT_F64
     } else {
       e.vmovsd(e.qword[addr], i.src2);
     }
-    if (IsTracingData()) {
+    if (IsTracingBinary()) {
+      e.TraceContextAccess(TraceRecordType::kContextStoreF64, i.src1.value);
+    } else if (IsTracingData()) {
       e.lea(e.GetNativeParam(1), e.qword[addr]);
       e.mov(e.GetNativeParam(0), i.src1.value);
       e.CallNative(reinterpret_cast<void*>(TraceContextStoreF64));
@@ -526,7 +552,9 @@ struct STORE_CONTEXT_V128
     } else {
       e.vmovaps(e.ptr[addr], i.src2);
     }
-    if (IsTracingData()) {
+    if (IsTracingBinary()) {
+      e.TraceContextAccess(TraceRecordType::kContextStoreV128, i.src1.value);
+    } else if (IsTracingData()) {
       e.lea(e.GetNativeParam(1), e.ptr[addr]);
       e.mov(e.GetNativeParam(0), i.src1.value);
       e.CallNative(reinterpret_cast<void*>(TraceContextStoreV128));
@@ -540,23 +568,78 @@ EMITTER_OPCODE_TABLE(OPCODE_STORE_CONTEXT, STORE_CONTEXT_I8, STORE_CONTEXT_I16,
 // ============================================================================
 // OPCODE_LOAD_MMIO
 // ============================================================================
+// The address is constant when the frontend could tell it was MMIO. Sites
+// learned from MMIOHandler faults have whatever address the guest computed,
+// so those check it against the range and go to guest memory on a miss.
+static void MovMmioAddress(X64Emitter& e, const Xbyak::Reg32& dest,
+                           const I64Op& address) {
+  if (address.is_constant) {
+    e.mov(dest, uint32_t(address.constant()));
+  } else {
+    e.mov(dest, address.reg().cvt32());
+  }
+}
+static void EmitMmioRangeCheck(X64Emitter& e, const MMIORange* mmio_range,
+                               const I64Op& address, Xbyak::Label& miss) {
+  if (address.is_constant) {
+    return;
+  }
+  e.mov(e.eax, address.reg().cvt32());
+  e.and_(e.eax, mmio_range->mask);
+  e.cmp(e.eax, mmio_range->address);
+  e.jne(miss, CodeGenerator::T_NEAR);
+}
+
 // Note: all types are always aligned in the context.
 struct LOAD_MMIO_I32
-    : Sequence<LOAD_MMIO_I32, I<OPCODE_LOAD_MMIO, I32Op, OffsetOp, OffsetOp>> {
+    : Sequence<LOAD_MMIO_I32, I<OPCODE_LOAD_MMIO, I32Op, OffsetOp, I64Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
     // uint64_t (context, addr)
     auto mmio_range = reinterpret_cast<MMIORange*>(i.src1.value);
-    auto read_address = uint32_t(i.src2.value);
+    Xbyak::Label miss;
+    EmitMmioRangeCheck(e, mmio_range, i.src2, miss);
+    // The callback context is a per-session heap object.
+    e.MarkNotPersistable();
     e.mov(e.GetNativeParam(0), uint64_t(mmio_range->callback_context));
-    e.mov(e.GetNativeParam(1).cvt32(), read_address);
-    e.CallNativeSafe(reinterpret_cast<void*>(mmio_range->read));
-    e.bswap(e.eax);
+    MovMmioAddress(e, e.GetNativeParam(1).cvt32(), i.src2);
+    e.CallHostHelper(reinterpret_cast<void*>(mmio_range->read));
+    // Registers hold guest memory as loaded without the swap flag.
+    if (!(i.instr->flags & LoadStoreFlags::LOAD_STORE_BYTE_SWAP)) {
+      e.bswap(e.eax);
+    }
+    // dest may be given the register src2 is last used from, so the address
+    // is taken before it is written.
+    if (IsTracingBinary()) {
+      MovMmioAddress(e, e.r9d, i.src2);
+      e.vmovd(e.xmm0, e.eax);
+    } else if (IsTracingData()) {
+      MovMmioAddress(e, e.GetNativeParam(0).cvt32(), i.src2);
+      e.mov(e.GetNativeParam(1).cvt32(), e.eax);
+    }
     e.mov(i.dest, e.eax);
-    if (IsTracingData()) {
-      e.mov(e.GetNativeParam(0), i.dest);
-      e.mov(e.edx, read_address);
+    if (IsTracingBinary()) {
+      e.EmitTraceRecord(TraceRecordType::kContextLoadI32);
+    } else if (IsTracingData()) {
       e.CallNative(reinterpret_cast<void*>(TraceContextLoadI32));
     }
+    if (i.src2.is_constant) {
+      return;
+    }
+    Xbyak::Label done;
+    e.jmp(done, CodeGenerator::T_NEAR);
+    e.L(miss);
+    auto addr = ComputeMemoryAddress(e, i.src2);
+    if (i.instr->flags & LoadStoreFlags::LOAD_STORE_BYTE_SWAP) {
+      if (e.IsFeatureEnabled(kX64EmitMovbe)) {
+        e.movbe(i.dest, e.dword[addr]);
+      } else {
+        e.mov(i.dest, e.dword[addr]);
+        e.bswap(i.dest);
+      }
+    } else {
+      e.mov(i.dest, e.dword[addr]);
+    }
+    e.L(done);
   }
 };
 EMITTER_OPCODE_TABLE(OPCODE_LOAD_MMIO, LOAD_MMIO_I32);
@@ -567,29 +650,65 @@ EMITTER_OPCODE_TABLE(OPCODE_LOAD_MMIO, LOAD_MMIO_I32);
 // Note: all types are always aligned on the stack.
 struct STORE_MMIO_I32
     : Sequence<STORE_MMIO_I32,
-               I<OPCODE_STORE_MMIO, VoidOp, OffsetOp, OffsetOp, I32Op>> {
+               I<OPCODE_STORE_MMIO, VoidOp, OffsetOp, I64Op, I32Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
     // void (context, addr, value)
     auto mmio_range = reinterpret_cast<MMIORange*>(i.src1.value);
-    auto write_address = uint32_t(i.src2.value);
+    bool swapped =
+        (i.instr->flags & LoadStoreFlags::LOAD_STORE_BYTE_SWAP) != 0;
+    Xbyak::Label miss;
+    EmitMmioRangeCheck(e, mmio_range, i.src2, miss);
+    // The callback context is a per-session heap object.
+    e.MarkNotPersistable();
     e.mov(e.GetNativeParam(0), uint64_t(mmio_range->callback_context));
-    e.mov(e.GetNativeParam(1).cvt32(), write_address);
+    MovMmioAddress(e, e.GetNativeParam(1).cvt32(), i.src2);
     if (i.src3.is_constant) {
-      e.mov(e.GetNativeParam(2).cvt32(), xe::byte_swap(i.src3.constant()));
+      e.mov(e.GetNativeParam(2).cvt32(),
+            swapped ? i.src3.constant() : xe::byte_swap(i.src3.constant()));
     } else {
       e.mov(e.GetNativeParam(2).cvt32(), i.src3);
-      e.bswap(e.GetNativeParam(2).cvt32());
+      if (!swapped) {
+        e.bswap(e.GetNativeParam(2).cvt32());
+      }
     }
-    e.CallNativeSafe(reinterpret_cast<void*>(mmio_range->write));
-    if (IsTracingData()) {
+    e.CallHostHelper(reinterpret_cast<void*>(mmio_range->write));
+    if (IsTracingBinary()) {
+      if (i.src3.is_constant) {
+        e.mov(e.r8d, i.src3.constant());
+        e.vmovd(e.xmm0, e.r8d);
+      } else {
+        e.vmovd(e.xmm0, i.src3);
+      }
+      MovMmioAddress(e, e.r9d, i.src2);
+      e.EmitTraceRecord(TraceRecordType::kContextStoreI32);
+    } else if (IsTracingData()) {
       if (i.src3.is_constant) {
-        e.mov(e.GetNativeParam(0).cvt32(), i.src3.constant());
+        e.mov(e.GetNativeParam(1).cvt32(), i.src3.constant());
       } else {
-        e.mov(e.GetNativeParam(0).cvt32(), i.src3);
+        e.mov(e.GetNativeParam(1).cvt32(), i.src3);
       }
-      e.mov(e.edx, write_address);
+      MovMmioAddress(e, e.GetNativeParam(0).cvt32(), i.src2);
       e.CallNative(reinterpret_cast<void*>(TraceContextStoreI32));
     }
+    if (i.src2.is_constant) {
+      return;
+    }
+    Xbyak::Label done;
+    e.jmp(done, CodeGenerator::T_NEAR);
+    e.L(miss);
+    auto addr = ComputeMemoryAddress(e, i.src2);
+    if (i.src3.is_constant) {
+      e.mov(e.dword[addr],
+            swapped ? xe::byte_swap(i.src3.constant()) : i.src3.constant());
+    } else if (swapped) {
+      // Not through eax, which may hold the address.
+      e.mov(e.GetNativeParam(2).cvt32(), i.src3);
+      e.bswap(e.GetNativeParam(2).cvt32());
+      e.mov(e.dword[addr], e.GetNativeParam(2).cvt32());
+    } else {
+      e.mov(e.dword[addr], i.src3);
+    }
+    e.L(done);
   }
 };
 EMITTER_OPCODE_TABLE(OPCODE_STORE_MMIO, STORE_MMIO_I32);
@@ -748,8 +867,13 @@ EMITTER_OPCODE_TABLE(OPCODE_STORE_OFFSET, STORE_OFFSET_I8, STORE_OFFSET_I16,
 struct LOAD_I8 : Sequence<LOAD_I8, I<OPCODE_LOAD, I8Op, I64Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
     auto addr = ComputeMemoryAddress(e, i.src1);
+    if (IsTracingBinary()) {
+      e.MovTraceMemoryKey(addr);
+    }
     e.mov(i.dest, e.byte[addr]);
-    if (IsTracingData()) {
+    if (IsTracingBinary()) {
+      e.TraceMemoryLoad(TraceRecordType::kMemoryLoadI8, i.dest);
+    } else if (IsTracingData()) {
       e.mov(e.GetNativeParam(1).cvt8(), i.dest);
       e.lea(e.GetNativeParam(0), e.ptr[addr]);
       e.CallNative(reinterpret_cast<void*>(TraceMemoryLoadI8));
@@ -759,6 +883,9 @@ struct LOAD_I8 : Sequence<LOAD_I8, I<OPCODE_LOAD, I8Op, I64Op>> {
 struct LOAD_I16 : Sequence<LOAD_I16, I<OPCODE_LOAD, I16Op, I64Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
     auto addr = ComputeMemoryAddress(e, i.src1);
+    if (IsTracingBinary()) {
+      e.MovTraceMemoryKey(addr);
+    }
     if (i.instr->flags & LoadStoreFlags::LOAD_STORE_BYTE_SWAP) {
       if (e.IsFeatureEnabled(kX64EmitMovbe)) {
         e.movbe(i.dest, e.word[addr]);
@@ -769,7 +896,9 @@ struct LOAD_I16 : Sequence<LOAD_I16, I<OPCODE_LOAD, I16Op, I64Op>> {
     } else {
       e.mov(i.dest, e.word[addr]);
     }
-    if (IsTracingData()) {
+    if (IsTracingBinary()) {
+      e.TraceMemoryLoad(TraceRecordType::kMemoryLoadI16, i.dest);
+    } else if (IsTracingData()) {
       e.mov(e.GetNativeParam(1).cvt16(), i.dest);
       e.lea(e.GetNativeParam(0), e.ptr[addr]);
       e.CallNative(reinterpret_cast<void*>(TraceMemoryLoadI16));
@@ -779,6 +908,9 @@ struct LOAD_I16 : Sequence<LOAD_I16, I<OPCODE_LOAD, I16Op, I64Op>> {
 struct LOAD_I32 : Sequence<LOAD_I32, I<OPCODE_LOAD, I32Op, I64Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
     auto addr = ComputeMemoryAddress(e, i.src1);
+    if (IsTracingBinary()) {
+      e.MovTraceMemoryKey(addr);
+    }
     if (i.instr->flags & LoadStoreFlags::LOAD_STORE_BYTE_SWAP) {
       if (e.IsFeatureEnabled(kX64EmitMovbe)) {
         e.movbe(i.dest, e.dword[addr]);
@@ -789,7 +921,9 @@ struct LOAD_I32 : Sequence<LOAD_I32, I<OPCODE_LOAD, I32Op, I64Op>> {
     } else {
       e.mov(i.dest, e.dword[addr]);
     }
-    if (IsTracingData()) {
+    if (IsTracingBinary()) {
+      e.TraceMemoryLoad(TraceRecordType::kMemoryLoadI32, i.dest);
+    } else if (IsTracingData()) {
       e.mov(e.GetNativeParam(1).cvt32(), i.dest);
       e.lea(e.GetNativeParam(0), e.ptr[addr]);
       e.CallNative(reinterpret_cast<void*>(TraceMemoryLoadI32));
@@ -799,6 +933,9 @@ struct LOAD_I32 : Sequence<LOAD_I32, I<OPCODE_LOAD, I32Op, I64Op>> {
 struct LOAD_I64 : Sequence<LOAD_I64, I<OPCODE_LOAD, I64Op, I64Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
     auto addr = ComputeMemoryAddress(e, i.src1);
+    if (IsTracingBinary()) {
+      e.MovTraceMemoryKey(addr);
+    }
     if (i.instr->flags & LoadStoreFlags::LOAD_STORE_BYTE_SWAP) {
       if (e.IsFeatureEnabled(kX64EmitMovbe)) {
         e.movbe(i.dest, e.qword[addr]);
@@ -809,7 +946,9 @@ struct LOAD_I64 : Sequence<LOAD_I64, I<OPCODE_LOAD, I64Op, I64Op>> {
     } else {
       e.mov(i.dest, e.qword[addr]);
     }
-    if (IsTracingData()) {
+    if (IsTracingBinary()) {
+      e.TraceMemoryLoad(TraceRecordType::kMemoryLoadI64, i.dest);
+    } else if (IsTracingData()) {
       e.mov(e.GetNativeParam(1), i.dest);
       e.lea(e.GetNativeParam(0), e.ptr[addr]);
       e.CallNative(reinterpret_cast<void*>(TraceMemoryLoadI64));
@@ -819,11 +958,16 @@ struct LOAD_I64 : Sequence<LOAD_I64, I<OPCODE_LOAD, I64Op, I64Op>> {
 struct LOAD_F32 : Sequence<LOAD_F32, I<OPCODE_LOAD, F32Op, I64Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
     auto addr = ComputeMemoryAddress(e, i.src1);
+    if (IsTracingBinary()) {
+      e.MovTraceMemoryKey(addr);
+    }
     e.vmovss(i.dest, e.dword[addr]);
     if (i.instr->flags & LoadStoreFlags::LOAD_STORE_BYTE_SWAP) {
       assert_always("not implemented yet");
     }
-    if (IsTracingData()) {
+    if (IsTracingBinary()) {
+      e.TraceMemoryLoad(TraceRecordType::kMemoryLoadF32, i.dest);
+    } else if (IsTracingData()) {
       e.lea(e.GetNativeParam(1), e.dword[addr]);
       e.lea(e.GetNativeParam(0), e.ptr[addr]);
       e.CallNative(reinterpret_cast<void*>(TraceMemoryLoadF32));
@@ -833,11 +977,16 @@ struct LOAD_F32 : Sequence<LOAD_F32, I<OPCODE_LOAD, F32Op, I64Op>> {
 struct LOAD_F64 : Sequence<LOAD_F64, I<OPCODE_LOAD, F64Op, I64Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
     auto addr = ComputeMemoryAddress(e, i.src1);
+    if (IsTracingBinary()) {
+      e.MovTraceMemoryKey(addr);
+    }
     e.vmovsd(i.dest, e.qword[addr]);
     if (i.instr->flags & LoadStoreFlags::LOAD_STORE_BYTE_SWAP) {
       assert_always("not implemented yet");
     }
-    if (IsTracingData()) {
+    if (IsTracingBinary()) {
+      e.TraceMemoryLoad(TraceRecordType::kMemoryLoadF64, i.dest);
+    } else if (IsTracingData()) {
       e.lea(e.GetNativeParam(1), e.qword[addr]);
       e.lea(e.GetNativeParam(0), e.ptr[addr]);
       e.CallNative(reinterpret_cast<void*>(TraceMemoryLoadF64));
@@ -847,13 +996,18 @@ struct LOAD_F64 : Sequence<LOAD_F64, I<OPCODE_LOAD, F64Op, I64Op>> {
 struct LOAD_V128 : Sequence<LOAD_V128, I<OPCODE_LOAD, V128Op, I64Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
     auto addr = ComputeMemoryAddress(e, i.src1);
+    if (IsTracingBinary()) {
+      e.MovTraceMemoryKey(addr);
+    }
     // TODO(benvanik): we should try to stick to movaps if possible.
     e.vmovups(i.dest, e.ptr[addr]);
     if (i.instr->flags & LoadStoreFlags::LOAD_STORE_BYTE_SWAP) {
       // TODO(benvanik): find a way to do this without the memory load.
       e.vpshufb(i.dest, i.dest, e.GetXmmConstPtr(XMMByteSwapMask));
     }
-    if (IsTracingData()) {
+    if (IsTracingBinary()) {
+      e.TraceMemoryLoad(TraceRecordType::kMemoryLoadV128, i.dest);
+    } else if (IsTracingData()) {
       e.lea(e.GetNativeParam(1), e.ptr[addr]);
       e.lea(e.GetNativeParam(0), e.ptr[addr]);
       e.CallNative(reinterpret_cast<void*>(TraceMemoryLoadV128));
@@ -875,7 +1029,10 @@ struct STORE_I8 : Sequence<STORE_I8, I<OPCODE_STORE, VoidOp, I64Op, I8Op>> {
     } else {
       e.mov(e.byte[addr], i.src2);
     }
-    if (IsTracingData()) {
+    if (IsTracingBinary()) {
+      addr = ComputeMemoryAddress(e, i.src1);
+      e.TraceMemoryStore(TraceRecordType::kMemoryStoreI8, addr);
+    } else if (IsTracingData()) {
       addr = ComputeMemoryAddress(e, i.src1);
       e.mov(e.GetNativeParam(1).cvt8(), e.byte[addr]);
       e.lea(e.GetNativeParam(0), e.ptr[addr]);
@@ -900,7 +1057,10 @@ struct STORE_I16 : Sequence<STORE_I16, I<OPCODE_STORE, VoidOp, I64Op, I16Op>> {
         e.mov(e.word[addr], i.src2);
       }
     }
-    if (IsTracingData()) {
+    if (IsTracingBinary()) {
+      addr = ComputeMemoryAddress(e, i.src1);
+      e.TraceMemoryStore(TraceRecordType::kMemoryStoreI16, addr);
+    } else if (IsTracingData()) {
       addr = ComputeMemoryAddress(e, i.src1);
       e.mov(e.GetNativeParam(1).cvt16(), e.word[addr]);
       e.lea(e.GetNativeParam(0), e.ptr[addr]);
@@ -925,7 +1085,10 @@ struct STORE_I32 : Sequence<STORE_I32, I<OPCODE_STORE, VoidOp, I64Op, I32Op>> {
         e.mov(e.dword[addr], i.src2);
       }
     }
-    if (IsTracingData()) {
+    if (IsTracingBinary()) {
+      addr = ComputeMemoryAddress(e, i.src1);
+      e.TraceMemoryStore(TraceRecordType::kMemoryStoreI32, addr);
+    } else if (IsTracingData()) {
       addr = ComputeMemoryAddress(e, i.src1);
       e.mov(e.GetNativeParam(1).cvt32(), e.dword[addr]);
       e.lea(e.GetNativeParam(0), e.ptr[addr]);
@@ -950,7 +1113,10 @@ struct STORE_I64 : Sequence<STORE_I64, I<OPCODE_STORE, VoidOp, I64Op, I64Op>> {
         e.mov(e.qword[addr], i.src2);
       }
     }
-    if (IsTracingData()) {
+    if (IsTracingBinary()) {
+      addr = ComputeMemoryAddress(e, i.src1);
+      e.TraceMemoryStore(TraceRecordType::kMemoryStoreI64, addr);
+    } else if (IsTracingData()) {
       addr = ComputeMemoryAddress(e, i.src1);
       e.mov(e.GetNativeParam(1), e.qword[addr]);
       e.lea(e.GetNativeParam(0), e.ptr[addr]);
@@ -971,7 +1137,10 @@ struct STORE_F32 : Sequence<STORE_F32, I<OPCODE_STORE, VoidOp, I64Op, F32Op>> {
         e.vmovss(e.dword[addr], i.src2);
       }
     }
-    if (IsTracingData()) {
+    if (IsTracingBinary()) {
+      addr = ComputeMemoryAddress(e, i.src1);
+      e.TraceMemoryStore(TraceRecordType::kMemoryStoreF32, addr);
+    } else if (IsTracingData()) {
       addr = ComputeMemoryAddress(e, i.src1);
       e.lea(e.GetNativeParam(1), e.ptr[addr]);
       e.lea(e.GetNativeParam(0), e.ptr[addr]);
@@ -992,7 +1161,10 @@ struct STORE_F64 : Sequence<STORE_F64, I<OPCODE_STORE, VoidOp, I64Op, F64Op>> {
         e.vmovsd(e.qword[addr], i.src2);
       }
     }
-    if (IsTracingData()) {
+    if (IsTracingBinary()) {
+      addr = ComputeMemoryAddress(e, i.src1);
+      e.TraceMemoryStore(TraceRecordType::kMemoryStoreF64, addr);
+    } else if (IsTracingData()) {
       addr = ComputeMemoryAddress(e, i.src1);
       e.lea(e.GetNativeParam(1), e.ptr[addr]);
       e.lea(e.GetNativeParam(0), e.ptr[addr]);
@@ -1016,7 +1188,10 @@ struct STORE_V128
         e.vmovaps(e.ptr[addr], i.src2);
       }
     }
-    if (IsTracingData()) {
+    if (IsTracingBinary()) {
+      addr = ComputeMemoryAddress(e, i.src1);
+      e.TraceMemoryStore(TraceRecordType::kMemoryStoreV128, addr);
+    } else if (IsTracingData()) {
       addr = ComputeMemoryAddress(e, i.src1);
       e.lea(e.GetNativeParam(1), e.ptr[addr]);
       e.lea(e.GetNativeParam(0), e.ptr[addr]);
@@ -1115,7 +1290,13 @@ EMITTER_OPCODE_TABLE(OPCODE_CACHE_CONTROL, CACHE_CONTROL);
 // ============================================================================
 struct MEMORY_BARRIER
     : Sequence<MEMORY_BARRIER, I<OPCODE_MEMORY_BARRIER, VoidOp>> {
-  static void Emit(X64Emitter& e, const EmitArgType& i) { e.mfence(); }
+  static void Emit(X64Emitter& e, const EmitArgType& i) {
+    // lwsync and eieio only order what TSO already orders. Sync has to keep
+    // earlier stores from passing later loads.
+    if (MemoryBarrierType(i.instr->flags) == MEMORY_BARRIER_TYPE_SYNC) {
+      e.mfence();
+    }
+  }
 };
 EMITTER_OPCODE_TABLE(OPCODE_MEMORY_BARRIER, MEMORY_BARRIER);
 
@@ -1150,7 +1331,15 @@ struct MEMSET_I64_I8_I64
         assert_unhandled_case(i.src3.constant());
         break;
     }
-    if (IsTracingData()) {
+    if (IsTracingBinary()) {
+      addr = ComputeMemoryAddress(e, i.src1);
+      e.mov(e.r8d, uint32_t(i.src2.constant()));
+      e.vmovd(e.xmm0, e.r8d);
+      e.lea(e.r9, e.ptr[addr]);
+      e.sub(e.r9, e.GetMembaseReg());
+      e.EmitTraceRecord(TraceRecordType::kMemset,
+                        uint32_t(i.src3.constant()));
+    } else if (IsTracingData()) {
       addr = ComputeMemoryAddress(e, i.src1);
       e.mov(e.GetNativeParam(2), i.src3.constant());
       e.mov(e.GetNativeParam(1), i.src2.constant());
@@ -3,12 +3,9 @@
 #include "xenia/cpu/backend/x64/x64_sequences.h"
 
 #include <algorithm>
-#include <cstring>
 
 #include "xenia/cpu/backend/x64/x64_op.h"
-
-// For OPCODE_PACK/OPCODE_UNPACK
-#include "third_party/half/include/half.hpp"
+#include "xenia/cpu/hir/vector_ops.h"
 
 namespace xe {
 namespace cpu {
@@ -160,14 +157,14 @@ struct LOAD_VECTOR_SHL_I8
     if (i.src1.is_constant) {
       auto sh = i.src1.constant();
       assert_true(sh < xe::countof(lvsl_table));
-      e.mov(e.rax, (uintptr_t)&lvsl_table[sh]);
+      e.MovHostAddress(e.rax, &lvsl_table[sh]);
       e.vmovaps(i.dest, e.ptr[e.rax]);
     } else {
       // TODO(benvanik): find a cheaper way of doing this.
       e.movzx(e.rdx, i.src1);
       e.and_(e.dx, 0xF);
       e.shl(e.dx, 4);
-      e.mov(e.rax, (uintptr_t)lvsl_table);
+      e.MovHostAddress(e.rax, lvsl_table);
       e.vmovaps(i.dest, e.ptr[e.rax + e.rdx]);
     }
   }
@@ -201,14 +198,14 @@ struct LOAD_VECTOR_SHR_I8
     if (i.src1.is_constant) {
       auto sh = i.src1.constant();
       assert_true(sh < xe::countof(lvsr_table));
-      e.mov(e.rax, (uintptr_t)&lvsr_table[sh]);
+      e.MovHostAddress(e.rax, &lvsr_table[sh]);
       e.vmovaps(i.dest, e.ptr[e.rax]);
     } else {
       // TODO(benvanik): find a cheaper way of doing this.
       e.movzx(e.rdx, i.src1);
       e.and_(e.dx, 0xF);
       e.shl(e.dx, 4);
-      e.mov(e.rax, (uintptr_t)lvsr_table);
+      e.MovHostAddress(e.rax, lvsr_table);
       e.vmovaps(i.dest, e.ptr[e.rax + e.rdx]);
     }
   }
@@ -783,24 +780,200 @@ struct VECTOR_SUB
 };
 EMITTER_OPCODE_TABLE(OPCODE_VECTOR_SUB, VECTOR_SUB);
 
+// ============================================================================
+// Variable 8-bit and 16-bit vector shifts
+// ============================================================================
+// x86 has no per-element shift for these sizes before AVX-512BW (and none at
+// all for bytes), so they are built out of the shifts that do exist.
+enum class VectorShiftOp {
+  kShl,
+  kShr,
+  kSha,
+  kRotateLeft,
+};
+
+// Shifts every byte of src1 by the low 3 bits of the matching byte of src2.
+// The count bits are moved to the top of each byte one at a time and select,
+// with vpblendvb, whether the value is shifted by 4, 2 and 1. Only needs AVX.
+template <typename ARGS>
+static void EmitVectorShiftI8(X64Emitter& e, const ARGS& i, VectorShiftOp op) {
+  // Bit 2 of each count to bit 7. Bits crossing into the next byte are never
+  // looked at by vpblendvb.
+  if (i.src2.is_constant) {
+    e.LoadConstantXmm(e.xmm1, i.src2.constant());
+    e.vpsllw(e.xmm1, e.xmm1, 5);
+  } else {
+    e.vpsllw(e.xmm1, i.src2, 5);
+  }
+  if (i.src1.is_constant) {
+    e.LoadConstantXmm(e.xmm0, i.src1.constant());
+  } else {
+    e.vmovdqa(e.xmm0, i.src1);
+  }
+  // Both sources are consumed, so dest is free as a temporary.
+  if (op == VectorShiftOp::kSha) {
+    // Arithmetic shifts of negative values are ~(~x >> n), so flip them
+    // around a logical shift.
+    e.vpxor(i.dest, i.dest, i.dest);
+    e.vpcmpgtb(i.dest, i.dest, e.xmm0);
+    e.vpxor(e.xmm0, e.xmm0, i.dest);
+  }
+  for (int step = 4; step; step >>= 1) {
+    if (op == VectorShiftOp::kRotateLeft) {
+      e.vpsrlw(i.dest, e.xmm0, 8 - step);
+      e.vpand(i.dest, e.GetXmmConstPtr(step == 4   ? XMMByteMask0F
+                                       : step == 2 ? XMMByteMask03
+                                                   : XMMByteMask01));
+    }
+    if (op == VectorShiftOp::kShl || op == VectorShiftOp::kRotateLeft) {
+      if (step == 1) {
+        e.vpaddb(e.xmm2, e.xmm0, e.xmm0);
+      } else {
+        e.vpsllw(e.xmm2, e.xmm0, step);
+        e.vpand(e.xmm2,
+                e.GetXmmConstPtr(step == 4 ? XMMByteMaskF0 : XMMByteMaskFC));
+      }
+    } else {
+      e.vpsrlw(e.xmm2, e.xmm0, step);
+      e.vpand(e.xmm2, e.GetXmmConstPtr(step == 4   ? XMMByteMask0F
+                                       : step == 2 ? XMMByteMask3F
+                                                   : XMMByteMask7F));
+    }
+    if (op == VectorShiftOp::kRotateLeft) {
+      e.vpor(e.xmm2, i.dest);
+    }
+    e.vpblendvb(e.xmm0, e.xmm0, e.xmm2, e.xmm1);
+    if (step != 1) {
+      e.vpaddb(e.xmm1, e.xmm1, e.xmm1);
+    }
+  }
+  if (op == VectorShiftOp::kSha) {
+    e.vpxor(i.dest, e.xmm0, i.dest);
+  } else {
+    e.vmovdqa(i.dest, e.xmm0);
+  }
+}
+
+// Shifts every word of src1 by the low 4 bits of the matching word of src2.
+// Returns false if the host has neither AVX-512BW nor AVX2.
+template <typename ARGS>
+static bool EmitVectorShiftI16(X64Emitter& e, const ARGS& i,
+                               VectorShiftOp op) {
+  if (e.IsFeatureEnabled(kX64EmitAVX512Ortho | kX64EmitAVX512BW)) {
+    if (i.src2.is_constant) {
+      vec128_t counts = i.src2.constant();
+      for (size_t n = 0; n < 8; ++n) {
+        counts.u16[n] &= 0xF;
+      }
+      e.LoadConstantXmm(e.xmm0, counts);
+    } else {
+      e.vpand(e.xmm0, i.src2, e.GetXmmConstPtr(XMMShiftMaskPI16));
+    }
+    Xmm src1 = i.dest;
+    if (i.src1.is_constant) {
+      e.LoadConstantXmm(src1, i.src1.constant());
+    } else {
+      src1 = i.src1;
+    }
+    switch (op) {
+      case VectorShiftOp::kShl:
+        e.vpsllvw(i.dest, src1, e.xmm0);
+        break;
+      case VectorShiftOp::kShr:
+        e.vpsrlvw(i.dest, src1, e.xmm0);
+        break;
+      case VectorShiftOp::kSha:
+        e.vpsravw(i.dest, src1, e.xmm0);
+        break;
+      case VectorShiftOp::kRotateLeft:
+        // (x << n) | (x >> (-n & 15)); both halves are x when n is 0.
+        e.vpsllvw(e.xmm1, src1, e.xmm0);
+        e.vpxor(e.xmm2, e.xmm2, e.xmm2);
+        e.vpsubw(e.xmm0, e.xmm2, e.xmm0);
+        e.vpand(e.xmm0, e.GetXmmConstPtr(XMMShiftMaskPI16));
+        e.vpsrlvw(e.xmm0, src1, e.xmm0);
+        e.vpor(i.dest, e.xmm1, e.xmm0);
+        break;
+    }
+    return true;
+  }
+
+  if (!e.IsFeatureEnabled(kX64EmitAVX2)) {
+    return false;
+  }
+  // Shift the even and the odd words of each dword with the dword shifts:
+  // xmm0 gets the counts of the even words, xmm1 those of the odd ones.
+  if (i.src2.is_constant) {
+    const auto& shamt = i.src2.constant();
+    vec128_t even_counts, odd_counts;
+    for (size_t n = 0; n < 4; ++n) {
+      even_counts.u32[n] = shamt.u32[n] & 0xF;
+      odd_counts.u32[n] = (shamt.u32[n] >> 16) & 0xF;
+    }
+    e.LoadConstantXmm(e.xmm0, even_counts);
+    e.LoadConstantXmm(e.xmm1, odd_counts);
+  } else {
+    e.vpsrld(e.xmm1, i.src2, 16);
+    e.vpand(e.xmm0, i.src2, e.GetXmmConstPtr(XMMShiftMaskEvenPI16));
+    e.vpand(e.xmm1, e.GetXmmConstPtr(XMMShiftMaskEvenPI16));
+  }
+  // src2 is consumed, so a constant src1 can live in dest until the end.
+  Xmm src1 = i.dest;
+  if (i.src1.is_constant) {
+    e.LoadConstantXmm(src1, i.src1.constant());
+  } else {
+    src1 = i.src1;
+  }
+  switch (op) {
+    case VectorShiftOp::kShl:
+      e.vpsllvd(e.xmm0, src1, e.xmm0);
+      e.vpsrld(e.xmm2, src1, 16);
+      e.vpsllvd(e.xmm1, e.xmm2, e.xmm1);
+      e.vpslld(e.xmm1, e.xmm1, 16);
+      break;
+    case VectorShiftOp::kShr:
+      e.vpand(e.xmm2, src1, e.GetXmmConstPtr(XMMMaskEvenPI16));
+      e.vpsrlvd(e.xmm0, e.xmm2, e.xmm0);
+      e.vpsrlvd(e.xmm1, src1, e.xmm1);
+      break;
+    case VectorShiftOp::kSha:
+      e.vpslld(e.xmm2, src1, 16);
+      e.vpsrad(e.xmm2, e.xmm2, 16);
+      e.vpsravd(e.xmm0, e.xmm2, e.xmm0);
+      e.vpsravd(e.xmm1, src1, e.xmm1);
+      break;
+    case VectorShiftOp::kRotateLeft:
+      // With the word repeated in both halves of the dword, the high half of
+      // the shifted dword is the rotated word.
+      e.vpslld(e.xmm2, src1, 16);
+      e.vpblendw(e.xmm2, e.xmm2, src1, 0b01010101);
+      e.vpsllvd(e.xmm0, e.xmm2, e.xmm0);
+      e.vpsrld(e.xmm0, e.xmm0, 16);
+      e.vpsrld(e.xmm2, src1, 16);
+      e.vpblendw(e.xmm2, e.xmm2, src1, 0b10101010);
+      e.vpsllvd(e.xmm1, e.xmm2, e.xmm1);
+      break;
+  }
+  e.vpblendw(i.dest, e.xmm0, e.xmm1, 0b10101010);
+  return true;
+}
+
 // ============================================================================
 // OPCODE_VECTOR_SHL
 // ============================================================================
 template <typename T, std::enable_if_t<std::is_integral<T>::value, int> = 0>
 static __m128i EmulateVectorShl(void*, __m128i src1, __m128i src2) {
-  alignas(16) T value[16 / sizeof(T)];
-  alignas(16) T shamt[16 / sizeof(T)];
+  alignas(16) vec128_t value;
+  alignas(16) vec128_t shamt;
 
   // Load SSE registers into a C array.
-  _mm_store_si128(reinterpret_cast<__m128i*>(value), src1);
-  _mm_store_si128(reinterpret_cast<__m128i*>(shamt), src2);
+  _mm_store_si128(reinterpret_cast<__m128i*>(&value), src1);
+  _mm_store_si128(reinterpret_cast<__m128i*>(&shamt), src2);
 
-  for (size_t i = 0; i < (16 / sizeof(T)); ++i) {
-    value[i] = value[i] << (shamt[i] & ((sizeof(T) * 8) - 1));
-  }
+  value = hir::vector_ops::Shl<T>(value, shamt);
 
   // Store result and return it.
-  return _mm_load_si128(reinterpret_cast<__m128i*>(value));
+  return _mm_load_si128(reinterpret_cast<__m128i*>(&value));
 }
 
 struct VECTOR_SHL_V128
@@ -823,7 +996,6 @@ struct VECTOR_SHL_V128
   }
 
   static void EmitInt8(X64Emitter& e, const EmitArgType& i) {
-    // TODO(benvanik): native version (with shift magic).
     if (i.src2.is_constant) {
       if (e.IsFeatureEnabled(kX64EmitGFNI)) {
         const auto& shamt = i.src2.constant();
@@ -844,13 +1016,8 @@ struct VECTOR_SHL_V128
           return;
         }
       }
-      e.lea(e.GetNativeParam(1), e.StashConstantXmm(1, i.src2.constant()));
-    } else {
-      e.lea(e.GetNativeParam(1), e.StashXmm(1, i.src2));
     }
-    e.lea(e.GetNativeParam(0), e.StashXmm(0, i.src1));
-    e.CallNativeSafe(reinterpret_cast<void*>(EmulateVectorShl<uint8_t>));
-    e.vmovaps(i.dest, e.xmm0);
+    EmitVectorShiftI8(e, i, VectorShiftOp::kShl);
   }
 
   static void EmitInt16(X64Emitter& e, const EmitArgType& i) {
@@ -878,7 +1045,11 @@ struct VECTOR_SHL_V128
       }
     }
 
-    // Shift 8 words in src1 by amount specified in src2.
+    if (EmitVectorShiftI16(e, i, VectorShiftOp::kShl)) {
+      return;
+    }
+
+    // No AVX2: shift 8 words in src1 by amount specified in src2.
     Xbyak::Label emu, end;
 
     // Only bother with this check if shift amt isn't constant.
@@ -898,7 +1069,6 @@ struct VECTOR_SHL_V128
       e.jmp(end);
     }
 
-    // TODO(benvanik): native version (with shift magic).
     e.L(emu);
     if (i.src2.is_constant) {
       e.lea(e.GetNativeParam(1), e.StashConstantXmm(1, i.src2.constant()));
@@ -996,19 +1166,17 @@ EMITTER_OPCODE_TABLE(OPCODE_VECTOR_SHL, VECTOR_SHL_V128);
 // ============================================================================
 template <typename T, std::enable_if_t<std::is_integral<T>::value, int> = 0>
 static __m128i EmulateVectorShr(void*, __m128i src1, __m128i src2) {
-  alignas(16) T value[16 / sizeof(T)];
-  alignas(16) T shamt[16 / sizeof(T)];
+  alignas(16) vec128_t value;
+  alignas(16) vec128_t shamt;
 
   // Load SSE registers into a C array.
-  _mm_store_si128(reinterpret_cast<__m128i*>(value), src1);
-  _mm_store_si128(reinterpret_cast<__m128i*>(shamt), src2);
+  _mm_store_si128(reinterpret_cast<__m128i*>(&value), src1);
+  _mm_store_si128(reinterpret_cast<__m128i*>(&shamt), src2);
 
-  for (size_t i = 0; i < (16 / sizeof(T)); ++i) {
-    value[i] = value[i] >> (shamt[i] & ((sizeof(T) * 8) - 1));
-  }
+  value = hir::vector_ops::Shr<T>(value, shamt);
 
   // Store result and return it.
-  return _mm_load_si128(reinterpret_cast<__m128i*>(value));
+  return _mm_load_si128(reinterpret_cast<__m128i*>(&value));
 }
 
 struct VECTOR_SHR_V128
@@ -1031,7 +1199,6 @@ struct VECTOR_SHR_V128
   }
 
   static void EmitInt8(X64Emitter& e, const EmitArgType& i) {
-    // TODO(benvanik): native version (with shift magic).
     if (i.src2.is_constant) {
       if (e.IsFeatureEnabled(kX64EmitGFNI)) {
         const auto& shamt = i.src2.constant();
@@ -1052,13 +1219,8 @@ struct VECTOR_SHR_V128
           return;
         }
       }
-      e.lea(e.GetNativeParam(1), e.StashConstantXmm(1, i.src2.constant()));
-    } else {
-      e.lea(e.GetNativeParam(1), e.StashXmm(1, i.src2));
     }
-    e.lea(e.GetNativeParam(0), e.StashXmm(0, i.src1));
-    e.CallNativeSafe(reinterpret_cast<void*>(EmulateVectorShr<uint8_t>));
-    e.vmovaps(i.dest, e.xmm0);
+    EmitVectorShiftI8(e, i, VectorShiftOp::kShr);
   }
 
   static void EmitInt16(X64Emitter& e, const EmitArgType& i) {
@@ -1078,7 +1240,11 @@ struct VECTOR_SHR_V128
       }
     }
 
-    // Shift 8 words in src1 by amount specified in src2.
+    if (EmitVectorShiftI16(e, i, VectorShiftOp::kShr)) {
+      return;
+    }
+
+    // No AVX2: shift 8 words in src1 by amount specified in src2.
     Xbyak::Label emu, end;
 
     // See if the shift is equal first for a shortcut.
@@ -1098,7 +1264,6 @@ struct VECTOR_SHR_V128
       e.jmp(end);
     }
 
-    // TODO(benvanik): native version (with shift magic).
     e.L(emu);
     if (i.src2.is_constant) {
       e.lea(e.GetNativeParam(1), e.StashConstantXmm(1, i.src2.constant()));
@@ -1214,7 +1379,6 @@ struct VECTOR_SHA_V128
   }
 
   static void EmitInt8(X64Emitter& e, const EmitArgType& i) {
-    // TODO(benvanik): native version (with shift magic).
     if (i.src2.is_constant) {
       if (e.IsFeatureEnabled(kX64EmitGFNI)) {
         const auto& shamt = i.src2.constant();
@@ -1237,13 +1401,8 @@ struct VECTOR_SHA_V128
           return;
         }
       }
-      e.lea(e.GetNativeParam(1), e.StashConstantXmm(1, i.src2.constant()));
-    } else {
-      e.lea(e.GetNativeParam(1), e.StashXmm(1, i.src2));
     }
-    e.lea(e.GetNativeParam(0), e.StashXmm(0, i.src1));
-    e.CallNativeSafe(reinterpret_cast<void*>(EmulateVectorShr<int8_t>));
-    e.vmovaps(i.dest, e.xmm0);
+    EmitVectorShiftI8(e, i, VectorShiftOp::kSha);
   }
 
   static void EmitInt16(X64Emitter& e, const EmitArgType& i) {
@@ -1263,7 +1422,11 @@ struct VECTOR_SHA_V128
       }
     }
 
-    // Shift 8 words in src1 by amount specified in src2.
+    if (EmitVectorShiftI16(e, i, VectorShiftOp::kSha)) {
+      return;
+    }
+
+    // No AVX2: shift 8 words in src1 by amount specified in src2.
     Xbyak::Label emu, end;
 
     // See if the shift is equal first for a shortcut.
@@ -1283,7 +1446,6 @@ struct VECTOR_SHA_V128
       e.jmp(end);
     }
 
-    // TODO(benvanik): native version (with shift magic).
     e.L(emu);
     if (i.src2.is_constant) {
       e.lea(e.GetNativeParam(1), e.StashConstantXmm(1, i.src2.constant()));
@@ -1366,19 +1528,17 @@ EMITTER_OPCODE_TABLE(OPCODE_VECTOR_SHA, VECTOR_SHA_V128);
 // ============================================================================
 template <typename T, std::enable_if_t<std::is_integral<T>::value, int> = 0>
 static __m128i EmulateVectorRotateLeft(void*, __m128i src1, __m128i src2) {
-  alignas(16) T value[16 / sizeof(T)];
-  alignas(16) T shamt[16 / sizeof(T)];
+  alignas(16) vec128_t value;
+  alignas(16) vec128_t shamt;
 
   // Load SSE registers into a C array.
-  _mm_store_si128(reinterpret_cast<__m128i*>(value), src1);
-  _mm_store_si128(reinterpret_cast<__m128i*>(shamt), src2);
+  _mm_store_si128(reinterpret_cast<__m128i*>(&value), src1);
+  _mm_store_si128(reinterpret_cast<__m128i*>(&shamt), src2);
 
-  for (size_t i = 0; i < (16 / sizeof(T)); ++i) {
-    value[i] = xe::rotate_left<T>(value[i], shamt[i] & ((sizeof(T) * 8) - 1));
-  }
+  value = hir::vector_ops::RotateLeft<T>(value, shamt);
 
   // Store result and return it.
-  return _mm_load_si128(reinterpret_cast<__m128i*>(value));
+  return _mm_load_si128(reinterpret_cast<__m128i*>(&value));
 }
 
 struct VECTOR_ROTATE_LEFT_V128
@@ -1387,19 +1547,12 @@ struct VECTOR_ROTATE_LEFT_V128
   static void Emit(X64Emitter& e, const EmitArgType& i) {
     switch (i.instr->flags) {
       case INT8_TYPE:
-        // TODO(benvanik): native version (with shift magic).
-        if (i.src2.is_constant) {
-          e.lea(e.GetNativeParam(1), e.StashConstantXmm(1, i.src2.constant()));
-        } else {
-          e.lea(e.GetNativeParam(1), e.StashXmm(1, i.src2));
-        }
-        e.lea(e.GetNativeParam(0), e.StashXmm(0, i.src1));
-        e.CallNativeSafe(
-            reinterpret_cast<void*>(EmulateVectorRotateLeft<uint8_t>));
-        e.vmovaps(i.dest, e.xmm0);
+        EmitVectorShiftI8(e, i, VectorShiftOp::kRotateLeft);
         break;
       case INT16_TYPE:
-        // TODO(benvanik): native version (with shift magic).
+        if (EmitVectorShiftI16(e, i, VectorShiftOp::kRotateLeft)) {
+          break;
+        }
         if (i.src2.is_constant) {
           e.lea(e.GetNativeParam(1), e.StashConstantXmm(1, i.src2.constant()));
         } else {
@@ -1460,21 +1613,17 @@ EMITTER_OPCODE_TABLE(OPCODE_VECTOR_ROTATE_LEFT, VECTOR_ROTATE_LEFT_V128);
 // ============================================================================
 template <typename T, std::enable_if_t<std::is_integral<T>::value, int> = 0>
 static __m128i EmulateVectorAverage(void*, __m128i src1, __m128i src2) {
-  alignas(16) T src1v[16 / sizeof(T)];
-  alignas(16) T src2v[16 / sizeof(T)];
-  alignas(16) T value[16 / sizeof(T)];
+  alignas(16) vec128_t src1v;
+  alignas(16) vec128_t src2v;
 
   // Load SSE registers into a C array.
-  _mm_store_si128(reinterpret_cast<__m128i*>(src1v), src1);
-  _mm_store_si128(reinterpret_cast<__m128i*>(src2v), src2);
+  _mm_store_si128(reinterpret_cast<__m128i*>(&src1v), src1);
+  _mm_store_si128(reinterpret_cast<__m128i*>(&src2v), src2);
 
-  for (size_t i = 0; i < (16 / sizeof(T)); ++i) {
-    auto t = (uint64_t(src1v[i]) + uint64_t(src2v[i]) + 1) / 2;
-    value[i] = T(t);
-  }
+  alignas(16) vec128_t value = hir::vector_ops::Average<T>(src1v, src2v);
 
   // Store result and return it.
-  return _mm_load_si128(reinterpret_cast<__m128i*>(value));
+  return _mm_load_si128(reinterpret_cast<__m128i*>(&value));
 }
 
 struct VECTOR_AVERAGE
@@ -1652,7 +1801,7 @@ struct EXTRACT_I32
       e.mov(e.al, i.src2);
       e.and_(e.al, 0x03);
       e.shl(e.al, 4);
-      e.mov(e.rdx, reinterpret_cast<uint64_t>(extract_table_32));
+      e.MovHostAddress(e.rdx, extract_table_32);
       e.vmovaps(e.xmm0, e.ptr[e.rdx + e.rax]);
       e.vpshufb(e.xmm0, src1, e.xmm0);
       e.vpextrd(i.dest, e.xmm0, 0);
@@ -2113,16 +2262,10 @@ struct PACK : Sequence<PACK, I<OPCODE_PACK, V128Op, V128Op, V128Op>> {
     e.vpshufb(i.dest, i.dest, e.GetXmmConstPtr(XMMPackD3DCOLOR));
   }
   static __m128i EmulateFLOAT16_2(void*, __m128 src1) {
-    alignas(16) float a[4];
-    alignas(16) uint16_t b[8];
-    _mm_store_ps(a, src1);
-    std::memset(b, 0, sizeof(b));
-
-    for (int i = 0; i < 2; i++) {
-      b[7 - i] = half_float::detail::float2half<std::round_toward_zero>(a[i]);
-    }
-
-    return _mm_load_si128(reinterpret_cast<__m128i*>(b));
+    alignas(16) vec128_t a;
+    _mm_store_ps(a.f32, src1);
+    alignas(16) vec128_t b = hir::vector_ops::PackFloat16_2(a);
+    return _mm_load_si128(reinterpret_cast<__m128i*>(&b));
   }
   static void EmitFLOAT16_2(X64Emitter& e, const EmitArgType& i) {
     assert_true(i.src2.value->IsConstantZero());
@@ -2152,17 +2295,10 @@ struct PACK : Sequence<PACK, I<OPCODE_PACK, V128Op, V128Op, V128Op>> {
     }
   }
   static __m128i EmulateFLOAT16_4(void*, __m128 src1) {
-    alignas(16) float a[4];
-    alignas(16) uint16_t b[8];
-    _mm_store_ps(a, src1);
-    std::memset(b, 0, sizeof(b));
-
-    for (int i = 0; i < 4; i++) {
-      b[7 - (i ^ 2)] =
-          half_float::detail::float2half<std::round_toward_zero>(a[i]);
-    }
-
-    return _mm_load_si128(reinterpret_cast<__m128i*>(b));
+    alignas(16) vec128_t a;
+    _mm_store_ps(a.f32, src1);
+    alignas(16) vec128_t b = hir::vector_ops::PackFloat16_4(a);
+    return _mm_load_si128(reinterpret_cast<__m128i*>(&b));
   }
   static void EmitFLOAT16_4(X64Emitter& e, const EmitArgType& i) {
     assert_true(i.src2.value->IsConstantZero());
@@ -2282,56 +2418,35 @@ struct PACK : Sequence<PACK, I<OPCODE_PACK, V128Op, V128Op, V128Op>> {
     // Merge XZ and YW.
     e.vorps(i.dest, e.xmm0);
   }
-  static __m128i EmulatePack8_IN_16_UN_UN_SAT(void*, __m128i src1,
-                                              __m128i src2) {
-    alignas(16) uint16_t a[8];
-    alignas(16) uint16_t b[8];
-    alignas(16) uint8_t c[16];
-    _mm_store_si128(reinterpret_cast<__m128i*>(a), src1);
-    _mm_store_si128(reinterpret_cast<__m128i*>(b), src2);
-    for (int i = 0; i < 8; ++i) {
-      c[i] = uint8_t(std::max(uint16_t(0), std::min(uint16_t(255), a[i])));
-      c[i + 8] = uint8_t(std::max(uint16_t(0), std::min(uint16_t(255), b[i])));
-    }
-    return _mm_load_si128(reinterpret_cast<__m128i*>(c));
-  }
-  static __m128i EmulatePack8_IN_16_UN_UN(void*, __m128i src1, __m128i src2) {
-    alignas(16) uint8_t a[16];
-    alignas(16) uint8_t b[16];
-    alignas(16) uint8_t c[16];
-    _mm_store_si128(reinterpret_cast<__m128i*>(a), src1);
-    _mm_store_si128(reinterpret_cast<__m128i*>(b), src2);
-    for (int i = 0; i < 8; ++i) {
-      c[i] = a[i * 2];
-      c[i + 8] = b[i * 2];
-    }
-    return _mm_load_si128(reinterpret_cast<__m128i*>(c));
-  }
   static void Emit8_IN_16(X64Emitter& e, const EmitArgType& i, uint32_t flags) {
     // TODO(benvanik): handle src2 (or src1) being constant zero
     if (IsPackInUnsigned(flags)) {
       if (IsPackOutUnsigned(flags)) {
+        // Clamp (or truncate) every word to 0-255 first so the signed
+        // saturation of vpackuswb never kicks in.
+        Xmm src1 = e.xmm0;
+        if (i.src1.is_constant) {
+          e.LoadConstantXmm(src1, i.src1.constant());
+        } else {
+          src1 = i.src1;
+        }
+        Xmm src2 = e.xmm1;
+        if (i.src2.is_constant) {
+          e.LoadConstantXmm(src2, i.src2.constant());
+        } else {
+          src2 = i.src2;
+        }
         if (IsPackOutSaturate(flags)) {
           // unsigned -> unsigned + saturate
-          if (i.src2.is_constant) {
-            e.lea(e.GetNativeParam(1),
-                  e.StashConstantXmm(1, i.src2.constant()));
-          } else {
-            e.lea(e.GetNativeParam(1), e.StashXmm(1, i.src2));
-          }
-          e.lea(e.GetNativeParam(0), e.StashXmm(0, i.src1));
-          e.CallNativeSafe(
-              reinterpret_cast<void*>(EmulatePack8_IN_16_UN_UN_SAT));
-          e.vmovaps(i.dest, e.xmm0);
-          e.vpshufb(i.dest, i.dest, e.GetXmmConstPtr(XMMByteOrderMask));
+          e.vpminuw(e.xmm0, src1, e.GetXmmConstPtr(XMMLowByteMaskPI16));
+          e.vpminuw(e.xmm1, src2, e.GetXmmConstPtr(XMMLowByteMaskPI16));
         } else {
           // unsigned -> unsigned
-          e.lea(e.GetNativeParam(1), e.StashXmm(1, i.src2));
-          e.lea(e.GetNativeParam(0), e.StashXmm(0, i.src1));
-          e.CallNativeSafe(reinterpret_cast<void*>(EmulatePack8_IN_16_UN_UN));
-          e.vmovaps(i.dest, e.xmm0);
-          e.vpshufb(i.dest, i.dest, e.GetXmmConstPtr(XMMByteOrderMask));
+          e.vpand(e.xmm0, src1, e.GetXmmConstPtr(XMMLowByteMaskPI16));
+          e.vpand(e.xmm1, src2, e.GetXmmConstPtr(XMMLowByteMaskPI16));
         }
+        e.vpackuswb(i.dest, e.xmm0, e.xmm1);
+        e.vpshufb(i.dest, i.dest, e.GetXmmConstPtr(XMMByteOrderMask));
       } else {
         if (IsPackOutSaturate(flags)) {
           // unsigned -> signed + saturate
@@ -2529,19 +2644,10 @@ struct UNPACK : Sequence<UNPACK, I<OPCODE_UNPACK, V128Op, V128Op>> {
     // To convert to 0 to 1, games multiply by 0x47008081 and add 0xC7008081.
   }
   static __m128 EmulateFLOAT16_2(void*, __m128i src1) {
-    alignas(16) uint16_t a[8];
-    alignas(16) float b[4];
-    _mm_store_si128(reinterpret_cast<__m128i*>(a), src1);
-
-    for (int i = 0; i < 2; i++) {
-      b[i] = half_float::detail::half2float(a[VEC128_W(6 + i)]);
-    }
-
-    // Constants, or something
-    b[2] = 0.f;
-    b[3] = 1.f;
-
-    return _mm_load_ps(b);
+    alignas(16) vec128_t a;
+    _mm_store_si128(reinterpret_cast<__m128i*>(&a), src1);
+    alignas(16) vec128_t b = hir::vector_ops::UnpackFloat16_2(a);
+    return _mm_load_ps(b.f32);
   }
   static void EmitFLOAT16_2(X64Emitter& e, const EmitArgType& i) {
     // 1 bit sign, 5 bit exponent, 10 bit mantissa
@@ -2586,15 +2692,10 @@ struct UNPACK : Sequence<UNPACK, I<OPCODE_UNPACK, V128Op, V128Op>> {
     }
   }
   static __m128 EmulateFLOAT16_4(void*, __m128i src1) {
-    alignas(16) uint16_t a[8];
-    alignas(16) float b[4];
-    _mm_store_si128(reinterpret_cast<__m128i*>(a), src1);
-
-    for (int i = 0; i < 4; i++) {
-      b[i] = half_float::detail::half2float(a[VEC128_W(4 + i)]);
-    }
-
-    return _mm_load_ps(b);
+    alignas(16) vec128_t a;
+    _mm_store_si128(reinterpret_cast<__m128i*>(&a), src1);
+    alignas(16) vec128_t b = hir::vector_ops::UnpackFloat16_4(a);
+    return _mm_load_ps(b.f32);
   }
   static void EmitFLOAT16_4(X64Emitter& e, const EmitArgType& i) {
     // src = [(dest.x | dest.y), (dest.z | dest.w), 0, 0]
@@ -10,8 +10,10 @@
 #include "xenia/base/logging.h"
 #include "xenia/base/string.h"
 #include "xenia/base/threading.h"
+#include "xenia/cpu/backend/x64/x64_backend.h"
 #include "xenia/cpu/backend/x64/x64_emitter.h"
 #include "xenia/cpu/backend/x64/x64_op.h"
+#include "xenia/cpu/backend/x64/x64_trace_writer.h"
 #include "xenia/cpu/backend/x64/x64_tracers.h"
 #include "xenia/cpu/backend/x64/x64_util.h"
 #include "xenia/cpu/hir/hir_builder.h"
@@ -38,11 +40,18 @@ std::unordered_map<uint32_t, SequenceSelectFn> sequence_table;
 // ============================================================================
 struct COMMENT : Sequence<COMMENT, I<OPCODE_COMMENT, VoidOp, OffsetOp>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
-    if (IsTracingInstr()) {
+    if (IsTracingBinary()) {
+      // String IDs only mean something to this session's trace file.
+      auto str = reinterpret_cast<const char*>(i.src1.value);
+      e.MarkNotPersistable();
+      e.mov(e.r9d, e.backend()->trace_writer()->InternString(str));
+      e.EmitTraceRecord(TraceRecordType::kString);
+    } else if (IsTracingInstr()) {
       auto str = reinterpret_cast<const char*>(i.src1.value);
       // TODO(benvanik): pass through.
       // TODO(benvanik): don't just leak this memory.
       auto str_copy = xe_strdup(str);
+      e.MarkNotPersistable();
       e.mov(e.rdx, reinterpret_cast<uint64_t>(str_copy));
       e.CallNative(reinterpret_cast<void*>(TraceString));
     }
@@ -444,7 +453,7 @@ struct LOAD_CLOCK : Sequence<LOAD_CLOCK, I<OPCODE_LOAD_CLOCK, I64Op>> {
       e.div(e.rcx);
       e.mov(i.dest, e.rax);
     } else {
-      e.CallNative(LoadClock);
+      e.CallHostHelper(reinterpret_cast<void*>(LoadClock));
       e.mov(i.dest, e.rax);
     }
   }
@@ -2951,28 +2960,26 @@ struct SHL_I64 : Sequence<SHL_I64, I<OPCODE_SHL, I64Op, I64Op, I8Op>> {
 };
 struct SHL_V128 : Sequence<SHL_V128, I<OPCODE_SHL, V128Op, V128Op, I8Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
-    // TODO(benvanik): native version (with shift magic).
+    // The whole register is one big endian value with each dword lane holding
+    // one guest word, most significant first. Shift every lane and carry in
+    // the top bits of the next one. shamt is [0,7]; shifting by 32 when it is
+    // 0 clears the carry.
+    e.vpsrldq(e.xmm0, i.src1, 4);
     if (i.src2.is_constant) {
-      e.mov(e.GetNativeParam(1), i.src2.constant());
+      uint8_t shamt = i.src2.constant() & 0x7;
+      e.vpsrld(e.xmm0, e.xmm0, 32 - shamt);
+      e.vpslld(i.dest, i.src1, shamt);
     } else {
-      e.mov(e.GetNativeParam(1), i.src2);
-    }
-    e.lea(e.GetNativeParam(0), e.StashXmm(0, i.src1));
-    e.CallNativeSafe(reinterpret_cast<void*>(EmulateShlV128));
-    e.vmovaps(i.dest, e.xmm0);
-  }
-  static __m128i EmulateShlV128(void*, __m128i src1, uint8_t src2) {
-    // Almost all instances are shamt = 1, but non-constant.
-    // shamt is [0,7]
-    uint8_t shamt = src2 & 0x7;
-    alignas(16) vec128_t value;
-    _mm_store_si128(reinterpret_cast<__m128i*>(&value), src1);
-    for (int i = 0; i < 15; ++i) {
-      value.u8[i ^ 0x3] = (value.u8[i ^ 0x3] << shamt) |
-                          (value.u8[(i + 1) ^ 0x3] >> (8 - shamt));
+      e.movzx(e.eax, i.src2);
+      e.and_(e.eax, 0x7);
+      e.vmovd(e.xmm1, e.eax);
+      e.neg(e.eax);
+      e.add(e.eax, 32);
+      e.vmovd(e.xmm2, e.eax);
+      e.vpsrld(e.xmm0, e.xmm0, e.xmm2);
+      e.vpslld(i.dest, i.src1, e.xmm1);
     }
-    value.u8[15 ^ 0x3] = value.u8[15 ^ 0x3] << shamt;
-    return _mm_load_si128(reinterpret_cast<__m128i*>(&value));
+    e.vpor(i.dest, e.xmm0);
   }
 };
 EMITTER_OPCODE_TABLE(OPCODE_SHL, SHL_I8, SHL_I16, SHL_I32, SHL_I64, SHL_V128);
@@ -3028,28 +3035,23 @@ struct SHR_I64 : Sequence<SHR_I64, I<OPCODE_SHR, I64Op, I64Op, I8Op>> {
 };
 struct SHR_V128 : Sequence<SHR_V128, I<OPCODE_SHR, V128Op, V128Op, I8Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
-    // TODO(benvanik): native version (with shift magic).
+    // See SHL_V128; the carry comes from the previous lane instead.
+    e.vpslldq(e.xmm0, i.src1, 4);
     if (i.src2.is_constant) {
-      e.mov(e.GetNativeParam(1), i.src2.constant());
+      uint8_t shamt = i.src2.constant() & 0x7;
+      e.vpslld(e.xmm0, e.xmm0, 32 - shamt);
+      e.vpsrld(i.dest, i.src1, shamt);
     } else {
-      e.mov(e.GetNativeParam(1), i.src2);
+      e.movzx(e.eax, i.src2);
+      e.and_(e.eax, 0x7);
+      e.vmovd(e.xmm1, e.eax);
+      e.neg(e.eax);
+      e.add(e.eax, 32);
+      e.vmovd(e.xmm2, e.eax);
+      e.vpslld(e.xmm0, e.xmm0, e.xmm2);
+      e.vpsrld(i.dest, i.src1, e.xmm1);
     }
-    e.lea(e.GetNativeParam(0), e.StashXmm(0, i.src1));
-    e.CallNativeSafe(reinterpret_cast<void*>(EmulateShrV128));
-    e.vmovaps(i.dest, e.xmm0);
-  }
-  static __m128i EmulateShrV128(void*, __m128i src1, uint8_t src2) {
-    // Almost all instances are shamt = 1, but non-constant.
-    // shamt is [0,7]
-    uint8_t shamt = src2 & 0x7;
-    alignas(16) vec128_t value;
-    _mm_store_si128(reinterpret_cast<__m128i*>(&value), src1);
-    for (int i = 15; i > 0; --i) {
-      value.u8[i ^ 0x3] = (value.u8[i ^ 0x3] >> shamt) |
-                          (value.u8[(i - 1) ^ 0x3] << (8 - shamt));
-    }
-    value.u8[0 ^ 0x3] = value.u8[0 ^ 0x3] >> shamt;
-    return _mm_load_si128(reinterpret_cast<__m128i*>(&value));
+    e.vpor(i.dest, e.xmm0);
   }
 };
 EMITTER_OPCODE_TABLE(OPCODE_SHR, SHR_I8, SHR_I16, SHR_I32, SHR_I64, SHR_V128);
@@ -3299,7 +3301,7 @@ struct SET_ROUNDING_MODE_I32
   static void Emit(X64Emitter& e, const EmitArgType& i) {
     e.mov(e.rcx, i.src1);
     e.and_(e.rcx, 0x7);
-    e.mov(e.rax, uintptr_t(mxcsr_table));
+    e.MovHostAddress(e.rax, mxcsr_table);
     e.vldmxcsr(e.ptr[e.rax + e.rcx * 4]);
   }
 };
@@ -3315,6 +3317,14 @@ static int anchor_memory_dest = anchor_memory;
 extern volatile int anchor_vector;
 static int anchor_vector_dest = anchor_vector;
 
+void RegisterHostHelpers(X64Backend* backend) {
+  // Reads the host clock through xe::Clock, which is plain C++ and may use
+  // any register the host ABI lets it. MMIO callbacks belong to whoever maps
+  // the range and are left to the same default.
+  backend->RegisterHostHelper(reinterpret_cast<void*>(LOAD_CLOCK::LoadClock),
+                              kHostAbiClobbers);
+}
+
 bool SelectSequence(X64Emitter* e, const Instr* i, const Instr** new_tail) {
   const InstrKey key(i);
   auto it = sequence_table.find(key);
@@ -11,6 +11,7 @@ namespace cpu {
 namespace backend {
 namespace x64 {
 
+class X64Backend;
 class X64Emitter;
 
 typedef bool (*SequenceSelectFn)(X64Emitter&, const hir::Instr*);
@@ -32,6 +33,9 @@ static bool Register() {
 #define EMITTER_OPCODE_TABLE(name, ...) \
   const auto X64_INSTR_##name = Register<__VA_ARGS__>();
 
+// Tells the backend what the host helpers the sequences call clobber.
+void RegisterHostHelpers(X64Backend* backend);
+
 bool SelectSequence(X64Emitter* e, const hir::Instr* i,
                     const hir::Instr** new_tail);
 
@@ -0,0 +1,163 @@
+#include "xenia/cpu/backend/x64/x64_trace_writer.h"
+
+#include <algorithm>
+
+#include "xenia/base/assert.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/logging.h"
+
+namespace xe {
+namespace cpu {
+namespace backend {
+namespace x64 {
+
+std::unique_ptr<X64TraceWriter> X64TraceWriter::Create(
+    const std::filesystem::path& path, uint32_t ring_size) {
+  FILE* file = xe::filesystem::OpenFile(path, "wb");
+  if (!file) {
+    XELOGE("Unable to open binary trace file {}", xe::path_to_utf8(path));
+    return nullptr;
+  }
+  TraceFileHeader header = {kTraceFileSignature, kTraceFileVersion};
+  fwrite(&header, sizeof(header), 1, file);
+
+  uint32_t rounded_ring_size = 64;
+  while (rounded_ring_size < ring_size) {
+    rounded_ring_size <<= 1;
+  }
+  auto writer = std::unique_ptr<X64TraceWriter>(
+      new X64TraceWriter(file, rounded_ring_size));
+  writer->running_ = true;
+  xe::threading::Thread::CreationParameters params;
+  auto writer_ptr = writer.get();
+  writer->writer_thread_ = xe::threading::Thread::Create(
+      params, [writer_ptr]() { writer_ptr->WriterThreadMain(); });
+  if (!writer->writer_thread_) {
+    XELOGE("Unable to create the binary trace writer thread");
+    writer->running_ = false;
+    return nullptr;
+  }
+  writer->writer_thread_->set_name("Binary Trace Writer");
+  XELOGI("Writing binary trace to {}, {} records per thread",
+         xe::path_to_utf8(path), rounded_ring_size);
+  return writer;
+}
+
+X64TraceWriter::X64TraceWriter(FILE* file, uint32_t ring_size)
+    : file_(file), ring_size_(ring_size) {}
+
+X64TraceWriter::~X64TraceWriter() {
+  if (running_) {
+    running_ = false;
+    xe::threading::Wait(writer_thread_.get(), false);
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  // Threads still alive keep their rings; whatever they hold so far is kept.
+  for (auto ring : rings_) {
+    DrainRing(ring);
+  }
+  fclose(file_);
+}
+
+TraceRing* X64TraceWriter::AllocRing(uint32_t thread_id) {
+  auto ring = new TraceRing();
+  ring->write_index = 0;
+  ring->index_mask = ring_size_ - 1;
+  ring->records = new TraceRecord[ring_size_];
+  ring->thread_id = thread_id;
+  ring->read_index = 0;
+  std::lock_guard<std::mutex> lock(mutex_);
+  rings_.push_back(ring);
+  return ring;
+}
+
+void X64TraceWriter::FreeRing(TraceRing* ring) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    DrainRing(ring);
+    rings_.erase(std::remove(rings_.begin(), rings_.end(), ring),
+                 rings_.end());
+  }
+  delete[] ring->records;
+  delete ring;
+}
+
+uint32_t X64TraceWriter::InternString(const std::string_view str) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = string_ids_.find(std::string(str));
+  if (it != string_ids_.end()) {
+    return it->second;
+  }
+  uint32_t id = uint32_t(string_ids_.size());
+  string_ids_.emplace(std::string(str), id);
+  // Written before any code referring to it can run, so always ahead of the
+  // records using it.
+  WriteChunk(TraceChunkType::kString, id, uint32_t(str.size()), str.data(),
+             str.size());
+  return id;
+}
+
+void X64TraceWriter::WriterThreadMain() {
+  while (running_) {
+    xe::threading::Sleep(std::chrono::milliseconds(1));
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto ring : rings_) {
+      DrainRing(ring);
+    }
+  }
+}
+
+void X64TraceWriter::DrainRing(TraceRing* ring) {
+  uint64_t capacity = ring->index_mask + 1;
+  uint64_t write_index = ring->write_index.load(std::memory_order_acquire);
+  uint64_t read_index = ring->read_index;
+  uint64_t dropped_count = 0;
+  if (write_index - read_index > capacity) {
+    dropped_count = write_index - read_index - capacity;
+    read_index = write_index - capacity;
+  }
+  size_t count = size_t(write_index - read_index);
+  drain_buffer_.resize(count);
+  for (size_t i = 0; i < count; ++i) {
+    drain_buffer_[i] = ring->records[(read_index + i) & ring->index_mask];
+  }
+  // The thread keeps running while we copy; anything it may have overwritten
+  // in the meantime is garbage. That includes the slot of the record it is
+  // writing, which is published only once complete. The fence keeps the
+  // copy ahead of the index read.
+  std::atomic_thread_fence(std::memory_order_acquire);
+  uint64_t overwritten_end =
+      ring->write_index.load(std::memory_order_relaxed) - capacity + 1;
+  size_t skip_count = 0;
+  if (int64_t(overwritten_end - read_index) > 0) {
+    skip_count =
+        size_t(std::min(uint64_t(count), overwritten_end - read_index));
+  }
+  dropped_count += skip_count;
+  ring->read_index = write_index;
+
+  if (dropped_count) {
+    WriteChunk(TraceChunkType::kDropped, ring->thread_id,
+               uint32_t(dropped_count), nullptr, 0);
+  }
+  if (count > skip_count) {
+    WriteChunk(TraceChunkType::kRecords, ring->thread_id,
+               uint32_t(count - skip_count), drain_buffer_.data() + skip_count,
+               (count - skip_count) * sizeof(TraceRecord));
+  }
+}
+
+void X64TraceWriter::WriteChunk(TraceChunkType type, uint32_t id,
+                                uint32_t count, const void* payload,
+                                size_t payload_size) {
+  TraceChunkHeader header = {type, id, count};
+  fwrite(&header, sizeof(header), 1, file_);
+  if (payload_size) {
+    fwrite(payload, payload_size, 1, file_);
+  }
+}
+
+}  // namespace x64
+}  // namespace backend
+}  // namespace cpu
+}  // namespace xe
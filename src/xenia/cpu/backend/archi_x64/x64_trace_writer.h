@@ -0,0 +1,81 @@
+#ifndef XENIA_CPU_BACKEND_X64_X64_TRACE_WRITER_H_
+#define XENIA_CPU_BACKEND_X64_X64_TRACE_WRITER_H_
+
+#include <atomic>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "xenia/base/threading.h"
+#include "xenia/cpu/backend/x64/x64_tracers.h"
+
+namespace xe {
+namespace cpu {
+namespace backend {
+namespace x64 {
+
+// Per-thread ring of binary trace records, the backend data of each
+// ThreadState in binary tracing mode. Generated code appends to it inline
+// (see X64Emitter::EmitTraceRecord) and never waits for the writer thread:
+// if it laps the ring the oldest records are lost.
+struct TraceRing {
+  // Only stored to by the owning thread, after the record itself.
+  std::atomic<uint64_t> write_index;
+  uint64_t index_mask;
+  TraceRecord* records;
+  uint32_t thread_id;
+  // Only touched by the writer, under its lock.
+  uint64_t read_index;
+};
+static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t),
+              "Generated code stores to write_index directly");
+
+// Owns the trace file and drains the rings of all threads into it from a
+// background thread.
+class X64TraceWriter {
+ public:
+  ~X64TraceWriter();
+
+  static std::unique_ptr<X64TraceWriter> Create(
+      const std::filesystem::path& path, uint32_t ring_size);
+
+  TraceRing* AllocRing(uint32_t thread_id);
+  // Drains the ring one last time and frees it.
+  void FreeRing(TraceRing* ring);
+
+  // Returns the ID kString records use to refer to the string, writing the
+  // string to the file the first time it is seen.
+  uint32_t InternString(const std::string_view str);
+
+ private:
+  X64TraceWriter(FILE* file, uint32_t ring_size);
+
+  void WriterThreadMain();
+  void DrainRing(TraceRing* ring);
+  void WriteChunk(TraceChunkType type, uint32_t id, uint32_t count,
+                  const void* payload, size_t payload_size);
+
+  FILE* file_ = nullptr;
+  uint32_t ring_size_ = 0;
+
+  std::atomic<bool> running_ = {false};
+  std::unique_ptr<xe::threading::Thread> writer_thread_;
+
+  // Guards everything below and the file.
+  std::mutex mutex_;
+  std::vector<TraceRing*> rings_;
+  std::unordered_map<std::string, uint32_t> string_ids_;
+  std::vector<TraceRecord> drain_buffer_;
+};
+
+}  // namespace x64
+}  // namespace backend
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_BACKEND_X64_X64_TRACE_WRITER_H_
@@ -2,13 +2,26 @@
 #include "xenia/cpu/backend/x64/x64_tracers.h"
 
 #include <cinttypes>
+#include <cstring>
 
+#include "third_party/fmt/include/fmt/format.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/vec128.h"
 #include "xenia/cpu/backend/x64/x64_emitter.h"
 #include "xenia/cpu/processor.h"
 #include "xenia/cpu/thread_state.h"
 
+DEFINE_path(trace_binary_path, "",
+            "Trace guest instructions and data accesses into this file as "
+            "binary records, written inline by the generated code and drained "
+            "by a background thread. Decode with xenia-trace-decoder.",
+            "x64");
+DEFINE_int32(trace_binary_ring_size, 65536,
+             "Records buffered per thread with --trace_binary_path (rounded "
+             "up to a power of two). Records the drain thread cannot keep up "
+             "with are dropped.",
+             "x64");
+
 namespace xe {
 namespace cpu {
 namespace backend {
@@ -40,6 +53,9 @@ uint32_t GetTracingMode() {
 #if DTRACE
   mode |= TRACING_DATA;
 #endif  // DTRACE
+  if (!cvars::trace_binary_path.empty()) {
+    mode |= TRACING_INSTR | TRACING_DATA | TRACING_BINARY;
+  }
   return mode;
 }
 
@@ -199,6 +215,153 @@ void TraceMemset(void* raw_context, uint32_t address, uint8_t value,
          length, value);
 }
 
+uint32_t GetTraceRecordValueSize(TraceRecordType type) {
+  switch (type) {
+    case TraceRecordType::kContextLoadI8:
+    case TraceRecordType::kContextStoreI8:
+    case TraceRecordType::kMemoryLoadI8:
+    case TraceRecordType::kMemoryStoreI8:
+    case TraceRecordType::kMemset:
+      return 1;
+    case TraceRecordType::kContextLoadI16:
+    case TraceRecordType::kContextStoreI16:
+    case TraceRecordType::kMemoryLoadI16:
+    case TraceRecordType::kMemoryStoreI16:
+      return 2;
+    case TraceRecordType::kContextLoadI32:
+    case TraceRecordType::kContextLoadF32:
+    case TraceRecordType::kContextStoreI32:
+    case TraceRecordType::kContextStoreF32:
+    case TraceRecordType::kMemoryLoadI32:
+    case TraceRecordType::kMemoryLoadF32:
+    case TraceRecordType::kMemoryStoreI32:
+    case TraceRecordType::kMemoryStoreF32:
+      return 4;
+    case TraceRecordType::kContextLoadI64:
+    case TraceRecordType::kContextLoadF64:
+    case TraceRecordType::kContextStoreI64:
+    case TraceRecordType::kContextStoreF64:
+    case TraceRecordType::kMemoryLoadI64:
+    case TraceRecordType::kMemoryLoadF64:
+    case TraceRecordType::kMemoryStoreI64:
+    case TraceRecordType::kMemoryStoreF64:
+      return 8;
+    case TraceRecordType::kContextLoadV128:
+    case TraceRecordType::kContextStoreV128:
+    case TraceRecordType::kMemoryLoadV128:
+    case TraceRecordType::kMemoryStoreV128:
+      return 16;
+    default:
+      return 0;
+  }
+}
+
+std::string FormatTraceRecord(const TraceRecord& record,
+                              const std::string& string) {
+  uint8_t u8 = record.value[0];
+  uint16_t u16;
+  uint32_t u32[4];
+  uint64_t u64;
+  float f32[4];
+  double f64;
+  std::memcpy(&u16, record.value, sizeof(u16));
+  std::memcpy(u32, record.value, sizeof(u32));
+  std::memcpy(&u64, record.value, sizeof(u64));
+  std::memcpy(f32, u32, sizeof(f32));
+  std::memcpy(&f64, &u64, sizeof(f64));
+  int32_t i32[4] = {int32_t(u32[0]), int32_t(u32[1]), int32_t(u32[2]),
+                    int32_t(u32[3])};
+  uint32_t key = record.key;
+  switch (record.type) {
+    case TraceRecordType::kString:
+      return string;
+
+    case TraceRecordType::kContextLoadI8:
+      return fmt::format("{} ({:X}) = ctx i8 +{}", int8_t(u8), u8, key);
+    case TraceRecordType::kContextLoadI16:
+      return fmt::format("{} ({:X}) = ctx i16 +{}", int16_t(u16), u16, key);
+    case TraceRecordType::kContextLoadI32:
+      return fmt::format("{} ({:X}) = ctx i32 +{}", i32[0], u32[0], key);
+    case TraceRecordType::kContextLoadI64:
+      return fmt::format("{} ({:X}) = ctx i64 +{}", int64_t(u64), u64, key);
+    case TraceRecordType::kContextLoadF32:
+      return fmt::format("{} ({:X}) = ctx f32 +{}", f32[0], i32[0], key);
+    case TraceRecordType::kContextLoadF64:
+      return fmt::format("{} ({:X}) = ctx f64 +{}", f64, int64_t(u64), key);
+    case TraceRecordType::kContextLoadV128:
+      return fmt::format(
+          "[{}, {}, {}, {}] [{:08X}, {:08X}, {:08X}, {:08X}] = ctx v128 +{}",
+          f32[0], f32[1], f32[2], f32[3], i32[0], i32[1], i32[2], i32[3], key);
+
+    case TraceRecordType::kContextStoreI8:
+      return fmt::format("ctx i8 +{} = {} ({:X})", key, int8_t(u8), u8);
+    case TraceRecordType::kContextStoreI16:
+      return fmt::format("ctx i16 +{} = {} ({:X})", key, int16_t(u16), u16);
+    case TraceRecordType::kContextStoreI32:
+      return fmt::format("ctx i32 +{} = {} ({:X})", key, i32[0], u32[0]);
+    case TraceRecordType::kContextStoreI64:
+      return fmt::format("ctx i64 +{} = {} ({:X})", key, int64_t(u64), u64);
+    case TraceRecordType::kContextStoreF32:
+      return fmt::format("ctx f32 +{} = {} ({:X})", key, f32[0], i32[0]);
+    case TraceRecordType::kContextStoreF64:
+      return fmt::format("ctx f64 +{} = {} ({:X})", key, f64, int64_t(u64));
+    case TraceRecordType::kContextStoreV128:
+      return fmt::format(
+          "ctx v128 +{} = [{}, {}, {}, {}] [{:08X}, {:08X}, {:08X}, {:08X}]",
+          key, f32[0], f32[1], f32[2], f32[3], i32[0], i32[1], i32[2], i32[3]);
+
+    case TraceRecordType::kMemoryLoadI8:
+      return fmt::format("{} ({:X}) = load.i8 {:08X}", int8_t(u8), u8, key);
+    case TraceRecordType::kMemoryLoadI16:
+      return fmt::format("{} ({:X}) = load.i16 {:08X}", int16_t(u16), u16,
+                         key);
+    case TraceRecordType::kMemoryLoadI32:
+      return fmt::format("{} ({:X}) = load.i32 {:08X}", i32[0], u32[0], key);
+    case TraceRecordType::kMemoryLoadI64:
+      return fmt::format("{} ({:X}) = load.i64 {:08X}", int64_t(u64), u64,
+                         key);
+    case TraceRecordType::kMemoryLoadF32:
+      return fmt::format("{} ({:X}) = load.f32 {:08X}", f32[0], i32[0], key);
+    case TraceRecordType::kMemoryLoadF64:
+      return fmt::format("{} ({:X}) = load.f64 {:08X}", f64, int64_t(u64),
+                         key);
+    case TraceRecordType::kMemoryLoadV128:
+      return fmt::format(
+          "[{}, {}, {}, {}] [{:08X}, {:08X}, {:08X}, {:08X}] = load.v128 "
+          "{:08X}",
+          f32[0], f32[1], f32[2], f32[3], i32[0], i32[1], i32[2], i32[3], key);
+
+    case TraceRecordType::kMemoryStoreI8:
+      return fmt::format("store.i8 {:08X} = {} ({:X})", key, int8_t(u8), u8);
+    case TraceRecordType::kMemoryStoreI16:
+      return fmt::format("store.i16 {:08X} = {} ({:X})", key, int16_t(u16),
+                         u16);
+    case TraceRecordType::kMemoryStoreI32:
+      return fmt::format("store.i32 {:08X} = {} ({:X})", key, i32[0], u32[0]);
+    case TraceRecordType::kMemoryStoreI64:
+      return fmt::format("store.i64 {:08X} = {} ({:X})", key, int64_t(u64),
+                         u64);
+    case TraceRecordType::kMemoryStoreF32:
+      return fmt::format("store.f32 {:08X} = {} ({:X})", key, f32[0], i32[0]);
+    case TraceRecordType::kMemoryStoreF64:
+      return fmt::format("store.f64 {:08X} = {} ({:X})", key, f64,
+                         int64_t(u64));
+    case TraceRecordType::kMemoryStoreV128:
+      return fmt::format(
+          "store.v128 {:08X} = [{}, {}, {}, {}] [{:08X}, {:08X}, {:08X}, "
+          "{:08X}]",
+          key, f32[0], f32[1], f32[2], f32[3], i32[0], i32[1], i32[2], i32[3]);
+
+    case TraceRecordType::kMemset:
+      return fmt::format("memset {:08X}-{:08X} ({}) = {:02X}", key,
+                         key + uint32_t(record.extra), record.extra, u8);
+
+    default:
+      return fmt::format("unknown trace record type {}",
+                         uint32_t(record.type));
+  }
+}
+
 }  // namespace x64
 }  // namespace backend
 }  // namespace cpu
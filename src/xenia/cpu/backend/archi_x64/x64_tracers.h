@@ -3,6 +3,12 @@
 
 #include <xmmintrin.h>
 #include <cstdint>
+#include <string>
+
+#include "xenia/base/cvar.h"
+
+DECLARE_path(trace_binary_path);
+DECLARE_int32(trace_binary_ring_size);
 
 namespace xe {
 namespace cpu {
@@ -13,11 +19,100 @@ class X64Emitter;
 enum TracingMode {
   TRACING_INSTR = (1 << 1),
   TRACING_DATA = (1 << 2),
+  // Records are written inline to the thread's TraceRing instead of calling
+  // the functions below. Set with --trace_binary_path.
+  TRACING_BINARY = (1 << 3),
 };
 
 uint32_t GetTracingMode();
 inline bool IsTracingInstr() { return (GetTracingMode() & TRACING_INSTR) != 0; }
 inline bool IsTracingData() { return (GetTracingMode() & TRACING_DATA) != 0; }
+inline bool IsTracingBinary() {
+  return (GetTracingMode() & TRACING_BINARY) != 0;
+}
+
+// One record per trace function below, in binary tracing mode.
+enum class TraceRecordType : uint16_t {
+  kString,
+  kContextLoadI8,
+  kContextLoadI16,
+  kContextLoadI32,
+  kContextLoadI64,
+  kContextLoadF32,
+  kContextLoadF64,
+  kContextLoadV128,
+  kContextStoreI8,
+  kContextStoreI16,
+  kContextStoreI32,
+  kContextStoreI64,
+  kContextStoreF32,
+  kContextStoreF64,
+  kContextStoreV128,
+  kMemoryLoadI8,
+  kMemoryLoadI16,
+  kMemoryLoadI32,
+  kMemoryLoadI64,
+  kMemoryLoadF32,
+  kMemoryLoadF64,
+  kMemoryLoadV128,
+  kMemoryStoreI8,
+  kMemoryStoreI16,
+  kMemoryStoreI32,
+  kMemoryStoreI64,
+  kMemoryStoreF32,
+  kMemoryStoreF64,
+  kMemoryStoreV128,
+  kMemset,
+  kCount,
+};
+
+struct TraceRecord {
+  TraceRecordType type;
+  // Reserved, zero.
+  uint16_t flags;
+  // Context offset, guest address or string ID.
+  uint32_t key;
+  // Memset length.
+  uint64_t extra;
+  // The value as read from the context or memory, or the result of a memory
+  // load (byte swapped if the load was), zero-extended.
+  uint8_t value[16];
+};
+static_assert(sizeof(TraceRecord) == 32, "Generated code assumes 32 bytes");
+constexpr uint32_t kTraceRecordShift = 5;
+
+// Bytes of value a record of the given type carries.
+uint32_t GetTraceRecordValueSize(TraceRecordType type);
+// Formats the record as the trace function of its type would have logged it.
+// string is the text of kString records.
+std::string FormatTraceRecord(const TraceRecord& record,
+                              const std::string& string);
+
+// Binary trace file layout: a TraceFileHeader, then TraceChunkHeaders each
+// followed by their payload.
+constexpr uint32_t kTraceFileSignature = 0x43525458;  // 'XTRC'
+constexpr uint32_t kTraceFileVersion = 2;
+
+struct TraceFileHeader {
+  uint32_t signature;
+  uint32_t version;
+};
+
+enum class TraceChunkType : uint32_t {
+  // id is the thread ID; count TraceRecords follow.
+  kRecords,
+  // id is the string ID; count bytes of text follow.
+  kString,
+  // id is the thread ID; count records were lost because the thread filled
+  // its ring faster than it was drained.
+  kDropped,
+};
+
+struct TraceChunkHeader {
+  TraceChunkType type;
+  uint32_t id;
+  uint32_t count;
+};
 
 void TraceString(void* raw_context, const char* str);
 
@@ -14,7 +14,7 @@ bool Backend::Initialize(Processor* processor) {
   return true;
 }
 
-void* Backend::AllocThreadData() { return nullptr; }
+void* Backend::AllocThreadData(uint32_t thread_id) { return nullptr; }
 
 void Backend::FreeThreadData(void* thread_data) {}
 
@@ -1,6 +1,7 @@
 #ifndef XENIA_CPU_BACKEND_BACKEND_H_
 #define XENIA_CPU_BACKEND_BACKEND_H_
 
+#include <filesystem>
 #include <memory>
 
 #include "xenia/cpu/backend/machine_info.h"
@@ -34,7 +35,9 @@ class Backend {
 
   virtual bool Initialize(Processor* processor);
 
-  virtual void* AllocThreadData();
+  // Per-thread data of the backend, reachable from generated code through
+  // ThreadState::backend_data_offset().
+  virtual void* AllocThreadData(uint32_t thread_id);
   virtual void FreeThreadData(void* thread_data);
 
   virtual void CommitExecutableRange(uint32_t guest_low,
@@ -51,6 +54,23 @@ class Backend {
   virtual uint64_t CalculateNextHostInstruction(ThreadDebugInfo* thread_info,
                                                 uint64_t current_pc) = 0;
 
+  // Opens the on-disk cache of generated code for the given module, if the
+  // backend supports one. Functions compiled afterwards are added to it.
+  // With rebuild any existing contents are discarded.
+  virtual bool OpenPersistentCache(const std::filesystem::path& cache_root,
+                                   uint64_t module_hash, bool rebuild = false) {
+    return false;
+  }
+  // Sets up the function from code generated in a previous session, if
+  // available and still valid. On success the function is ready to run
+  // without going through the frontend.
+  virtual bool LoadPersistedFunction(GuestFunction* function) { return false; }
+  // Stops routing calls to the function's generated code; the next call
+  // through its address resolves it again, and stops patching the call sites
+  // in that code. The code itself is left in place for threads still running
+  // in it.
+  virtual void UnlinkFunction(GuestFunction* function) {}
+
   virtual void InstallBreakpoint(Breakpoint* breakpoint) {}
   virtual void InstallBreakpoint(Breakpoint* breakpoint, Function* fn) {}
   virtual void UninstallBreakpoint(Breakpoint* breakpoint) {}
@@ -0,0 +1,183 @@
+#include "xenia/cpu/compile_queue.h"
+
+#include "third_party/fmt/include/fmt/format.h"
+#include "xenia/base/assert.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/profiling.h"
+#include "xenia/cpu/cpu_flags.h"
+#include "xenia/cpu/processor.h"
+
+namespace xe {
+namespace cpu {
+
+// Depth of the request the current thread is compiling. Zero on guest
+// threads, which are always compiling something they are blocked on.
+static thread_local uint32_t current_compile_depth_ = 0;
+
+CompileQueue::CompileQueue(Processor* processor) : processor_(processor) {}
+
+CompileQueue::~CompileQueue() { Shutdown(); }
+
+bool CompileQueue::Initialize(uint32_t worker_count) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  assert_true(worker_threads_.empty());
+  running_ = true;
+  for (uint32_t i = 0; i < worker_count; ++i) {
+    xe::threading::Thread::CreationParameters params;
+    // Deep HIR graphs recurse in a few passes; match guest thread stacks.
+    params.stack_size = 16 * 1024 * 1024;
+    auto thread = xe::threading::Thread::Create(
+        params, [this]() { WorkerThreadMain(); });
+    if (!thread) {
+      XELOGE("Unable to create JIT compile worker {}", i);
+      break;
+    }
+    thread->set_name(fmt::format("JIT Compile Worker {}", i));
+    thread->set_priority(xe::threading::ThreadPriority::kBelowNormal);
+    worker_threads_.push_back(std::move(thread));
+  }
+  return !worker_threads_.empty() || !worker_count;
+}
+
+void CompileQueue::Shutdown() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!running_) {
+      return;
+    }
+    running_ = false;
+    queue_ = {};
+    queued_depths_.clear();
+    tier_up_addresses_.clear();
+  }
+  work_cond_.notify_all();
+  idle_cond_.notify_all();
+  for (auto& thread : worker_threads_) {
+    xe::threading::Wait(thread.get(), false);
+  }
+  worker_threads_.clear();
+}
+
+void CompileQueue::Enqueue(uint32_t address) {
+  if (worker_threads_.empty()) {
+    return;
+  }
+  uint32_t depth = current_compile_depth_ + 1;
+  if (depth > uint32_t(cvars::jit_speculative_depth)) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    EnqueueLocked(address, depth);
+  }
+  work_cond_.notify_one();
+}
+
+void CompileQueue::Enqueue(const std::vector<uint32_t>& addresses) {
+  if (worker_threads_.empty() || addresses.empty()) {
+    return;
+  }
+  uint32_t depth = current_compile_depth_ + 1;
+  if (depth > uint32_t(cvars::jit_speculative_depth)) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (uint32_t address : addresses) {
+      EnqueueLocked(address, depth);
+    }
+  }
+  work_cond_.notify_all();
+}
+
+void CompileQueue::EnqueueTierUp(uint32_t address) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!running_ || !tier_up_addresses_.insert(address).second) {
+      return;
+    }
+    queue_.push({address, 0, next_sequence_++});
+  }
+  work_cond_.notify_one();
+}
+
+void CompileQueue::EnqueueLocked(uint32_t address, uint32_t depth) {
+  if (!running_) {
+    return;
+  }
+  auto it = queued_depths_.find(address);
+  if (it != queued_depths_.end()) {
+    if (it->second <= depth) {
+      // Already queued at least as urgently.
+      return;
+    }
+    // Re-queue shallower; the old request is dropped when popped.
+    it->second = depth;
+  } else {
+    queued_depths_.emplace(address, depth);
+  }
+  queue_.push({address, depth, next_sequence_++});
+}
+
+void CompileQueue::WaitForIdle() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  idle_cond_.wait(
+      lock, [this]() { return !running_ || (queue_.empty() && !busy_count_); });
+}
+
+void CompileQueue::WorkerThreadMain() {
+  bool was_busy = false;
+  uint32_t finished_tier_up = 0;
+  while (true) {
+    Request request;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (finished_tier_up) {
+        tier_up_addresses_.erase(finished_tier_up);
+        finished_tier_up = 0;
+      }
+      if (was_busy) {
+        was_busy = false;
+        if (!--busy_count_ && queue_.empty()) {
+          idle_cond_.notify_all();
+        }
+      }
+      work_cond_.wait(lock, [this]() { return !running_ || !queue_.empty(); });
+      if (!running_) {
+        return;
+      }
+      request = queue_.top();
+      queue_.pop();
+      if (!request.depth) {
+        ++busy_count_;
+        was_busy = true;
+        finished_tier_up = request.address;
+        lock.unlock();
+        SCOPE_profile_cpu_i("cpu", "CompileQueue::TierUp");
+        processor_->TierUpFunction(request.address);
+        continue;
+      }
+      auto it = queued_depths_.find(request.address);
+      if (it == queued_depths_.end() || it->second != request.depth) {
+        // Superseded by a shallower request for the same address.
+        if (queue_.empty() && !busy_count_) {
+          idle_cond_.notify_all();
+        }
+        continue;
+      }
+      queued_depths_.erase(it);
+      ++busy_count_;
+      was_busy = true;
+    }
+
+    SCOPE_profile_cpu_i("cpu", "CompileQueue::Compile");
+    current_compile_depth_ = request.depth;
+    if (processor_->PrecompileFunction(request.address)) {
+      compiled_count_.fetch_add(1, std::memory_order_relaxed);
+    }
+    current_compile_depth_ = 0;
+  }
+}
+
+}  // namespace cpu
+}  // namespace xe
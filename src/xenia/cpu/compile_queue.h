@@ -0,0 +1,99 @@
+#ifndef XENIA_CPU_COMPILE_QUEUE_H_
+#define XENIA_CPU_COMPILE_QUEUE_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "xenia/base/threading.h"
+
+namespace xe {
+namespace cpu {
+
+class Processor;
+
+// Pool of background threads that compile guest functions ahead of the guest
+// threads that will eventually call them.
+//
+// Requests are ordered by depth: the number of speculative hops from code a
+// guest thread is actually blocked on. A guest thread that misses in the
+// entry table still compiles inline (it has nothing better to do), and the
+// direct call targets discovered while doing so are queued at depth 1 so the
+// workers chase the code the guest is about to run first. Functions compiled
+// by the workers queue their own callees one level deeper, up to
+// --jit_speculative_depth.
+class CompileQueue {
+ public:
+  explicit CompileQueue(Processor* processor);
+  ~CompileQueue();
+
+  // Starts worker_count workers. With zero workers Enqueue is a no-op.
+  bool Initialize(uint32_t worker_count);
+  // Stops all workers, dropping anything still queued.
+  void Shutdown();
+
+  uint32_t worker_count() const { return uint32_t(worker_threads_.size()); }
+
+  // Queues the function at the given address for compilation, one level
+  // deeper than whatever the calling thread is compiling (or depth 1 if the
+  // caller is a guest thread).
+  void Enqueue(uint32_t address);
+  void Enqueue(const std::vector<uint32_t>& addresses);
+  // Queues a hot baseline function for optimized recompilation. These go
+  // ahead of all speculative requests.
+  void EnqueueTierUp(uint32_t address);
+
+  // Blocks until nothing is queued and no worker is compiling, including any
+  // callees the workers queue along the way. Used by offline compilation.
+  void WaitForIdle();
+
+  // Number of functions compiled by the workers (for stats/benchmarking).
+  uint64_t compiled_count() const { return compiled_count_.load(); }
+
+ private:
+  struct Request {
+    uint32_t address;
+    // 0 for tier-up requests.
+    uint32_t depth;
+    uint64_t sequence;
+    // std::priority_queue is a max-heap; invert so shallow/old pop first.
+    bool operator<(const Request& other) const {
+      if (depth != other.depth) {
+        return depth > other.depth;
+      }
+      return sequence > other.sequence;
+    }
+  };
+
+  void EnqueueLocked(uint32_t address, uint32_t depth);
+  void WorkerThreadMain();
+
+  Processor* processor_ = nullptr;
+
+  std::mutex mutex_;
+  std::condition_variable work_cond_;
+  std::condition_variable idle_cond_;
+  bool running_ = false;
+  // Workers currently compiling a request.
+  uint32_t busy_count_ = 0;
+  std::priority_queue<Request> queue_;
+  // Shallowest depth each address is currently queued at, to drop duplicate
+  // requests. Entries popped from queue_ at a deeper depth are stale.
+  std::unordered_map<uint32_t, uint32_t> queued_depths_;
+  // Tier-up requests queued or in progress.
+  std::unordered_set<uint32_t> tier_up_addresses_;
+  uint64_t next_sequence_ = 0;
+  std::atomic<uint64_t> compiled_count_ = {0};
+
+  std::vector<std::unique_ptr<xe::threading::Thread>> worker_threads_;
+};
+
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_COMPILE_QUEUE_H_
@@ -0,0 +1,275 @@
+#include "xenia/cpu/compiler/compile_profiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
+#include "third_party/fmt/include/fmt/format.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/logging.h"
+#include "xenia/cpu/hir/block.h"
+#include "xenia/cpu/hir/instr.h"
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+
+using namespace xe::cpu::hir;
+
+namespace {
+
+const char kFrontendStageName[] = "Frontend";
+
+std::atomic<bool> enabled_ = {false};
+
+std::mutex mutex_;
+std::vector<CompileProfiler::StageTotals> stage_totals_;
+std::vector<CompileProfiler::FunctionSample> function_samples_;
+
+// The function being translated on this thread.
+struct PendingFunction {
+  bool active = false;
+  std::chrono::steady_clock::time_point start_time;
+  uint64_t stage_ns = 0;
+  bool seen_stage = false;
+  CompileProfiler::HIRSize initial_size;
+  CompileProfiler::HIRSize final_size;
+  uint64_t peak_bytes = 0;
+};
+thread_local PendingFunction pending_function_;
+
+// mutex_ must be held.
+CompileProfiler::StageTotals& LookupStage(const char* name) {
+  if (stage_totals_.empty()) {
+    stage_totals_.emplace_back();
+    stage_totals_.back().name = kFrontendStageName;
+  }
+  for (auto& totals : stage_totals_) {
+    if (totals.name == name) {
+      return totals;
+    }
+  }
+  stage_totals_.emplace_back();
+  stage_totals_.back().name = name;
+  return stage_totals_.back();
+}
+
+void AddToStage(const CompileProfiler::StageSample& sample) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto& totals = LookupStage(sample.name);
+  ++totals.run_count;
+  totals.total_ns += sample.duration_ns;
+  totals.max_ns = std::max(totals.max_ns, sample.duration_ns);
+  totals.instrs_before += sample.before.instr_count;
+  totals.instrs_after += sample.after.instr_count;
+  totals.values_before += sample.before.value_count;
+  totals.values_after += sample.after.value_count;
+  totals.peak_bytes =
+      std::max({totals.peak_bytes, sample.before.bytes, sample.after.bytes});
+  for (const auto& counter : sample.counters) {
+    auto it = std::find_if(
+        totals.counters.begin(), totals.counters.end(),
+        [&counter](const auto& other) { return other.name == counter.name; });
+    if (it == totals.counters.end()) {
+      totals.counters.emplace_back();
+      it = totals.counters.end() - 1;
+      it->name = counter.name;
+    }
+    it->total += counter.value;
+  }
+}
+
+}  // namespace
+
+bool CompileProfiler::is_enabled() {
+  return enabled_.load(std::memory_order_relaxed);
+}
+
+void CompileProfiler::set_enabled(bool enabled) { enabled_ = enabled; }
+
+CompileProfiler::HIRSize CompileProfiler::MeasureHIR(HIRBuilder* builder) {
+  HIRSize size;
+  uint32_t use_count = 0;
+  for (auto block = builder->first_block(); block; block = block->next) {
+    ++size.block_count;
+    for (auto i = block->instr_head; i; i = i->next) {
+      ++size.instr_count;
+      if (i->dest) {
+        ++size.value_count;
+      }
+      use_count += (i->src1_use ? 1 : 0) + (i->src2_use ? 1 : 0) +
+                   (i->src3_use ? 1 : 0);
+    }
+  }
+  size.bytes =
+      size.block_count * sizeof(Block) + size.instr_count * sizeof(Instr) +
+      size.value_count * sizeof(Value) + use_count * sizeof(Value::Use);
+  return size;
+}
+
+void CompileProfiler::BeginFunction() {
+  if (!is_enabled()) {
+    return;
+  }
+  pending_function_ = PendingFunction();
+  pending_function_.active = true;
+  pending_function_.start_time = std::chrono::steady_clock::now();
+}
+
+void CompileProfiler::RecordStage(const StageSample& sample) {
+  auto& pending = pending_function_;
+  if (pending.active) {
+    if (!pending.seen_stage) {
+      pending.seen_stage = true;
+      pending.initial_size = sample.before;
+    }
+    pending.stage_ns += sample.duration_ns;
+    pending.final_size = sample.after;
+    pending.peak_bytes = std::max(
+        {pending.peak_bytes, sample.before.bytes, sample.after.bytes});
+  }
+  AddToStage(sample);
+}
+
+void CompileProfiler::EndFunction(uint32_t address, bool succeeded) {
+  auto& pending = pending_function_;
+  if (!pending.active) {
+    return;
+  }
+  pending.active = false;
+  if (!succeeded) {
+    return;
+  }
+  uint64_t duration_ns = uint64_t(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now() - pending.start_time)
+          .count());
+  FunctionSample function_sample;
+  function_sample.address = address;
+  function_sample.duration_ns = duration_ns;
+  function_sample.frontend_ns =
+      duration_ns - std::min(duration_ns, pending.stage_ns);
+  function_sample.initial_size = pending.initial_size;
+  function_sample.final_size = pending.final_size;
+  function_sample.peak_bytes = pending.peak_bytes;
+
+  StageSample frontend_sample;
+  frontend_sample.name = kFrontendStageName;
+  frontend_sample.duration_ns = function_sample.frontend_ns;
+  frontend_sample.after = pending.initial_size;
+  AddToStage(frontend_sample);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  function_samples_.push_back(function_sample);
+}
+
+std::vector<CompileProfiler::StageTotals> CompileProfiler::stage_totals() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stage_totals_;
+}
+
+std::vector<CompileProfiler::FunctionSample>
+CompileProfiler::function_samples() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return function_samples_;
+}
+
+void CompileProfiler::Reset() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  stage_totals_.clear();
+  function_samples_.clear();
+}
+
+bool CompileProfiler::WriteReport(const std::filesystem::path& path) {
+  auto stages = stage_totals();
+  auto functions = function_samples();
+
+  auto summary_path = path;
+  summary_path += ".txt";
+  FILE* file = xe::filesystem::OpenFile(summary_path, "wb");
+  if (!file) {
+    XELOGE("Unable to write {}", xe::path_to_utf8(summary_path));
+    return false;
+  }
+  uint64_t total_ns = 0;
+  for (const auto& stage : stages) {
+    total_ns += stage.total_ns;
+  }
+  fmt::print(file, "{} functions in {:.2f}ms\n\n", functions.size(),
+             total_ns / 1000000.0);
+  fmt::print(file,
+             "{:<32} {:>8} {:>10} {:>6} {:>9} {:>9} {:>10} {:>10} {:>10} "
+             "{:>10} {:>9}\n",
+             "stage", "runs", "total ms", "share", "mean us", "max us",
+             "instrs in", "instrs out", "values in", "values out",
+             "peak KiB");
+  for (const auto& stage : stages) {
+    uint64_t runs = std::max(stage.run_count, uint64_t(1));
+    fmt::print(file,
+               "{:<32} {:>8} {:>10.2f} {:>5.1f}% {:>9.2f} {:>9.2f} {:>10.1f} "
+               "{:>10.1f} {:>10.1f} {:>10.1f} {:>9.1f}\n",
+               stage.name, stage.run_count, stage.total_ns / 1000000.0,
+               total_ns ? stage.total_ns * 100.0 / total_ns : 0.0,
+               stage.total_ns / 1000.0 / runs, stage.max_ns / 1000.0,
+               double(stage.instrs_before) / runs,
+               double(stage.instrs_after) / runs,
+               double(stage.values_before) / runs,
+               double(stage.values_after) / runs, stage.peak_bytes / 1024.0);
+  }
+
+  fmt::print(file, "\nStage counters (mean per run):\n");
+  for (const auto& stage : stages) {
+    uint64_t runs = std::max(stage.run_count, uint64_t(1));
+    for (const auto& counter : stage.counters) {
+      fmt::print(file, "{:<32} {:<24} {:>10.2f}\n", stage.name, counter.name,
+                 double(counter.total) / runs);
+    }
+  }
+
+  std::sort(functions.begin(), functions.end(),
+            [](const auto& a, const auto& b) {
+              return a.duration_ns > b.duration_ns;
+            });
+  fmt::print(file, "\nSlowest functions:\n");
+  fmt::print(file, "{:<10} {:>10} {:>12} {:>9} {:>9} {:>9}\n", "address",
+             "total us", "frontend us", "instrs", "values", "peak KiB");
+  for (size_t i = 0; i < std::min(functions.size(), size_t(50)); ++i) {
+    const auto& function = functions[i];
+    fmt::print(file, "{:08X}   {:>10.2f} {:>12.2f} {:>9} {:>9} {:>9.1f}\n",
+               function.address, function.duration_ns / 1000.0,
+               function.frontend_ns / 1000.0,
+               function.initial_size.instr_count,
+               function.initial_size.value_count,
+               function.peak_bytes / 1024.0);
+  }
+  fclose(file);
+
+  auto csv_path = path;
+  csv_path += ".csv";
+  file = xe::filesystem::OpenFile(csv_path, "wb");
+  if (!file) {
+    XELOGE("Unable to write {}", xe::path_to_utf8(csv_path));
+    return false;
+  }
+  fmt::print(file,
+             "address,total_ns,frontend_ns,initial_instrs,initial_values,"
+             "final_instrs,final_values,peak_bytes\n");
+  for (const auto& function : functions) {
+    fmt::print(file, "{:08X},{},{},{},{},{},{},{}\n", function.address,
+               function.duration_ns, function.frontend_ns,
+               function.initial_size.instr_count,
+               function.initial_size.value_count,
+               function.final_size.instr_count,
+               function.final_size.value_count, function.peak_bytes);
+  }
+  fclose(file);
+
+  XELOGI("Wrote the compile profile of {} functions to {}.txt/.csv",
+         functions.size(), xe::path_to_utf8(path));
+  return true;
+}
+
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
@@ -0,0 +1,95 @@
+#ifndef XENIA_CPU_COMPILER_COMPILE_PROFILER_H_
+#define XENIA_CPU_COMPILER_COMPILE_PROFILER_H_
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "xenia/cpu/hir/hir_builder.h"
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+
+// Where JIT compile time goes, with --compile_profile_path.
+//
+// Compiler::Compile records every pass it runs and the backend records code
+// emission, as stages of the function being compiled on the calling thread.
+// BeginFunction/EndFunction bracket a whole translation; the part of it no
+// stage accounts for is put down to the frontend. Everything is folded into
+// process-wide totals as it comes in.
+class CompileProfiler {
+ public:
+  // Size of the HIR of a function. Arena keeps no usage count, so bytes are
+  // estimated from the live blocks, instructions, values and uses.
+  struct HIRSize {
+    uint32_t block_count = 0;
+    uint32_t instr_count = 0;
+    uint32_t value_count = 0;
+    uint64_t bytes = 0;
+  };
+  // A count particular to one stage, such as the spills of the register
+  // allocator. Summed over runs.
+  struct Counter {
+    const char* name;
+    uint64_t value;
+  };
+  struct StageSample {
+    const char* name;
+    uint64_t duration_ns;
+    HIRSize before;
+    HIRSize after;
+    std::vector<Counter> counters;
+  };
+  struct CounterTotals {
+    std::string name;
+    uint64_t total = 0;
+  };
+  struct StageTotals {
+    std::string name;
+    uint64_t run_count = 0;
+    uint64_t total_ns = 0;
+    uint64_t max_ns = 0;
+    uint64_t instrs_before = 0;
+    uint64_t instrs_after = 0;
+    uint64_t values_before = 0;
+    uint64_t values_after = 0;
+    uint64_t peak_bytes = 0;
+    std::vector<CounterTotals> counters;
+  };
+  struct FunctionSample {
+    uint32_t address;
+    uint64_t duration_ns;
+    uint64_t frontend_ns;
+    // As built by the frontend, and as handed to the backend.
+    HIRSize initial_size;
+    HIRSize final_size;
+    uint64_t peak_bytes;
+  };
+
+  static bool is_enabled();
+  static void set_enabled(bool enabled);
+
+  static HIRSize MeasureHIR(hir::HIRBuilder* builder);
+
+  static void BeginFunction();
+  static void RecordStage(const StageSample& sample);
+  // Failed translations are dropped.
+  static void EndFunction(uint32_t address, bool succeeded);
+
+  // In the order the stages first ran, the frontend first.
+  static std::vector<StageTotals> stage_totals();
+  static std::vector<FunctionSample> function_samples();
+  static void Reset();
+
+  // Writes <path>.txt, the stage totals and counters and the slowest
+  // functions, and <path>.csv, one line per function.
+  static bool WriteReport(const std::filesystem::path& path);
+};
+
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_COMPILER_COMPILE_PROFILER_H_
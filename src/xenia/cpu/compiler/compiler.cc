@@ -1,19 +1,36 @@
 #include "xenia/cpu/compiler/compiler.h"
 
+#include <chrono>
+
 #include "xenia/base/profiling.h"
+#include "xenia/cpu/compiler/compile_profiler.h"
 #include "xenia/cpu/compiler/compiler_pass.h"
 
 namespace xe {
 namespace cpu {
 namespace compiler {
 
+static thread_local CompileTier thread_tier_ = CompileTier::kOptimized;
+static thread_local GuestFunction* thread_function_ = nullptr;
+
 Compiler::Compiler(Processor* processor) : processor_(processor) {}
 
 Compiler::~Compiler() { Reset(); }
 
-void Compiler::AddPass(std::unique_ptr<CompilerPass> pass) {
+void Compiler::AddPass(std::unique_ptr<CompilerPass> pass,
+                       CompileTier min_tier) {
   pass->Initialize(this);
-  passes_.push_back(std::move(pass));
+  passes_.push_back({std::move(pass), min_tier});
+}
+
+CompileTier Compiler::thread_tier() { return thread_tier_; }
+
+void Compiler::set_thread_tier(CompileTier tier) { thread_tier_ = tier; }
+
+GuestFunction* Compiler::thread_function() { return thread_function_; }
+
+void Compiler::set_thread_function(GuestFunction* function) {
+  thread_function_ = function;
 }
 
 void Compiler::Reset() {}
@@ -21,12 +38,34 @@ void Compiler::Reset() {}
 bool Compiler::Compile(xe::cpu::hir::HIRBuilder* builder) {
   // TODO(benvanik): sophisticated stuff. Run passes in parallel, run until they
   //                 stop changing things, etc.
+  CompileTier tier = thread_tier_;
+  bool profiling = CompileProfiler::is_enabled();
   for (size_t i = 0; i < passes_.size(); ++i) {
-    auto& pass = passes_[i];
+    auto& entry = passes_[i];
+    if (entry.min_tier > tier) {
+      continue;
+    }
     scratch_arena_.Reset();
-    if (!pass->Run(builder)) {
+    if (!profiling) {
+      if (!entry.pass->Run(builder)) {
+        return false;
+      }
+      continue;
+    }
+    CompileProfiler::StageSample sample;
+    sample.name = entry.pass->name();
+    sample.before = CompileProfiler::MeasureHIR(builder);
+    auto start_time = std::chrono::steady_clock::now();
+    if (!entry.pass->Run(builder)) {
       return false;
     }
+    sample.duration_ns =
+        uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                     std::chrono::steady_clock::now() - start_time)
+                     .count());
+    sample.after = CompileProfiler::MeasureHIR(builder);
+    entry.pass->GetCounters(&sample.counters);
+    CompileProfiler::RecordStage(sample);
   }
 
   return true;
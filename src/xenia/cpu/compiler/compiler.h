@@ -6,6 +6,7 @@
 #include <vector>
 
 #include "xenia/base/arena.h"
+#include "xenia/cpu/function.h"
 #include "xenia/cpu/hir/hir_builder.h"
 
 namespace xe {
@@ -28,17 +29,36 @@ class Compiler {
   Processor* processor() const { return processor_; }
   Arena* scratch_arena() { return &scratch_arena_; }
 
-  void AddPass(std::unique_ptr<CompilerPass> pass);
+  // Adds a pass that runs for functions compiled at min_tier or above.
+  // Passes required to produce valid code (register allocation,
+  // finalization) must use kBaseline.
+  void AddPass(std::unique_ptr<CompilerPass> pass,
+               CompileTier min_tier = CompileTier::kBaseline);
 
   void Reset();
 
   bool Compile(hir::HIRBuilder* builder);
 
+  // Tier compiles on the calling thread run at. The frontend doesn't know
+  // about tiers, so the processor sets this around each translation.
+  static CompileTier thread_tier();
+  static void set_thread_tier(CompileTier tier);
+  // Function being translated on the calling thread, for passes relating it
+  // to other functions. The processor sets it around its translations unless
+  // debug info is wanted; null otherwise.
+  static GuestFunction* thread_function();
+  static void set_thread_function(GuestFunction* function);
+
  private:
+  struct PassEntry {
+    std::unique_ptr<CompilerPass> pass;
+    CompileTier min_tier;
+  };
+
   Processor* processor_;
   Arena scratch_arena_;
 
-  std::vector<std::unique_ptr<CompilerPass>> passes_;
+  std::vector<PassEntry> passes_;
 };
 
 }  // namespace compiler
@@ -2,7 +2,10 @@
 #ifndef XENIA_CPU_COMPILER_COMPILER_PASS_H_
 #define XENIA_CPU_COMPILER_COMPILER_PASS_H_
 
+#include <vector>
+
 #include "xenia/base/arena.h"
+#include "xenia/cpu/compiler/compile_profiler.h"
 #include "xenia/cpu/hir/hir_builder.h"
 
 namespace xe {
@@ -24,8 +27,15 @@ class CompilerPass {
 
   virtual bool Initialize(Compiler* compiler);
 
+  // Identifies the pass in compile profiles.
+  virtual const char* name() const = 0;
+
   virtual bool Run(hir::HIRBuilder* builder) = 0;
 
+  // Appends what the last Run did, for compile profiles.
+  virtual void GetCounters(
+      std::vector<CompileProfiler::Counter>* counters) const {}
+
  protected:
   Arena* scratch_arena() const;
 
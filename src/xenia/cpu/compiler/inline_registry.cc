@@ -0,0 +1,192 @@
+#include "xenia/cpu/compiler/inline_registry.h"
+
+#include <algorithm>
+
+#include "xenia/cpu/cpu_flags.h"
+#include "xenia/cpu/ppc/ppc_context.h"
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+
+// TODO(benvanik): remove when enums redefined.
+using namespace xe::cpu::hir;
+
+using xe::cpu::hir::Block;
+using xe::cpu::hir::HIRBuilder;
+using xe::cpu::hir::Value;
+
+// Whether the instruction means the same thing copied into another function.
+// Traps and debug breaks are reported at the guest address of the code they
+// are in, and locals belong to the function.
+static bool IsCopyable(const hir::Instr* i) {
+  if (i->opcode == &OPCODE_TRAP_info || i->opcode == &OPCODE_TRAP_TRUE_info ||
+      i->opcode == &OPCODE_DEBUG_BREAK_info ||
+      i->opcode == &OPCODE_DEBUG_BREAK_TRUE_info ||
+      i->opcode == &OPCODE_LOAD_LOCAL_info ||
+      i->opcode == &OPCODE_STORE_LOCAL_info ||
+      i->opcode == &OPCODE_SET_RETURN_ADDRESS_info) {
+    return false;
+  }
+  uint32_t signature = i->opcode->signature;
+  for (auto type : {GET_OPCODE_SIG_TYPE_SRC1(signature),
+                    GET_OPCODE_SIG_TYPE_SRC2(signature),
+                    GET_OPCODE_SIG_TYPE_SRC3(signature)}) {
+    if (type == OPCODE_SIG_TYPE_L || type == OPCODE_SIG_TYPE_S) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// A plain return, or a jump to LR the backend turns into one when LR is
+// still the return address (a blr).
+static bool IsReturn(const hir::Instr* i) {
+  if (i->opcode == &OPCODE_RETURN_info) {
+    return true;
+  }
+  if (i->opcode != &OPCODE_CALL_INDIRECT_info ||
+      (i->flags & (CALL_TAIL | CALL_POSSIBLE_RETURN)) !=
+          (CALL_TAIL | CALL_POSSIBLE_RETURN)) {
+    return false;
+  }
+  auto def = i->src1.value->def;
+  return def && def->opcode == &OPCODE_LOAD_CONTEXT_info &&
+         def->src1.offset == offsetof(ppc::PPCContext, lr);
+}
+
+InlineRegistry::InlineRegistry() = default;
+
+InlineRegistry::~InlineRegistry() = default;
+
+uint32_t InlineRegistry::max_body_size() {
+  return uint32_t(std::max(0, cvars::jit_inline_leaf_size));
+}
+
+bool InlineRegistry::Capture(uint32_t address, HIRBuilder* builder) {
+  uint32_t max_size = max_body_size();
+  if (!max_size) {
+    return false;
+  }
+  Block* body_block = nullptr;
+  for (auto block = builder->first_block(); block; block = block->next) {
+    for (auto i = block->instr_head; i; i = i->next) {
+      if (i->opcode->flags & OPCODE_FLAG_IGNORE) {
+        continue;
+      }
+      if (body_block) {
+        return false;
+      }
+      body_block = block;
+      break;
+    }
+  }
+  if (!body_block) {
+    return false;
+  }
+
+  auto body = std::make_shared<Body>();
+  body->address = address;
+  std::unordered_map<const Value*, uint32_t> value_indices;
+  const hir::Instr* last = nullptr;
+  for (auto i = body_block->instr_head; i; i = i->next) {
+    if (i->opcode->flags & OPCODE_FLAG_IGNORE) {
+      continue;
+    }
+    if (body->instrs.size() == max_size ||
+        (last && (last->opcode->flags & OPCODE_FLAG_BRANCH)) ||
+        !IsCopyable(i)) {
+      return false;
+    }
+    if (i->opcode == &OPCODE_STORE_CONTEXT_info &&
+        i->src1.offset == offsetof(ppc::PPCContext, lr)) {
+      // Would have to be restored for the caller's code after the call.
+      return false;
+    }
+    Instr record = {};
+    record.opcode = i->opcode;
+    record.flags = i->flags;
+    uint32_t signature = i->opcode->signature;
+    const hir::Instr::Op* ops[3] = {&i->src1, &i->src2, &i->src3};
+    OpcodeSignatureType types[3] = {GET_OPCODE_SIG_TYPE_SRC1(signature),
+                                    GET_OPCODE_SIG_TYPE_SRC2(signature),
+                                    GET_OPCODE_SIG_TYPE_SRC3(signature)};
+    for (size_t n = 0; n < 3; ++n) {
+      auto& operand = record.src[n];
+      if (types[n] == OPCODE_SIG_TYPE_O) {
+        operand.kind = Operand::kOffset;
+        operand.offset = ops[n]->offset;
+      } else if (types[n] == OPCODE_SIG_TYPE_V) {
+        auto value = ops[n]->value;
+        if (value->IsConstant()) {
+          operand.kind = Operand::kConstant;
+          operand.type = value->type;
+          operand.constant = value->constant;
+        } else {
+          auto it = value_indices.find(value);
+          if (it == value_indices.end()) {
+            return false;
+          }
+          operand.kind = Operand::kValue;
+          operand.value_index = it->second;
+        }
+      }
+    }
+    if (i->dest) {
+      record.has_dest = true;
+      record.dest_type = i->dest->type;
+      value_indices[i->dest] = uint32_t(body->instrs.size());
+    }
+    body->instrs.push_back(record);
+    last = i;
+  }
+  if (!IsReturn(last)) {
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto& entry = entries_[address];
+  if (!entry.body) {
+    ++captured_count_;
+  }
+  entry.body = std::move(body);
+  return true;
+}
+
+std::shared_ptr<const InlineRegistry::Body> InlineRegistry::Acquire(
+    uint32_t address, uint32_t caller_address) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = entries_.find(address);
+  if (it == entries_.end()) {
+    return nullptr;
+  }
+  auto& callers = it->second.callers;
+  if (std::find(callers.begin(), callers.end(), caller_address) ==
+      callers.end()) {
+    callers.push_back(caller_address);
+  }
+  return it->second.body;
+}
+
+std::vector<uint32_t> InlineRegistry::Remove(uint32_t address) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = entries_.find(address);
+  if (it == entries_.end()) {
+    return {};
+  }
+  auto callers = std::move(it->second.callers);
+  entries_.erase(it);
+  return callers;
+}
+
+InlineRegistry::Stats InlineRegistry::stats() const {
+  Stats stats;
+  stats.captured_count = captured_count_;
+  stats.inlined_call_count = inlined_call_count_;
+  stats.expanded_save_rest_count = expanded_save_rest_count_;
+  return stats;
+}
+
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
@@ -0,0 +1,96 @@
+#ifndef XENIA_CPU_COMPILER_INLINE_REGISTRY_H_
+#define XENIA_CPU_COMPILER_INLINE_REGISTRY_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "xenia/cpu/hir/hir_builder.h"
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+
+// Guest functions other functions may inline, per processor.
+//
+// LeafCapturePass records the optimized HIR of small leaf functions (one
+// block, no calls or branches) as they are translated, and LeafInliningPass
+// copies it over calls to them in functions translated afterwards. Callers
+// are remembered so the processor can throw their code away together with
+// the callee's when the callee is overwritten. Also counts the calls the
+// inlining passes got rid of, for the report at shutdown.
+class InlineRegistry {
+ public:
+  struct Operand {
+    enum Kind : uint8_t {
+      kNone,
+      // Result of an earlier instruction in the body.
+      kValue,
+      kConstant,
+      kOffset,
+    };
+    Kind kind;
+    hir::TypeName type;
+    uint32_t value_index;
+    uint64_t offset;
+    hir::Value::ConstantValue constant;
+  };
+  struct Instr {
+    const hir::OpcodeInfo* opcode;
+    uint16_t flags;
+    bool has_dest;
+    hir::TypeName dest_type;
+    Operand src[3];
+  };
+  // Instructions in order, the one returning last.
+  struct Body {
+    uint32_t address;
+    std::vector<Instr> instrs;
+  };
+  struct Stats {
+    uint64_t captured_count;
+    uint64_t inlined_call_count;
+    uint64_t expanded_save_rest_count;
+  };
+
+  InlineRegistry();
+  ~InlineRegistry();
+
+  // Largest body, in instructions, worth inlining (--jit_inline_leaf_size).
+  static uint32_t max_body_size();
+
+  // Records the function if it is a leaf small enough to inline.
+  bool Capture(uint32_t address, hir::HIRBuilder* builder);
+  // Body of the function at address, noting that caller_address inlines it.
+  std::shared_ptr<const Body> Acquire(uint32_t address,
+                                      uint32_t caller_address);
+  // Forgets the function at address. Returns the functions that inlined it.
+  std::vector<uint32_t> Remove(uint32_t address);
+
+  void RecordInlinedCalls(uint32_t count) { inlined_call_count_ += count; }
+  void RecordExpandedSaveRest(uint32_t count) {
+    expanded_save_rest_count_ += count;
+  }
+  Stats stats() const;
+
+ private:
+  struct Entry {
+    std::shared_ptr<const Body> body;
+    std::vector<uint32_t> callers;
+  };
+
+  std::mutex mutex_;
+  std::unordered_map<uint32_t, Entry> entries_;
+  std::atomic<uint64_t> captured_count_ = {0};
+  std::atomic<uint64_t> inlined_call_count_ = {0};
+  std::atomic<uint64_t> expanded_save_rest_count_ = {0};
+};
+
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_COMPILER_INLINE_REGISTRY_H_
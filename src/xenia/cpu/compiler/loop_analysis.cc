@@ -0,0 +1,237 @@
+#include "xenia/cpu/compiler/loop_analysis.h"
+
+#include <algorithm>
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+
+// TODO(benvanik): remove when enums redefined.
+using namespace xe::cpu::hir;
+
+using xe::cpu::hir::Block;
+using xe::cpu::hir::HIRBuilder;
+using xe::cpu::hir::Instr;
+
+static bool IsUnconditionalJump(const Instr* i) {
+  if (i->opcode == &OPCODE_CALL_info ||
+      i->opcode == &OPCODE_CALL_INDIRECT_info) {
+    return (i->flags & CALL_TAIL) != 0;
+  }
+  return i->opcode == &OPCODE_BRANCH_info || i->opcode == &OPCODE_RETURN_info;
+}
+
+void LoopAnalysis::Analyze(HIRBuilder* builder) {
+  blocks_.clear();
+  for (auto block = builder->first_block(); block; block = block->next) {
+    block->ordinal = uint16_t(blocks_.size());
+    blocks_.push_back(block);
+  }
+  size_t block_count = blocks_.size();
+  successors_.assign(block_count, {});
+  predecessors_.assign(block_count, {});
+  for (auto block : blocks_) {
+    auto& successors = successors_[block->ordinal];
+    for (auto i = block->instr_head; i; i = i->next) {
+      Label* label = nullptr;
+      if (i->opcode == &OPCODE_BRANCH_info) {
+        label = i->src1.label;
+      } else if (i->opcode == &OPCODE_BRANCH_TRUE_info ||
+                 i->opcode == &OPCODE_BRANCH_FALSE_info) {
+        label = i->src2.label;
+      }
+      if (label && label->block) {
+        successors.push_back(label->block->ordinal);
+      }
+    }
+    if (block->next &&
+        !(block->instr_tail && IsUnconditionalJump(block->instr_tail))) {
+      successors.push_back(block->next->ordinal);
+    }
+    std::sort(successors.begin(), successors.end());
+    successors.erase(std::unique(successors.begin(), successors.end()),
+                     successors.end());
+    for (auto successor : successors) {
+      predecessors_[successor].push_back(block->ordinal);
+    }
+  }
+
+  ComputeDominators();
+  FindLoops();
+}
+
+void LoopAnalysis::ComputeDominators() {
+  size_t block_count = blocks_.size();
+  reverse_postorder_.clear();
+  rpo_numbers_.assign(block_count, UINT32_MAX);
+  idoms_.assign(block_count, -1);
+  dominated_.assign(block_count, {});
+  if (!block_count) {
+    return;
+  }
+
+  std::vector<uint8_t> visited(block_count, 0);
+  std::vector<std::pair<uint16_t, size_t>> stack;
+  stack.push_back({0, 0});
+  visited[0] = 1;
+  while (!stack.empty()) {
+    auto& top = stack.back();
+    auto& successors = successors_[top.first];
+    if (top.second < successors.size()) {
+      uint16_t successor = successors[top.second++];
+      if (!visited[successor]) {
+        visited[successor] = 1;
+        stack.push_back({successor, 0});
+      }
+    } else {
+      reverse_postorder_.push_back(top.first);
+      stack.pop_back();
+    }
+  }
+  std::reverse(reverse_postorder_.begin(), reverse_postorder_.end());
+  for (size_t n = 0; n < reverse_postorder_.size(); ++n) {
+    rpo_numbers_[reverse_postorder_[n]] = uint32_t(n);
+  }
+
+  // Cooper, Harvey and Kennedy, "A Simple, Fast Dominance Algorithm".
+  idoms_[0] = 0;
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (size_t n = 1; n < reverse_postorder_.size(); ++n) {
+      uint16_t block = reverse_postorder_[n];
+      int32_t new_idom = -1;
+      for (auto predecessor : predecessors_[block]) {
+        if (idoms_[predecessor] == -1) {
+          continue;
+        }
+        if (new_idom == -1) {
+          new_idom = predecessor;
+          continue;
+        }
+        int32_t a = predecessor;
+        int32_t b = new_idom;
+        while (a != b) {
+          while (rpo_numbers_[a] > rpo_numbers_[b]) {
+            a = idoms_[a];
+          }
+          while (rpo_numbers_[b] > rpo_numbers_[a]) {
+            b = idoms_[b];
+          }
+        }
+        new_idom = a;
+      }
+      if (idoms_[block] != new_idom) {
+        idoms_[block] = new_idom;
+        changed = true;
+      }
+    }
+  }
+
+  for (size_t n = 1; n < reverse_postorder_.size(); ++n) {
+    uint16_t block = reverse_postorder_[n];
+    dominated_[idoms_[block]].push_back(block);
+  }
+}
+
+bool LoopAnalysis::Dominates(uint16_t a, uint16_t b) const {
+  if (idoms_[a] == -1 || idoms_[b] == -1) {
+    return false;
+  }
+  // Dominators have lower reverse postorder numbers than what they dominate.
+  int32_t block = b;
+  while (rpo_numbers_[block] > rpo_numbers_[a]) {
+    block = idoms_[block];
+  }
+  return block == a;
+}
+
+void LoopAnalysis::FindLoops() {
+  size_t block_count = blocks_.size();
+  loops_.clear();
+  loop_of_.assign(block_count, -1);
+
+  // A back edge goes to a block dominating its source. Each header gets one
+  // loop, holding everything that reaches any of its latches without going
+  // through the header.
+  std::vector<uint8_t> in_loop(block_count, 0);
+  std::vector<uint16_t> worklist;
+  for (auto header : reverse_postorder_) {
+    Loop loop;
+    for (auto predecessor : predecessors_[header]) {
+      if (Dominates(header, predecessor)) {
+        loop.latches.push_back(predecessor);
+      }
+    }
+    if (loop.latches.empty()) {
+      continue;
+    }
+    loop.header = blocks_[header];
+    loop.parent = -1;
+    loop.depth = 1;
+    std::fill(in_loop.begin(), in_loop.end(), uint8_t(0));
+    in_loop[header] = 1;
+    worklist = loop.latches;
+    while (!worklist.empty()) {
+      uint16_t block = worklist.back();
+      worklist.pop_back();
+      if (in_loop[block] || idoms_[block] == -1) {
+        continue;
+      }
+      in_loop[block] = 1;
+      worklist.insert(worklist.end(), predecessors_[block].begin(),
+                      predecessors_[block].end());
+    }
+    for (auto block : reverse_postorder_) {
+      if (in_loop[block]) {
+        loop.blocks.push_back(block);
+      }
+    }
+    loops_.push_back(std::move(loop));
+  }
+
+  // Nested loops are strictly smaller than the loops around them.
+  std::stable_sort(loops_.begin(), loops_.end(),
+                   [](const Loop& a, const Loop& b) {
+                     return a.blocks.size() < b.blocks.size();
+                   });
+  for (int32_t n = 0; n < int32_t(loops_.size()); ++n) {
+    for (auto block : loops_[n].blocks) {
+      if (loop_of_[block] == -1) {
+        loop_of_[block] = n;
+      }
+    }
+  }
+  for (int32_t n = 0; n < int32_t(loops_.size()); ++n) {
+    auto& loop = loops_[n];
+    for (int32_t m = n + 1; m < int32_t(loops_.size()); ++m) {
+      auto& blocks = loops_[m].blocks;
+      if (std::find(blocks.begin(), blocks.end(), loop.header->ordinal) !=
+          blocks.end()) {
+        loop.parent = m;
+        break;
+      }
+    }
+  }
+  // Parents come later in the list, so walk it backwards.
+  for (int32_t n = int32_t(loops_.size()) - 1; n >= 0; --n) {
+    auto& loop = loops_[n];
+    if (loop.parent != -1) {
+      loop.depth = loops_[loop.parent].depth + 1;
+    }
+  }
+}
+
+bool LoopAnalysis::IsInLoop(uint16_t ordinal, int32_t loop_index) const {
+  for (int32_t loop = loop_of_[ordinal]; loop != -1;
+       loop = loops_[loop].parent) {
+    if (loop == loop_index) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
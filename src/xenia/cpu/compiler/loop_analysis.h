@@ -0,0 +1,86 @@
+#ifndef XENIA_CPU_COMPILER_LOOP_ANALYSIS_H_
+#define XENIA_CPU_COMPILER_LOOP_ANALYSIS_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "xenia/cpu/hir/hir_builder.h"
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+
+// Block graph, dominator tree and natural loops of a function, for passes.
+//
+// Analyze() numbers the blocks in list order and everything is indexed by
+// block ordinal. Edges include the fall-through ones ControlFlowAnalysisPass
+// leaves implicit. Blocks unreachable from the entry have no dominator and
+// belong to no loop. Any change to the blocks or branches invalidates the
+// results.
+class LoopAnalysis {
+ public:
+  struct Loop {
+    hir::Block* header;
+    // Index of the innermost loop containing this one, or -1.
+    int32_t parent;
+    // 1 for outermost loops.
+    uint32_t depth;
+    // Ordinals of the blocks in the loop, header first, then in reverse
+    // postorder.
+    std::vector<uint16_t> blocks;
+    // Sources of the back edges to the header.
+    std::vector<uint16_t> latches;
+  };
+
+  void Analyze(hir::HIRBuilder* builder);
+
+  size_t block_count() const { return blocks_.size(); }
+  hir::Block* block(uint16_t ordinal) const { return blocks_[ordinal]; }
+  const std::vector<uint16_t>& successors(uint16_t ordinal) const {
+    return successors_[ordinal];
+  }
+  const std::vector<uint16_t>& predecessors(uint16_t ordinal) const {
+    return predecessors_[ordinal];
+  }
+  // Reachable blocks only, the entry first.
+  const std::vector<uint16_t>& reverse_postorder() const {
+    return reverse_postorder_;
+  }
+
+  bool is_reachable(uint16_t ordinal) const { return idoms_[ordinal] != -1; }
+  // The entry block is its own immediate dominator.
+  int32_t immediate_dominator(uint16_t ordinal) const {
+    return idoms_[ordinal];
+  }
+  // Children in the dominator tree.
+  const std::vector<uint16_t>& dominated(uint16_t ordinal) const {
+    return dominated_[ordinal];
+  }
+  bool Dominates(uint16_t a, uint16_t b) const;
+
+  // Innermost loops first.
+  const std::vector<Loop>& loops() const { return loops_; }
+  // Index of the innermost loop containing the block, or -1.
+  int32_t loop_of(uint16_t ordinal) const { return loop_of_[ordinal]; }
+  bool IsInLoop(uint16_t ordinal, int32_t loop_index) const;
+
+ private:
+  void ComputeDominators();
+  void FindLoops();
+
+  std::vector<hir::Block*> blocks_;
+  std::vector<std::vector<uint16_t>> successors_;
+  std::vector<std::vector<uint16_t>> predecessors_;
+  std::vector<uint16_t> reverse_postorder_;
+  std::vector<uint32_t> rpo_numbers_;
+  std::vector<int32_t> idoms_;
+  std::vector<std::vector<uint16_t>> dominated_;
+  std::vector<Loop> loops_;
+  std::vector<int32_t> loop_of_;
+};
+
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_COMPILER_LOOP_ANALYSIS_H_
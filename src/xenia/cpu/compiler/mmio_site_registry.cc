@@ -0,0 +1,36 @@
+#include "xenia/cpu/compiler/mmio_site_registry.h"
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+
+MMIOSiteRegistry::MMIOSiteRegistry() = default;
+
+MMIOSiteRegistry::~MMIOSiteRegistry() = default;
+
+bool MMIOSiteRegistry::Record(uint32_t address, MMIORange* range) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return sites_.emplace(address, range).second;
+}
+
+MMIORange* MMIOSiteRegistry::Lookup(uint32_t address) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = sites_.find(address);
+  return it != sites_.end() ? it->second : nullptr;
+}
+
+void MMIOSiteRegistry::Remove(uint32_t address, uint32_t length) {
+  if (!length) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  uint64_t end = uint64_t(address) + length;
+  auto it = sites_.lower_bound(address);
+  while (it != sites_.end() && it->first < end) {
+    it = sites_.erase(it);
+  }
+}
+
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
@@ -0,0 +1,42 @@
+#ifndef XENIA_CPU_COMPILER_MMIO_SITE_REGISTRY_H_
+#define XENIA_CPU_COMPILER_MMIO_SITE_REGISTRY_H_
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+
+#include "xenia/cpu/mmio_handler.h"
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+
+// Guest instructions known to access MMIO ranges, per processor.
+//
+// The processor records a site the first time MMIOHandler services a fault
+// from the code generated for it, and throws that function away.
+// ConstantPropagationPass then lowers the access to LOAD_MMIO/STORE_MMIO on
+// the next translation, so the site stops faulting.
+class MMIOSiteRegistry {
+ public:
+  MMIOSiteRegistry();
+  ~MMIOSiteRegistry();
+
+  // Notes that the instruction at address accessed range. Returns false if
+  // it was already known.
+  bool Record(uint32_t address, MMIORange* range);
+  // The range the instruction at address accessed, if any.
+  MMIORange* Lookup(uint32_t address);
+  // Forgets the sites in [address, address + length).
+  void Remove(uint32_t address, uint32_t length);
+
+ private:
+  std::mutex mutex_;
+  std::map<uint32_t, MMIORange*> sites_;
+};
+
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_COMPILER_MMIO_SITE_REGISTRY_H_
@@ -20,6 +20,7 @@ class ConditionalGroupPass : public CompilerPass {
 
   bool Initialize(Compiler* compiler) override;
 
+  const char* name() const override { return "ConditionalGroup"; }
   bool Run(hir::HIRBuilder* builder) override;
 
   void AddPass(std::unique_ptr<CompilerPass> pass);
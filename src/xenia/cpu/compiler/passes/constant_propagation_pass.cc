@@ -8,6 +8,7 @@
 #include "xenia/base/assert.h"
 #include "xenia/base/cvar.h"
 #include "xenia/base/profiling.h"
+#include "xenia/cpu/compiler/compiler.h"
 #include "xenia/cpu/function.h"
 #include "xenia/cpu/processor.h"
 
@@ -62,10 +63,16 @@ bool ConstantPropagationPass::Run(HIRBuilder* builder, bool& result) {
   result = false;
   auto block = builder->first_block();
   while (block) {
+    // Guest instruction the current one was translated from.
+    uint32_t source_offset = 0;
     auto i = block->instr_head;
     while (i) {
       auto v = i->dest;
       switch (i->opcode->num) {
+        case OPCODE_SOURCE_OFFSET:
+          source_offset = uint32_t(i->src1.offset);
+          break;
+
         case OPCODE_DEBUG_BREAK_TRUE:
           if (i->src1.value->IsConstant()) {
             if (i->src1.value->IsConstantTrue()) {
@@ -206,9 +213,9 @@ bool ConstantPropagationPass::Run(HIRBuilder* builder, bool& result) {
 
         case OPCODE_LOAD:
         case OPCODE_LOAD_OFFSET:
-          if (i->src1.value->IsConstant()) {
-            assert_false(i->flags & LOAD_STORE_BYTE_SWAP);
-            auto memory = processor_->memory();
+          if (i->src1.value->IsConstant() &&
+              (i->opcode->num != OPCODE_LOAD_OFFSET ||
+               i->src2.value->IsConstant())) {
             auto address = i->src1.value->constant.i32;
             if (i->opcode->num == OPCODE_LOAD_OFFSET) {
               address += i->src2.value->constant.i32;
@@ -217,53 +224,16 @@ bool ConstantPropagationPass::Run(HIRBuilder* builder, bool& result) {
             auto mmio_range =
                 processor_->memory()->LookupVirtualMappedRange(address);
             if (cvars::inline_mmio_access && mmio_range) {
-              i->Replace(&OPCODE_LOAD_MMIO_info, 0);
+              i->Replace(&OPCODE_LOAD_MMIO_info, i->flags);
               i->src1.offset = reinterpret_cast<uint64_t>(mmio_range);
-              i->src2.offset = address;
+              i->set_src2(builder->LoadConstantUint64(uint32_t(address)));
+              result = true;
+            } else if (FoldReadOnlyLoad(builder, i, uint32_t(address))) {
+              i->Remove();
               result = true;
-            } else {
-              auto heap = memory->LookupHeap(address);
-              uint32_t protect;
-              if (heap && heap->QueryProtect(address, &protect) &&
-                  !(protect & kMemoryProtectWrite) &&
-                  (protect & kMemoryProtectRead)) {
-                // Memory is readonly - can just return the value.
-                auto host_addr = memory->TranslateVirtual(address);
-                switch (v->type) {
-                  case INT8_TYPE:
-                    v->set_constant(xe::load<uint8_t>(host_addr));
-                    i->Remove();
-                    result = true;
-                    break;
-                  case INT16_TYPE:
-                    v->set_constant(xe::load<uint16_t>(host_addr));
-                    i->Remove();
-                    result = true;
-                    break;
-                  case INT32_TYPE:
-                    v->set_constant(xe::load<uint32_t>(host_addr));
-                    i->Remove();
-                    result = true;
-                    break;
-                  case INT64_TYPE:
-                    v->set_constant(xe::load<uint64_t>(host_addr));
-                    i->Remove();
-                    result = true;
-                    break;
-                  case VEC128_TYPE:
-                    vec128_t val;
-                    val.low = xe::load<uint64_t>(host_addr);
-                    val.high = xe::load<uint64_t>(host_addr + 8);
-                    v->set_constant(val);
-                    i->Remove();
-                    result = true;
-                    break;
-                  default:
-                    assert_unhandled_case(v->type);
-                    break;
-                }
-              }
             }
+          } else if (LowerMmioSite(builder, i, source_offset)) {
+            result = true;
           }
           break;
         case OPCODE_STORE:
@@ -282,12 +252,14 @@ bool ConstantPropagationPass::Run(HIRBuilder* builder, bool& result) {
                 value = i->src3.value;
               }
 
-              i->Replace(&OPCODE_STORE_MMIO_info, 0);
+              i->Replace(&OPCODE_STORE_MMIO_info, i->flags);
               i->src1.offset = reinterpret_cast<uint64_t>(mmio_range);
-              i->src2.offset = address;
+              i->set_src2(builder->LoadConstantUint64(uint32_t(address)));
               i->set_src3(value);
               result = true;
             }
+          } else if (LowerMmioSite(builder, i, source_offset)) {
+            result = true;
           }
           break;
 
@@ -732,14 +704,81 @@ bool ConstantPropagationPass::Run(HIRBuilder* builder, bool& result) {
             result = true;
           }
           break;
-        // TODO(benvanik): INSERT/EXTRACT
-        // TODO(benvanik): PERMUTE/SWIZZLE
+        case OPCODE_INSERT:
+          if (i->src1.value->IsConstant() && i->src2.value->IsConstant() &&
+              i->src3.value->IsConstant()) {
+            v->set_from(i->src1.value);
+            v->Insert(i->src2.value, i->src3.value);
+            i->Remove();
+            result = true;
+          }
+          break;
         case OPCODE_EXTRACT:
           if (i->src1.value->IsConstant() && i->src2.value->IsConstant()) {
             v->set_zero(v->type);
             v->Extract(i->src1.value, i->src2.value);
             i->Remove();
             result = true;
+          } else if (i->src1.value->def &&
+                     i->src1.value->def->opcode == &OPCODE_SPLAT_info &&
+                     i->src1.value->def->src1.value->type == v->type) {
+            // Every element of a splat is the splatted value.
+            auto splatted = i->src1.value->def->src1.value;
+            i->Replace(&OPCODE_ASSIGN_info, 0);
+            i->set_src1(splatted);
+            result = true;
+          }
+          break;
+        case OPCODE_LOAD_VECTOR_SHL:
+          if (i->src1.value->IsConstant()) {
+            v->set_zero(VEC128_TYPE);
+            v->LoadVectorShl(i->src1.value);
+            i->Remove();
+            result = true;
+          }
+          break;
+        case OPCODE_LOAD_VECTOR_SHR:
+          if (i->src1.value->IsConstant()) {
+            v->set_zero(VEC128_TYPE);
+            v->LoadVectorShr(i->src1.value);
+            i->Remove();
+            result = true;
+          }
+          break;
+        case OPCODE_PERMUTE:
+          if (i->src1.value->IsConstant() && i->src2.value->IsConstant() &&
+              i->src3.value->IsConstant()) {
+            v->set_zero(VEC128_TYPE);
+            v->Permute(i->src1.value, i->src2.value, i->src3.value,
+                       hir::TypeName(i->flags));
+            i->Remove();
+            result = true;
+          }
+          break;
+        case OPCODE_SWIZZLE:
+          // The backend only swizzles words.
+          if (i->src1.value->IsConstant() &&
+              (i->flags == INT32_TYPE || i->flags == FLOAT32_TYPE)) {
+            v->set_from(i->src1.value);
+            v->Swizzle(uint32_t(i->src2.offset));
+            i->Remove();
+            result = true;
+          }
+          break;
+        case OPCODE_PACK:
+          if (i->src1.value->IsConstant() && i->src2.value->IsConstant()) {
+            if (v->Pack(i->src1.value, i->src2.value, i->flags)) {
+              i->Remove();
+              result = true;
+            }
+          }
+          break;
+        case OPCODE_UNPACK:
+          if (i->src1.value->IsConstant()) {
+            if (v->Unpack(i->src1.value, i->flags)) {
+              i->Remove();
+              result = true;
+            }
           }
           break;
         case OPCODE_SPLAT:
@@ -855,6 +894,35 @@ bool ConstantPropagationPass::Run(HIRBuilder* builder, bool& result) {
           }
           break;
 
+        case OPCODE_VECTOR_MAX:
+          if (i->src1.value->IsConstant() && i->src2.value->IsConstant() &&
+              (i->flags >> 8) <= INT32_TYPE) {
+            v->set_from(i->src1.value);
+            v->VectorMax(i->src2.value, hir::TypeName(i->flags >> 8),
+                         !!(i->flags & ARITHMETIC_UNSIGNED));
+            i->Remove();
+            result = true;
+          }
+          break;
+        case OPCODE_VECTOR_MIN:
+          if (i->src1.value->IsConstant() && i->src2.value->IsConstant() &&
+              (i->flags >> 8) <= INT32_TYPE) {
+            v->set_from(i->src1.value);
+            v->VectorMin(i->src2.value, hir::TypeName(i->flags >> 8),
+                         !!(i->flags & ARITHMETIC_UNSIGNED));
+            i->Remove();
+            result = true;
+          }
+          break;
+        case OPCODE_VECTOR_SHA:
+          if (i->src1.value->IsConstant() && i->src2.value->IsConstant()) {
+            v->set_from(i->src1.value);
+            v->VectorSha(i->src2.value, hir::TypeName(i->flags));
+            i->Remove();
+            result = true;
+          }
+          break;
+
         case OPCODE_DOT_PRODUCT_3:
           if (i->src1.value->IsConstant() && i->src2.value->IsConstant()) {
             v->set_from(i->src1.value);
@@ -898,6 +966,114 @@ bool ConstantPropagationPass::Run(HIRBuilder* builder, bool& result) {
   return true;
 }
 
+bool ConstantPropagationPass::FoldReadOnlyLoad(HIRBuilder* builder, Instr* i,
+                                               uint32_t address) {
+  // The function is thrown away if the data changes after all, so it has to
+  // be known.
+  auto function = Compiler::thread_function();
+  auto v = i->dest;
+  if (!function || v->type == FLOAT32_TYPE || v->type == FLOAT64_TYPE) {
+    return false;
+  }
+  uint32_t size = uint32_t(GetTypeSize(v->type));
+  // The pages have to be read-only right now as well; the loader only
+  // protects them once the image is set up.
+  auto memory = processor_->memory();
+  auto heap = memory->LookupHeap(address);
+  for (uint32_t end : {address, address + size - 1}) {
+    uint32_t protect;
+    if (!heap || !heap->QueryProtect(end, &protect) ||
+        (protect & kMemoryProtectWrite) || !(protect & kMemoryProtectRead)) {
+      return false;
+    }
+  }
+  if (!processor_->read_only_data()->Acquire(address, size,
+                                             function->address())) {
+    return false;
+  }
+
+  auto host_addr = memory->TranslateVirtual(address);
+  switch (v->type) {
+    case INT8_TYPE:
+      v->set_constant(xe::load<uint8_t>(host_addr));
+      break;
+    case INT16_TYPE:
+      v->set_constant(xe::load<uint16_t>(host_addr));
+      break;
+    case INT32_TYPE:
+      v->set_constant(xe::load<uint32_t>(host_addr));
+      break;
+    case INT64_TYPE:
+      v->set_constant(xe::load<uint64_t>(host_addr));
+      break;
+    case VEC128_TYPE: {
+      vec128_t val;
+      val.low = xe::load<uint64_t>(host_addr);
+      val.high = xe::load<uint64_t>(host_addr + 8);
+      v->set_constant(val);
+      break;
+    }
+    default:
+      assert_unhandled_case(v->type);
+      break;
+  }
+  // The combined form MemorySequenceCombinationPass leaves for a load
+  // followed by a BYTE_SWAP.
+  if (i->flags & LOAD_STORE_BYTE_SWAP) {
+    v->ByteSwap();
+  }
+  builder->set_attributes(builder->attributes() |
+                          FUNCTION_ATTRIB_READ_ONLY_DATA);
+  return true;
+}
+
+bool ConstantPropagationPass::LowerMmioSite(HIRBuilder* builder, Instr* i,
+                                            uint32_t source_offset) {
+  if (!cvars::inline_mmio_access || !source_offset) {
+    return false;
+  }
+  bool is_load = i->opcode->num == OPCODE_LOAD ||
+                 i->opcode->num == OPCODE_LOAD_OFFSET;
+  bool has_offset = i->opcode->num == OPCODE_LOAD_OFFSET ||
+                    i->opcode->num == OPCODE_STORE_OFFSET;
+  // Only dwords go through MMIO ranges.
+  Value* value = nullptr;
+  if (is_load) {
+    if (i->dest->type != INT32_TYPE) {
+      return false;
+    }
+  } else {
+    value = has_offset ? i->src3.value : i->src2.value;
+    if (value->type != INT32_TYPE) {
+      return false;
+    }
+  }
+  auto mmio_range = processor_->mmio_sites()->Lookup(source_offset);
+  if (!mmio_range) {
+    return false;
+  }
+
+  Value* address = i->src1.value;
+  if (has_offset) {
+    if (address->type != i->src2.value->type) {
+      return false;
+    }
+    auto last_instr = builder->last_instr();
+    address = builder->Add(address, i->src2.value);
+    if (builder->last_instr() != last_instr) {
+      builder->last_instr()->MoveBefore(i);
+    }
+  }
+  i->Replace(is_load ? &OPCODE_LOAD_MMIO_info : &OPCODE_STORE_MMIO_info,
+             i->flags);
+  i->src1.offset = reinterpret_cast<uint64_t>(mmio_range);
+  i->set_src2(address);
+  if (!is_load) {
+    i->set_src3(value);
+  }
+  return true;
+}
+
 }  // namespace passes
 }  // namespace compiler
 }  // namespace cpu
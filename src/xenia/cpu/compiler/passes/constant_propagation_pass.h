@@ -14,9 +14,17 @@ class ConstantPropagationPass : public ConditionalGroupSubpass {
   ConstantPropagationPass();
   ~ConstantPropagationPass() override;
 
+  const char* name() const override { return "ConstantPropagation"; }
   bool Run(hir::HIRBuilder* builder, bool& result) override;
 
  private:
+  // Turns a load from read-only data of a loaded module into its value.
+  bool FoldReadOnlyLoad(hir::HIRBuilder* builder, hir::Instr* i,
+                        uint32_t address);
+  // Turns a load or store with a computed address into LOAD_MMIO/STORE_MMIO
+  // if the guest instruction it came from faulted on an MMIO range before.
+  bool LowerMmioSite(hir::HIRBuilder* builder, hir::Instr* i,
+                     uint32_t source_offset);
 };
 
 }  // namespace passes
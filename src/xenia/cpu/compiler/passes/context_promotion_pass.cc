@@ -1,7 +1,10 @@
 
 #include "xenia/cpu/compiler/passes/context_promotion_pass.h"
 
+#include <algorithm>
+
 #include "xenia/apu/apu_flags.h"
+#include "xenia/base/assert.h"
 #include "xenia/base/cvar.h"
 #include "xenia/base/profiling.h"
 #include "xenia/cpu/compiler/compiler.h"
@@ -12,6 +15,10 @@ DECLARE_bool(debug);
 
 DEFINE_bool(store_all_context_values, false,
             "Don't strip dead context stores to aid in debugging.", "CPU");
+DEFINE_bool(global_context_promotion, true,
+            "Forward context values and strip dead context stores across "
+            "blocks instead of only within each block.",
+            "CPU");
 
 namespace xe {
 namespace cpu {
@@ -26,6 +33,46 @@ using xe::cpu::hir::HIRBuilder;
 using xe::cpu::hir::Instr;
 using xe::cpu::hir::Value;
 
+static const uint16_t kNoSlot = UINT16_MAX;
+
+// Instructions that may read or write any part of the context behind our back:
+// calls, returns, externs and everything else volatile. Branches within the
+// function are covered by the block graph instead.
+static bool IsContextBarrier(const Instr* i) {
+  if (i->opcode == &OPCODE_BRANCH_info ||
+      i->opcode == &OPCODE_BRANCH_TRUE_info ||
+      i->opcode == &OPCODE_BRANCH_FALSE_info) {
+    return false;
+  }
+  return (i->opcode->flags & (OPCODE_FLAG_VOLATILE | OPCODE_FLAG_BRANCH)) ||
+         i->opcode == &OPCODE_CONTEXT_BARRIER_info;
+}
+
+static bool IsUnconditionalJump(const Instr* i) {
+  if (i->opcode == &OPCODE_CALL_info ||
+      i->opcode == &OPCODE_CALL_INDIRECT_info) {
+    return (i->flags & CALL_TAIL) != 0;
+  }
+  return i->opcode == &OPCODE_BRANCH_info || i->opcode == &OPCODE_RETURN_info;
+}
+
+static void CountContextAccesses(HIRBuilder* builder, uint32_t* out_loads,
+                                 uint32_t* out_stores) {
+  uint32_t loads = 0;
+  uint32_t stores = 0;
+  for (auto block = builder->first_block(); block; block = block->next) {
+    for (auto i = block->instr_head; i; i = i->next) {
+      if (i->opcode == &OPCODE_LOAD_CONTEXT_info) {
+        ++loads;
+      } else if (i->opcode == &OPCODE_STORE_CONTEXT_info) {
+        ++stores;
+      }
+    }
+  }
+  *out_loads = loads;
+  *out_stores = stores;
+}
+
 ContextPromotionPass::ContextPromotionPass() : CompilerPass() {}
 
 ContextPromotionPass::~ContextPromotionPass() {}
@@ -38,6 +85,7 @@ bool ContextPromotionPass::Initialize(Compiler* compiler) {
   // This is a terrible implementation.
   context_values_.resize(sizeof(ppc::PPCContext));
   context_validity_.resize(static_cast<uint32_t>(sizeof(ppc::PPCContext)));
+  slot_indices_.resize(sizeof(ppc::PPCContext), kNoSlot);
 
   return true;
 }
@@ -57,26 +105,47 @@ bool ContextPromotionPass::Run(HIRBuilder* builder) {
   //   store_context +100, v1
   // This is more generally done by DSE, however if it could be done here
   // instead as it may be faster (at least on the block-level).
+  //
+  // Both are first done within each block and then across blocks, so values
+  // survive loop back edges and stores are only kept when some path reads
+  // them before they are overwritten.
+  CountContextAccesses(builder, &last_stats_.loads_before,
+                       &last_stats_.stores_before);
 
   // Promote loads to values.
-  // Process each block independently, for now.
   auto block = builder->first_block();
   while (block) {
     PromoteBlock(block);
     block = block->next;
   }
 
+  bool global =
+      cvars::global_context_promotion && BuildBlockInfos(builder);
+  if (global) {
+    PromoteAcrossBlocks(builder);
+  }
+
   // Remove all dead stores.
   // This will break debugging as we can't recover this information when
   // trying to extract stack traces/register values, so we don't do that.
   if (!cvars::debug && !cvars::store_all_context_values) {
-    block = builder->first_block();
-    while (block) {
-      RemoveDeadStoresBlock(block);
-      block = block->next;
+    if (global) {
+      RemoveDeadStores();
+    } else {
+      block = builder->first_block();
+      while (block) {
+        RemoveDeadStoresBlock(block);
+        block = block->next;
+      }
     }
   }
 
+  if (global) {
+    ReleaseBlockInfos();
+  }
+
+  CountContextAccesses(builder, &last_stats_.loads_after,
+                       &last_stats_.stores_after);
   return true;
 }
 
@@ -139,6 +208,362 @@ void ContextPromotionPass::RemoveDeadStoresBlock(Block* block) {
   }
 }
 
+bool ContextPromotionPass::BuildBlockInfos(HIRBuilder* builder) {
+  // Number blocks and give every accessed context offset a dense slot index
+  // so the dataflow sets stay small.
+  slot_offsets_.clear();
+  slot_types_.clear();
+  std::vector<uint16_t> mixed_type_slots;
+  size_t block_count = 0;
+  for (auto block = builder->first_block(); block; block = block->next) {
+    if (block_count >= UINT16_MAX) {
+      // Leave slot_indices_ clean for the next function.
+      ReleaseBlockInfos();
+      return false;
+    }
+    block->ordinal = static_cast<uint16_t>(block_count++);
+    for (auto i = block->instr_head; i; i = i->next) {
+      TypeName type;
+      if (i->opcode == &OPCODE_LOAD_CONTEXT_info) {
+        type = i->dest->type;
+      } else if (i->opcode == &OPCODE_STORE_CONTEXT_info) {
+        type = i->src2.value->type;
+      } else {
+        continue;
+      }
+      uint16_t& slot = slot_indices_[i->src1.offset];
+      if (slot == kNoSlot) {
+        slot = static_cast<uint16_t>(slot_offsets_.size());
+        slot_offsets_.push_back(static_cast<uint32_t>(i->src1.offset));
+        slot_types_.push_back(type);
+      } else if (slot_types_[slot] != type) {
+        mixed_type_slots.push_back(slot);
+      }
+    }
+  }
+  if (slot_offsets_.empty()) {
+    return false;
+  }
+  block_count_ = block_count;
+  uint32_t slot_count = static_cast<uint32_t>(slot_offsets_.size());
+
+  // Slots are keyed by offset alone, so anything that partially overlaps
+  // another slot or changes type can't be tracked as a single value.
+  unsafe_slots_.resize(slot_count);
+  unsafe_slots_.reset();
+  for (uint16_t slot : mixed_type_slots) {
+    unsafe_slots_.set(slot);
+  }
+  std::vector<uint16_t> sorted_slots(slot_count);
+  for (uint32_t n = 0; n < slot_count; ++n) {
+    sorted_slots[n] = static_cast<uint16_t>(n);
+  }
+  std::sort(sorted_slots.begin(), sorted_slots.end(),
+            [this](uint16_t a, uint16_t b) {
+              return slot_offsets_[a] < slot_offsets_[b];
+            });
+  uint32_t covered_end = 0;
+  uint16_t covering_slot = kNoSlot;
+  for (uint16_t slot : sorted_slots) {
+    uint32_t offset = slot_offsets_[slot];
+    uint32_t end = offset + uint32_t(GetTypeSize(slot_types_[slot]));
+    if (covering_slot != kNoSlot && offset < covered_end) {
+      unsafe_slots_.set(slot);
+      unsafe_slots_.set(covering_slot);
+    }
+    if (end > covered_end) {
+      covered_end = end;
+      covering_slot = slot;
+    }
+  }
+
+  if (block_infos_.size() < block_count) {
+    block_infos_.resize(block_count);
+  }
+  auto reset_bits = [slot_count](llvm::BitVector& bits) {
+    bits.resize(slot_count);
+    bits.reset();
+  };
+  for (size_t n = 0; n < block_count; ++n) {
+    auto& info = block_infos_[n];
+    info.successors.clear();
+    info.predecessors.clear();
+    info.exits = false;
+    info.has_barrier = false;
+    reset_bits(info.defined);
+    reset_bits(info.exposed_loads);
+    reset_bits(info.available_in);
+    reset_bits(info.available_out);
+    reset_bits(info.needed_in);
+    reset_bits(info.needed_out);
+    reset_bits(info.live_in);
+    reset_bits(info.live_out);
+  }
+
+  llvm::BitVector seen(slot_count);
+  for (auto block = builder->first_block(); block; block = block->next) {
+    auto& info = block_infos_[block->ordinal];
+    info.block = block;
+
+    // Same edges as ControlFlowAnalysisPass, plus the fall-through edge it
+    // leaves implicit.
+    auto tail = block->instr_tail;
+    for (auto i = tail; i && (i->opcode->flags & OPCODE_FLAG_BRANCH);
+         i = i->prev) {
+      if (i->opcode == &OPCODE_BRANCH_info) {
+        info.successors.push_back(i->src1.label->block->ordinal);
+      } else if (i->opcode == &OPCODE_BRANCH_TRUE_info ||
+                 i->opcode == &OPCODE_BRANCH_FALSE_info) {
+        info.successors.push_back(i->src2.label->block->ordinal);
+      }
+    }
+    if (!tail || !IsUnconditionalJump(tail)) {
+      if (block->next) {
+        info.successors.push_back(block->next->ordinal);
+      } else {
+        info.exits = true;
+      }
+    }
+    for (uint16_t successor : info.successors) {
+      block_infos_[successor].predecessors.push_back(block->ordinal);
+    }
+
+    seen.reset();
+    for (auto i = block->instr_head; i; i = i->next) {
+      if (IsContextBarrier(i)) {
+        info.has_barrier = true;
+        info.defined.reset();
+      } else if (i->opcode == &OPCODE_LOAD_CONTEXT_info ||
+                 i->opcode == &OPCODE_STORE_CONTEXT_info) {
+        uint16_t slot = slot_indices_[i->src1.offset];
+        if (!info.has_barrier && !seen.test(slot) &&
+            i->opcode == &OPCODE_LOAD_CONTEXT_info) {
+          info.exposed_loads.set(slot);
+        }
+        seen.set(slot);
+        info.defined.set(slot);
+      }
+    }
+  }
+  return true;
+}
+
+void ContextPromotionPass::ReleaseBlockInfos() {
+  for (uint32_t offset : slot_offsets_) {
+    slot_indices_[offset] = kNoSlot;
+  }
+  slot_offsets_.clear();
+  slot_types_.clear();
+}
+
+void ContextPromotionPass::PromoteAcrossBlocks(HIRBuilder* builder) {
+  uint32_t slot_count = static_cast<uint32_t>(slot_offsets_.size());
+
+  // Forward dataflow: a slot is available on entry to a block if every
+  // predecessor defines it after its last barrier or passes it through.
+  for (size_t n = 0; n < block_count_; ++n) {
+    block_infos_[n].available_out.set();
+  }
+  llvm::BitVector scratch(slot_count);
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (size_t n = 0; n < block_count_; ++n) {
+      auto& info = block_infos_[n];
+      if (!n || info.predecessors.empty()) {
+        info.available_in.reset();
+      } else {
+        info.available_in = block_infos_[info.predecessors[0]].available_out;
+        for (size_t p = 1; p < info.predecessors.size(); ++p) {
+          info.available_in &= block_infos_[info.predecessors[p]].available_out;
+        }
+      }
+      scratch = info.defined;
+      if (!info.has_barrier) {
+        scratch |= info.available_in;
+      }
+      if (scratch != info.available_out) {
+        info.available_out = scratch;
+        changed = true;
+      }
+    }
+  }
+
+  // Loads that can take their value from predecessors. Reuse exposed_loads
+  // to hold them from here on.
+  bool any_promoted = false;
+  for (size_t n = 0; n < block_count_; ++n) {
+    auto& info = block_infos_[n];
+    info.exposed_loads &= info.available_in;
+    info.exposed_loads.reset(unsafe_slots_);
+    any_promoted |= info.exposed_loads.any();
+  }
+  if (!any_promoted) {
+    return;
+  }
+
+  // Backward dataflow: which blocks have to leave their final value of a
+  // slot in its local for a promoted load further down.
+  changed = true;
+  while (changed) {
+    changed = false;
+    for (size_t n = block_count_; n-- > 0;) {
+      auto& info = block_infos_[n];
+      info.needed_out.reset();
+      for (uint16_t successor : info.successors) {
+        info.needed_out |= block_infos_[successor].needed_in;
+      }
+      scratch = info.exposed_loads;
+      if (!info.has_barrier) {
+        llvm::BitVector passed_through = info.needed_out;
+        passed_through.reset(info.defined);
+        scratch |= passed_through;
+      }
+      if (scratch != info.needed_in) {
+        info.needed_in = scratch;
+        changed = true;
+      }
+    }
+  }
+
+  // The local acts as the phi for the slot: every block that defines the
+  // slot on a path to a promoted load writes its final value into it, and
+  // the load reads it back.
+  std::vector<Value*> slot_locals(slot_count, nullptr);
+  auto get_slot_local = [&](uint16_t slot) {
+    if (!slot_locals[slot]) {
+      slot_locals[slot] = builder->AllocLocal(slot_types_[slot]);
+    }
+    return slot_locals[slot];
+  };
+  std::vector<Value*> last_values(slot_count, nullptr);
+  for (size_t n = 0; n < block_count_; ++n) {
+    auto& info = block_infos_[n];
+    auto block = info.block;
+
+    // Final value of each slot the block has to hand on. Gathered before
+    // loads are rewritten so those still count as definitions.
+    scratch = info.needed_out;
+    scratch &= info.defined;
+    if (scratch.any()) {
+      for (auto i = block->instr_head; i; i = i->next) {
+        if (i->opcode == &OPCODE_LOAD_CONTEXT_info) {
+          last_values[slot_indices_[i->src1.offset]] = i->dest;
+        } else if (i->opcode == &OPCODE_STORE_CONTEXT_info) {
+          last_values[slot_indices_[i->src1.offset]] = i->src2.value;
+        }
+      }
+    }
+
+    if (info.exposed_loads.any()) {
+      for (auto i = block->instr_head; i && !IsContextBarrier(i);
+           i = i->next) {
+        if (i->opcode != &OPCODE_LOAD_CONTEXT_info) {
+          continue;
+        }
+        uint16_t slot = slot_indices_[i->src1.offset];
+        if (info.exposed_loads.test(slot)) {
+          i->opcode = &OPCODE_LOAD_LOCAL_info;
+          i->set_src1(get_slot_local(slot));
+          info.exposed_loads.reset(slot);
+        }
+      }
+    }
+
+    if (scratch.none()) {
+      continue;
+    }
+    // Before the branches ending the block, if any.
+    auto insert_before = block->instr_tail;
+    while (insert_before && insert_before->prev &&
+           (insert_before->prev->opcode->flags & OPCODE_FLAG_BRANCH)) {
+      insert_before = insert_before->prev;
+    }
+    if (insert_before && !(insert_before->opcode->flags & OPCODE_FLAG_BRANCH)) {
+      insert_before = nullptr;
+    }
+    for (int slot = scratch.find_first(); slot != -1;
+         slot = scratch.find_next(slot)) {
+      Value* value = last_values[slot];
+      assert_not_null(value);
+      auto def = value->def;
+      if (def && def->opcode == &OPCODE_LOAD_LOCAL_info &&
+          def->src1.value == slot_locals[slot]) {
+        // Promoted load that is still in the local.
+        continue;
+      }
+      builder->StoreLocal(get_slot_local(uint16_t(slot)), value);
+      auto store = builder->last_instr();
+      if (insert_before) {
+        store->MoveBefore(insert_before);
+      } else {
+        // Falls through: append by moving in front of the tail and swapping.
+        store->MoveBefore(block->instr_tail);
+        block->instr_tail->MoveBefore(store);
+      }
+    }
+  }
+}
+
+void ContextPromotionPass::RemoveDeadStores() {
+  // Backward dataflow: a slot is live if some path reads it (or reaches a
+  // barrier or the end of the function) before it is stored again.
+  uint32_t slot_count = static_cast<uint32_t>(slot_offsets_.size());
+  llvm::BitVector live(slot_count);
+  auto transfer = [&](BlockInfo& info, bool remove) {
+    live = info.live_out;
+    for (auto i = info.block->instr_tail; i;) {
+      auto prev = i->prev;
+      if (IsContextBarrier(i)) {
+        live.set();
+      } else if (i->opcode == &OPCODE_LOAD_CONTEXT_info) {
+        live.set(slot_indices_[i->src1.offset]);
+      } else if (i->opcode == &OPCODE_STORE_CONTEXT_info) {
+        uint16_t slot = slot_indices_[i->src1.offset];
+        if (remove && !live.test(slot) && !unsafe_slots_.test(slot)) {
+          i->Remove();
+        } else {
+          live.reset(slot);
+        }
+      }
+      i = prev;
+    }
+  };
+
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (size_t n = block_count_; n-- > 0;) {
+      auto& info = block_infos_[n];
+      if (info.exits) {
+        info.live_out.set();
+      } else {
+        info.live_out.reset();
+        for (uint16_t successor : info.successors) {
+          info.live_out |= block_infos_[successor].live_in;
+        }
+      }
+      transfer(info, false);
+      if (live != info.live_in) {
+        info.live_in = live;
+        changed = true;
+      }
+    }
+  }
+
+  for (size_t n = 0; n < block_count_; ++n) {
+    transfer(block_infos_[n], true);
+  }
+}
+
+void ContextPromotionPass::GetCounters(
+    std::vector<CompileProfiler::Counter>* counters) const {
+  counters->push_back({"context_loads_before", last_stats_.loads_before});
+  counters->push_back({"context_stores_before", last_stats_.stores_before});
+  counters->push_back({"context_loads_after", last_stats_.loads_after});
+  counters->push_back({"context_stores_after", last_stats_.stores_after});
+}
+
 }  // namespace passes
 }  // namespace compiler
 }  // namespace cpu
@@ -1,4 +1,3 @@
-
 #ifndef XENIA_CPU_COMPILER_PASSES_CONTEXT_PROMOTION_PASS_H_
 #define XENIA_CPU_COMPILER_PASSES_CONTEXT_PROMOTION_PASS_H_
 
@@ -25,20 +24,76 @@ namespace passes {
 
 class ContextPromotionPass : public CompilerPass {
  public:
+  // LOAD_CONTEXT/STORE_CONTEXT counts of a function before and after the
+  // pass ran.
+  struct Stats {
+    uint32_t loads_before;
+    uint32_t stores_before;
+    uint32_t loads_after;
+    uint32_t stores_after;
+  };
+
   ContextPromotionPass();
   virtual ~ContextPromotionPass() override;
 
   bool Initialize(Compiler* compiler) override;
 
+  const char* name() const override { return "ContextPromotion"; }
   bool Run(hir::HIRBuilder* builder) override;
 
+  // Counts for the last function run through this pass.
+  const Stats& last_stats() const { return last_stats_; }
+  void GetCounters(
+      std::vector<CompileProfiler::Counter>* counters) const override;
+
  private:
+  // Per-block dataflow state for the cross-block passes, indexed by the dense
+  // context slot index (not the byte offset).
+  struct BlockInfo {
+    hir::Block* block;
+    std::vector<uint16_t> successors;
+    std::vector<uint16_t> predecessors;
+    // Falls off the end of the function.
+    bool exits;
+    // Contains a call or other instruction that may touch the context.
+    bool has_barrier;
+    // Slots with a known value at the end of the block (defined after the
+    // last barrier).
+    llvm::BitVector defined;
+    // Slots whose first access before any barrier is a load.
+    llvm::BitVector exposed_loads;
+    llvm::BitVector available_in;
+    llvm::BitVector available_out;
+    // Slots whose value must be written to their local on exit.
+    llvm::BitVector needed_in;
+    llvm::BitVector needed_out;
+    llvm::BitVector live_in;
+    llvm::BitVector live_out;
+  };
+
   void PromoteBlock(hir::Block* block);
   void RemoveDeadStoresBlock(hir::Block* block);
 
+  bool BuildBlockInfos(hir::HIRBuilder* builder);
+  void ReleaseBlockInfos();
+  void PromoteAcrossBlocks(hir::HIRBuilder* builder);
+  void RemoveDeadStores();
+
  private:
   std::vector<hir::Value*> context_values_;
   llvm::BitVector context_validity_;
+
+  // Byte offset -> dense slot index, kNoSlot if not accessed.
+  std::vector<uint16_t> slot_indices_;
+  std::vector<uint32_t> slot_offsets_;
+  std::vector<hir::TypeName> slot_types_;
+  // Slots accessed with more than one type or overlapping another slot. They
+  // are left to the per-block passes.
+  llvm::BitVector unsafe_slots_;
+  std::vector<BlockInfo> block_infos_;
+  size_t block_count_ = 0;
+
+  Stats last_stats_ = {};
 };
 
 }  // namespace passes
@@ -13,6 +13,7 @@ class ControlFlowAnalysisPass : public CompilerPass {
   ControlFlowAnalysisPass();
   ~ControlFlowAnalysisPass() override;
 
+  const char* name() const override { return "ControlFlowAnalysis"; }
   bool Run(hir::HIRBuilder* builder) override;
 
  private:
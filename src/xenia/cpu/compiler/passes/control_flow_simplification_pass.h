@@ -13,6 +13,7 @@ class ControlFlowSimplificationPass : public CompilerPass {
   ControlFlowSimplificationPass();
   ~ControlFlowSimplificationPass() override;
 
+  const char* name() const override { return "ControlFlowSimplification"; }
   bool Run(hir::HIRBuilder* builder) override;
 
  private:
@@ -13,6 +13,7 @@ class DataFlowAnalysisPass : public CompilerPass {
   DataFlowAnalysisPass();
   ~DataFlowAnalysisPass() override;
 
+  const char* name() const override { return "DataFlowAnalysis"; }
   bool Run(hir::HIRBuilder* builder) override;
 
  private:
@@ -13,6 +13,7 @@ class DeadCodeEliminationPass : public CompilerPass {
   DeadCodeEliminationPass();
   ~DeadCodeEliminationPass() override;
 
+  const char* name() const override { return "DeadCodeElimination"; }
   bool Run(hir::HIRBuilder* builder) override;
 
  private:
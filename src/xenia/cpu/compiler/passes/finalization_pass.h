@@ -13,6 +13,7 @@ class FinalizationPass : public CompilerPass {
   FinalizationPass();
   ~FinalizationPass() override;
 
+  const char* name() const override { return "Finalization"; }
   bool Run(hir::HIRBuilder* builder) override;
 
  private:
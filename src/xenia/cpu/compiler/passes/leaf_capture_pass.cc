@@ -0,0 +1,34 @@
+#include "xenia/cpu/compiler/passes/leaf_capture_pass.h"
+
+#include "xenia/base/profiling.h"
+#include "xenia/cpu/compiler/compiler.h"
+#include "xenia/cpu/processor.h"
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+namespace passes {
+
+using xe::cpu::hir::HIRBuilder;
+
+LeafCapturePass::LeafCapturePass() : CompilerPass() {}
+
+LeafCapturePass::~LeafCapturePass() = default;
+
+bool LeafCapturePass::Run(HIRBuilder* builder) {
+  SCOPE_profile_cpu_f("cpu");
+
+  // Only what the processor translates has an address to be called at.
+  auto function = Compiler::thread_function();
+  if (!function || function->behavior() != Function::Behavior::kDefault ||
+      function->flags()) {
+    return true;
+  }
+  processor_->inline_registry()->Capture(function->address(), builder);
+  return true;
+}
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
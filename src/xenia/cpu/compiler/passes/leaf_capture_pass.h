@@ -0,0 +1,29 @@
+#ifndef XENIA_CPU_COMPILER_PASSES_LEAF_CAPTURE_PASS_H_
+#define XENIA_CPU_COMPILER_PASSES_LEAF_CAPTURE_PASS_H_
+
+#include "xenia/cpu/compiler/compiler_pass.h"
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+namespace passes {
+
+// Hands the optimized HIR of the function being translated to the
+// processor's InlineRegistry, which keeps it if the function is a leaf small
+// enough for LeafInliningPass. Changes nothing. Goes after the passes that
+// shrink the code, and before anything target specific.
+class LeafCapturePass : public CompilerPass {
+ public:
+  LeafCapturePass();
+  ~LeafCapturePass() override;
+
+  const char* name() const override { return "LeafCapture"; }
+  bool Run(hir::HIRBuilder* builder) override;
+};
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_COMPILER_PASSES_LEAF_CAPTURE_PASS_H_
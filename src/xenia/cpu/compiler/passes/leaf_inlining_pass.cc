@@ -0,0 +1,128 @@
+#include "xenia/cpu/compiler/passes/leaf_inlining_pass.h"
+
+#include "xenia/base/profiling.h"
+#include "xenia/cpu/compiler/compiler.h"
+#include "xenia/cpu/processor.h"
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+namespace passes {
+
+// TODO(benvanik): remove when enums redefined.
+using namespace xe::cpu::hir;
+
+using xe::cpu::hir::Block;
+using xe::cpu::hir::HIRBuilder;
+using xe::cpu::hir::Instr;
+using xe::cpu::hir::Value;
+
+static void SetSource(Instr* i, size_t n, Value* value) {
+  switch (n) {
+    case 0:
+      i->set_src1(value);
+      break;
+    case 1:
+      i->set_src2(value);
+      break;
+    default:
+      i->set_src3(value);
+      break;
+  }
+}
+
+LeafInliningPass::LeafInliningPass() : CompilerPass() {}
+
+LeafInliningPass::~LeafInliningPass() = default;
+
+bool LeafInliningPass::Run(HIRBuilder* builder) {
+  SCOPE_profile_cpu_f("cpu");
+
+  last_stats_ = {};
+  // Inlining callers are tracked by address.
+  auto function = Compiler::thread_function();
+  if (!function || !InlineRegistry::max_body_size()) {
+    return true;
+  }
+  auto registry = processor_->inline_registry();
+  for (auto block = builder->first_block(); block; block = block->next) {
+    auto i = block->instr_head;
+    while (i) {
+      auto next = i->next;
+      if (i->opcode == &OPCODE_CALL_info &&
+          i->src1.symbol->address() != function->address()) {
+        auto body =
+            registry->Acquire(i->src1.symbol->address(), function->address());
+        if (body) {
+          Inline(builder, i, *body);
+        }
+      }
+      i = next;
+    }
+  }
+  if (last_stats_.inlined_count) {
+    builder->set_attributes(builder->attributes() |
+                            FUNCTION_ATTRIB_INLINED_CALLS);
+    registry->RecordInlinedCalls(last_stats_.inlined_count);
+  }
+  return true;
+}
+
+void LeafInliningPass::Inline(HIRBuilder* builder, Instr* call,
+                              const InlineRegistry::Body& body) {
+  size_t count = body.instrs.size();
+  if (!(call->flags & CALL_TAIL)) {
+    --count;
+  }
+  values_.assign(count, nullptr);
+  // Appended instructions go to a new block if the last one was ended, which
+  // is removed again once they have all been moved in front of the call.
+  Block* last_block = builder->last_block();
+  for (size_t n = 0; n < count; ++n) {
+    const auto& record = body.instrs[n];
+    Value* dest =
+        record.has_dest ? builder->AllocValue(record.dest_type) : nullptr;
+    auto i = builder->AppendOp(*record.opcode, record.flags, dest);
+    Instr::Op* ops[3] = {&i->src1, &i->src2, &i->src3};
+    for (size_t m = 0; m < 3; ++m) {
+      const auto& operand = record.src[m];
+      switch (operand.kind) {
+        case InlineRegistry::Operand::kValue:
+          SetSource(i, m, values_[operand.value_index]);
+          break;
+        case InlineRegistry::Operand::kConstant: {
+          Value* value = builder->AllocValue(operand.type);
+          value->flags = VALUE_IS_CONSTANT;
+          value->constant = operand.constant;
+          SetSource(i, m, value);
+          break;
+        }
+        case InlineRegistry::Operand::kOffset:
+          ops[m]->offset = operand.offset;
+          break;
+        default:
+          break;
+      }
+    }
+    values_[n] = dest;
+    i->MoveBefore(call);
+  }
+  call->Remove();
+  if (builder->last_block() != last_block) {
+    builder->RemoveBlock(builder->last_block());
+  }
+
+  ++last_stats_.inlined_count;
+  last_stats_.inlined_instr_count += uint32_t(count);
+}
+
+void LeafInliningPass::GetCounters(
+    std::vector<CompileProfiler::Counter>* counters) const {
+  counters->push_back({"inlined_calls", last_stats_.inlined_count});
+  counters->push_back({"inlined_instrs", last_stats_.inlined_instr_count});
+}
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
@@ -0,0 +1,56 @@
+#ifndef XENIA_CPU_COMPILER_PASSES_LEAF_INLINING_PASS_H_
+#define XENIA_CPU_COMPILER_PASSES_LEAF_INLINING_PASS_H_
+
+#include <vector>
+
+#include "xenia/cpu/compiler/compiler_pass.h"
+#include "xenia/cpu/compiler/inline_registry.h"
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+namespace passes {
+
+// Replaces direct calls to small leaf functions with a copy of their body,
+// as LeafCapturePass recorded it when they were translated. Functions not
+// translated yet are called as usual; the same call gets inlined when the
+// caller is translated again (at tier-up, for instance).
+//
+// A non-tail call drops the callee's final return, which only goes back to
+// the LR the call set. A tail call keeps it, returning for the caller.
+// Inlining callers are marked with FUNCTION_ATTRIB_INLINED_CALLS and get
+// thrown away with the callee when its code is overwritten.
+class LeafInliningPass : public CompilerPass {
+ public:
+  // Results of the last function run through this pass.
+  struct Stats {
+    uint32_t inlined_count;
+    // Instructions copied in.
+    uint32_t inlined_instr_count;
+  };
+
+  LeafInliningPass();
+  ~LeafInliningPass() override;
+
+  const char* name() const override { return "LeafInlining"; }
+  bool Run(hir::HIRBuilder* builder) override;
+
+  const Stats& last_stats() const { return last_stats_; }
+  void GetCounters(
+      std::vector<CompileProfiler::Counter>* counters) const override;
+
+ private:
+  void Inline(hir::HIRBuilder* builder, hir::Instr* call,
+              const InlineRegistry::Body& body);
+
+  Stats last_stats_ = {};
+  // Indexed like the body's instructions.
+  std::vector<hir::Value*> values_;
+};
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_COMPILER_PASSES_LEAF_INLINING_PASS_H_
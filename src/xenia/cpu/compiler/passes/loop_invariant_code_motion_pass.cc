@@ -0,0 +1,261 @@
+#include "xenia/cpu/compiler/passes/loop_invariant_code_motion_pass.h"
+
+#include "xenia/base/profiling.h"
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+namespace passes {
+
+// TODO(benvanik): remove when enums redefined.
+using namespace xe::cpu::hir;
+
+using xe::cpu::hir::Block;
+using xe::cpu::hir::HIRBuilder;
+using xe::cpu::hir::Instr;
+using xe::cpu::hir::Value;
+
+static bool IsUnconditionalJump(const Instr* i) {
+  if (i->opcode == &OPCODE_CALL_info ||
+      i->opcode == &OPCODE_CALL_INDIRECT_info) {
+    return (i->flags & CALL_TAIL) != 0;
+  }
+  return i->opcode == &OPCODE_BRANCH_info || i->opcode == &OPCODE_RETURN_info;
+}
+
+// Same as ContextPromotionPass: anything that may touch the context behind
+// our back.
+static bool IsContextBarrier(const Instr* i) {
+  if (i->opcode == &OPCODE_BRANCH_info ||
+      i->opcode == &OPCODE_BRANCH_TRUE_info ||
+      i->opcode == &OPCODE_BRANCH_FALSE_info) {
+    return false;
+  }
+  return (i->opcode->flags & (OPCODE_FLAG_VOLATILE | OPCODE_FLAG_BRANCH)) ||
+         i->opcode == &OPCODE_CONTEXT_BARRIER_info;
+}
+
+static bool IsFloatType(TypeName type) {
+  return type == FLOAT32_TYPE || type == FLOAT64_TYPE || type == VEC128_TYPE;
+}
+
+// Whether the result only depends on the operands and computing it can't
+// fault.
+static bool IsPure(const Instr* i) {
+  uint32_t signature = i->opcode->signature;
+  if (GET_OPCODE_SIG_TYPE_DEST(signature) != OPCODE_SIG_TYPE_V || !i->dest) {
+    return false;
+  }
+  if (i->opcode->flags & (OPCODE_FLAG_BRANCH | OPCODE_FLAG_MEMORY |
+                          OPCODE_FLAG_VOLATILE | OPCODE_FLAG_PAIRED_PREV)) {
+    return false;
+  }
+  // DID_SATURATE reads the flags the instruction before it left.
+  if (i->next && (i->next->opcode->flags & OPCODE_FLAG_PAIRED_PREV)) {
+    return false;
+  }
+  if (GET_OPCODE_SIG_TYPE_SRC1(signature) == OPCODE_SIG_TYPE_L ||
+      GET_OPCODE_SIG_TYPE_SRC2(signature) == OPCODE_SIG_TYPE_L ||
+      GET_OPCODE_SIG_TYPE_SRC3(signature) == OPCODE_SIG_TYPE_L) {
+    return false;
+  }
+  // Integer division raises #DE on x64.
+  return i->opcode != &OPCODE_DIV_info &&
+         i->opcode != &OPCODE_LOAD_CLOCK_info &&
+         i->opcode != &OPCODE_LOAD_LOCAL_info &&
+         i->opcode != &OPCODE_LOAD_CONTEXT_info;
+}
+
+static void MoveToEnd(Instr* i, Block* block) {
+  if (i->prev) {
+    i->prev->next = i->next;
+  } else {
+    i->block->instr_head = i->next;
+  }
+  if (i->next) {
+    i->next->prev = i->prev;
+  } else {
+    i->block->instr_tail = i->prev;
+  }
+  i->block = block;
+  i->next = nullptr;
+  i->prev = block->instr_tail;
+  if (i->prev) {
+    i->prev->next = i;
+  } else {
+    block->instr_head = i;
+  }
+  block->instr_tail = i;
+}
+
+LoopInvariantCodeMotionPass::LoopInvariantCodeMotionPass() : CompilerPass() {}
+
+LoopInvariantCodeMotionPass::~LoopInvariantCodeMotionPass() = default;
+
+bool LoopInvariantCodeMotionPass::Run(HIRBuilder* builder) {
+  SCOPE_profile_cpu_f("cpu");
+
+  last_stats_ = {};
+  analysis_.Analyze(builder);
+  if (analysis_.loops().empty()) {
+    return true;
+  }
+  last_stats_.loop_count = uint32_t(analysis_.loops().size());
+  std::vector<Block*> headers;
+  for (const auto& loop : analysis_.loops()) {
+    headers.push_back(loop.header);
+  }
+
+  bool dirty = false;
+  for (auto header : headers) {
+    if (dirty) {
+      // A preheader went in; ordinals and loop bodies have changed.
+      analysis_.Analyze(builder);
+      dirty = false;
+    }
+    const auto& loops = analysis_.loops();
+    for (int32_t n = 0; n < int32_t(loops.size()); ++n) {
+      if (loops[n].header == header) {
+        dirty = HoistLoop(builder, n);
+        break;
+      }
+    }
+  }
+  return true;
+}
+
+bool LoopInvariantCodeMotionPass::HoistLoop(HIRBuilder* builder,
+                                            int32_t loop_index) {
+  const auto& loop = analysis_.loops()[loop_index];
+  Block* header = loop.header;
+  if (header->prev &&
+      analysis_.IsInLoop(header->prev->ordinal, loop_index) &&
+      !(header->prev->instr_tail &&
+        IsUnconditionalJump(header->prev->instr_tail))) {
+    return false;
+  }
+
+  bool context_clobbered = false;
+  bool rounding_mode_changes = false;
+  std::vector<std::pair<uint64_t, uint64_t>> stored_ranges;
+  for (auto ordinal : loop.blocks) {
+    for (auto i = analysis_.block(ordinal)->instr_head; i; i = i->next) {
+      if (IsContextBarrier(i)) {
+        context_clobbered = true;
+      } else if (i->opcode == &OPCODE_STORE_CONTEXT_info) {
+        stored_ranges.push_back(
+            {i->src1.offset,
+             i->src1.offset + GetTypeSize(i->src2.value->type)});
+      } else if (i->opcode == &OPCODE_SET_ROUNDING_MODE_info) {
+        rounding_mode_changes = true;
+      }
+    }
+  }
+
+  invariant_values_.assign(builder->max_value_ordinal(), 0);
+  auto is_invariant = [&](const Value* value) {
+    if (value->IsConstant()) {
+      return true;
+    }
+    if (!value->def) {
+      return false;
+    }
+    return invariant_values_[value->ordinal] ||
+           !analysis_.IsInLoop(value->def->block->ordinal, loop_index);
+  };
+  std::vector<Instr*> hoisted;
+  uint32_t context_load_count = 0;
+  for (auto ordinal : loop.blocks) {
+    for (auto i = analysis_.block(ordinal)->instr_head; i; i = i->next) {
+      if (i->opcode == &OPCODE_LOAD_CONTEXT_info) {
+        if (context_clobbered) {
+          continue;
+        }
+        uint64_t start = i->src1.offset;
+        uint64_t end = start + GetTypeSize(i->dest->type);
+        bool stored = false;
+        for (const auto& range : stored_ranges) {
+          stored |= start < range.second && range.first < end;
+        }
+        if (stored) {
+          continue;
+        }
+        ++context_load_count;
+      } else {
+        if (!IsPure(i)) {
+          continue;
+        }
+        uint32_t signature = i->opcode->signature;
+        if ((GET_OPCODE_SIG_TYPE_SRC1(signature) == OPCODE_SIG_TYPE_V &&
+             !is_invariant(i->src1.value)) ||
+            (GET_OPCODE_SIG_TYPE_SRC2(signature) == OPCODE_SIG_TYPE_V &&
+             !is_invariant(i->src2.value)) ||
+            (GET_OPCODE_SIG_TYPE_SRC3(signature) == OPCODE_SIG_TYPE_V &&
+             !is_invariant(i->src3.value))) {
+          continue;
+        }
+        if (rounding_mode_changes &&
+            (IsFloatType(i->dest->type) ||
+             (GET_OPCODE_SIG_TYPE_SRC1(signature) == OPCODE_SIG_TYPE_V &&
+              IsFloatType(i->src1.value->type)))) {
+          continue;
+        }
+      }
+      invariant_values_[i->dest->ordinal] = 1;
+      hoisted.push_back(i);
+    }
+  }
+  if (hoisted.empty()) {
+    return false;
+  }
+
+  // Entries into the loop go through the preheader; the back edges still go
+  // straight to the header. Falling through into the header from outside
+  // now falls into the preheader.
+  Block* preheader = builder->InsertBlock(header);
+  Label* preheader_label = nullptr;
+  for (auto predecessor : analysis_.predecessors(header->ordinal)) {
+    if (analysis_.IsInLoop(predecessor, loop_index)) {
+      continue;
+    }
+    for (auto i = analysis_.block(predecessor)->instr_head; i; i = i->next) {
+      Label** label = nullptr;
+      if (i->opcode == &OPCODE_BRANCH_info) {
+        label = &i->src1.label;
+      } else if (i->opcode == &OPCODE_BRANCH_TRUE_info ||
+                 i->opcode == &OPCODE_BRANCH_FALSE_info) {
+        label = &i->src2.label;
+      }
+      if (!label || (*label)->block != header) {
+        continue;
+      }
+      if (!preheader_label) {
+        preheader_label = builder->NewLabel();
+        builder->MarkLabel(preheader_label, preheader);
+      }
+      *label = preheader_label;
+    }
+  }
+  for (auto i : hoisted) {
+    MoveToEnd(i, preheader);
+  }
+
+  ++last_stats_.hoisted_loop_count;
+  last_stats_.hoisted_count += uint32_t(hoisted.size());
+  last_stats_.hoisted_context_load_count += context_load_count;
+  return true;
+}
+
+void LoopInvariantCodeMotionPass::GetCounters(
+    std::vector<CompileProfiler::Counter>* counters) const {
+  counters->push_back({"loops", last_stats_.loop_count});
+  counters->push_back({"hoisted_loops", last_stats_.hoisted_loop_count});
+  counters->push_back({"hoisted", last_stats_.hoisted_count});
+  counters->push_back(
+      {"hoisted_context_loads", last_stats_.hoisted_context_load_count});
+}
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
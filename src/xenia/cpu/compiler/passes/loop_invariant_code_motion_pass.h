@@ -0,0 +1,59 @@
+#ifndef XENIA_CPU_COMPILER_PASSES_LOOP_INVARIANT_CODE_MOTION_PASS_H_
+#define XENIA_CPU_COMPILER_PASSES_LOOP_INVARIANT_CODE_MOTION_PASS_H_
+
+#include <vector>
+
+#include "xenia/cpu/compiler/compiler_pass.h"
+#include "xenia/cpu/compiler/loop_analysis.h"
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+namespace passes {
+
+// Hoists loop-invariant work into a preheader block created ahead of each
+// loop: pure instructions whose operands are all defined outside the loop,
+// and LOAD_CONTEXTs of context the loop never stores to (in loops without
+// calls). Nothing hoisted can fault, so it is fine for it to run even when
+// the loop body would not have.
+//
+// Loops are done innermost first, so an outer loop can take what was hoisted
+// out of an inner one further. Loops entered by falling through from their
+// own body are skipped, as there is nowhere to put the preheader.
+class LoopInvariantCodeMotionPass : public CompilerPass {
+ public:
+  // Results of the last function run through this pass.
+  struct Stats {
+    uint32_t loop_count;
+    // Loops given a preheader.
+    uint32_t hoisted_loop_count;
+    uint32_t hoisted_count;
+    // Of which LOAD_CONTEXTs.
+    uint32_t hoisted_context_load_count;
+  };
+
+  LoopInvariantCodeMotionPass();
+  ~LoopInvariantCodeMotionPass() override;
+
+  const char* name() const override { return "LoopInvariantCodeMotion"; }
+  bool Run(hir::HIRBuilder* builder) override;
+
+  const Stats& last_stats() const { return last_stats_; }
+  void GetCounters(
+      std::vector<CompileProfiler::Counter>* counters) const override;
+
+ private:
+  bool HoistLoop(hir::HIRBuilder* builder, int32_t loop_index);
+
+  Stats last_stats_ = {};
+  LoopAnalysis analysis_;
+  // Indexed by value ordinal.
+  std::vector<uint8_t> invariant_values_;
+};
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_COMPILER_PASSES_LOOP_INVARIANT_CODE_MOTION_PASS_H_
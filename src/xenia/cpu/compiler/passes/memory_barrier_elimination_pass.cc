@@ -0,0 +1,125 @@
+#include "xenia/cpu/compiler/passes/memory_barrier_elimination_pass.h"
+
+#include "xenia/base/profiling.h"
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+namespace passes {
+
+// TODO(benvanik): remove when enums redefined.
+using namespace xe::cpu::hir;
+
+using xe::cpu::hir::Block;
+using xe::cpu::hir::HIRBuilder;
+using xe::cpu::hir::Instr;
+
+enum MemoryAccess {
+  kAccessNone = 0,
+  kAccessLoad = 1 << 0,
+  kAccessStore = 1 << 1,
+  // Drains the store buffer, like a lock-prefixed instruction.
+  kAccessFence = 1 << 2,
+};
+
+// How an instruction touches guest-visible memory. The context is private to
+// the thread and locals live on the host stack, so neither counts.
+static uint32_t GetMemoryAccess(const Instr* i) {
+  if (i->opcode == &OPCODE_LOAD_info || i->opcode == &OPCODE_LOAD_OFFSET_info) {
+    return kAccessLoad;
+  }
+  if (i->opcode == &OPCODE_STORE_info ||
+      i->opcode == &OPCODE_STORE_OFFSET_info ||
+      i->opcode == &OPCODE_MEMSET_info ||
+      i->opcode == &OPCODE_CACHE_CONTROL_info) {
+    return kAccessStore;
+  }
+  if (i->opcode == &OPCODE_ATOMIC_EXCHANGE_info ||
+      i->opcode == &OPCODE_ATOMIC_COMPARE_EXCHANGE_info) {
+    return kAccessFence;
+  }
+  // Calls and MMIO handlers run arbitrary code.
+  if (i->opcode == &OPCODE_CALL_info || i->opcode == &OPCODE_CALL_TRUE_info ||
+      i->opcode == &OPCODE_CALL_INDIRECT_info ||
+      i->opcode == &OPCODE_CALL_INDIRECT_TRUE_info ||
+      i->opcode == &OPCODE_CALL_EXTERN_info ||
+      i->opcode == &OPCODE_LOAD_MMIO_info ||
+      i->opcode == &OPCODE_STORE_MMIO_info) {
+    return kAccessLoad | kAccessStore;
+  }
+  return kAccessNone;
+}
+
+MemoryBarrierEliminationPass::MemoryBarrierEliminationPass()
+    : CompilerPass() {}
+
+MemoryBarrierEliminationPass::~MemoryBarrierEliminationPass() = default;
+
+bool MemoryBarrierEliminationPass::Run(HIRBuilder* builder) {
+  last_stats_ = {};
+  auto block = builder->first_block();
+  while (block) {
+    EliminateBlock(block);
+    block = block->next;
+  }
+  return true;
+}
+
+void MemoryBarrierEliminationPass::EliminateBlock(Block* block) {
+  // Nothing is known about predecessors, so assume a store is pending on
+  // entry and that a load follows the block.
+  bool store_pending = true;
+  // Sync not yet known to be needed.
+  Instr* pending_sync = nullptr;
+  auto i = block->instr_head;
+  while (i) {
+    auto next = i->next;
+    if (i->opcode == &OPCODE_MEMORY_BARRIER_info) {
+      ++last_stats_.barriers_before;
+      if (MemoryBarrierType(i->flags) != MEMORY_BARRIER_TYPE_SYNC) {
+        // TSO keeps loads in order and stores in order, and loads ahead of
+        // later stores, which is everything lwsync and eieio ask for.
+        i->Remove();
+      } else if (!store_pending || pending_sync) {
+        // Nothing to drain since the last fence.
+        i->Remove();
+      } else {
+        pending_sync = i;
+        ++last_stats_.fences_after;
+      }
+      i = next;
+      continue;
+    }
+    uint32_t access = GetMemoryAccess(i);
+    if (access & kAccessFence) {
+      if (pending_sync) {
+        // The lock prefix orders the same accesses.
+        pending_sync->Remove();
+        --last_stats_.fences_after;
+      }
+      pending_sync = nullptr;
+      store_pending = false;
+    } else if (access) {
+      if (pending_sync) {
+        // The sync stays; everything before it has been drained.
+        pending_sync = nullptr;
+        store_pending = false;
+      }
+      if (access & kAccessStore) {
+        store_pending = true;
+      }
+    }
+    i = next;
+  }
+}
+
+void MemoryBarrierEliminationPass::GetCounters(
+    std::vector<CompileProfiler::Counter>* counters) const {
+  counters->push_back({"barriers_before", last_stats_.barriers_before});
+  counters->push_back({"fences_after", last_stats_.fences_after});
+}
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
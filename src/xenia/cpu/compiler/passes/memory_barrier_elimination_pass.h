@@ -0,0 +1,46 @@
+#ifndef XENIA_CPU_COMPILER_PASSES_MEMORY_BARRIER_ELIMINATION_PASS_H_
+#define XENIA_CPU_COMPILER_PASSES_MEMORY_BARRIER_ELIMINATION_PASS_H_
+
+#include "xenia/cpu/compiler/compiler_pass.h"
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+namespace passes {
+
+// Removes MEMORY_BARRIERs that order nothing on an x86 (TSO) host.
+//
+// lwsync and eieio never need a fence. A sync only does when a store may be
+// waiting in the store buffer ahead of it and a load may follow it; one that
+// is directly followed by a lock-prefixed atomic is covered by the atomic.
+// Must run after every pass that could move memory accesses across barriers.
+class MemoryBarrierEliminationPass : public CompilerPass {
+ public:
+  // MEMORY_BARRIER counts of the last function run through this pass.
+  struct Stats {
+    uint32_t barriers_before;
+    uint32_t fences_after;
+  };
+
+  MemoryBarrierEliminationPass();
+  ~MemoryBarrierEliminationPass() override;
+
+  const char* name() const override { return "MemoryBarrierElimination"; }
+  bool Run(hir::HIRBuilder* builder) override;
+
+  const Stats& last_stats() const { return last_stats_; }
+  void GetCounters(
+      std::vector<CompileProfiler::Counter>* counters) const override;
+
+ private:
+  void EliminateBlock(hir::Block* block);
+
+  Stats last_stats_ = {};
+};
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_COMPILER_PASSES_MEMORY_BARRIER_ELIMINATION_PASS_H_
@@ -13,6 +13,7 @@ class MemorySequenceCombinationPass : public CompilerPass {
   MemorySequenceCombinationPass();
   ~MemorySequenceCombinationPass() override;
 
+  const char* name() const override { return "MemorySequenceCombination"; }
   bool Run(hir::HIRBuilder* builder) override;
 
  private:
@@ -1,13 +1,23 @@
 #include "xenia/cpu/compiler/passes/register_allocation_pass.h"
 
 #include <algorithm>
-#include <cstring>
 
 #include "xenia/base/assert.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
+#include "xenia/base/platform.h"
 #include "xenia/base/profiling.h"
 
+#if XE_COMPILER_MSVC
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#pragma warning(disable : 4267)
+#include <llvm/ADT/BitVector.h>
+#pragma warning(pop)
+#else
+#include <llvm/ADT/BitVector.h>
+#endif  // XE_COMPILER_MSVC
+
 namespace xe {
 namespace cpu {
 namespace compiler {
@@ -24,399 +34,556 @@ using xe::cpu::hir::RegAssignment;
 using xe::cpu::hir::TypeName;
 using xe::cpu::hir::Value;
 
-#define ASSERT_NO_CYCLES 0
+static bool IsCall(const Instr* instr) {
+  return instr->opcode == &OPCODE_CALL_info ||
+         instr->opcode == &OPCODE_CALL_TRUE_info ||
+         instr->opcode == &OPCODE_CALL_INDIRECT_info ||
+         instr->opcode == &OPCODE_CALL_INDIRECT_TRUE_info ||
+         instr->opcode == &OPCODE_CALL_EXTERN_info;
+}
+
+static bool IsUnconditionalJump(const Instr* instr) {
+  if (instr->opcode == &OPCODE_CALL_info ||
+      instr->opcode == &OPCODE_CALL_INDIRECT_info) {
+    return (instr->flags & CALL_TAIL) != 0;
+  }
+  return instr->opcode == &OPCODE_BRANCH_info ||
+         instr->opcode == &OPCODE_RETURN_info;
+}
+
+// Values that get a register: instruction results, not constants or local
+// slots.
+static bool IsRegisterValue(const Value* value) {
+  return value && !value->IsConstant() && value->def;
+}
+
+// Inserts instr after position, keeping paired instructions together.
+static void InsertAfter(Instr* instr, Instr* position) {
+  while (position->next &&
+         (position->next->opcode->flags & OPCODE_FLAG_PAIRED_PREV)) {
+    position = position->next;
+  }
+  if (position->next) {
+    instr->MoveBefore(position->next);
+  } else {
+    // End of the block: insert before and swap.
+    instr->MoveBefore(position);
+    position->MoveBefore(instr);
+  }
+}
+
+// First instruction of the pair instr belongs to, if any.
+static Instr* PairHead(Instr* instr) {
+  while (instr->prev && (instr->opcode->flags & OPCODE_FLAG_PAIRED_PREV)) {
+    instr = instr->prev;
+  }
+  return instr;
+}
+
+static void ReplaceSources(Instr* instr, Value* old_value, Value* new_value) {
+  uint32_t signature = instr->opcode->signature;
+  if (GET_OPCODE_SIG_TYPE_SRC1(signature) == OPCODE_SIG_TYPE_V &&
+      instr->src1.value == old_value) {
+    instr->set_src1(new_value);
+  }
+  if (GET_OPCODE_SIG_TYPE_SRC2(signature) == OPCODE_SIG_TYPE_V &&
+      instr->src2.value == old_value) {
+    instr->set_src2(new_value);
+  }
+  if (GET_OPCODE_SIG_TYPE_SRC3(signature) == OPCODE_SIG_TYPE_V &&
+      instr->src3.value == old_value) {
+    instr->set_src3(new_value);
+  }
+}
 
 RegisterAllocationPass::RegisterAllocationPass(const MachineInfo* machine_info)
     : CompilerPass() {
-  // Initialize register sets.
-  // TODO(benvanik): rewrite in a way that makes sense - this is terrible.
   auto mi_sets = machine_info->register_sets;
-  std::memset(&usage_sets_, 0, sizeof(usage_sets_));
   uint32_t n = 0;
-  while (mi_sets[n].count) {
+  while (n < xe::countof(classes_) && mi_sets[n].count) {
     auto& mi_set = mi_sets[n];
-    auto usage_set = new RegisterSetUsage();
-    usage_sets_.all_sets[n] = usage_set;
-    usage_set->count = mi_set.count;
-    usage_set->set = &mi_set;
+    auto& register_class = classes_[n];
+    register_class.set = &mi_set;
+    register_class.count = std::min(mi_set.count, 32u);
     if (mi_set.types & MachineInfo::RegisterSet::INT_TYPES) {
-      usage_sets_.int_set = usage_set;
+      int_class_ = &register_class;
     }
     if (mi_set.types & MachineInfo::RegisterSet::FLOAT_TYPES) {
-      usage_sets_.float_set = usage_set;
+      float_class_ = &register_class;
     }
     if (mi_set.types & MachineInfo::RegisterSet::VEC_TYPES) {
-      usage_sets_.vec_set = usage_set;
+      vec_class_ = &register_class;
     }
     n++;
   }
+  class_count_ = n;
 }
 
-RegisterAllocationPass::~RegisterAllocationPass() {
-  for (size_t n = 0; n < xe::countof(usage_sets_.all_sets); n++) {
-    if (!usage_sets_.all_sets[n]) {
-      break;
-    }
-    delete usage_sets_.all_sets[n];
-  }
-}
+RegisterAllocationPass::~RegisterAllocationPass() = default;
 
 bool RegisterAllocationPass::Run(HIRBuilder* builder) {
-  // Simple per-block allocator that operates on SSA form.
-  // Registers do not move across blocks, though this could be
-  // optimized with some intra-block analysis (dominators/etc).
-  // Really, it'd just be nice to have someone who knew what they
-  // were doing lower SSA and do this right.
+  // Linear scan over the instructions in block order. Values used only in the
+  // block defining them (nearly all of them, as the frontend passes guest
+  // state between blocks through the context) are allocated and split on the
+  // fly. Values crossing blocks are sized up first so they can't starve the
+  // block-local ones.
+  last_stats_ = {};
+
+  NumberInstructions(builder);
+  if (ComputeIntervals(builder)) {
+    ExtendCrossBlockIntervals(builder);
+    DemoteCrossBlockValues(builder);
+  }
+  return AllocateRegisters(builder);
+}
 
+void RegisterAllocationPass::NumberInstructions(HIRBuilder* builder) {
+  block_ranges_.clear();
   uint16_t block_ordinal = 0;
-  uint32_t instr_ordinal = 0;
-  auto block = builder->first_block();
-  while (block) {
+  // Start at 2 so spill code ahead of the first instruction stays positive.
+  uint32_t instr_ordinal = 2;
+  for (auto block = builder->first_block(); block; block = block->next) {
     // Sequential block ordinals.
     block->ordinal = block_ordinal++;
-
-    // Reset all state.
-    PrepareBlockState();
-
-    // Renumber all instructions in the block. This is required so that
-    // we can sort the usage pointers below.
-    auto instr = block->instr_head;
-    while (instr) {
-      // Sequential global instruction ordinals.
-      instr->ordinal = instr_ordinal++;
-      instr = instr->next;
+    BlockRange range;
+    range.first_ordinal = instr_ordinal;
+    range.has_call = false;
+    for (auto instr = block->instr_head; instr; instr = instr->next) {
+      instr->ordinal = instr_ordinal;
+      instr_ordinal += 2;
+      range.has_call |= IsCall(instr);
     }
+    range.last_ordinal =
+        block->instr_head ? instr_ordinal - 2 : range.first_ordinal;
+    block_ranges_.push_back(std::move(range));
+  }
+}
 
-    instr = block->instr_head;
-    while (instr) {
-      const auto info = instr->opcode;
-      uint32_t signature = info->signature;
-
-      // Update the register use heaps.
-      AdvanceUses(instr);
-
-      // Check sources for retirement. If any are unused after this instruction
-      // we can eagerly evict them to speed up register allocation.
-      // Since X64 (and other platforms) can often take advantage of dest==src1
-      // register mappings we track retired src1 so that we can attempt to
-      // reuse it.
-      // NOTE: these checks require that the usage list be sorted!
-      bool has_preferred_reg = false;
-      RegAssignment preferred_reg = {0};
-      if (GET_OPCODE_SIG_TYPE_SRC1(signature) == OPCODE_SIG_TYPE_V &&
-          !instr->src1.value->IsConstant()) {
-        if (!instr->src1_use->next) {
-          // Pull off preferred register. We will try to reuse this for the
-          // dest.
-          // NOTE: set may be null if this is a store local.
-          if (preferred_reg.set) {
-            has_preferred_reg = true;
-            preferred_reg = instr->src1.value->reg;
-          }
+bool RegisterAllocationPass::ComputeIntervals(HIRBuilder* builder) {
+  intervals_.assign(builder->max_value_ordinal(),
+                    Interval{UINT32_MAX, 0, 0, false, false});
+  cross_block_values_.clear();
+  for (auto block = builder->first_block(); block; block = block->next) {
+    for (auto instr = block->instr_head; instr; instr = instr->next) {
+      uint32_t signature = instr->opcode->signature;
+      if (GET_OPCODE_SIG_TYPE_DEST(signature) == OPCODE_SIG_TYPE_V) {
+        auto& dest_interval = interval(instr->dest);
+        dest_interval.start = instr->ordinal;
+        dest_interval.end = std::max(dest_interval.end, instr->ordinal);
+      }
+      Value* sources[3] = {nullptr};
+      if (GET_OPCODE_SIG_TYPE_SRC1(signature) == OPCODE_SIG_TYPE_V) {
+        sources[0] = instr->src1.value;
+      }
+      if (GET_OPCODE_SIG_TYPE_SRC2(signature) == OPCODE_SIG_TYPE_V) {
+        sources[1] = instr->src2.value;
+      }
+      if (GET_OPCODE_SIG_TYPE_SRC3(signature) == OPCODE_SIG_TYPE_V) {
+        sources[2] = instr->src3.value;
+      }
+      for (auto value : sources) {
+        if (!IsRegisterValue(value)) {
+          continue;
+        }
+        auto& value_interval = interval(value);
+        value_interval.end = std::max(value_interval.end, instr->ordinal);
+        ++value_interval.use_count;
+        if (value->def->block != block && !value_interval.cross_block) {
+          value_interval.cross_block = true;
+          cross_block_values_.push_back(value);
         }
       }
+    }
+  }
+  last_stats_.cross_block_count = uint32_t(cross_block_values_.size());
+  return !cross_block_values_.empty();
+}
 
+void RegisterAllocationPass::ExtendCrossBlockIntervals(HIRBuilder* builder) {
+  // Block successors, as ControlFlowAnalysisPass finds them plus fall-through.
+  for (auto block = builder->first_block(); block; block = block->next) {
+    auto& successors = block_ranges_[block->ordinal].successors;
+    successors.clear();
+    auto tail = block->instr_tail;
+    for (auto instr = tail;
+         instr && (instr->opcode->flags & OPCODE_FLAG_BRANCH);
+         instr = instr->prev) {
+      if (instr->opcode == &OPCODE_BRANCH_info) {
+        successors.push_back(instr->src1.label->block->ordinal);
+      } else if (instr->opcode == &OPCODE_BRANCH_TRUE_info ||
+                 instr->opcode == &OPCODE_BRANCH_FALSE_info) {
+        successors.push_back(instr->src2.label->block->ordinal);
+      }
+    }
+    if ((!tail || !IsUnconditionalJump(tail)) && block->next) {
+      successors.push_back(block->next->ordinal);
+    }
+  }
+
+  // Liveness of the cross-block values only; everything else is dead at
+  // block boundaries by definition.
+  uint32_t value_count = uint32_t(cross_block_values_.size());
+  std::vector<uint32_t> value_indices(intervals_.size(), UINT32_MAX);
+  for (uint32_t n = 0; n < value_count; ++n) {
+    value_indices[cross_block_values_[n]->ordinal] = n;
+  }
+  size_t block_count = block_ranges_.size();
+  std::vector<llvm::BitVector> used(block_count,
+                                    llvm::BitVector(value_count));
+  std::vector<llvm::BitVector> defined(block_count,
+                                       llvm::BitVector(value_count));
+  for (auto block = builder->first_block(); block; block = block->next) {
+    for (auto instr = block->instr_head; instr; instr = instr->next) {
+      uint32_t signature = instr->opcode->signature;
       if (GET_OPCODE_SIG_TYPE_DEST(signature) == OPCODE_SIG_TYPE_V) {
-        // Must not have been set already.
-        assert_null(instr->dest->reg.set);
-
-        // Sort the usage list. We depend on this in future uses of this
-        // variable.
-        SortUsageList(instr->dest);
-
-        // If we have a preferred register, use that.
-        // This way we can help along the stupid X86 two opcode instructions.
-        bool allocated;
-        if (has_preferred_reg) {
-          // Allocate with the given preferred register. If the register is in
-          // the wrong set it will not be reused.
-          allocated = TryAllocateRegister(instr->dest, preferred_reg);
-        } else {
-          // Allocate a register. This will either reserve a free one or
-          // spill and reuse an active one.
-          allocated = TryAllocateRegister(instr->dest);
+        uint32_t index = value_indices[instr->dest->ordinal];
+        if (index != UINT32_MAX) {
+          defined[block->ordinal].set(index);
+        }
+      }
+      Value* sources[3] = {nullptr};
+      if (GET_OPCODE_SIG_TYPE_SRC1(signature) == OPCODE_SIG_TYPE_V) {
+        sources[0] = instr->src1.value;
+      }
+      if (GET_OPCODE_SIG_TYPE_SRC2(signature) == OPCODE_SIG_TYPE_V) {
+        sources[1] = instr->src2.value;
+      }
+      if (GET_OPCODE_SIG_TYPE_SRC3(signature) == OPCODE_SIG_TYPE_V) {
+        sources[2] = instr->src3.value;
+      }
+      for (auto value : sources) {
+        if (!IsRegisterValue(value) || value->def->block == block) {
+          continue;
         }
-        if (!allocated) {
-          // Failed to allocate register -- need to spill and try again.
-          // We spill only those registers we aren't using.
-          if (!SpillOneRegister(builder, block, instr->dest->type)) {
-            // Unable to spill anything - this shouldn't happen.
-            XELOGE("Unable to spill any registers");
-            assert_always();
-            return false;
-          }
-
-          // Demand allocation.
-          if (!TryAllocateRegister(instr->dest)) {
-            // Boned.
-            XELOGE("Register allocation failed");
-            assert_always();
-            return false;
-          }
+        uint32_t index = value_indices[value->ordinal];
+        if (index != UINT32_MAX) {
+          used[block->ordinal].set(index);
         }
       }
+    }
+  }
 
-      instr = instr->next;
+  std::vector<llvm::BitVector> live_in(block_count,
+                                       llvm::BitVector(value_count));
+  std::vector<llvm::BitVector> live_out(block_count,
+                                        llvm::BitVector(value_count));
+  llvm::BitVector scratch(value_count);
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (size_t n = block_count; n-- > 0;) {
+      live_out[n].reset();
+      for (uint16_t successor : block_ranges_[n].successors) {
+        live_out[n] |= live_in[successor];
+      }
+      scratch = live_out[n];
+      scratch.reset(defined[n]);
+      scratch |= used[n];
+      if (scratch != live_in[n]) {
+        live_in[n] = scratch;
+        changed = true;
+      }
     }
-    block = block->next;
   }
 
-  return true;
+  // Widen each interval to every block it is live in. Keeping one interval
+  // per value leaves holes unused, but a loop-carried value stays put for the
+  // whole loop, which is what matters.
+  for (size_t n = 0; n < block_count; ++n) {
+    const auto& range = block_ranges_[n];
+    for (int index = live_in[n].find_first(); index != -1;
+         index = live_in[n].find_next(index)) {
+      Value* value = cross_block_values_[index];
+      auto& value_interval = interval(value);
+      if (range.first_ordinal < value_interval.start) {
+        // Reached ahead of its definition in block order.
+        value_interval.force_demote = true;
+      }
+      value_interval.end = std::max(value_interval.end, range.first_ordinal);
+    }
+    for (int index = live_out[n].find_first(); index != -1;
+         index = live_out[n].find_next(index)) {
+      Value* value = cross_block_values_[index];
+      auto& value_interval = interval(value);
+      // Guest calls don't preserve any allocatable register.
+      if (range.has_call) {
+        value_interval.force_demote = true;
+      }
+      value_interval.end =
+          std::max(value_interval.end, range.last_ordinal + 1);
+    }
+  }
 }
 
-void RegisterAllocationPass::DumpUsage(const char* name) {
-#if 0
-  fprintf(stdout, "\n%s:\n", name);
-  for (size_t i = 0; i < xe::countof(usage_sets_.all_sets); ++i) {
-    auto usage_set = usage_sets_.all_sets[i];
-    if (usage_set) {
-      fprintf(stdout, "set %s:\n", usage_set->set->name);
-      fprintf(stdout, "  avail: %s\n",
-              usage_set->availability.to_string().c_str());
-      fprintf(stdout, "  upcoming uses:\n");
-      for (auto it = usage_set->upcoming_uses.begin();
-           it != usage_set->upcoming_uses.end(); ++it) {
-        fprintf(stdout, "    v%d, used at %d\n",
-                it->value->ordinal,
-                it->use->instr->ordinal);
-      }
+void RegisterAllocationPass::DemoteCrossBlockValues(HIRBuilder* builder) {
+  std::vector<Value*> candidates;
+  for (auto value : cross_block_values_) {
+    if (interval(value).force_demote) {
+      DemoteValue(builder, value);
+    } else {
+      candidates.push_back(value);
+    }
+  }
+  std::sort(candidates.begin(), candidates.end(),
+            [this](const Value* a, const Value* b) {
+              return interval(a).start < interval(b).start;
+            });
+
+  // Classic linear scan over the cross-block intervals alone, with a budget
+  // that leaves kReservedRegisters of each set for everything else. The
+  // intervals losing out are the ones with the fewest uses per instruction
+  // covered.
+  for (uint32_t n = 0; n < class_count_; ++n) {
+    classes_[n].active.clear();
+  }
+  auto density = [this](const Value* value) {
+    const auto& value_interval = interval(value);
+    return double(value_interval.use_count) /
+           double(value_interval.end - value_interval.start + 1);
+  };
+  for (auto value : candidates) {
+    uint32_t start = interval(value).start;
+    auto register_class = RegisterClassForType(value->type);
+    auto& active = register_class->active;
+    active.erase(std::remove_if(active.begin(), active.end(),
+                                [this, start](const Value* active_value) {
+                                  return interval(active_value).end <= start;
+                                }),
+                 active.end());
+    active.push_back(value);
+    size_t budget = register_class->count > kReservedRegisters
+                        ? register_class->count - kReservedRegisters
+                        : 0;
+    while (active.size() > budget) {
+      auto sparsest = std::min_element(
+          active.begin(), active.end(),
+          [&density](const Value* a, const Value* b) {
+            return density(a) < density(b);
+          });
+      Value* demoted = *sparsest;
+      active.erase(sparsest);
+      DemoteValue(builder, demoted);
     }
   }
-  fflush(stdout);
-#endif
+  for (uint32_t n = 0; n < class_count_; ++n) {
+    classes_[n].active.clear();
+  }
 }
 
-void RegisterAllocationPass::PrepareBlockState() {
-  for (size_t i = 0; i < xe::countof(usage_sets_.all_sets); ++i) {
-    auto usage_set = usage_sets_.all_sets[i];
-    if (usage_set) {
-      usage_set->availability.set();
-      usage_set->upcoming_uses.clear();
+void RegisterAllocationPass::DemoteValue(HIRBuilder* builder, Value* value) {
+  ++last_stats_.demoted_count;
+
+  std::vector<Instr*> use_instrs;
+  for (auto use = value->use_head; use; use = use->next) {
+    use_instrs.push_back(use->instr);
+  }
+  std::sort(use_instrs.begin(), use_instrs.end());
+  use_instrs.erase(std::unique(use_instrs.begin(), use_instrs.end()),
+                   use_instrs.end());
+
+  // Store once right after the definition...
+  if (!value->local_slot) {
+    value->local_slot = builder->AllocLocal(value->type);
+  }
+  builder->StoreLocal(value->local_slot, value);
+  auto store = builder->last_instr();
+  InsertAfter(store, value->def);
+  store->ordinal = value->def->ordinal + 1;
+  ++last_stats_.spill_stores;
+
+  // ...and reload right before every use, so nothing has to stay in a
+  // register between blocks.
+  for (auto instr : use_instrs) {
+    auto head = PairHead(instr);
+    Value* reload = builder->LoadLocal(value->local_slot);
+    auto load = builder->last_instr();
+    load->MoveBefore(head);
+    load->ordinal = head->ordinal - 1;
+    reload->local_slot = value->local_slot;
+    ReplaceSources(instr, value, reload);
+    ++last_stats_.spill_loads;
+
+    uint32_t use_count = 0;
+    for (auto use = reload->use_head; use; use = use->next) {
+      ++use_count;
     }
+    interval(reload) = {load->ordinal, instr->ordinal, use_count, false,
+                        false};
   }
-  DumpUsage("PrepareBlockState");
+
+  auto& value_interval = interval(value);
+  value_interval.end = store->ordinal;
+  value_interval.use_count = 1;
+  value_interval.cross_block = false;
 }
 
-void RegisterAllocationPass::AdvanceUses(Instr* instr) {
-  for (size_t i = 0; i < xe::countof(usage_sets_.all_sets); ++i) {
-    auto usage_set = usage_sets_.all_sets[i];
-    if (!usage_set) {
-      break;
+bool RegisterAllocationPass::AllocateRegisters(HIRBuilder* builder) {
+  for (uint32_t n = 0; n < class_count_; ++n) {
+    auto& register_class = classes_[n];
+    register_class.available.reset();
+    for (uint32_t i = 0; i < register_class.count; ++i) {
+      register_class.available.set(i);
     }
-    auto& upcoming_uses = usage_set->upcoming_uses;
-    for (size_t j = 0; j < upcoming_uses.size();) {
-      auto& upcoming_use = upcoming_uses.at(j);
-      if (!upcoming_use.use) {
-        // No uses at all - we can remove right away.
-        // This comes up from instructions where the dest is never used,
-        // like the ATOMIC ops.
-        MarkRegAvailable(upcoming_use.value->reg);
-        upcoming_uses.erase(upcoming_uses.begin() + j);
-        // i remains the same.
+    register_class.active.clear();
+  }
+
+  for (auto block = builder->first_block(); block; block = block->next) {
+    // Spill code is inserted ahead of the walk, so it's visited as usual.
+    for (auto instr = block->instr_head; instr; instr = instr->next) {
+      uint32_t signature = instr->opcode->signature;
+      if (GET_OPCODE_SIG_TYPE_DEST(signature) != OPCODE_SIG_TYPE_V) {
         continue;
       }
-      if (upcoming_use.use->instr != instr) {
-        // Not yet at this instruction.
-        ++j;
-        continue;
+      // Must not have been set already.
+      assert_null(instr->dest->reg.set);
+
+      // Free everything whose last use is this instruction or earlier.
+      ExpireIntervals(instr->ordinal);
+
+      // If src1 dies here, try reusing its register for the dest. This way we
+      // can help along the stupid X86 two opcode instructions.
+      const RegAssignment* preferred_reg = nullptr;
+      if (GET_OPCODE_SIG_TYPE_SRC1(signature) == OPCODE_SIG_TYPE_V &&
+          IsRegisterValue(instr->src1.value) && instr->src1.value->reg.set &&
+          interval(instr->src1.value).end <= instr->ordinal) {
+        preferred_reg = &instr->src1.value->reg;
       }
-      // The use is from this instruction.
-      if (!upcoming_use.use->next) {
-        // Last use of the value. We can retire it now.
-        MarkRegAvailable(upcoming_use.value->reg);
-        upcoming_uses.erase(upcoming_uses.begin() + j);
-        // i remains the same.
-        continue;
-      } else {
-        // Used again. Push back the next use.
-        // Note that we may be used multiple times this instruction, so
-        // eat those.
-        auto next_use = upcoming_use.use->next;
-        while (next_use->next && next_use->instr == instr) {
-          next_use = next_use->next;
+
+      if (!TryAllocateRegister(instr->dest, preferred_reg)) {
+        // Failed to allocate register -- need to spill and try again.
+        if (!SpillOneRegister(builder, instr, instr->dest->type)) {
+          // Unable to spill anything - this shouldn't happen.
+          XELOGE("Unable to spill any registers");
+          assert_always();
+          return false;
+        }
+        if (!TryAllocateRegister(instr->dest, nullptr)) {
+          // Boned.
+          XELOGE("Register allocation failed");
+          assert_always();
+          return false;
         }
-        // Remove the iterator.
-        auto value = upcoming_use.value;
-        upcoming_uses.erase(upcoming_uses.begin() + j);
-        assert_true(next_use->instr->block == instr->block);
-        assert_true(value->def->block == instr->block);
-        upcoming_uses.emplace_back(value, next_use);
-        // i remains the same.
-        continue;
       }
+      ++last_stats_.value_count;
     }
   }
-  DumpUsage("AdvanceUses");
-}
 
-bool RegisterAllocationPass::IsRegInUse(const RegAssignment& reg) {
-  RegisterSetUsage* usage_set;
-  if (reg.set == usage_sets_.int_set->set) {
-    usage_set = usage_sets_.int_set;
-  } else if (reg.set == usage_sets_.float_set->set) {
-    usage_set = usage_sets_.float_set;
-  } else {
-    usage_set = usage_sets_.vec_set;
-  }
-  return !usage_set->availability.test(reg.index);
-}
-
-RegisterAllocationPass::RegisterSetUsage* RegisterAllocationPass::MarkRegUsed(
-    const RegAssignment& reg, Value* value, Value::Use* use) {
-  auto usage_set = RegisterSetForValue(value);
-  usage_set->availability.set(reg.index, false);
-  usage_set->upcoming_uses.emplace_back(value, use);
-  DumpUsage("MarkRegUsed");
-  return usage_set;
+  return true;
 }
 
-RegisterAllocationPass::RegisterSetUsage*
-RegisterAllocationPass::MarkRegAvailable(const hir::RegAssignment& reg) {
-  RegisterSetUsage* usage_set;
-  if (reg.set == usage_sets_.int_set->set) {
-    usage_set = usage_sets_.int_set;
-  } else if (reg.set == usage_sets_.float_set->set) {
-    usage_set = usage_sets_.float_set;
-  } else {
-    usage_set = usage_sets_.vec_set;
+void RegisterAllocationPass::ExpireIntervals(uint32_t ordinal) {
+  for (uint32_t n = 0; n < class_count_; ++n) {
+    auto& register_class = classes_[n];
+    auto& active = register_class.active;
+    for (size_t i = 0; i < active.size();) {
+      Value* value = active[i];
+      if (interval(value).end <= ordinal) {
+        register_class.available.set(value->reg.index);
+        active[i] = active.back();
+        active.pop_back();
+      } else {
+        ++i;
+      }
+    }
   }
-  usage_set->availability.set(reg.index, true);
-  return usage_set;
 }
 
 bool RegisterAllocationPass::TryAllocateRegister(
-    Value* value, const RegAssignment& preferred_reg) {
-  // If the preferred register matches type and is available, use it.
-  auto usage_set = RegisterSetForValue(value);
-  if (usage_set->set == preferred_reg.set) {
-    // Check if available.
-    if (!IsRegInUse(preferred_reg)) {
-      // Mark as in-use and return. Best case.
-      MarkRegUsed(preferred_reg, value, value->use_head);
-      value->reg = preferred_reg;
-      return true;
+    Value* value, const RegAssignment* preferred_reg) {
+  auto register_class = RegisterClassForType(value->type);
+  uint32_t index;
+  if (preferred_reg && preferred_reg->set == register_class->set &&
+      register_class->available.test(preferred_reg->index)) {
+    index = preferred_reg->index;
+  } else {
+    uint32_t available =
+        static_cast<uint32_t>(register_class->available.to_ulong());
+    if (!xe::bit_scan_forward(available, &index) ||
+        index >= register_class->count) {
+      // None available! Spill required.
+      return false;
     }
   }
-
-  // Otherwise, fallback to allocating like normal.
-  return TryAllocateRegister(value);
-}
-
-bool RegisterAllocationPass::TryAllocateRegister(Value* value) {
-  // Get the set this register is in.
-  RegisterSetUsage* usage_set = RegisterSetForValue(value);
-
-  // Find the first free register, if any.
-  // We have to ensure it's a valid one (in our count).
-  uint32_t first_unused = 0;
-  bool none_used = xe::bit_scan_forward(
-      static_cast<uint32_t>(usage_set->availability.to_ulong()), &first_unused);
-  if (none_used && first_unused < usage_set->count) {
-    // Available! Use it!
-    value->reg.set = usage_set->set;
-    value->reg.index = first_unused;
-    MarkRegUsed(value->reg, value, value->use_head);
-    return true;
-  }
-
-  // None available! Spill required.
-  return false;
+  value->reg.set = register_class->set;
+  value->reg.index = index;
+  register_class->available.reset(index);
+  register_class->active.push_back(value);
+  return true;
 }
 
-bool RegisterAllocationPass::SpillOneRegister(HIRBuilder* builder, Block* block,
+bool RegisterAllocationPass::SpillOneRegister(HIRBuilder* builder,
+                                              Instr* instr,
                                               TypeName required_type) {
-  // Get the set that we will be picking from.
-  RegisterSetUsage* usage_set;
-  if (required_type <= INT64_TYPE) {
-    usage_set = usage_sets_.int_set;
-  } else if (required_type <= FLOAT64_TYPE) {
-    usage_set = usage_sets_.float_set;
-  } else {
-    usage_set = usage_sets_.vec_set;
-  }
-
-  DumpUsage("SpillOneRegister (pre)");
-  // Pick the one with the furthest next use.
-  assert_true(!usage_set->upcoming_uses.empty());
-  auto furthest_usage =
-      std::max_element(usage_set->upcoming_uses.begin(),
-                       usage_set->upcoming_uses.end(), &RegisterUsage::Compare);
-  assert_true(furthest_usage->value->def->block == block);
-  assert_true(furthest_usage->use->instr->block == block);
-  auto spill_value = furthest_usage->value;
-  Value::Use* prev_use = furthest_usage->use->prev;
-  Value::Use* next_use = furthest_usage->use;
-  assert_not_null(next_use);
-  usage_set->upcoming_uses.erase(furthest_usage);
-  DumpUsage("SpillOneRegister (post)");
-  const auto reg = spill_value->reg;
-
-  // We know the spill_value use list is sorted, so we can cut it right now.
-  // This makes it easier down below.
-  auto new_head_use = next_use;
+  auto register_class = RegisterClassForType(required_type);
+  const uint32_t now = instr->ordinal;
+
+  // Pick the block-local value with the fewest remaining uses per instruction
+  // it would keep occupying the register for. Cross-block values are already
+  // within their budget.
+  Value* spill_value = nullptr;
+  Value::Use* next_use = nullptr;
+  double spill_density = 0;
+  uint32_t spill_end = 0;
+  for (auto value : register_class->active) {
+    const auto& value_interval = interval(value);
+    if (value_interval.cross_block) {
+      continue;
+    }
+    Value::Use* candidate_use = nullptr;
+    uint32_t remaining_uses = 0;
+    for (auto use = value->use_head; use; use = use->next) {
+      if (use->instr->ordinal <= now) {
+        continue;
+      }
+      ++remaining_uses;
+      if (!candidate_use ||
+          use->instr->ordinal < candidate_use->instr->ordinal) {
+        candidate_use = use;
+      }
+    }
+    if (!candidate_use || PairHead(candidate_use->instr)->ordinal <= now) {
+      continue;
+    }
+    double density =
+        double(remaining_uses) / double(value_interval.end - now);
+    if (!spill_value || density < spill_density ||
+        (density == spill_density && value_interval.end > spill_end)) {
+      spill_value = value;
+      next_use = candidate_use;
+      spill_density = density;
+      spill_end = value_interval.end;
+    }
+  }
+  if (!spill_value) {
+    return false;
+  }
+  ++last_stats_.spill_count;
 
   // Allocate local.
   if (spill_value->local_slot) {
     // Value is already assigned a slot. Since we allocate in order and this is
     // all SSA we know the stored value will be exactly what we want. Yay,
     // we can prevent the redundant store!
-    // In fact, we may even want to pin this spilled value so that we always
-    // use the spilled value and prevent the need for more locals.
   } else {
-    // Allocate a local slot.
     spill_value->local_slot = builder->AllocLocal(spill_value->type);
-
-    // Add store.
     builder->StoreLocal(spill_value->local_slot, spill_value);
     auto spill_store = builder->last_instr();
-    auto spill_store_use = spill_store->src2_use;
-    assert_null(spill_store_use->prev);
-    if (prev_use && prev_use->instr->opcode->flags & OPCODE_FLAG_PAIRED_PREV) {
-      // Instruction is paired. This is bad. We will insert the spill after the
-      // paired instruction.
-      assert_not_null(prev_use->instr->next);
-      spill_store->MoveBefore(prev_use->instr->next);
-
-      // Update last use.
-      spill_value->last_use = spill_store;
-    } else if (prev_use) {
-      // We insert the store immediately before the previous use.
-      // If we were smarter we could then re-run allocation and reuse the
-      // register
-      // once dropped.
-      spill_store->MoveBefore(prev_use->instr);
-
-      // Update last use.
-      spill_value->last_use = prev_use->instr;
-    } else {
-      // This is the first use, so the only thing we have is the define.
-      // Move the store to right after that.
-      spill_store->MoveBefore(spill_value->def->next);
-
-      // Update last use.
-      spill_value->last_use = spill_store;
-    }
+    InsertAfter(spill_store, spill_value->def);
+    spill_store->ordinal = spill_value->def->ordinal + 1;
+    ++last_stats_.spill_stores;
   }
 
-#if ASSERT_NO_CYCLES
-  builder->AssertNoCycles();
-  spill_value->def->block->AssertNoCycles();
-#endif  // ASSERT_NO_CYCLES
-
   // Add load.
   // Inserted immediately before the next use. Since by definition the next
   // use is after the instruction requesting the spill we know we haven't
   // done allocation for that code yet and can let that be handled
   // automatically when we get to it.
+  auto spill_head = PairHead(next_use->instr);
   auto new_value = builder->LoadLocal(spill_value->local_slot);
   auto spill_load = builder->last_instr();
-  spill_load->MoveBefore(next_use->instr);
-  // Note: implicit first use added.
-
-#if ASSERT_NO_CYCLES
-  builder->AssertNoCycles();
-  spill_value->def->block->AssertNoCycles();
-#endif  // ASSERT_NO_CYCLES
+  spill_load->MoveBefore(spill_head);
+  spill_load->ordinal = spill_head->ordinal - 1;
+  ++last_stats_.spill_loads;
 
   // Set the local slot of the new value to our existing one. This way we will
   // reuse that same memory if needed.
@@ -424,140 +591,59 @@ bool RegisterAllocationPass::SpillOneRegister(HIRBuilder* builder, Block* block,
 
   // Rename all future uses of the SSA value to the new value as loaded
   // from the local.
-  // We can quickly do this by walking the use list. Because the list is
-  // already sorted we know we are going to end up with a sorted list.
-  auto walk_use = new_head_use;
-  auto new_use_tail = walk_use;
-  while (walk_use) {
-    auto next_walk_use = walk_use->next;
-    auto instr = walk_use->instr;
-
-    uint32_t signature = instr->opcode->signature;
-    if (GET_OPCODE_SIG_TYPE_SRC1(signature) == OPCODE_SIG_TYPE_V) {
-      if (instr->src1.value == spill_value) {
-        instr->set_src1(new_value);
-      }
-    }
-    if (GET_OPCODE_SIG_TYPE_SRC2(signature) == OPCODE_SIG_TYPE_V) {
-      if (instr->src2.value == spill_value) {
-        instr->set_src2(new_value);
-      }
-    }
-    if (GET_OPCODE_SIG_TYPE_SRC3(signature) == OPCODE_SIG_TYPE_V) {
-      if (instr->src3.value == spill_value) {
-        instr->set_src3(new_value);
-      }
-    }
-
-    walk_use = next_walk_use;
-    if (walk_use) {
-      new_use_tail = walk_use;
+  std::vector<Instr*> future_instrs;
+  for (auto use = spill_value->use_head; use; use = use->next) {
+    if (use->instr->ordinal > now && use->instr != spill_load) {
+      future_instrs.push_back(use->instr);
     }
   }
-  new_value->last_use = new_use_tail->instr;
+  uint32_t end = interval(spill_value).end;
+  for (auto future_instr : future_instrs) {
+    ReplaceSources(future_instr, spill_value, new_value);
+  }
+  uint32_t use_count = 0;
+  for (auto use = new_value->use_head; use; use = use->next) {
+    ++use_count;
+  }
+  interval(new_value) = {spill_load->ordinal, end, use_count, false, false};
 
-  // Update tracking.
-  MarkRegAvailable(reg);
+  // The old value is done with its register.
+  interval(spill_value).end = now;
+  auto& active = register_class->active;
+  active.erase(std::find(active.begin(), active.end(), spill_value));
+  register_class->available.set(spill_value->reg.index);
 
   return true;
 }
 
-RegisterAllocationPass::RegisterSetUsage*
-RegisterAllocationPass::RegisterSetForValue(const Value* value) {
-  if (value->type <= INT64_TYPE) {
-    return usage_sets_.int_set;
-  } else if (value->type <= FLOAT64_TYPE) {
-    return usage_sets_.float_set;
-  } else {
-    return usage_sets_.vec_set;
+RegisterAllocationPass::Interval& RegisterAllocationPass::interval(
+    const Value* value) {
+  if (value->ordinal >= intervals_.size()) {
+    intervals_.resize(value->ordinal + 1,
+                      Interval{UINT32_MAX, 0, 0, false, false});
   }
+  return intervals_[value->ordinal];
 }
 
-namespace {
-int CompareValueUse(const Value::Use* a, const Value::Use* b) {
-  return a->instr->ordinal - b->instr->ordinal;
-}
-}  // namespace
-void RegisterAllocationPass::SortUsageList(Value* value) {
-  // Modified in-place linked list sort from:
-  // https://www.chiark.greenend.org.uk/~sgtatham/algorithms/listsort.c
-  if (!value->use_head) {
-    return;
-  }
-  Value::Use* head = value->use_head;
-  Value::Use* tail = nullptr;
-  int insize = 1;
-  while (true) {
-    auto p = head;
-    head = nullptr;
-    tail = nullptr;
-    // count number of merges we do in this pass
-    int nmerges = 0;
-    while (p) {
-      // there exists a merge to be done
-      nmerges++;
-      // step 'insize' places along from p
-      auto q = p;
-      int psize = 0;
-      for (int i = 0; i < insize; i++) {
-        psize++;
-        q = q->next;
-        if (!q) break;
-      }
-      // if q hasn't fallen off end, we have two lists to merge
-      int qsize = insize;
-      // now we have two lists; merge them
-      while (psize > 0 || (qsize > 0 && q)) {
-        // decide whether next element of merge comes from p or q
-        Value::Use* e = nullptr;
-        if (psize == 0) {
-          // p is empty; e must come from q
-          e = q;
-          q = q->next;
-          qsize--;
-        } else if (qsize == 0 || !q) {
-          // q is empty; e must come from p
-          e = p;
-          p = p->next;
-          psize--;
-        } else if (CompareValueUse(p, q) <= 0) {
-          // First element of p is lower (or same); e must come from p
-          e = p;
-          p = p->next;
-          psize--;
-        } else {
-          // First element of q is lower; e must come from q
-          e = q;
-          q = q->next;
-          qsize--;
-        }
-        // add the next element to the merged list
-        if (tail) {
-          tail->next = e;
-        } else {
-          head = e;
-        }
-        // Maintain reverse pointers in a doubly linked list.
-        e->prev = tail;
-        tail = e;
-      }
-      // now p has stepped 'insize' places along, and q has too
-      p = q;
-    }
-    if (tail) {
-      tail->next = nullptr;
-    }
-    // If we have done only one merge, we're finished
-    if (nmerges <= 1) {
-      // allow for nmerges==0, the empty list case
-      break;
-    }
-    // Otherwise repeat, merging lists twice the size
-    insize *= 2;
+RegisterAllocationPass::RegisterClass*
+RegisterAllocationPass::RegisterClassForType(TypeName type) {
+  if (type <= INT64_TYPE) {
+    return int_class_;
+  } else if (type <= FLOAT64_TYPE) {
+    return float_class_;
+  } else {
+    return vec_class_;
   }
+}
 
-  value->use_head = head;
-  value->last_use = tail->instr;
+void RegisterAllocationPass::GetCounters(
+    std::vector<CompileProfiler::Counter>* counters) const {
+  counters->push_back({"values", last_stats_.value_count});
+  counters->push_back({"cross_block_values", last_stats_.cross_block_count});
+  counters->push_back({"demoted_values", last_stats_.demoted_count});
+  counters->push_back({"spills", last_stats_.spill_count});
+  counters->push_back({"spill_stores", last_stats_.spill_stores});
+  counters->push_back({"spill_loads", last_stats_.spill_loads});
 }
 
 }  // namespace passes
@@ -1,10 +1,8 @@
-
 #ifndef XENIA_CPU_COMPILER_PASSES_REGISTER_ALLOCATION_PASS_H_
 #define XENIA_CPU_COMPILER_PASSES_REGISTER_ALLOCATION_PASS_H_
 
 #include <algorithm>
 #include <bitset>
-#include <functional>
 #include <vector>
 
 #include "xenia/cpu/backend/machine_info.h"
@@ -15,59 +13,102 @@ namespace cpu {
 namespace compiler {
 namespace passes {
 
+// Linear-scan allocator over live intervals.
+//
+// Every value gets a single register for its whole interval, as the emitter
+// expects. Values live across blocks have their interval widened to cover
+// every block they are live in (including whole loops), and compete for all
+// but kReservedRegisters of each set; the lowest use density ones are demoted
+// to a local up front. Values within a block are split on demand instead: the
+// active value with the lowest remaining use density is stored to a local and
+// reloaded ahead of its next use.
 class RegisterAllocationPass : public CompilerPass {
  public:
+  // Allocation results of the last function, for comparing spill traffic.
+  struct Stats {
+    uint32_t value_count;
+    // Values live across a block boundary.
+    uint32_t cross_block_count;
+    // Cross-block values kept in a local instead of a register.
+    uint32_t demoted_count;
+    // Block-local values split to make room.
+    uint32_t spill_count;
+    // Inserted STORE_LOCAL/LOAD_LOCAL instructions.
+    uint32_t spill_stores;
+    uint32_t spill_loads;
+  };
+
   explicit RegisterAllocationPass(const backend::MachineInfo* machine_info);
   ~RegisterAllocationPass() override;
 
+  const char* name() const override { return "RegisterAllocation"; }
   bool Run(hir::HIRBuilder* builder) override;
 
+  const Stats& last_stats() const { return last_stats_; }
+  void GetCounters(
+      std::vector<CompileProfiler::Counter>* counters) const override;
+
  private:
-  // TODO(benvanik): rewrite all this set shit -- too much indirection, the
-  // complexity is not needed.
-  struct RegisterUsage {
-    hir::Value* value;
-    hir::Value::Use* use;
-    RegisterUsage() : value(nullptr), use(nullptr) {}
-    RegisterUsage(hir::Value* value_, hir::Value::Use* use_)
-        : value(value_), use(use_) {}
-    static bool Compare(const RegisterUsage& a, const RegisterUsage& b) {
-      return a.use->instr->ordinal < b.use->instr->ordinal;
-    }
-  };
-  struct RegisterSetUsage {
+  // Registers of each set never handed to cross-block values, so block-local
+  // values (and the reloads of demoted ones) always have room.
+  static const uint32_t kReservedRegisters = 4;
+
+  struct RegisterClass {
     const backend::MachineInfo::RegisterSet* set = nullptr;
     uint32_t count = 0;
-    std::bitset<32> availability = 0;
-    // TODO(benvanik): another data type.
-    std::vector<RegisterUsage> upcoming_uses;
+    std::bitset<32> available;
+    // Values currently holding one of the registers.
+    std::vector<hir::Value*> active;
   };
 
-  void DumpUsage(const char* name);
-  void PrepareBlockState();
-  void AdvanceUses(hir::Instr* instr);
-  bool IsRegInUse(const hir::RegAssignment& reg);
-  RegisterSetUsage* MarkRegUsed(const hir::RegAssignment& reg,
-                                hir::Value* value, hir::Value::Use* use);
-  RegisterSetUsage* MarkRegAvailable(const hir::RegAssignment& reg);
+  // Indexed by value ordinal. Instruction ordinals are spaced by 2 so
+  // inserted spill code can be numbered in between.
+  struct Interval {
+    uint32_t start;
+    // Ordinal of the last instruction that needs the register.
+    uint32_t end;
+    uint32_t use_count;
+    bool cross_block;
+    // Must live in a local: live across a call or ahead of its definition.
+    bool force_demote;
+  };
 
+  struct BlockRange {
+    uint32_t first_ordinal;
+    uint32_t last_ordinal;
+    bool has_call;
+    std::vector<uint16_t> successors;
+  };
+
+  void NumberInstructions(hir::HIRBuilder* builder);
+  bool ComputeIntervals(hir::HIRBuilder* builder);
+  void ExtendCrossBlockIntervals(hir::HIRBuilder* builder);
+  void DemoteCrossBlockValues(hir::HIRBuilder* builder);
+  void DemoteValue(hir::HIRBuilder* builder, hir::Value* value);
+
+  bool AllocateRegisters(hir::HIRBuilder* builder);
+  void ExpireIntervals(uint32_t ordinal);
   bool TryAllocateRegister(hir::Value* value,
-                           const hir::RegAssignment& preferred_reg);
-  bool TryAllocateRegister(hir::Value* value);
-  bool SpillOneRegister(hir::HIRBuilder* builder, hir::Block* block,
+                           const hir::RegAssignment* preferred_reg);
+  bool SpillOneRegister(hir::HIRBuilder* builder, hir::Instr* instr,
                         hir::TypeName required_type);
 
-  RegisterSetUsage* RegisterSetForValue(const hir::Value* value);
-
-  void SortUsageList(hir::Value* value);
+  Interval& interval(const hir::Value* value);
+  RegisterClass* RegisterClassForType(hir::TypeName type);
 
  private:
-  struct {
-    RegisterSetUsage* int_set = nullptr;
-    RegisterSetUsage* float_set = nullptr;
-    RegisterSetUsage* vec_set = nullptr;
-    RegisterSetUsage* all_sets[3];
-  } usage_sets_;
+  // One per MachineInfo register set; float and vector values may share one.
+  RegisterClass classes_[8];
+  uint32_t class_count_ = 0;
+  RegisterClass* int_class_ = nullptr;
+  RegisterClass* float_class_ = nullptr;
+  RegisterClass* vec_class_ = nullptr;
+
+  std::vector<Interval> intervals_;
+  std::vector<BlockRange> block_ranges_;
+  std::vector<hir::Value*> cross_block_values_;
+
+  Stats last_stats_ = {};
 };
 
 }  // namespace passes
@@ -0,0 +1,173 @@
+#include "xenia/cpu/compiler/passes/save_rest_expansion_pass.h"
+
+#include "xenia/base/profiling.h"
+#include "xenia/cpu/function.h"
+#include "xenia/cpu/ppc/ppc_context.h"
+#include "xenia/cpu/processor.h"
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+namespace passes {
+
+// TODO(benvanik): remove when enums redefined.
+using namespace xe::cpu::hir;
+
+using xe::cpu::hir::Block;
+using xe::cpu::hir::HIRBuilder;
+using xe::cpu::hir::Instr;
+using xe::cpu::hir::Value;
+
+static size_t GprOffset(uint32_t n) {
+  return offsetof(ppc::PPCContext, r) + n * sizeof(uint64_t);
+}
+
+static size_t FprOffset(uint32_t n) {
+  return offsetof(ppc::PPCContext, f) + n * sizeof(double);
+}
+
+static size_t VrOffset(uint32_t n) {
+  return offsetof(ppc::PPCContext, v) + n * sizeof(vec128_t);
+}
+
+SaveRestExpansionPass::SaveRestExpansionPass() : CompilerPass() {}
+
+SaveRestExpansionPass::~SaveRestExpansionPass() = default;
+
+bool SaveRestExpansionPass::Run(HIRBuilder* builder) {
+  SCOPE_profile_cpu_f("cpu");
+
+  last_stats_ = {};
+  for (auto block = builder->first_block(); block; block = block->next) {
+    auto i = block->instr_head;
+    while (i) {
+      auto next = i->next;
+      if (i->opcode == &OPCODE_CALL_info && i->src1.symbol->flags() &&
+          ((i->flags & CALL_TAIL) ||
+           !(i->src1.symbol->flags() & Function::kFlagRestGprLr))) {
+        Expand(builder, i);
+        ++last_stats_.expanded_count;
+      }
+      i = next;
+    }
+  }
+  if (last_stats_.expanded_count) {
+    processor_->inline_registry()->RecordExpandedSaveRest(
+        last_stats_.expanded_count);
+  }
+  return true;
+}
+
+void SaveRestExpansionPass::Expand(HIRBuilder* builder, Instr* call) {
+  // The builder appends to the end of the function, in a new block if the
+  // last one was ended; everything is moved in front of the call afterwards
+  // and the new block removed again.
+  Block* last_block = builder->last_block();
+  Block* current_block = builder->current_block();
+  Instr* mark = current_block ? current_block->instr_tail : nullptr;
+
+  Function* helper = call->src1.symbol;
+  uint32_t flags = helper->flags();
+  uint32_t first = helper->save_rest_register();
+  bool returns = false;
+  if (flags & (Function::kFlagSaveGprLr | Function::kFlagRestGprLr)) {
+    // std/ld rN, -(8 * (32 - N) + 8)(r1), then the LR slot at -8(r1).
+    bool save = (flags & Function::kFlagSaveGprLr) != 0;
+    Value* sp = builder->LoadContext(GprOffset(1), INT64_TYPE);
+    for (uint32_t n = first; n <= 31; ++n) {
+      Value* address = builder->Add(
+          sp, builder->LoadConstantInt64(-int64_t(8 * (32 - n) + 8)));
+      if (save) {
+        builder->Store(address, builder->LoadContext(GprOffset(n), INT64_TYPE),
+                       LOAD_STORE_BYTE_SWAP);
+      } else {
+        builder->StoreContext(
+            GprOffset(n),
+            builder->Load(address, INT64_TYPE, LOAD_STORE_BYTE_SWAP));
+      }
+    }
+    Value* lr_address = builder->Add(sp, builder->LoadConstantInt64(-8));
+    if (save) {
+      builder->Store(lr_address,
+                     builder->Truncate(
+                         builder->LoadContext(GprOffset(12), INT64_TYPE),
+                         INT32_TYPE),
+                     LOAD_STORE_BYTE_SWAP);
+    } else {
+      // lwz r12, -8(r1); mtlr r12; blr
+      Value* lr = builder->ZeroExtend(
+          builder->Load(lr_address, INT32_TYPE, LOAD_STORE_BYTE_SWAP),
+          INT64_TYPE);
+      builder->StoreContext(GprOffset(12), lr);
+      builder->StoreContext(offsetof(ppc::PPCContext, lr), lr);
+      builder->CallIndirect(lr, CALL_TAIL | CALL_POSSIBLE_RETURN);
+      returns = true;
+    }
+  } else if (flags & (Function::kFlagSaveFpr | Function::kFlagRestFpr)) {
+    // stfd/lfd fN, -8 * (32 - N)(r12)
+    Value* base = builder->LoadContext(GprOffset(12), INT64_TYPE);
+    for (uint32_t n = first; n <= 31; ++n) {
+      Value* address = builder->Add(
+          base, builder->LoadConstantInt64(-int64_t(8 * (32 - n))));
+      if (flags & Function::kFlagSaveFpr) {
+        builder->Store(
+            address,
+            builder->Cast(builder->LoadContext(FprOffset(n), FLOAT64_TYPE),
+                          INT64_TYPE),
+            LOAD_STORE_BYTE_SWAP);
+      } else {
+        builder->StoreContext(
+            FprOffset(n),
+            builder->Cast(
+                builder->Load(address, INT64_TYPE, LOAD_STORE_BYTE_SWAP),
+                FLOAT64_TYPE));
+      }
+    }
+  } else {
+    // li r11, -16 * (last + 1 - N); stvx/lvx vN, r11, r12
+    uint32_t last = first < 64 ? 31 : 127;
+    Value* base = builder->LoadContext(GprOffset(12), INT64_TYPE);
+    for (uint32_t n = first; n <= last; ++n) {
+      Value* address = builder->And(
+          builder->Add(base, builder->LoadConstantInt64(
+                                 -int64_t(16 * (last + 1 - n)))),
+          builder->LoadConstantInt64(~int64_t(0xF)));
+      if (flags & Function::kFlagSaveVmx) {
+        builder->Store(address, builder->LoadContext(VrOffset(n), VEC128_TYPE),
+                       LOAD_STORE_BYTE_SWAP);
+      } else {
+        builder->StoreContext(
+            VrOffset(n),
+            builder->Load(address, VEC128_TYPE, LOAD_STORE_BYTE_SWAP));
+      }
+    }
+    builder->StoreContext(GprOffset(11), builder->LoadConstantInt64(-16));
+  }
+  if ((call->flags & CALL_TAIL) && !returns) {
+    // b __savegprlr_N and the like: the helper's blr returns for the caller.
+    builder->CallIndirect(
+        builder->LoadContext(offsetof(ppc::PPCContext, lr), INT64_TYPE),
+        CALL_TAIL | CALL_POSSIBLE_RETURN);
+  }
+
+  auto i = mark ? mark->next : builder->last_block()->instr_head;
+  while (i) {
+    auto next = i->next;
+    i->MoveBefore(call);
+    i = next;
+  }
+  call->Remove();
+  if (builder->last_block() != last_block) {
+    builder->RemoveBlock(builder->last_block());
+  }
+}
+
+void SaveRestExpansionPass::GetCounters(
+    std::vector<CompileProfiler::Counter>* counters) const {
+  counters->push_back({"expanded_calls", last_stats_.expanded_count});
+}
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
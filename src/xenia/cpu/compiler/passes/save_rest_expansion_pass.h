@@ -0,0 +1,48 @@
+#ifndef XENIA_CPU_COMPILER_PASSES_SAVE_REST_EXPANSION_PASS_H_
+#define XENIA_CPU_COMPILER_PASSES_SAVE_REST_EXPANSION_PASS_H_
+
+#include "xenia/cpu/compiler/compiler_pass.h"
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+namespace passes {
+
+// Replaces calls to the __savegprlr_N/__restgprlr_N, __savefpr_N/__restfpr_N
+// and __savevmx_N/__restvmx_N helpers XexModule found with the stores to or
+// loads from the stack they would do, straight between the context and
+// memory. Prologs and epilogs then stop costing a call and a return each,
+// and later passes can see which registers went where.
+//
+// __restgprlr_N returns from its caller, so only tail calls to it (the usual
+// b __restgprlr_N) are expanded; the expansion ends in the same jump to the
+// restored LR the helper would have done.
+class SaveRestExpansionPass : public CompilerPass {
+ public:
+  // Results of the last function run through this pass.
+  struct Stats {
+    uint32_t expanded_count;
+  };
+
+  SaveRestExpansionPass();
+  ~SaveRestExpansionPass() override;
+
+  const char* name() const override { return "SaveRestExpansion"; }
+  bool Run(hir::HIRBuilder* builder) override;
+
+  const Stats& last_stats() const { return last_stats_; }
+  void GetCounters(
+      std::vector<CompileProfiler::Counter>* counters) const override;
+
+ private:
+  void Expand(hir::HIRBuilder* builder, hir::Instr* call);
+
+  Stats last_stats_ = {};
+};
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_COMPILER_PASSES_SAVE_REST_EXPANSION_PASS_H_
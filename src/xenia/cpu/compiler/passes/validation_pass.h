@@ -13,6 +13,7 @@ class ValidationPass : public CompilerPass {
   ValidationPass();
   ~ValidationPass() override;
 
+  const char* name() const override { return "Validation"; }
   bool Run(hir::HIRBuilder* builder) override;
 
  private:
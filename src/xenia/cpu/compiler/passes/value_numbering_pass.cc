@@ -0,0 +1,297 @@
+#include "xenia/cpu/compiler/passes/value_numbering_pass.h"
+
+#include <algorithm>
+#include <cstring>
+#include <tuple>
+
+#include "xenia/base/profiling.h"
+#include "xenia/cpu/hir/block.h"
+#include "xenia/cpu/hir/instr.h"
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+namespace passes {
+
+// TODO(benvanik): remove when enums redefined.
+using namespace xe::cpu::hir;
+
+using xe::cpu::hir::Block;
+using xe::cpu::hir::HIRBuilder;
+using xe::cpu::hir::Instr;
+using xe::cpu::hir::Value;
+
+enum OperandKind : uint32_t {
+  kOperandNone,
+  kOperandValue,
+  kOperandConstant,
+  kOperandOffset,
+  kOperandSymbol,
+};
+
+// Loads kept available at a time; older ones are forgotten.
+static const size_t kMaxAvailableLoads = 32;
+
+static bool IsLoad(const Instr* i) {
+  return i->opcode == &OPCODE_LOAD_info ||
+         i->opcode == &OPCODE_LOAD_OFFSET_info;
+}
+
+static bool IsStore(const Instr* i) {
+  return i->opcode == &OPCODE_STORE_info ||
+         i->opcode == &OPCODE_STORE_OFFSET_info;
+}
+
+static bool IsFloatType(TypeName type) {
+  return type == FLOAT32_TYPE || type == FLOAT64_TYPE || type == VEC128_TYPE;
+}
+
+// Skips the ASSIGNs earlier numbering left behind, so their results number
+// the same as what they assign.
+static Value* Resolve(Value* value) {
+  while (value->def && value->def->opcode == &OPCODE_ASSIGN_info) {
+    value = value->def->src1.value;
+  }
+  return value;
+}
+
+// Whether the result only depends on the operands, and the instruction can
+// go away once it is known.
+static bool IsPure(const Instr* i) {
+  uint32_t signature = i->opcode->signature;
+  if (GET_OPCODE_SIG_TYPE_DEST(signature) != OPCODE_SIG_TYPE_V || !i->dest) {
+    return false;
+  }
+  if (i->opcode->flags & (OPCODE_FLAG_BRANCH | OPCODE_FLAG_MEMORY |
+                          OPCODE_FLAG_VOLATILE | OPCODE_FLAG_PAIRED_PREV)) {
+    return false;
+  }
+  // DID_SATURATE reads the flags the instruction before it left.
+  if (i->next && (i->next->opcode->flags & OPCODE_FLAG_PAIRED_PREV)) {
+    return false;
+  }
+  if (GET_OPCODE_SIG_TYPE_SRC1(signature) == OPCODE_SIG_TYPE_L ||
+      GET_OPCODE_SIG_TYPE_SRC2(signature) == OPCODE_SIG_TYPE_L ||
+      GET_OPCODE_SIG_TYPE_SRC3(signature) == OPCODE_SIG_TYPE_L) {
+    return false;
+  }
+  // Guest state is ContextPromotionPass's business.
+  return i->opcode != &OPCODE_ASSIGN_info &&
+         i->opcode != &OPCODE_LOAD_CLOCK_info &&
+         i->opcode != &OPCODE_LOAD_LOCAL_info &&
+         i->opcode != &OPCODE_LOAD_CONTEXT_info;
+}
+
+static void ReplaceWithValue(Instr* i, Value* value) {
+  i->Replace(&OPCODE_ASSIGN_info, 0);
+  i->set_src1(value);
+}
+
+size_t ValueNumberingPass::KeyHash::operator()(const Key& key) const {
+  size_t hash = reinterpret_cast<uintptr_t>(key.opcode);
+  hash = hash * 31 + key.flags;
+  hash = hash * 31 + key.type;
+  for (const auto& operand : key.src) {
+    hash = hash * 31 + operand.kind;
+    hash = hash * 31 + size_t(operand.bits[0] ^ (operand.bits[0] >> 32));
+    hash = hash * 31 + size_t(operand.bits[1] ^ (operand.bits[1] >> 32));
+  }
+  return hash;
+}
+
+ValueNumberingPass::ValueNumberingPass() : CompilerPass() {}
+
+ValueNumberingPass::~ValueNumberingPass() = default;
+
+bool ValueNumberingPass::Run(HIRBuilder* builder) {
+  SCOPE_profile_cpu_f("cpu");
+
+  last_stats_ = {};
+  rounding_mode_changes_ = false;
+  for (auto block = builder->first_block(); block; block = block->next) {
+    for (auto i = block->instr_head; i; i = i->next) {
+      if (i->opcode == &OPCODE_SET_ROUNDING_MODE_info) {
+        // Floating-point results depend on where they are computed then.
+        // This is rare enough not to bother tracking the mode.
+        rounding_mode_changes_ = true;
+      }
+    }
+  }
+
+  analysis_.Analyze(builder);
+  if (!analysis_.block_count()) {
+    return true;
+  }
+  available_.clear();
+  NumberBlock(analysis_.block(0), {});
+  available_.clear();
+  return true;
+}
+
+ValueNumberingPass::Key ValueNumberingPass::MakeKey(const Instr* i) const {
+  Key key = {};
+  key.opcode = i->opcode;
+  key.flags = i->flags;
+  key.type = i->dest->type;
+  uint32_t signature = i->opcode->signature;
+  const Instr::Op* ops[3] = {&i->src1, &i->src2, &i->src3};
+  OpcodeSignatureType types[3] = {
+      OpcodeSignatureType(GET_OPCODE_SIG_TYPE_SRC1(signature)),
+      OpcodeSignatureType(GET_OPCODE_SIG_TYPE_SRC2(signature)),
+      OpcodeSignatureType(GET_OPCODE_SIG_TYPE_SRC3(signature)),
+  };
+  for (size_t n = 0; n < 3; ++n) {
+    auto& operand = key.src[n];
+    switch (types[n]) {
+      case OPCODE_SIG_TYPE_V: {
+        auto value = Resolve(ops[n]->value);
+        if (value->IsConstant()) {
+          operand.kind = kOperandConstant | (uint32_t(value->type) << 8);
+          std::memcpy(operand.bits, &value->constant,
+                      GetTypeSize(value->type));
+        } else {
+          operand.kind = kOperandValue;
+          operand.bits[0] = reinterpret_cast<uintptr_t>(value);
+        }
+        break;
+      }
+      case OPCODE_SIG_TYPE_O:
+        operand.kind = kOperandOffset;
+        operand.bits[0] = ops[n]->offset;
+        break;
+      case OPCODE_SIG_TYPE_S:
+        operand.kind = kOperandSymbol;
+        operand.bits[0] = reinterpret_cast<uintptr_t>(ops[n]->symbol);
+        break;
+      default:
+        operand.kind = kOperandNone;
+        break;
+    }
+  }
+  if (i->opcode->flags & OPCODE_FLAG_COMMUNATIVE) {
+    // Order the operands the same whichever way round they were written.
+    auto& a = key.src[0];
+    auto& b = key.src[1];
+    if (std::tie(a.kind, a.bits[0], a.bits[1]) >
+        std::tie(b.kind, b.bits[0], b.bits[1])) {
+      std::swap(a, b);
+    }
+  }
+  return key;
+}
+
+ValueNumberingPass::Access ValueNumberingPass::GetAccess(const Instr* i) {
+  Access access = {Resolve(i->src1.value), 0, 0};
+  TypeName type = IsLoad(i) ? i->dest->type
+                  : i->opcode == &OPCODE_STORE_OFFSET_info
+                      ? i->src3.value->type
+                      : i->src2.value->type;
+  access.size = uint32_t(GetTypeSize(type));
+  if (i->opcode == &OPCODE_LOAD_OFFSET_info ||
+      i->opcode == &OPCODE_STORE_OFFSET_info) {
+    auto offset = Resolve(i->src2.value);
+    if (!offset->IsConstant()) {
+      access.size = 0;
+      return access;
+    }
+    access.offset = offset->constant.i64;
+  }
+  // The frontend computes displacements with an ADD of a constant.
+  auto def = access.base->def;
+  if (def && def->opcode == &OPCODE_ADD_info) {
+    auto addend = Resolve(def->src2.value);
+    if (addend->IsConstant() && addend->type == INT64_TYPE) {
+      access.base = Resolve(def->src1.value);
+      access.offset += addend->constant.i64;
+    }
+  }
+  return access;
+}
+
+bool ValueNumberingPass::MayAlias(const Access& a, const Access& b) {
+  if (!a.size || !b.size || a.base != b.base) {
+    return true;
+  }
+  return a.offset < b.offset + int64_t(b.size) &&
+         b.offset < a.offset + int64_t(a.size);
+}
+
+void ValueNumberingPass::NumberBlock(Block* block,
+                                     std::vector<AvailableLoad> loads) {
+  std::vector<Key> inserted;
+  for (auto i = block->instr_head; i; i = i->next) {
+    if (IsLoad(i)) {
+      Key key = MakeKey(i);
+      auto it = std::find_if(
+          loads.begin(), loads.end(),
+          [&key](const AvailableLoad& load) { return load.key == key; });
+      if (it != loads.end()) {
+        ReplaceWithValue(i, it->value);
+        ++last_stats_.eliminated_load_count;
+        continue;
+      }
+      if (loads.size() == kMaxAvailableLoads) {
+        loads.erase(loads.begin());
+      }
+      loads.push_back({key, GetAccess(i), i->dest});
+      continue;
+    }
+    if (IsStore(i)) {
+      Access access = GetAccess(i);
+      loads.erase(std::remove_if(loads.begin(), loads.end(),
+                                 [&access](const AvailableLoad& load) {
+                                   return MayAlias(load.access, access);
+                                 }),
+                  loads.end());
+      continue;
+    }
+    if (i->opcode->flags & (OPCODE_FLAG_MEMORY | OPCODE_FLAG_VOLATILE)) {
+      // Calls, barriers, atomics, MMIO and memsets.
+      loads.clear();
+      continue;
+    }
+    if (!IsPure(i)) {
+      continue;
+    }
+    if (rounding_mode_changes_ &&
+        (IsFloatType(i->dest->type) ||
+         (GET_OPCODE_SIG_TYPE_SRC1(i->opcode->signature) ==
+              OPCODE_SIG_TYPE_V &&
+          IsFloatType(i->src1.value->type)))) {
+      continue;
+    }
+    Key key = MakeKey(i);
+    auto it = available_.find(key);
+    if (it != available_.end()) {
+      ReplaceWithValue(i, it->second);
+      ++last_stats_.eliminated_count;
+      continue;
+    }
+    available_.emplace(key, i->dest);
+    inserted.push_back(key);
+  }
+
+  for (auto dominated : analysis_.dominated(block->ordinal)) {
+    // Only a block entered from here alone sees memory as it was left.
+    if (analysis_.predecessors(dominated).size() == 1) {
+      NumberBlock(analysis_.block(dominated), loads);
+    } else {
+      NumberBlock(analysis_.block(dominated), {});
+    }
+  }
+
+  for (const auto& key : inserted) {
+    available_.erase(key);
+  }
+}
+
+void ValueNumberingPass::GetCounters(
+    std::vector<CompileProfiler::Counter>* counters) const {
+  counters->push_back({"eliminated", last_stats_.eliminated_count});
+  counters->push_back({"eliminated_loads", last_stats_.eliminated_load_count});
+}
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
@@ -0,0 +1,102 @@
+#ifndef XENIA_CPU_COMPILER_PASSES_VALUE_NUMBERING_PASS_H_
+#define XENIA_CPU_COMPILER_PASSES_VALUE_NUMBERING_PASS_H_
+
+#include <unordered_map>
+#include <vector>
+
+#include "xenia/cpu/compiler/compiler_pass.h"
+#include "xenia/cpu/compiler/loop_analysis.h"
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+namespace passes {
+
+// Dominator-based global value numbering.
+//
+// Walks the dominator tree keeping a scoped table of the pure computations
+// available on the way down; an instruction computing the same thing from the
+// same operands as one that dominates it becomes an ASSIGN of the earlier
+// result, for SimplificationPass and DCE to clean up. Commutative operands are
+// numbered in a canonical order and constants by their contents.
+//
+// Guest memory loads are reused too, but only until anything that may write
+// the location (a store to it, a call, a barrier or an atomic), and only along
+// chains of blocks with a single predecessor each.
+class ValueNumberingPass : public CompilerPass {
+ public:
+  // Results of the last function run through this pass.
+  struct Stats {
+    // Pure instructions replaced by an earlier result.
+    uint32_t eliminated_count;
+    // Loads replaced by an earlier load of the same location.
+    uint32_t eliminated_load_count;
+  };
+
+  ValueNumberingPass();
+  ~ValueNumberingPass() override;
+
+  const char* name() const override { return "ValueNumbering"; }
+  bool Run(hir::HIRBuilder* builder) override;
+
+  const Stats& last_stats() const { return last_stats_; }
+  void GetCounters(
+      std::vector<CompileProfiler::Counter>* counters) const override;
+
+ private:
+  struct Operand {
+    // OperandKind, and the type of constants. bits holds the value, offset
+    // or symbol pointer, or the contents of a constant.
+    uint32_t kind;
+    uint64_t bits[2];
+    bool operator==(const Operand& other) const {
+      return kind == other.kind && bits[0] == other.bits[0] &&
+             bits[1] == other.bits[1];
+    }
+  };
+  struct Key {
+    const hir::OpcodeInfo* opcode;
+    uint32_t flags;
+    uint32_t type;
+    Operand src[3];
+    bool operator==(const Key& other) const {
+      return opcode == other.opcode && flags == other.flags &&
+             type == other.type && src[0] == other.src[0] &&
+             src[1] == other.src[1] && src[2] == other.src[2];
+    }
+  };
+  struct KeyHash {
+    size_t operator()(const Key& key) const;
+  };
+  // Guest memory a load or store covers, as a base value plus a constant
+  // offset when the address is computed that way.
+  struct Access {
+    hir::Value* base;
+    int64_t offset;
+    // 0 if unknown.
+    uint32_t size;
+  };
+  struct AvailableLoad {
+    Key key;
+    Access access;
+    hir::Value* value;
+  };
+
+  void NumberBlock(hir::Block* block, std::vector<AvailableLoad> loads);
+  Key MakeKey(const hir::Instr* i) const;
+  static Access GetAccess(const hir::Instr* i);
+  static bool MayAlias(const Access& a, const Access& b);
+
+  Stats last_stats_ = {};
+  bool rounding_mode_changes_ = false;
+
+  LoopAnalysis analysis_;
+  std::unordered_map<Key, hir::Value*, KeyHash> available_;
+};
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_COMPILER_PASSES_VALUE_NUMBERING_PASS_H_
@@ -13,6 +13,7 @@ class ValueReductionPass : public CompilerPass {
   ValueReductionPass();
   ~ValueReductionPass() override;
 
+  const char* name() const override { return "ValueReduction"; }
   bool Run(hir::HIRBuilder* builder) override;
 
  private:
@@ -0,0 +1,88 @@
+#include "xenia/cpu/compiler/read_only_data_registry.h"
+
+#include <algorithm>
+#include <iterator>
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+
+ReadOnlyDataRegistry::ReadOnlyDataRegistry() = default;
+
+ReadOnlyDataRegistry::~ReadOnlyDataRegistry() = default;
+
+void ReadOnlyDataRegistry::AddRange(uint32_t address, uint32_t size) {
+  if (!size) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  ranges_[address] = uint64_t(address) + size;
+}
+
+void ReadOnlyDataRegistry::RemoveRange(uint32_t address, uint32_t size) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  uint64_t end = uint64_t(address) + size;
+  auto it = ranges_.upper_bound(address);
+  if (it != ranges_.begin() && std::prev(it)->second > address) {
+    --it;
+  }
+  while (it != ranges_.end() && it->first < end) {
+    it = ranges_.erase(it);
+  }
+}
+
+bool ReadOnlyDataRegistry::Acquire(uint32_t address, uint32_t size,
+                                   uint32_t function_address) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = ranges_.upper_bound(address);
+  if (it == ranges_.begin()) {
+    return false;
+  }
+  --it;
+  uint64_t end = uint64_t(address) + size;
+  if (end > it->second) {
+    return false;
+  }
+  for (uint32_t page = address >> kPageShift;
+       page <= uint32_t((end - 1) >> kPageShift); ++page) {
+    auto& users = users_[page];
+    if (std::find(users.begin(), users.end(), function_address) ==
+        users.end()) {
+      users.push_back(function_address);
+    }
+  }
+  return true;
+}
+
+std::vector<uint32_t> ReadOnlyDataRegistry::Remove(uint32_t address,
+                                                   uint32_t length) {
+  if (!length) {
+    return {};
+  }
+  uint32_t page_first = address >> kPageShift;
+  uint32_t page_last =
+      uint32_t((uint64_t(address) + length - 1) >> kPageShift);
+  std::vector<uint32_t> functions;
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = users_.lower_bound(page_first);
+  while (it != users_.end() && it->first <= page_last) {
+    for (uint32_t function_address : it->second) {
+      if (std::find(functions.begin(), functions.end(), function_address) ==
+          functions.end()) {
+        functions.push_back(function_address);
+      }
+    }
+    it = users_.erase(it);
+  }
+  removed_.insert(functions.begin(), functions.end());
+  return functions;
+}
+
+bool ReadOnlyDataRegistry::TakeRemoved(uint32_t function_address) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return removed_.erase(function_address) != 0;
+}
+
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
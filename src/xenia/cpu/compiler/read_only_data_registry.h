@@ -0,0 +1,55 @@
+#ifndef XENIA_CPU_COMPILER_READ_ONLY_DATA_REGISTRY_H_
+#define XENIA_CPU_COMPILER_READ_ONLY_DATA_REGISTRY_H_
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+
+// Guest data ConstantPropagationPass may fold loads from, per processor.
+//
+// XexModule adds the PE sections of its image that have no write access.
+// Functions that folded a load are remembered by the page it read, so the
+// processor can throw their code away if the data changes after all: when
+// the image is patched or unloaded, or the guest makes the pages writable.
+class ReadOnlyDataRegistry {
+ public:
+  static constexpr uint32_t kPageShift = 12;
+
+  ReadOnlyDataRegistry();
+  ~ReadOnlyDataRegistry();
+
+  void AddRange(uint32_t address, uint32_t size);
+  void RemoveRange(uint32_t address, uint32_t size);
+
+  // Whether all of [address, address + size) is read-only data, noting that
+  // function_address folded a load from it if so.
+  bool Acquire(uint32_t address, uint32_t size, uint32_t function_address);
+  // Forgets the functions that folded loads from pages in the range and
+  // returns them.
+  std::vector<uint32_t> Remove(uint32_t address, uint32_t length);
+  // Whether Remove returned function_address since the last call. A
+  // function still being compiled can't be invalidated yet, so the
+  // processor asks again once it is installed.
+  bool TakeRemoved(uint32_t function_address);
+
+ private:
+  std::mutex mutex_;
+  // Range start to end (exclusive).
+  std::map<uint32_t, uint64_t> ranges_;
+  // Page number to the functions that folded loads from it.
+  std::map<uint32_t, std::vector<uint32_t>> users_;
+  // Functions Remove returned that haven't been asked about since.
+  std::unordered_set<uint32_t> removed_;
+};
+
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_COMPILER_READ_ONLY_DATA_REGISTRY_H_
@@ -29,6 +29,37 @@ DEFINE_bool(
 DEFINE_bool(validate_hir, false,
             "Perform validation checks on the HIR during compilation.", "CPU");
 
+DEFINE_int32(jit_compile_threads, -1,
+             "Number of background threads speculatively compiling guest "
+             "functions. -1 picks based on the host core count, 0 disables "
+             "background compilation.",
+             "CPU");
+DEFINE_int32(jit_speculative_depth, 2,
+             "How many levels of direct calls below code a guest thread is "
+             "running the background compiler will follow.",
+             "CPU");
+DEFINE_bool(jit_persistent_cache, false,
+            "Store generated code for the title in the cache root and reuse it "
+            "in later sessions instead of recompiling.",
+            "CPU");
+DEFINE_bool(jit_tiered_compilation, false,
+            "Compile guest functions with a fast, lightly optimized pipeline "
+            "first and recompile them with all passes once they get hot.",
+            "CPU");
+DEFINE_int32(jit_tier_up_threshold, 1000,
+             "Number of calls after which a baseline function is recompiled "
+             "with all optimizations (with --jit_tiered_compilation).",
+             "CPU");
+DEFINE_bool(jit_invalidate_on_write, true,
+            "Throw away generated code when the guest overwrites the code it "
+            "was translated from (runtime patches, overlays, self-modifying "
+            "code) and recompile it on the next call.",
+            "CPU");
+DEFINE_int32(jit_inline_leaf_size, 16,
+             "Copy guest leaf functions of up to this many HIR instructions "
+             "into the optimized code of functions calling them (0 disables).",
+             "CPU");
+
 DEFINE_uint64(
     pvr, 0x710700,
     "Processor version and revision number.\nBits 0 to 15 are the version "
@@ -18,6 +18,14 @@ DECLARE_bool(disable_global_lock);
 
 DECLARE_bool(validate_hir);
 
+DECLARE_int32(jit_compile_threads);
+DECLARE_int32(jit_speculative_depth);
+DECLARE_bool(jit_persistent_cache);
+DECLARE_bool(jit_tiered_compilation);
+DECLARE_int32(jit_tier_up_threshold);
+DECLARE_bool(jit_invalidate_on_write);
+DECLARE_int32(jit_inline_leaf_size);
+
 DECLARE_uint64(pvr);
 
 // Breakpoints:
@@ -1,81 +1,244 @@
-
 #include "xenia/cpu/entry_table.h"
 
+#include <algorithm>
+#include <iterator>
+
+#include "xenia/base/assert.h"
+#include "xenia/base/memory.h"
 #include "xenia/base/profiling.h"
-#include "xenia/base/threading.h"
 
 namespace xe {
 namespace cpu {
 
-EntryTable::EntryTable() = default;
+EntryTable::EntryTable()
+    : roots_(new std::atomic<Slot*>[kRootSlotCount]()),
+      ranges_(std::make_shared<const RangeSnapshot>()) {}
 
 EntryTable::~EntryTable() {
   auto global_lock = global_critical_region_.Acquire();
-  for (auto it : map_) {
-    Entry* entry = it.second;
+  for (Entry* entry : entries_) {
     delete entry;
   }
+  entries_.clear();
+  for (uint32_t i = 0; i < kRootSlotCount; ++i) {
+    Slot* leaf = roots_[i].load(std::memory_order_relaxed);
+    if (leaf) {
+      xe::memory::DeallocFixed(leaf, 0, xe::memory::DeallocationType::kRelease);
+    }
+  }
+}
+
+EntryTable::Slot* EntryTable::LookupSlot(uint32_t address, bool create) {
+  assert_zero(address & 0x3);
+  uint32_t index = address >> 2;
+  auto& root = roots_[index >> kLeafBits];
+  Slot* leaf = root.load(std::memory_order_acquire);
+  if (!leaf) {
+    if (!create) {
+      return nullptr;
+    }
+    // Freshly allocated pages are zero filled, which is a valid empty slot.
+    auto new_leaf = reinterpret_cast<Slot*>(xe::memory::AllocFixed(
+        nullptr, kLeafSlotCount * sizeof(Slot),
+        xe::memory::AllocationType::kReserveCommit,
+        xe::memory::PageAccess::kReadWrite));
+    assert_not_null(new_leaf);
+    if (root.compare_exchange_strong(leaf, new_leaf,
+                                     std::memory_order_acq_rel,
+                                     std::memory_order_acquire)) {
+      leaf = new_leaf;
+    } else {
+      // Lost the race; leaf now holds the winner.
+      xe::memory::DeallocFixed(new_leaf, 0,
+                               xe::memory::DeallocationType::kRelease);
+    }
+  }
+  return &leaf[index & (kLeafSlotCount - 1)];
 }
 
 Entry* EntryTable::Get(uint32_t address) {
-  auto global_lock = global_critical_region_.Acquire();
-  const auto& it = map_.find(address);
-  Entry* entry = it != map_.end() ? it->second : nullptr;
+  Slot* slot = LookupSlot(address, false);
+  if (!slot) {
+    return nullptr;
+  }
+  Entry* entry = slot->load(std::memory_order_acquire);
   if (entry) {
     // TODO(benvanik): wait if needed?
-    if (entry->status != Entry::STATUS_READY) {
+    if (entry->status.load(std::memory_order_acquire) != Entry::STATUS_READY) {
       entry = nullptr;
     }
   }
   return entry;
 }
 
-Entry::Status EntryTable::GetOrCreate(uint32_t address, Entry** out_entry) {
-  // TODO(benvanik): replace with a map with wait-free for find.
-  // https://github.com/facebook/folly/blob/master/folly/AtomicHashMap.h
-
-  auto global_lock = global_critical_region_.Acquire();
-  const auto& it = map_.find(address);
-  Entry* entry = it != map_.end() ? it->second : nullptr;
-  Entry::Status status;
-  if (entry) {
-    // If we aren't ready yet spin and wait.
-    if (entry->status == Entry::STATUS_COMPILING) {
-      // Still compiling, so spin.
-      do {
-        global_lock.unlock();
-        // TODO(benvanik): sleep for less time?
-        xe::threading::Sleep(std::chrono::microseconds(10));
-        global_lock.lock();
-      } while (entry->status == Entry::STATUS_COMPILING);
+Entry::Status EntryTable::GetOrCreate(uint32_t address, Entry** out_entry,
+                                      bool wait) {
+  Slot* slot = LookupSlot(address, true);
+  Entry* entry = slot->load(std::memory_order_acquire);
+  if (!entry) {
+    // Create and try to install; the thread that installs it owns
+    // compilation.
+    auto new_entry = new Entry();
+    new_entry->address = address;
+    new_entry->end_address = 0;
+    new_entry->status.store(Entry::STATUS_COMPILING, std::memory_order_relaxed);
+    new_entry->function = nullptr;
+    if (slot->compare_exchange_strong(entry, new_entry,
+                                      std::memory_order_acq_rel,
+                                      std::memory_order_acquire)) {
+      {
+        auto global_lock = global_critical_region_.Acquire();
+        entries_.push_back(new_entry);
+      }
+      *out_entry = new_entry;
+      return Entry::STATUS_NEW;
     }
-    status = entry->status;
-  } else {
-    // Create and return for initialization.
-    entry = new Entry();
-    entry->address = address;
-    entry->end_address = 0;
-    entry->status = Entry::STATUS_COMPILING;
-    entry->function = 0;
-    map_[address] = entry;
-    status = Entry::STATUS_NEW;
+    // Another thread beat us to it; entry now holds theirs.
+    delete new_entry;
+  }
+  Entry::Status status = entry->status.load(std::memory_order_acquire);
+  if (status == Entry::STATUS_COMPILING && wait) {
+    WaitForEntry(entry);
+    status = entry->status.load(std::memory_order_acquire);
   }
-  global_lock.unlock();
   *out_entry = entry;
   return status;
 }
 
+void EntryTable::Publish(Entry* entry, Entry::Status status) {
+  assert_true(status == Entry::STATUS_READY || status == Entry::STATUS_FAILED);
+  if (status == Entry::STATUS_READY) {
+    auto global_lock = global_critical_region_.Acquire();
+    pending_ranges_.push_back(
+        {entry->address, entry->end_address, 0, entry->function});
+    ranges_dirty_.store(true, std::memory_order_release);
+  }
+  auto& bucket = wait_bucket(entry);
+  {
+    // Storing under the bucket lock orders the store against a waiter that
+    // has checked the status but not yet parked.
+    std::lock_guard<std::mutex> lock(bucket.mutex);
+    entry->status.store(status, std::memory_order_release);
+  }
+  bucket.cond.notify_all();
+}
+
+void EntryTable::WaitForEntry(Entry* entry) {
+  SCOPE_profile_cpu_f("cpu");
+  auto& bucket = wait_bucket(entry);
+  std::unique_lock<std::mutex> lock(bucket.mutex);
+  bucket.cond.wait(lock, [entry]() {
+    return entry->status.load(std::memory_order_acquire) !=
+           Entry::STATUS_COMPILING;
+  });
+}
+
+std::shared_ptr<const EntryTable::RangeSnapshot>
+EntryTable::AcquireRangeSnapshot() {
+  if (!ranges_dirty_.load(std::memory_order_acquire)) {
+    return std::atomic_load(&ranges_);
+  }
+
+  auto global_lock = global_critical_region_.Acquire();
+  auto snapshot = std::atomic_load(&ranges_);
+  if (pending_ranges_.empty()) {
+    // Another query merged them while we waited on the lock.
+    return snapshot;
+  }
+
+  // Merge the sorted pending ranges into a copy of the current snapshot.
+  // Publishing is far more frequent than querying, so batching keeps
+  // inserts O(1) and the rebuild cost amortized over every publish since.
+  auto by_address = [](const FunctionRange& a, const FunctionRange& b) {
+    return a.address < b.address;
+  };
+  std::sort(pending_ranges_.begin(), pending_ranges_.end(), by_address);
+  auto merged = std::make_shared<RangeSnapshot>();
+  merged->reserve(snapshot->size() + pending_ranges_.size());
+  std::merge(snapshot->begin(), snapshot->end(), pending_ranges_.begin(),
+             pending_ranges_.end(), std::back_inserter(*merged), by_address);
+  pending_ranges_.clear();
+  ranges_dirty_.store(false, std::memory_order_release);
+
+  IndexRanges(merged->data(), merged->size());
+
+  snapshot = std::move(merged);
+  std::atomic_store(&ranges_, snapshot);
+  return snapshot;
+}
+
+uint32_t EntryTable::IndexRanges(FunctionRange* ranges, size_t count) {
+  if (!count) {
+    return 0;
+  }
+  size_t mid = count / 2;
+  auto& node = ranges[mid];
+  node.max_end_address =
+      std::max({node.end_address, IndexRanges(ranges, mid),
+                IndexRanges(ranges + mid + 1, count - mid - 1)});
+  return node.max_end_address;
+}
+
+void EntryTable::CollectRanges(const FunctionRange* ranges, size_t count,
+                               uint32_t address,
+                               std::vector<Function*>* fns) {
+  // Visits O((k + 1) log n) ranges for k results: a subtree is only entered
+  // if it holds a result or lies on the path to the first range starting
+  // past the address.
+  while (count) {
+    size_t mid = count / 2;
+    const auto& node = ranges[mid];
+    if (node.max_end_address < address) {
+      return;
+    }
+    CollectRanges(ranges, mid, address, fns);
+    if (node.address > address) {
+      // This range and everything after it start past the address.
+      return;
+    }
+    if (address <= node.end_address) {
+      fns->push_back(node.function);
+    }
+    ranges += mid + 1;
+    count -= mid + 1;
+  }
+}
+
 std::vector<Function*> EntryTable::FindWithAddress(uint32_t address) {
+  auto snapshot = AcquireRangeSnapshot();
+  std::vector<Function*> fns;
+  CollectRanges(snapshot->data(), snapshot->size(), address, &fns);
+  return fns;
+}
+
+std::vector<Function*> EntryTable::Invalidate(uint32_t low_address,
+                                              uint32_t high_address) {
   auto global_lock = global_critical_region_.Acquire();
+  // Holding the lock keeps Publish from adding ranges behind our back.
+  auto snapshot = AcquireRangeSnapshot();
+
   std::vector<Function*> fns;
-  for (auto& it : map_) {
-    Entry* entry = it.second;
-    if (address >= entry->address && address <= entry->end_address) {
-      if (entry->status == Entry::STATUS_READY) {
-        fns.push_back(entry->function);
-      }
+  auto remaining = std::make_shared<RangeSnapshot>();
+  remaining->reserve(snapshot->size());
+  for (const auto& range : *snapshot) {
+    if (range.address > high_address || range.end_address < low_address) {
+      remaining->push_back(range);
+      continue;
+    }
+    fns.push_back(range.function);
+    Slot* slot = LookupSlot(range.address, false);
+    Entry* entry = slot ? slot->load(std::memory_order_acquire) : nullptr;
+    if (entry && entry->function == range.function) {
+      slot->compare_exchange_strong(entry, nullptr, std::memory_order_acq_rel,
+                                    std::memory_order_relaxed);
     }
   }
+  if (!fns.empty()) {
+    IndexRanges(remaining->data(), remaining->size());
+    std::shared_ptr<const RangeSnapshot> snapshot_remaining =
+        std::move(remaining);
+    std::atomic_store(&ranges_, snapshot_remaining);
+  }
   return fns;
 }
 
@@ -1,7 +1,10 @@
 #ifndef XENIA_CPU_ENTRY_TABLE_H_
 #define XENIA_CPU_ENTRY_TABLE_H_
 
-#include <unordered_map>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
 #include <vector>
 
 #include "xenia/base/mutex.h"
@@ -21,24 +24,99 @@ typedef struct Entry_t {
 
   uint32_t address;
   uint32_t end_address;
-  Status status;
+  // Written with release semantics once the entry leaves STATUS_COMPILING;
+  // end_address and function are only valid to read after observing that.
+  std::atomic<Status> status;
   Function* function;
 } Entry;
 
+// Maps guest function addresses to their compilation entries.
+// Guest code is 4b aligned, so the table is a two level radix tree over the
+// remaining 30 address bits. Leaves are allocated on first use, so the sparse
+// guest code layout only costs the leaves actually referenced. Windows
+// commits a whole leaf at once; posix only backs the pages that are touched.
+// Lookups never take a lock.
 class EntryTable {
  public:
   EntryTable();
   ~EntryTable();
 
+  // Returns the entry at the given address if it is STATUS_READY.
   Entry* Get(uint32_t address);
-  Entry::Status GetOrCreate(uint32_t address, Entry** out_entry);
+  // Returns the entry at the given address, creating it if needed.
+  // If STATUS_NEW is returned the caller owns compilation of the entry and
+  // must call Publish when done. If another thread is compiling the entry
+  // this blocks until that thread publishes it, unless wait is false in which
+  // case STATUS_COMPILING is returned immediately.
+  Entry::Status GetOrCreate(uint32_t address, Entry** out_entry,
+                            bool wait = true);
+  // Finalizes an entry returned as STATUS_NEW from GetOrCreate and wakes any
+  // threads waiting on it. status must be STATUS_READY or STATUS_FAILED.
+  void Publish(Entry* entry, Entry::Status status);
 
+  // Returns all ready functions whose [address, end_address] range contains
+  // the given address. Lock-free unless functions have been published since
+  // the last query, in which case the range index is rebuilt first.
   std::vector<Function*> FindWithAddress(uint32_t address);
 
+  // Unlinks every ready function overlapping [low_address, high_address] so
+  // the next GetOrCreate at its address starts a fresh entry, and returns
+  // them. The old entries stay allocated as lock-free readers may still hold
+  // them.
+  std::vector<Function*> Invalidate(uint32_t low_address,
+                                    uint32_t high_address);
+
  private:
+  static constexpr uint32_t kLeafBits = 16;
+  static constexpr uint32_t kLeafSlotCount = 1u << kLeafBits;
+  static constexpr uint32_t kRootBits = 32 - 2 - kLeafBits;
+  static constexpr uint32_t kRootSlotCount = 1u << kRootBits;
+  // Waiters park on one of these, keyed by the entry address. Collisions only
+  // cause spurious wakeups.
+  static constexpr uint32_t kWaitBucketCount = 64;
+
+  typedef std::atomic<Entry*> Slot;
+
+  struct FunctionRange {
+    uint32_t address;
+    uint32_t end_address;
+    // Largest end_address in the subtree rooted at this range. The sorted
+    // snapshot is read as an implicit binary tree, each subarray rooted at
+    // its middle, so a containment query skips any subtree ending before the
+    // address no matter how long the functions overlapping it are.
+    uint32_t max_end_address;
+    Function* function;
+  };
+  // Immutable once published; replaced wholesale (copy-on-write).
+  typedef std::vector<FunctionRange> RangeSnapshot;
+
+  struct WaitBucket {
+    std::mutex mutex;
+    std::condition_variable cond;
+  };
+
+  Slot* LookupSlot(uint32_t address, bool create);
+  WaitBucket& wait_bucket(const Entry* entry) {
+    return wait_buckets_[(entry->address >> 2) % kWaitBucketCount];
+  }
+  void WaitForEntry(Entry* entry);
+  std::shared_ptr<const RangeSnapshot> AcquireRangeSnapshot();
+  static uint32_t IndexRanges(FunctionRange* ranges, size_t count);
+  static void CollectRanges(const FunctionRange* ranges, size_t count,
+                            uint32_t address, std::vector<Function*>* fns);
+
+  std::unique_ptr<std::atomic<Slot*>[]> roots_;
+  WaitBucket wait_buckets_[kWaitBucketCount];
+
+  // Guards entries_ and pending_ranges_, which are only touched when entries
+  // are created or published.
   xe::global_critical_region global_critical_region_;
-  // TODO(benvanik): replace with a better data structure.
-  std::unordered_map<uint32_t, Entry*> map_;
+  std::vector<Entry*> entries_;
+  // Ranges published since the last snapshot, merged in on the next query.
+  std::vector<FunctionRange> pending_ranges_;
+  std::atomic<bool> ranges_dirty_ = {false};
+  // Sorted by address; accessed with std::atomic_load/atomic_store.
+  std::shared_ptr<const RangeSnapshot> ranges_;
 };
 
 }  // namespace cpu
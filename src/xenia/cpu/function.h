@@ -1,6 +1,7 @@
 #ifndef XENIA_CPU_FUNCTION_H_
 #define XENIA_CPU_FUNCTION_H_
 
+#include <atomic>
 #include <memory>
 #include <vector>
 
@@ -17,6 +18,15 @@ class Export;
 
 namespace cpu {
 
+// Optimization level guest code is compiled at. With
+// --jit_tiered_compilation functions start out at kBaseline, which skips the
+// expensive passes and counts entries, and are recompiled at kOptimized once
+// they cross --jit_tier_up_threshold.
+enum class CompileTier : uint8_t {
+  kBaseline = 0,
+  kOptimized = 1,
+};
+
 struct SourceMapEntry {
   uint32_t guest_address;  // PPC guest address (0x82....).
   uint32_t hir_offset;     // Block ordinal (16b) | Instr ordinal (16b)
@@ -34,6 +44,17 @@ class Function : public Symbol {
     kExtern,
   };
 
+  // Marks the register save/restore helpers XexModule::FindSaveRest finds.
+  // Calls to them can be expanded in place instead.
+  enum Flags : uint32_t {
+    kFlagSaveGprLr = 1 << 0,
+    kFlagRestGprLr = 1 << 1,
+    kFlagSaveFpr = 1 << 2,
+    kFlagRestFpr = 1 << 3,
+    kFlagSaveVmx = 1 << 4,
+    kFlagRestVmx = 1 << 5,
+  };
+
   ~Function() override;
 
   uint32_t address() const { return address_; }
@@ -43,6 +64,14 @@ class Function : public Symbol {
   Behavior behavior() const { return behavior_; }
   void set_behavior(Behavior value) { behavior_ = value; }
   bool is_guest() const { return behavior_ != Behavior::kBuiltin; }
+  uint32_t flags() const { return flags_; }
+  // First register a save/restore helper handles; it goes on through the
+  // last one of its bank (r31, f31, v31 or v127).
+  uint32_t save_rest_register() const { return save_rest_register_; }
+  void set_save_rest(uint32_t flags, uint32_t first_register) {
+    flags_ = flags;
+    save_rest_register_ = first_register;
+  }
 
   bool ContainsAddress(uint32_t address) const {
     if (!address_ || !end_address_) {
@@ -63,6 +92,8 @@ class Function : public Symbol {
 
   uint32_t end_address_ = 0;
   Behavior behavior_ = Behavior::kDefault;
+  uint32_t flags_ = 0;
+  uint32_t save_rest_register_ = 0;
 };
 
 class BuiltinFunction : public Function {
@@ -109,6 +140,10 @@ class GuestFunction : public Function {
   FunctionTraceData& trace_data() { return trace_data_; }
   std::vector<SourceMapEntry>& source_map() { return source_map_; }
 
+  // Tier the current machine code was compiled at.
+  CompileTier tier() const { return tier_; }
+  void set_tier(CompileTier tier) { tier_ = tier; }
+
   ExternHandler extern_handler() const { return extern_handler_; }
   Export* export_data() const { return export_data_; }
   void SetupExtern(ExternHandler handler, Export* export_data = nullptr);
@@ -132,6 +167,7 @@ class GuestFunction : public Function {
   std::vector<SourceMapEntry> source_map_;
   ExternHandler extern_handler_ = nullptr;
   Export* export_data_ = nullptr;
+  std::atomic<CompileTier> tier_ = {CompileTier::kOptimized};
 };
 
 }  // namespace cpu
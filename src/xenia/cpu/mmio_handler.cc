@@ -65,6 +65,9 @@ bool MMIOHandler::RegisterRange(uint32_t virtual_address, uint32_t mask,
                                 uint32_t size, void* context,
                                 MMIOReadCallback read_callback,
                                 MMIOWriteCallback write_callback) {
+  if (mapped_ranges_.size() >= kPartialPage - 1) {
+    return false;
+  }
   mapped_ranges_.push_back({
       virtual_address,
       mask,
@@ -73,10 +76,62 @@ bool MMIOHandler::RegisterRange(uint32_t virtual_address, uint32_t mask,
       read_callback,
       write_callback,
   });
+  if ((virtual_address & mask) != virtual_address) {
+    // Never matches anything.
+    return true;
+  }
+
+  // A mask with no bits below the page size takes all of a page or none of
+  // it.
+  uint16_t entry = uint16_t(mapped_ranges_.size());
+  if (mask & ((1u << kPageShift) - 1)) {
+    entry = kPartialPage;
+  }
+  // The pages the range matches have the masked page number bits of its
+  // address and any value of the rest; count through those.
+  uint32_t free_bits = ~mask >> kPageShift;
+  uint32_t page_bits = free_bits;
+  while (true) {
+    uint32_t page = (virtual_address >> kPageShift) | page_bits;
+    auto& table = page_tables_[page >> kPageTableShift];
+    if (!table) {
+      table = std::make_unique<PageTable>();
+      table->fill(0);
+    }
+    // Earlier ranges match first. A page one of them has taken whole stays
+    // theirs, and a partial page is scanned in registration order anyway.
+    uint16_t& page_entry = (*table)[page & ((1u << kPageTableShift) - 1)];
+    if (!page_entry) {
+      page_entry = entry;
+    }
+    if (!page_bits) {
+      break;
+    }
+    page_bits = (page_bits - 1) & free_bits;
+  }
   return true;
 }
 
+void MMIOHandler::SetAccessSiteCallback(AccessSiteCallback callback,
+                                        void* context) {
+  access_site_callback_ = callback;
+  access_site_callback_context_ = context;
+}
+
 MMIORange* MMIOHandler::LookupRange(uint32_t virtual_address) {
+  uint32_t page = virtual_address >> kPageShift;
+  auto& table = page_tables_[page >> kPageTableShift];
+  if (!table) {
+    return nullptr;
+  }
+  uint16_t entry = (*table)[page & ((1u << kPageTableShift) - 1)];
+  if (entry == kPartialPage) {
+    return ScanRanges(virtual_address);
+  }
+  return entry ? &mapped_ranges_[entry - 1] : nullptr;
+}
+
+MMIORange* MMIOHandler::ScanRanges(uint32_t virtual_address) {
   for (auto& range : mapped_ranges_) {
     if ((virtual_address & range.mask) == range.address) {
       return &range;
@@ -86,24 +141,22 @@ MMIORange* MMIOHandler::LookupRange(uint32_t virtual_address) {
 }
 
 bool MMIOHandler::CheckLoad(uint32_t virtual_address, uint32_t* out_value) {
-  for (const auto& range : mapped_ranges_) {
-    if ((virtual_address & range.mask) == range.address) {
-      *out_value = static_cast<uint32_t>(
-          range.read(nullptr, range.callback_context, virtual_address));
-      return true;
-    }
+  auto range = LookupRange(virtual_address);
+  if (!range) {
+    return false;
   }
-  return false;
+  *out_value = static_cast<uint32_t>(
+      range->read(nullptr, range->callback_context, virtual_address));
+  return true;
 }
 
 bool MMIOHandler::CheckStore(uint32_t virtual_address, uint32_t value) {
-  for (const auto& range : mapped_ranges_) {
-    if ((virtual_address & range.mask) == range.address) {
-      range.write(nullptr, range.callback_context, virtual_address, value);
-      return true;
-    }
+  auto range = LookupRange(virtual_address);
+  if (!range) {
+    return false;
   }
-  return false;
+  range->write(nullptr, range->callback_context, virtual_address, value);
+  return true;
 }
 
 bool MMIOHandler::TryDecodeLoadStore(const uint8_t* p,
@@ -405,21 +458,13 @@ bool MMIOHandler::ExceptionCallback(Exception* ex) {
   }
   void* fault_host_address = reinterpret_cast<void*>(ex->fault_address());
 
-  // Access violations are pretty rare, so we can do a linear search here.
   // Only check if in the virtual range, as we only support virtual ranges.
   const MMIORange* range = nullptr;
   uint32_t fault_guest_virtual_address = 0;
   if (ex->fault_address() < uint64_t(physical_membase_)) {
     fault_guest_virtual_address = host_to_guest_virtual_(
         host_to_guest_virtual_context_, fault_host_address);
-    for (const auto& test_range : mapped_ranges_) {
-      if ((fault_guest_virtual_address & test_range.mask) ==
-          test_range.address) {
-        // Address is within the range of this mapping.
-        range = &test_range;
-        break;
-      }
-    }
+    range = LookupRange(fault_guest_virtual_address);
   }
   if (!range) {
     // Recheck if the pages are still protected (race condition - another thread
@@ -555,6 +600,12 @@ bool MMIOHandler::ExceptionCallback(Exception* ex) {
   // Advance RIP to the next instruction so that we resume properly.
   ex->set_resume_pc(rip + decoded_load_store.length);
 
+  if (access_site_callback_) {
+    access_site_callback_(access_site_callback_context_,
+                          reinterpret_cast<void*>(rip),
+                          fault_guest_virtual_address);
+  }
+
   return true;
 }
 
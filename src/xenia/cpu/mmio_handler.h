@@ -2,9 +2,10 @@
 #ifndef XENIA_CPU_MMIO_HANDLER_H_
 #define XENIA_CPU_MMIO_HANDLER_H_
 
+#include <array>
+#include <deque>
 #include <memory>
 #include <mutex>
-#include <vector>
 
 #include "xenia/base/mutex.h"
 #include "xenia/base/platform.h"
@@ -41,6 +42,10 @@ class MMIOHandler {
   typedef bool (*AccessViolationCallback)(
       std::unique_lock<std::recursive_mutex> global_lock_locked_once,
       void* context, void* host_address, bool is_write);
+  // Called after a fault on a mapped range has been serviced, with the host
+  // instruction that made the access.
+  typedef void (*AccessSiteCallback)(void* context, void* host_pc,
+                                     uint32_t virtual_address);
 
   // access_violation_callback is called with global_critical_region locked once
   // on the thread, so if multiple threads trigger an access violation in the
@@ -58,6 +63,8 @@ class MMIOHandler {
                      MMIOWriteCallback write_callback);
   MMIORange* LookupRange(uint32_t virtual_address);
 
+  void SetAccessSiteCallback(AccessSiteCallback callback, void* context);
+
   bool CheckLoad(uint32_t virtual_address, uint32_t* out_value);
   bool CheckStore(uint32_t virtual_address, uint32_t value);
 
@@ -75,7 +82,20 @@ class MMIOHandler {
   uint8_t* physical_membase_;
   uint8_t* memory_end_;
 
-  std::vector<MMIORange> mapped_ranges_;
+  // A deque so the ranges handed out stay where they are.
+  std::deque<MMIORange> mapped_ranges_;
+
+  // Two-level table of the range each 4 KB page belongs to, filled in by
+  // RegisterRange so lookups don't depend on the number of ranges. Entries
+  // are indices into mapped_ranges_ plus one, 0 for no range, or
+  // kPartialPage for pages only partly covered by a mask with bits below the
+  // page size, which are looked up the slow way.
+  static constexpr uint32_t kPageShift = 12;
+  static constexpr uint32_t kPageTableShift = 10;
+  static constexpr uint16_t kPartialPage = 0xFFFF;
+  typedef std::array<uint16_t, 1 << kPageTableShift> PageTable;
+  std::unique_ptr<PageTable>
+      page_tables_[1 << (32 - kPageShift - kPageTableShift)];
 
   HostToGuestVirtual host_to_guest_virtual_;
   const void* host_to_guest_virtual_context_;
@@ -83,6 +103,9 @@ class MMIOHandler {
   AccessViolationCallback access_violation_callback_;
   void* access_violation_callback_context_;
 
+  AccessSiteCallback access_site_callback_ = nullptr;
+  void* access_site_callback_context_ = nullptr;
+
   static MMIOHandler* global_handler_;
 
   xe::global_critical_region global_critical_region_;
@@ -141,6 +164,8 @@ class MMIOHandler {
 
   static bool TryDecodeLoadStore(const uint8_t* p,
                                  DecodedLoadStore& decoded_out);
+
+  MMIORange* ScanRanges(uint32_t virtual_address);
 };
 
 }  // namespace cpu
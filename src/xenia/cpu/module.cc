@@ -138,6 +138,35 @@ Symbol::Status Module::DefineVariable(Symbol* symbol) {
   return DefineSymbol(symbol);
 }
 
+void Module::UndeclareFunction(Function* function) {
+  auto global_lock = global_critical_region_.Acquire();
+  auto it = map_.find(function->address());
+  if (it != map_.end() && it->second == function) {
+    map_.erase(it);
+  }
+}
+
+Function* Module::CreateReplacementFunction(Function* function) {
+  auto replacement = CreateFunction(function->address());
+  replacement->set_end_address(function->end_address());
+  replacement->set_name(function->name());
+  replacement->set_behavior(function->behavior());
+  replacement->set_save_rest(function->flags(),
+                             function->save_rest_register());
+  replacement->set_status(Symbol::Status::kDeclared);
+  auto global_lock = global_critical_region_.Acquire();
+  list_.emplace_back(replacement.get());
+  return replacement.release();
+}
+
+void Module::ReplaceFunction(Function* function, Function* replacement) {
+  auto global_lock = global_critical_region_.Acquire();
+  auto it = map_.find(function->address());
+  if (it != map_.end() && it->second == function) {
+    it->second = replacement;
+  }
+}
+
 void Module::ForEachFunction(std::function<void(Function*)> callback) {
   auto global_lock = global_critical_region_.Acquire();
   for (auto& symbol : list_) {
@@ -36,6 +36,16 @@ class Module {
 
   Symbol::Status DefineFunction(Function* symbol);
   Symbol::Status DefineVariable(Symbol* symbol);
+  // Drops the function from the address map so the next DeclareFunction at
+  // its address creates a new one. The old function stays owned by the module
+  // since its code may still be running.
+  void UndeclareFunction(Function* function);
+  // Creates a declared function at the address of an existing one without
+  // putting it in the address map, so replacement code can be generated while
+  // the existing function keeps running. Publish it with ReplaceFunction.
+  Function* CreateReplacementFunction(Function* function);
+  // Points the address map at replacement if it still holds function.
+  void ReplaceFunction(Function* function, Function* replacement);
 
   void ForEachFunction(std::function<void(Function*)> callback);
   void ForEachSymbol(size_t start_index, size_t end_index,
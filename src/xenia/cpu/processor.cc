@@ -13,11 +13,14 @@
 #include "xenia/base/exception_handler.h"
 #include "xenia/base/literals.h"
 #include "xenia/base/logging.h"
+#include "xenia/base/math.h"
 #include "xenia/base/memory.h"
 #include "xenia/base/platform.h"
 #include "xenia/base/profiling.h"
 #include "xenia/base/threading.h"
 #include "xenia/cpu/breakpoint.h"
+#include "xenia/cpu/compiler/compile_profiler.h"
+#include "xenia/cpu/compiler/compiler.h"
 #include "xenia/cpu/cpu_flags.h"
 #include "xenia/cpu/export_resolver.h"
 #include "xenia/cpu/module.h"
@@ -43,6 +46,21 @@ DEFINE_path(trace_function_data_path, "", "File to write trace data to.",
             "CPU");
 DEFINE_bool(break_on_start, false, "Break into the debugger on startup.",
             "CPU");
+DEFINE_path(sample_profile_path, "",
+            "Sample the guest threads while running and write "
+            "<path>.folded (flame graph input) and <path>.txt (time per "
+            "function) on exit.",
+            "CPU");
+DEFINE_int32(sample_profile_interval_us, 1000,
+             "Microseconds between samples with --sample_profile_path.",
+             "CPU");
+DEFINE_path(compile_profile_path, "",
+            "Time every compiler pass of every translated function and write "
+            "<path>.txt (per pass totals) and <path>.csv (per function) on "
+            "exit.",
+            "CPU");
+
+DECLARE_bool(inline_mmio_access);
 
 namespace xe {
 namespace kernel {
@@ -81,6 +99,39 @@ Processor::Processor(xe::Memory* memory, ExportResolver* export_resolver)
     : memory_(memory), export_resolver_(export_resolver) {}
 
 Processor::~Processor() {
+  if (sampling_profiler_) {
+    // Function names are needed until the report is out.
+    sampling_profiler_->Stop();
+    sampling_profiler_->WriteReport(cvars::sample_profile_path);
+    sampling_profiler_.reset();
+  }
+  // Workers call back into the frontend/backend, so stop them first.
+  if (compile_queue_) {
+    compile_queue_->Shutdown();
+  }
+  if (!cvars::compile_profile_path.empty()) {
+    compiler::CompileProfiler::WriteReport(cvars::compile_profile_path);
+  }
+  auto inline_stats = inline_registry_.stats();
+  if (inline_stats.expanded_save_rest_count ||
+      inline_stats.inlined_call_count) {
+    XELOGI(
+        "Compiled out {} calls to save/restore helpers and {} calls to leaf "
+        "functions ({} leaf functions recorded)",
+        inline_stats.expanded_save_rest_count,
+        inline_stats.inlined_call_count, inline_stats.captured_count);
+  }
+  if (code_write_callback_handle_) {
+    memory_->UnregisterPhysicalMemoryInvalidationCallback(
+        code_write_callback_handle_);
+    code_write_callback_handle_ = nullptr;
+  }
+  if (write_access_callback_handle_) {
+    memory_->UnregisterWriteAccessCallback(write_access_callback_handle_);
+    write_access_callback_handle_ = nullptr;
+  }
+  memory_->SetMMIOAccessSiteCallback(nullptr, nullptr);
+
   {
     auto global_lock = global_critical_region_.Acquire();
     modules_.clear();
@@ -126,6 +177,33 @@ bool Processor::Setup(std::unique_ptr<backend::Backend> backend) {
   backend_ = std::move(backend);
   frontend_ = std::move(frontend);
 
+  // Background compilation. Leave headroom for the guest threads, which
+  // still compile anything they block on themselves.
+  int32_t compile_threads = cvars::jit_compile_threads;
+  if (compile_threads < 0) {
+    compile_threads =
+        std::min(4, int32_t(xe::threading::logical_processor_count()) / 4);
+  }
+  compile_queue_ = std::make_unique<CompileQueue>(this);
+  if (!compile_queue_->Initialize(uint32_t(std::max(compile_threads, 0)))) {
+    XELOGW("Background JIT compilation unavailable");
+  }
+
+  if (cvars::jit_invalidate_on_write) {
+    code_page_bits_.reset(
+        new std::atomic<uint64_t>[(1ull << (32 - kCodePageShift)) / 64]());
+    code_write_callback_handle_ =
+        memory_->RegisterPhysicalMemoryInvalidationCallback(
+            CodeWriteCallbackThunk, this);
+  }
+  // Loads from read-only data may have been folded into generated code.
+  write_access_callback_handle_ =
+      memory_->RegisterWriteAccessCallback(WriteAccessCallbackThunk, this);
+  // Code that faulted on MMIO gets recompiled to call the range directly.
+  if (cvars::inline_mmio_access) {
+    memory_->SetMMIOAccessSiteCallback(MMIOAccessSiteCallbackThunk, this);
+  }
+
   // Stack walker is used when profiling, debugging, and dumping.
   // Note that creation may fail, in which case we'll have to disable those
   // features.
@@ -142,6 +220,19 @@ bool Processor::Setup(std::unique_ptr<backend::Backend> backend) {
     }
   }
 
+  if (!cvars::compile_profile_path.empty()) {
+    compiler::CompileProfiler::set_enabled(true);
+  }
+
+  if (!cvars::sample_profile_path.empty() && code_cache) {
+    sampling_profiler_ = std::make_unique<SamplingProfiler>(this);
+    if (!sampling_profiler_->Start(
+            uint32_t(std::max(cvars::sample_profile_interval_us, 1)))) {
+      XELOGW("Sampling profiler unavailable");
+      sampling_profiler_.reset();
+    }
+  }
+
   // Open the trace data path, if requested.
   functions_trace_path_ = cvars::trace_function_data_path;
   if (!functions_trace_path_.empty()) {
@@ -224,21 +315,7 @@ Function* Processor::ResolveFunction(uint32_t address) {
   Entry::Status status = entry_table_.GetOrCreate(address, &entry);
   if (status == Entry::STATUS_NEW) {
     // Needs to be generated. We have the 'lock' on it and must do so now.
-
-    // Grab symbol declaration.
-    auto function = LookupFunction(address);
-    if (!function) {
-      entry->status = Entry::STATUS_FAILED;
-      return nullptr;
-    }
-
-    if (!DemandFunction(function)) {
-      entry->status = Entry::STATUS_FAILED;
-      return nullptr;
-    }
-    entry->function = function;
-    entry->end_address = function->end_address();
-    status = entry->status = Entry::STATUS_READY;
+    return CompileEntry(entry);
   }
   if (status == Entry::STATUS_READY) {
     // Ready to use.
@@ -249,6 +326,276 @@ Function* Processor::ResolveFunction(uint32_t address) {
   }
 }
 
+bool Processor::PrecompileFunction(uint32_t address) {
+  Entry* entry;
+  Entry::Status status = entry_table_.GetOrCreate(address, &entry, false);
+  if (status != Entry::STATUS_NEW) {
+    // Done or in progress on another thread.
+    return false;
+  }
+  return CompileEntry(entry) != nullptr;
+}
+
+void Processor::RequestTierUp(uint32_t address) {
+  if (compile_queue_ && compile_queue_->worker_count()) {
+    compile_queue_->EnqueueTierUp(address);
+  } else {
+    // Nobody to hand it to; pay for it on this thread once.
+    TierUpFunction(address);
+  }
+}
+
+bool Processor::TierUpFunction(uint32_t address) {
+  Entry* entry = entry_table_.Get(address);
+  if (!entry) {
+    return false;
+  }
+  auto function = static_cast<GuestFunction*>(entry->function);
+  if (function->tier() != CompileTier::kBaseline) {
+    return false;
+  }
+
+  // Translate again with every pass into a new function; other threads keep
+  // reading the source map and machine code of the baseline one while it
+  // runs. Placing the new code rewrites the indirection slot, so calls
+  // through the table switch over atomically; threads already inside the
+  // baseline code finish there, and that code is never freed.
+  auto module = function->module();
+  auto replacement =
+      static_cast<GuestFunction*>(module->CreateReplacementFunction(function));
+  replacement->set_tier(CompileTier::kOptimized);
+  function->set_tier(CompileTier::kOptimized);
+  // Only data the baseline code folded can have been removed before now.
+  read_only_data_.TakeRemoved(address);
+  compiler::Compiler::set_thread_function(replacement);
+  compiler::CompileProfiler::BeginFunction();
+  bool defined = frontend_->DefineFunction(replacement, debug_info_flags_);
+  compiler::CompileProfiler::EndFunction(address, defined);
+  compiler::Compiler::set_thread_function(nullptr);
+  if (!defined) {
+    XELOGW("Tier-up recompilation of {:08X} failed; keeping baseline code",
+           address);
+    return false;
+  }
+  OnFunctionDefined(replacement);
+  replacement->set_status(Symbol::Status::kDefined);
+
+  // Publish the replacement in the module first, so a thread that resolves
+  // the address between the two steps below picks it up instead of
+  // compiling it again.
+  module->ReplaceFunction(function, replacement);
+  entry_table_.Invalidate(address, address);
+  Entry* new_entry;
+  if (entry_table_.GetOrCreate(address, &new_entry, false) ==
+      Entry::STATUS_NEW) {
+    new_entry->function = replacement;
+    new_entry->end_address = replacement->end_address();
+    entry_table_.Publish(new_entry, Entry::STATUS_READY);
+  }
+  DiscardIfReadOnlyDataRemoved(replacement);
+  return true;
+}
+
+Function* Processor::CompileEntry(Entry* entry) {
+  // Grab symbol declaration.
+  auto function = LookupFunction(entry->address);
+  if (!function) {
+    entry_table_.Publish(entry, Entry::STATUS_FAILED);
+    return nullptr;
+  }
+
+  if (!DemandFunction(function)) {
+    entry_table_.Publish(entry, Entry::STATUS_FAILED);
+    return nullptr;
+  }
+  if (code_page_bits_ && function->is_guest()) {
+    WatchCodeRange(function->address(), function->end_address());
+  }
+  entry->function = function;
+  entry->end_address = function->end_address();
+  entry_table_.Publish(entry, Entry::STATUS_READY);
+  if (DiscardIfReadOnlyDataRemoved(function)) {
+    return ResolveFunction(entry->address);
+  }
+  return function;
+}
+
+bool Processor::DiscardIfReadOnlyDataRemoved(Function* function) {
+  // InvalidateCodeRange finds nothing to invalidate while the function is
+  // still being compiled, so data it folded may have changed before it got
+  // here. Now that it is installed, a later removal finds it instead.
+  uint32_t address = function->address();
+  if (!read_only_data_.TakeRemoved(address)) {
+    return false;
+  }
+  auto functions = entry_table_.Invalidate(address, address);
+  if (functions.empty()) {
+    return false;
+  }
+  DiscardFunctions(functions);
+  return true;
+}
+
+void Processor::WatchCodeRange(uint32_t address, uint32_t end_address) {
+  uint32_t page_first = address >> kCodePageShift;
+  uint32_t page_last = end_address >> kCodePageShift;
+  bool newly_watched = false;
+  for (uint32_t page = page_first; page <= page_last; ++page) {
+    uint64_t bit = uint64_t(1) << (page & 63);
+    if (!(code_page_bits_[page >> 6].fetch_or(bit, std::memory_order_acq_rel) &
+          bit)) {
+      newly_watched = true;
+    }
+  }
+  if (!newly_watched) {
+    return;
+  }
+  // Writes to the physical views fault on watched pages. The XEX heaps have
+  // no such watches; their writers call InvalidateCodeRange directly.
+  uint32_t physical_address = memory_->GetPhysicalAddress(address);
+  if (physical_address != UINT32_MAX) {
+    memory_->EnablePhysicalMemoryAccessCallbacks(
+        physical_address, end_address - address + 4, true, false);
+  }
+}
+
+std::pair<uint32_t, uint32_t> Processor::CodeWriteCallbackThunk(
+    void* context_ptr, uint32_t physical_address_start, uint32_t length,
+    bool exact_range) {
+  auto processor = reinterpret_cast<Processor*>(context_ptr);
+  // Same mapping as PhysicalHeap::GetPhysicalAddress for each view.
+  processor->InvalidateCodeRange(0xA0000000 + physical_address_start, length);
+  processor->InvalidateCodeRange(0xC0000000 + physical_address_start, length);
+  if (physical_address_start >= 0x1000) {
+    processor->InvalidateCodeRange(0xE0000000 + physical_address_start - 0x1000,
+                                   length);
+  }
+  // Only the written pages get unwatched. Their bits were cleared above, so
+  // WatchCodeRange protects them again once code is translated from them;
+  // pages unwatched beyond them would keep their bits and never be.
+  return std::make_pair(physical_address_start, length);
+}
+
+void Processor::WriteAccessCallbackThunk(void* context_ptr, uint32_t address,
+                                         uint32_t length) {
+  auto processor = reinterpret_cast<Processor*>(context_ptr);
+  processor->InvalidateCodeRange(address, length);
+}
+
+bool Processor::ClaimCodePages(uint32_t address, uint32_t length,
+                               uint32_t* low_address,
+                               uint32_t* high_address) {
+  if (!code_page_bits_) {
+    return false;
+  }
+  uint32_t page_first = address >> kCodePageShift;
+  uint32_t page_last =
+      uint32_t((uint64_t(address) + length - 1) >> kCodePageShift);
+
+  // Claim the watched pages in the range. Whoever clears a bit invalidates
+  // the functions on that page, so concurrent writers don't repeat the work.
+  uint32_t hit_first = UINT32_MAX;
+  uint32_t hit_last = 0;
+  for (uint32_t i = page_first >> 6; i <= page_last >> 6; ++i) {
+    uint64_t mask = ~uint64_t(0);
+    if (i == page_first >> 6) {
+      mask &= ~uint64_t(0) << (page_first & 63);
+    }
+    if (i == page_last >> 6) {
+      mask &= ~uint64_t(0) >> (63 - (page_last & 63));
+    }
+    if (!(code_page_bits_[i].load(std::memory_order_relaxed) & mask)) {
+      continue;
+    }
+    uint64_t hits =
+        code_page_bits_[i].fetch_and(~mask, std::memory_order_acq_rel) & mask;
+    if (!hits) {
+      continue;
+    }
+    hit_first = std::min(hit_first, (i << 6) + xe::tzcnt(hits));
+    hit_last = (i << 6) + 63 - xe::lzcnt(hits);
+  }
+  if (hit_first == UINT32_MAX) {
+    return false;
+  }
+
+  *low_address = hit_first << kCodePageShift;
+  *high_address = (hit_last << kCodePageShift) | ((1u << kCodePageShift) - 1);
+  return true;
+}
+
+void Processor::InvalidateCodeRange(uint32_t address, uint32_t length) {
+  if (!length) {
+    return;
+  }
+  // Functions that folded loads from read-only data in the range.
+  std::vector<Function*> functions;
+  for (uint32_t user : read_only_data_.Remove(address, length)) {
+    auto users = entry_table_.Invalidate(user, user);
+    functions.insert(functions.end(), users.begin(), users.end());
+  }
+  uint32_t low_address;
+  uint32_t high_address;
+  if (ClaimCodePages(address, length, &low_address, &high_address)) {
+    auto overwritten = entry_table_.Invalidate(low_address, high_address);
+    mmio_sites_.Remove(address, length);
+    functions.insert(functions.end(), overwritten.begin(), overwritten.end());
+  }
+  if (functions.empty()) {
+    return;
+  }
+  DiscardFunctions(functions);
+  XELOGD("Invalidated {} functions overwritten in {:08X}-{:08X}",
+         functions.size(), address, uint32_t(address + length - 1));
+}
+
+void Processor::DiscardFunctions(std::vector<Function*>& functions) {
+  // Code that inlined any of these holds a stale copy of it. The list grows
+  // as we go, so callers that were inlined in turn are handled too.
+  for (size_t i = 0; i < functions.size(); ++i) {
+    for (uint32_t caller : inline_registry_.Remove(functions[i]->address())) {
+      auto callers = entry_table_.Invalidate(caller, caller);
+      functions.insert(functions.end(), callers.begin(), callers.end());
+    }
+  }
+  for (Function* function : functions) {
+    // A fresh symbol gets declared (and its extent rescanned) on the next
+    // call; threads still inside the old code finish there.
+    function->module()->UndeclareFunction(function);
+    if (function->is_guest()) {
+      backend_->UnlinkFunction(static_cast<GuestFunction*>(function));
+    }
+  }
+}
+
+void Processor::MMIOAccessSiteCallbackThunk(void* context_ptr, void* host_pc,
+                                            uint32_t virtual_address) {
+  auto processor = reinterpret_cast<Processor*>(context_ptr);
+  auto code_cache = processor->backend_->code_cache();
+  auto function =
+      code_cache ? code_cache->LookupFunction(uint64_t(host_pc)) : nullptr;
+  if (!function || function->source_map().empty()) {
+    // Host code (a thunk or a kernel export) rather than a guest function,
+    // or one with no guest instructions to tell the sites apart by.
+    return;
+  }
+  uint32_t site = function->MapMachineCodeToGuestAddress(uintptr_t(host_pc));
+  auto range = processor->memory_->LookupVirtualMappedRange(virtual_address);
+  if (!range || !processor->mmio_sites_.Record(site, range)) {
+    return;
+  }
+  // Recompiled code calls the range directly from this site. The thread
+  // that faulted resumes in the old code, which stays valid until then.
+  uint32_t address = function->address();
+  auto functions = processor->entry_table_.Invalidate(address, address);
+  if (functions.empty()) {
+    return;
+  }
+  processor->DiscardFunctions(functions);
+  XELOGD("Recompiling {:08X} to call MMIO range {:08X} from {:08X}", address,
+         range->address, site);
+}
+
 Function* Processor::LookupFunction(uint32_t address) {
   // TODO(benvanik): fast reject invalid addresses/log errors.
 
@@ -298,10 +645,36 @@ bool Processor::DemandFunction(Function* function) {
   if (symbol_status == Symbol::Status::kNew) {
     // Symbol is undefined, so define now.
     assert_true(function->is_guest());
-    if (!frontend_->DefineFunction(static_cast<GuestFunction*>(function),
-                                   debug_info_flags_)) {
-      function->set_status(Symbol::Status::kFailed);
-      return false;
+    auto guest_function = static_cast<GuestFunction*>(function);
+    // Code from the persistent cache carries no debug info, so only use it
+    // when none was requested. Only optimized code is ever persisted.
+    bool loaded = !debug_info_flags_ &&
+                  backend_->LoadPersistedFunction(guest_function);
+    if (!loaded) {
+      // Debug info wants the full pipeline to stay representative.
+      auto tier = cvars::jit_tiered_compilation && !debug_info_flags_
+                      ? CompileTier::kBaseline
+                      : CompileTier::kOptimized;
+      guest_function->set_tier(tier);
+      compiler::Compiler::set_thread_tier(tier);
+      // Only data an earlier compile folded can have been removed before
+      // now.
+      read_only_data_.TakeRemoved(guest_function->address());
+      // Without it nothing gets inlined, which keeps breakpoints in callees
+      // working when debugging.
+      compiler::Compiler::set_thread_function(
+          debug_info_flags_ ? nullptr : guest_function);
+      compiler::CompileProfiler::BeginFunction();
+      bool defined =
+          frontend_->DefineFunction(guest_function, debug_info_flags_);
+      compiler::CompileProfiler::EndFunction(guest_function->address(),
+                                             defined);
+      compiler::Compiler::set_thread_function(nullptr);
+      compiler::Compiler::set_thread_tier(CompileTier::kOptimized);
+      if (!defined) {
+        function->set_status(Symbol::Status::kFailed);
+        return false;
+      }
     }
 
     // Before we give the symbol back to the rest, let the debugger know.
@@ -506,6 +879,9 @@ void Processor::OnThreadDestroyed(uint32_t thread_id) {
   auto thread_info = it->second.get();
   thread_info->state = ThreadDebugInfo::State::kZombie;
   thread_info->thread = nullptr;
+  if (sampling_profiler_) {
+    sampling_profiler_->OnThreadDestroyed(thread_id);
+  }
 }
 
 void Processor::OnThreadEnteringWait(uint32_t thread_id) {
@@ -1,21 +1,28 @@
 #ifndef XENIA_CPU_PROCESSOR_H_
 #define XENIA_CPU_PROCESSOR_H_
 
+#include <atomic>
 #include <map>
 #include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "xenia/base/cvar.h"
 #include "xenia/base/mapped_memory.h"
 #include "xenia/base/mutex.h"
 #include "xenia/cpu/backend/backend.h"
+#include "xenia/cpu/compile_queue.h"
+#include "xenia/cpu/compiler/inline_registry.h"
+#include "xenia/cpu/compiler/mmio_site_registry.h"
+#include "xenia/cpu/compiler/read_only_data_registry.h"
 #include "xenia/cpu/debug_listener.h"
 #include "xenia/cpu/entry_table.h"
 #include "xenia/cpu/export_resolver.h"
 #include "xenia/cpu/function.h"
 #include "xenia/cpu/module.h"
 #include "xenia/cpu/ppc/ppc_frontend.h"
+#include "xenia/cpu/sampling_profiler.h"
 #include "xenia/cpu/thread_debug_info.h"
 #include "xenia/cpu/thread_state.h"
 #include "xenia/memory.h"
@@ -62,6 +69,10 @@ class Processor {
   ppc::PPCFrontend* frontend() const { return frontend_.get(); }
   backend::Backend* backend() const { return backend_.get(); }
   ExportResolver* export_resolver() const { return export_resolver_; }
+  CompileQueue* compile_queue() const { return compile_queue_.get(); }
+  compiler::InlineRegistry* inline_registry() { return &inline_registry_; }
+  compiler::ReadOnlyDataRegistry* read_only_data() { return &read_only_data_; }
+  compiler::MMIOSiteRegistry* mmio_sites() { return &mmio_sites_; }
 
   bool Setup(std::unique_ptr<backend::Backend> backend);
 
@@ -106,6 +117,23 @@ class Processor {
   Function* LookupFunction(uint32_t address);
   Function* LookupFunction(Module* module, uint32_t address);
   Function* ResolveFunction(uint32_t address);
+  // Compiles the function at the given address unless another thread already
+  // owns it. Never blocks on other compiles. Returns true if this call did
+  // the compilation. Used by the background compile workers.
+  bool PrecompileFunction(uint32_t address);
+  // Called from baseline code whose entry counter ran out. Queues the
+  // function for recompilation at CompileTier::kOptimized.
+  void RequestTierUp(uint32_t address);
+  // Recompiles a baseline function with all passes into a new function and
+  // swaps that in. Returns false if the function is not (or no longer) at the
+  // baseline tier or recompiling failed.
+  bool TierUpFunction(uint32_t address);
+  // Throws away the generated code of every function translated from guest
+  // code in the given range, or that folded loads from read-only data in it,
+  // so it is recompiled on its next call. Called whenever guest code or data
+  // may have been overwritten; ranges without any translated code return
+  // after a bitmap test.
+  void InvalidateCodeRange(uint32_t address, uint32_t length);
 
   bool Execute(ThreadState* thread_state, uint32_t address);
   bool ExecuteRaw(ThreadState* thread_state, uint32_t address);
@@ -228,6 +256,27 @@ class Processor {
                                          uint32_t current_pc);
 
   bool DemandFunction(Function* function);
+  // Compiles an entry returned as STATUS_NEW and publishes the result.
+  Function* CompileEntry(Entry* entry);
+  // Discards a just installed function if read-only data it folded changed
+  // while it was compiled. Returns whether it did.
+  bool DiscardIfReadOnlyDataRemoved(Function* function);
+  // Marks the guest pages holding the function's code as watched for writes.
+  void WatchCodeRange(uint32_t address, uint32_t end_address);
+  static std::pair<uint32_t, uint32_t> CodeWriteCallbackThunk(
+      void* context_ptr, uint32_t physical_address_start, uint32_t length,
+      bool exact_range);
+  // Clears the watched bits of the code pages in the range, returning the
+  // bounds of the pages that had them.
+  bool ClaimCodePages(uint32_t address, uint32_t length,
+                      uint32_t* low_address, uint32_t* high_address);
+  static void WriteAccessCallbackThunk(void* context_ptr, uint32_t address,
+                                       uint32_t length);
+  static void MMIOAccessSiteCallbackThunk(void* context_ptr, void* host_pc,
+                                          uint32_t virtual_address);
+  // Unpublishes the functions and everything that inlined them (appended to
+  // the list as they are found) so they are recompiled on their next call.
+  void DiscardFunctions(std::vector<Function*>& functions);
 
   Memory* memory_ = nullptr;
   std::unique_ptr<StackWalker> stack_walker_;
@@ -240,12 +289,26 @@ class Processor {
   // If specified, the file trace data gets written to when running.
   std::filesystem::path functions_trace_path_;
   std::unique_ptr<ChunkedMappedMemoryWriter> functions_trace_file_;
+  // With --sample_profile_path.
+  std::unique_ptr<SamplingProfiler> sampling_profiler_;
 
   std::unique_ptr<ppc::PPCFrontend> frontend_;
   std::unique_ptr<backend::Backend> backend_;
   ExportResolver* export_resolver_ = nullptr;
 
   EntryTable entry_table_;
+  // One bit per guest page holding translated code (with
+  // --jit_invalidate_on_write). Invalidation clears the bits it hits, so
+  // further writes to the same pages only cost a bit test until code is
+  // translated from them again.
+  static constexpr uint32_t kCodePageShift = 12;
+  std::unique_ptr<std::atomic<uint64_t>[]> code_page_bits_;
+  void* code_write_callback_handle_ = nullptr;
+  void* write_access_callback_handle_ = nullptr;
+  std::unique_ptr<CompileQueue> compile_queue_;
+  compiler::InlineRegistry inline_registry_;
+  compiler::ReadOnlyDataRegistry read_only_data_;
+  compiler::MMIOSiteRegistry mmio_sites_;
   xe::global_critical_region global_critical_region_;
   ExecutionState execution_state_ = ExecutionState::kPaused;
   std::vector<std::unique_ptr<Module>> modules_;
@@ -0,0 +1,242 @@
+#include "xenia/cpu/sampling_profiler.h"
+
+#include <algorithm>
+#include <set>
+
+#include "third_party/fmt/include/fmt/format.h"
+#include "xenia/base/assert.h"
+#include "xenia/base/byte_order.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/math.h"
+#include "xenia/cpu/backend/code_cache.h"
+#include "xenia/cpu/processor.h"
+#include "xenia/cpu/thread.h"
+#include "xenia/cpu/thread_debug_info.h"
+
+namespace xe {
+namespace cpu {
+
+SamplingProfiler::SamplingProfiler(Processor* processor)
+    : processor_(processor),
+      code_cache_(processor->backend()->code_cache()) {}
+
+SamplingProfiler::~SamplingProfiler() { Stop(); }
+
+bool SamplingProfiler::Start(uint32_t interval_us) {
+  assert_false(running_);
+  if (!code_cache_ || !InitializePlatform()) {
+    return false;
+  }
+  interval_us_ = std::max(interval_us, 1u);
+  running_ = true;
+  xe::threading::Thread::CreationParameters params;
+  sampler_thread_ =
+      xe::threading::Thread::Create(params, [this]() { SamplerThreadMain(); });
+  if (!sampler_thread_) {
+    XELOGE("Unable to create the sampling profiler thread");
+    running_ = false;
+    ShutdownPlatform();
+    return false;
+  }
+  sampler_thread_->set_name("Sampling Profiler");
+  sampler_thread_->set_priority(xe::threading::ThreadPriority::kHighest);
+  return true;
+}
+
+void SamplingProfiler::Stop() {
+  if (!running_) {
+    return;
+  }
+  running_ = false;
+  xe::threading::Wait(sampler_thread_.get(), false);
+  sampler_thread_.reset();
+  ShutdownPlatform();
+}
+
+void SamplingProfiler::SamplerThreadMain() {
+  while (running_) {
+    xe::threading::Sleep(std::chrono::microseconds(interval_us_));
+    SampleAllThreads();
+  }
+}
+
+void SamplingProfiler::OnThreadDestroyed(uint32_t thread_id) {
+  std::lock_guard<std::mutex> lock(capture_mutex_);
+  destroyed_thread_ids_.insert(thread_id);
+}
+
+void SamplingProfiler::SampleAllThreads() {
+  struct SampledThread {
+    uint32_t thread_id;
+    Thread* thread;
+    std::string name;
+  };
+  std::vector<SampledThread> threads;
+  {
+    auto global_lock = global_critical_region_.Acquire();
+    for (auto thread_info : processor_->QueryThreadDebugInfos()) {
+      auto thread = thread_info->thread;
+      if (!thread || thread_info->suspended ||
+          thread_info->state != ThreadDebugInfo::State::kAlive ||
+          !thread->can_debugger_suspend()) {
+        continue;
+      }
+      threads.push_back(
+          {thread_info->thread_id, thread,
+           thread->thread_name().empty()
+               ? fmt::format("Thread {:08X}", thread_info->thread_id)
+               : thread->thread_name()});
+    }
+    // Destructions from here on are seen below.
+    std::lock_guard<std::mutex> lock(capture_mutex_);
+    destroyed_thread_ids_.clear();
+  }
+
+  // Guest threads keep running while others are captured; only the capture
+  // itself is serialized with thread destruction.
+  uint64_t frame_host_pcs[kMaxFrameCount];
+  for (const auto& sampled_thread : threads) {
+    size_t frame_count;
+    {
+      std::lock_guard<std::mutex> lock(capture_mutex_);
+      if (destroyed_thread_ids_.count(sampled_thread.thread_id)) {
+        continue;
+      }
+      frame_count = CaptureThreadStack(sampled_thread.thread, frame_host_pcs,
+                                       xe::countof(frame_host_pcs));
+    }
+    if (frame_count) {
+      RecordSample(sampled_thread.name, frame_host_pcs, frame_count);
+    }
+  }
+}
+
+std::string SamplingProfiler::GetExternName(uint32_t call_guest_pc) {
+  // Kernel exports are only ever called directly: bl to the import thunk.
+  auto code = processor_->memory()->TranslateVirtual<const xe::be<uint32_t>*>(
+      call_guest_pc);
+  uint32_t instr = *code;
+  if ((instr >> 26) != 18 || !(instr & 1)) {
+    return {};
+  }
+  uint32_t target = uint32_t(int32_t(instr << 6) >> 6) & ~3u;
+  if (!(instr & 2)) {
+    target += call_guest_pc;
+  }
+  auto function = processor_->LookupFunction(target);
+  if (!function || function->behavior() != Function::Behavior::kExtern) {
+    return {};
+  }
+  return function->name();
+}
+
+void SamplingProfiler::RecordSample(const std::string& thread_name,
+                                    const uint64_t* frame_host_pcs,
+                                    size_t frame_count) {
+  // Guest frames, innermost first. Host frames outside the outermost guest
+  // frame are how the thread got started and are dropped.
+  std::vector<std::string> frames;
+  bool seen_guest_frame = false;
+  for (size_t i = 0; i < frame_count; ++i) {
+    auto function = code_cache_->LookupFunction(frame_host_pcs[i]);
+    if (!function) {
+      continue;
+    }
+    if (!seen_guest_frame) {
+      seen_guest_frame = true;
+      if (i) {
+        // The thread is in host code called from this frame, and its pc is
+        // the return address of that call.
+        auto call_guest_pc =
+            function->MapMachineCodeToGuestAddress(frame_host_pcs[i] - 1);
+        auto extern_name = call_guest_pc ? GetExternName(call_guest_pc)
+                                         : std::string();
+        frames.push_back(extern_name.empty() ? "[host]"
+                                             : "[kernel] " + extern_name);
+      }
+    }
+    frames.push_back(function->name().empty()
+                         ? fmt::format("sub_{:08X}", function->address())
+                         : function->name());
+  }
+  if (frames.empty()) {
+    // Not running guest code at all.
+    return;
+  }
+
+  std::string folded = thread_name;
+  for (auto it = frames.rbegin(); it != frames.rend(); ++it) {
+    folded += ';';
+    folded += *it;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  ++folded_stacks_[folded];
+  auto& thread_counts = thread_counts_[thread_name];
+  ++thread_counts.sample_count;
+  ++thread_counts.functions[frames.front()].self;
+  // Recursive functions only count once towards their total.
+  std::set<std::string> counted;
+  for (const auto& frame : frames) {
+    if (counted.insert(frame).second) {
+      ++thread_counts.functions[frame].total;
+    }
+  }
+  ++sample_count_;
+}
+
+bool SamplingProfiler::WriteReport(const std::filesystem::path& path) {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  auto folded_path = path;
+  folded_path += ".folded";
+  FILE* file = xe::filesystem::OpenFile(folded_path, "wb");
+  if (!file) {
+    XELOGE("Unable to write {}", xe::path_to_utf8(folded_path));
+    return false;
+  }
+  for (const auto& it : folded_stacks_) {
+    fmt::print(file, "{} {}\n", it.first, it.second);
+  }
+  fclose(file);
+
+  auto summary_path = path;
+  summary_path += ".txt";
+  file = xe::filesystem::OpenFile(summary_path, "wb");
+  if (!file) {
+    XELOGE("Unable to write {}", xe::path_to_utf8(summary_path));
+    return false;
+  }
+  fmt::print(file, "{} samples every {}us\n", sample_count_.load(),
+             interval_us_);
+  for (const auto& thread_it : thread_counts_) {
+    const auto& thread_counts = thread_it.second;
+    fmt::print(file, "\n{}: {} samples\n", thread_it.first,
+               thread_counts.sample_count);
+    fmt::print(file, "  {:>7} {:>7} {:>9} {:>9}  {}\n", "self%", "total%",
+               "self", "total", "function");
+    std::vector<std::pair<std::string, FunctionCounts>> functions(
+        thread_counts.functions.begin(), thread_counts.functions.end());
+    std::sort(functions.begin(), functions.end(),
+              [](const auto& a, const auto& b) {
+                return a.second.self != b.second.self
+                           ? a.second.self > b.second.self
+                           : a.second.total > b.second.total;
+              });
+    double scale = 100.0 / double(thread_counts.sample_count);
+    for (const auto& function : functions) {
+      fmt::print(file, "  {:>6.2f}% {:>6.2f}% {:>9} {:>9}  {}\n",
+                 function.second.self * scale, function.second.total * scale,
+                 function.second.self, function.second.total, function.first);
+    }
+  }
+  fclose(file);
+
+  XELOGI("Wrote {} profile samples to {}.folded/.txt", sample_count_.load(),
+         xe::path_to_utf8(path));
+  return true;
+}
+
+}  // namespace cpu
+}  // namespace xe
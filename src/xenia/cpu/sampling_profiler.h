@@ -0,0 +1,109 @@
+#ifndef XENIA_CPU_SAMPLING_PROFILER_H_
+#define XENIA_CPU_SAMPLING_PROFILER_H_
+
+#include <atomic>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "xenia/base/mutex.h"
+#include "xenia/base/threading.h"
+
+namespace xe {
+namespace cpu {
+namespace backend {
+class CodeCache;
+}  // namespace backend
+}  // namespace cpu
+}  // namespace xe
+
+namespace xe {
+namespace cpu {
+
+class Processor;
+class Thread;
+struct ThreadDebugInfo;
+
+// Statistical profiler for guest code.
+//
+// A background thread interrupts each guest thread at a fixed interval,
+// captures its host stack and maps the frames in generated code back to guest
+// functions. Host code called from guest code is attributed to the kernel
+// export it was called as, when that can be told from the call site. Nothing
+// is added to the generated code, unlike --trace_functions.
+class SamplingProfiler {
+ public:
+  explicit SamplingProfiler(Processor* processor);
+  ~SamplingProfiler();
+
+  bool Start(uint32_t interval_us);
+  void Stop();
+
+  uint64_t sample_count() const { return sample_count_; }
+
+  // Called by the processor, with the global lock held, before the Thread is
+  // freed. Waits for a capture of the thread to finish.
+  void OnThreadDestroyed(uint32_t thread_id);
+
+  // Writes <path>.folded, one "thread;outermost;...;innermost count" line per
+  // distinct stack (the input of flamegraph.pl), and <path>.txt, the self and
+  // total sample counts of every function per thread.
+  bool WriteReport(const std::filesystem::path& path);
+
+ private:
+  static const size_t kMaxFrameCount = 128;
+
+  struct FunctionCounts {
+    uint64_t self = 0;
+    uint64_t total = 0;
+  };
+  struct ThreadCounts {
+    uint64_t sample_count = 0;
+    std::map<std::string, FunctionCounts> functions;
+  };
+
+  void SamplerThreadMain();
+  void SampleAllThreads();
+  void RecordSample(const std::string& thread_name,
+                    const uint64_t* frame_host_pcs, size_t frame_count);
+  std::string GetExternName(uint32_t call_guest_pc);
+
+  // Platform-specific. CaptureThreadStack fills frame_host_pcs innermost
+  // frame first and must not allocate while the thread is stopped: it may be
+  // holding the heap lock.
+  bool InitializePlatform();
+  void ShutdownPlatform();
+  size_t CaptureThreadStack(Thread* thread, uint64_t* frame_host_pcs,
+                            size_t frame_count);
+
+  Processor* processor_ = nullptr;
+  backend::CodeCache* code_cache_ = nullptr;
+  xe::global_critical_region global_critical_region_;
+
+  // Held across each capture, which can take milliseconds, instead of the
+  // global lock. Taken after the global lock when both are needed.
+  std::mutex capture_mutex_;
+  // Threads destroyed since SampleAllThreads took its list of threads.
+  std::set<uint32_t> destroyed_thread_ids_;
+
+  uint32_t interval_us_ = 0;
+  std::atomic<bool> running_ = {false};
+  std::unique_ptr<xe::threading::Thread> sampler_thread_;
+
+  std::mutex mutex_;
+  // Sample counts of each distinct folded stack.
+  std::unordered_map<std::string, uint64_t> folded_stacks_;
+  // Keyed by thread name.
+  std::map<std::string, ThreadCounts> thread_counts_;
+  std::atomic<uint64_t> sample_count_ = {0};
+};
+
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_SAMPLING_PROFILER_H_
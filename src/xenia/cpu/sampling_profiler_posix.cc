@@ -0,0 +1,173 @@
+#include "xenia/cpu/sampling_profiler.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <ucontext.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+
+#include "xenia/base/logging.h"
+#include "xenia/base/math.h"
+#include "xenia/cpu/backend/code_cache.h"
+#include "xenia/cpu/function.h"
+#include "xenia/cpu/thread.h"
+
+namespace xe {
+namespace cpu {
+
+// There is no stack walker on posix. The sampled thread copies its registers
+// and the top of its stack in a SIGPROF handler, and the sampler thread finds
+// the frames in the copy. The handler must not unwind itself: the unwinder
+// takes the lock __register_frame holds while a guest thread places code it
+// compiled, and the signal may land in that thread. Only one thread is
+// sampled at a time.
+enum SampleState : uint64_t {
+  kSampleIdle,
+  kSampleRequested,
+  kSampleCapturing,
+  kSampleDone,
+};
+
+// The state in the low two bits and the number of the request above them,
+// so a signal that arrives after its request timed out can't take a later
+// one.
+static std::atomic<uint64_t> sample_request_ = {kSampleIdle};
+static uint64_t sample_sequence_ = 0;
+// The thread the request is for; a late signal may reach another one.
+static std::atomic<uintptr_t> sample_thread_ = {0};
+// One past the highest address of the sampled thread's stack.
+static uint64_t sample_stack_end_ = 0;
+
+static const size_t kStackCopySize = 32 * 1024;
+static uint64_t sample_pc_ = 0;
+static uint64_t sample_sp_ = 0;
+static uint64_t sample_stack_[kStackCopySize / sizeof(uint64_t)];
+static size_t sample_stack_count_ = 0;
+static struct sigaction previous_sigprof_action_;
+
+static uint64_t SampleRequest(uint64_t sequence, SampleState state) {
+  return (sequence << 2) | state;
+}
+
+static void SigprofHandler(int signal, siginfo_t* info, void* context) {
+  uint64_t request = sample_request_.load(std::memory_order_acquire);
+  if ((request & 3) != kSampleRequested ||
+      sample_thread_.load(std::memory_order_relaxed) !=
+          uintptr_t(pthread_self())) {
+    return;
+  }
+  uint64_t sequence = request >> 2;
+  if (!sample_request_.compare_exchange_strong(
+          request, SampleRequest(sequence, kSampleCapturing))) {
+    return;
+  }
+  auto ucontext = reinterpret_cast<ucontext_t*>(context);
+  sample_pc_ = uint64_t(ucontext->uc_mcontext.gregs[REG_RIP]);
+  sample_sp_ = uint64_t(ucontext->uc_mcontext.gregs[REG_RSP]);
+  size_t size = 0;
+  if (sample_sp_ < sample_stack_end_) {
+    size = size_t(std::min<uint64_t>(sample_stack_end_ - sample_sp_,
+                                     kStackCopySize)) &
+           ~size_t(7);
+    std::memcpy(sample_stack_, reinterpret_cast<const void*>(sample_sp_),
+                size);
+  }
+  sample_stack_count_ = size / sizeof(uint64_t);
+  sample_request_.store(SampleRequest(sequence, kSampleDone),
+                        std::memory_order_release);
+}
+
+// Whether the instruction before host_pc is a call, as the ones X64Emitter
+// emits are: call rel32, call reg, or call qword [reg + disp] / [rip + disp].
+static bool FollowsCall(GuestFunction* function, uint64_t host_pc) {
+  auto begin = function->machine_code();
+  auto code = reinterpret_cast<const uint8_t*>(host_pc);
+  if (code - begin < 7) {
+    return code - begin >= 5 && code[-5] == 0xE8;
+  }
+  return code[-5] == 0xE8 || (code[-2] == 0xFF && (code[-1] & 0xF8) == 0xD0) ||
+         (code[-3] == 0xFF && (code[-2] & 0xF8) == 0x50) ||
+         (code[-6] == 0xFF &&
+          (code[-5] == 0x15 || (code[-5] & 0xF8) == 0x90));
+}
+
+bool SamplingProfiler::InitializePlatform() {
+  struct sigaction action = {};
+  action.sa_sigaction = SigprofHandler;
+  action.sa_flags = SA_SIGINFO | SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  if (sigaction(SIGPROF, &action, &previous_sigprof_action_)) {
+    XELOGE("Unable to install the SIGPROF handler");
+    return false;
+  }
+  return true;
+}
+
+void SamplingProfiler::ShutdownPlatform() {
+  sigaction(SIGPROF, &previous_sigprof_action_, nullptr);
+}
+
+size_t SamplingProfiler::CaptureThreadStack(Thread* thread,
+                                            uint64_t* frame_host_pcs,
+                                            size_t frame_count) {
+  auto native_handle =
+      pthread_t(reinterpret_cast<uintptr_t>(thread->thread()->native_handle()));
+  // The thread isn't stopped here, so this may allocate.
+  pthread_attr_t attr;
+  if (pthread_getattr_np(native_handle, &attr)) {
+    return 0;
+  }
+  void* stack_address;
+  size_t stack_size;
+  int result = pthread_attr_getstack(&attr, &stack_address, &stack_size);
+  pthread_attr_destroy(&attr);
+  if (result) {
+    return 0;
+  }
+  sample_stack_end_ = uint64_t(uintptr_t(stack_address)) + stack_size;
+
+  uint64_t sequence = ++sample_sequence_;
+  sample_thread_.store(uintptr_t(native_handle), std::memory_order_relaxed);
+  sample_request_.store(SampleRequest(sequence, kSampleRequested),
+                        std::memory_order_release);
+  if (pthread_kill(native_handle, SIGPROF)) {
+    sample_request_.store(SampleRequest(sequence, kSampleIdle));
+    return 0;
+  }
+  // A thread blocked with the signal masked never answers; give up on it.
+  auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::milliseconds(5);
+  while (sample_request_.load(std::memory_order_acquire) !=
+         SampleRequest(sequence, kSampleDone)) {
+    if (std::chrono::steady_clock::now() > deadline) {
+      uint64_t expected = SampleRequest(sequence, kSampleRequested);
+      if (sample_request_.compare_exchange_strong(
+              expected, SampleRequest(sequence, kSampleIdle))) {
+        return 0;
+      }
+      // The handler is already writing, so it will finish.
+    }
+    xe::threading::MaybeYield();
+  }
+  sample_request_.store(SampleRequest(sequence, kSampleIdle));
+
+  // Without frame pointers or unwind info for host code, the return
+  // addresses into generated code are found by scanning the copy. Host
+  // frames between them are dropped by RecordSample either way.
+  size_t captured = 0;
+  frame_host_pcs[captured++] = sample_pc_;
+  for (size_t i = 0; i < sample_stack_count_ && captured < frame_count; ++i) {
+    uint64_t value = sample_stack_[i];
+    auto function = code_cache_->LookupFunction(value);
+    if (function && FollowsCall(function, value)) {
+      frame_host_pcs[captured++] = value;
+    }
+  }
+  return captured;
+}
+
+}  // namespace cpu
+}  // namespace xe
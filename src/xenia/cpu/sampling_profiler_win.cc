@@ -0,0 +1,38 @@
+#include "xenia/cpu/sampling_profiler.h"
+
+#include "xenia/base/host_thread_context.h"
+#include "xenia/base/logging.h"
+#include "xenia/cpu/processor.h"
+#include "xenia/cpu/stack_walker.h"
+#include "xenia/cpu/thread.h"
+
+namespace xe {
+namespace cpu {
+
+bool SamplingProfiler::InitializePlatform() {
+  if (!processor_->stack_walker()) {
+    XELOGE("Sampling profiler needs the stack walker");
+    return false;
+  }
+  return true;
+}
+
+void SamplingProfiler::ShutdownPlatform() {}
+
+size_t SamplingProfiler::CaptureThreadStack(Thread* thread,
+                                            uint64_t* frame_host_pcs,
+                                            size_t frame_count) {
+  auto native_thread = thread->thread();
+  if (!native_thread->Suspend()) {
+    return 0;
+  }
+  HostThreadContext host_context;
+  size_t count = processor_->stack_walker()->CaptureStackTrace(
+      native_thread->native_handle(), frame_host_pcs, 0, frame_count, nullptr,
+      &host_context);
+  native_thread->Resume();
+  return count;
+}
+
+}  // namespace cpu
+}  // namespace xe
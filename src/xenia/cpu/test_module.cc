@@ -28,20 +28,46 @@ TestModule::TestModule(Processor* processor, const std::string_view name,
   assembler_ = processor->backend()->CreateAssembler();
   assembler_->Initialize();
 
+  // Prologs and epilogs stop calling the register save/restore helpers.
+  compiler_->AddPass(std::make_unique<passes::SaveRestExpansionPass>());
+
   // Merge blocks early. This will let us use more context in other passes.
   // The CFG is required for simplification and dirtied by it.
   compiler_->AddPass(std::make_unique<passes::ControlFlowAnalysisPass>());
-  compiler_->AddPass(std::make_unique<passes::ControlFlowSimplificationPass>());
-  compiler_->AddPass(std::make_unique<passes::ControlFlowAnalysisPass>());
+  compiler_->AddPass(std::make_unique<passes::ControlFlowSimplificationPass>(),
+                     CompileTier::kOptimized);
+  compiler_->AddPass(std::make_unique<passes::ControlFlowAnalysisPass>(),
+                     CompileTier::kOptimized);
 
   // Passes are executed in the order they are added. Multiple of the same
   // pass type may be used.
-  compiler_->AddPass(std::make_unique<passes::ContextPromotionPass>());
-  compiler_->AddPass(std::make_unique<passes::SimplificationPass>());
-  compiler_->AddPass(std::make_unique<passes::ConstantPropagationPass>());
-  compiler_->AddPass(std::make_unique<passes::SimplificationPass>());
+  // Baseline code skips all of these; it only has to be correct.
+  compiler_->AddPass(std::make_unique<passes::LeafInliningPass>(),
+                     CompileTier::kOptimized);
+  compiler_->AddPass(std::make_unique<passes::ContextPromotionPass>(),
+                     CompileTier::kOptimized);
+  compiler_->AddPass(std::make_unique<passes::SimplificationPass>(),
+                     CompileTier::kOptimized);
+  compiler_->AddPass(std::make_unique<passes::ConstantPropagationPass>(),
+                     CompileTier::kOptimized);
+  // Again for the indirect calls constant propagation resolved.
+  compiler_->AddPass(std::make_unique<passes::LeafInliningPass>(),
+                     CompileTier::kOptimized);
+  compiler_->AddPass(std::make_unique<passes::LoopInvariantCodeMotionPass>(),
+                     CompileTier::kOptimized);
+  // Leaves ASSIGNs behind for the simplification and DCE after it.
+  compiler_->AddPass(std::make_unique<passes::ValueNumberingPass>(),
+                     CompileTier::kOptimized);
+  compiler_->AddPass(std::make_unique<passes::SimplificationPass>(),
+                     CompileTier::kOptimized);
   // compiler_->AddPass(std::make_unique<passes::DeadStoreEliminationPass>());
-  compiler_->AddPass(std::make_unique<passes::DeadCodeEliminationPass>());
+  compiler_->AddPass(std::make_unique<passes::DeadCodeEliminationPass>(),
+                     CompileTier::kOptimized);
+  compiler_->AddPass(std::make_unique<passes::LeafCapturePass>(),
+                     CompileTier::kOptimized);
+  // Nothing may move memory accesses across barriers after this.
+  compiler_->AddPass(std::make_unique<passes::MemoryBarrierEliminationPass>(),
+                     CompileTier::kOptimized);
 
   //// Removes all unneeded variables. Try not to add new ones after this.
   // compiler_->AddPass(new passes::ValueReductionPass());
@@ -83,8 +109,11 @@ Symbol::Status TestModule::DeclareFunction(uint32_t address,
       return Symbol::Status::kFailed;
     }
 
-    // Run optimization passes.
+    // Run optimization passes. Known to them as Processor::DemandFunction
+    // does, so test functions can inline one another.
+    Compiler::set_thread_function(function);
     compiler_->Compile(builder_.get());
+    Compiler::set_thread_function(nullptr);
 
     // Assemble the function.
     assembler_->Assemble(function, builder_.get(), 0, nullptr);
@@ -0,0 +1,211 @@
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "xenia/cpu/compiler/compile_profiler.h"
+#include "xenia/cpu/testing/util.h"
+
+using namespace xe;
+using namespace xe::cpu;
+using namespace xe::cpu::hir;
+using namespace xe::cpu::testing;
+using xe::cpu::compiler::CompileProfiler;
+
+// There is no way to save the HIR of real titles, so the corpus is generated:
+// straight-line integer and vector code over guest registers, byte-swapped
+// memory traffic and forward branches, sized like typical guest functions.
+// The seed is the function index, so every run compiles the same corpus.
+static void GenerateCorpusFunction(HIRBuilder& b, uint32_t index) {
+  std::mt19937 rng(index);
+  auto random = [&rng](uint32_t count) { return uint32_t(rng() % count); };
+
+  std::vector<Value*> gprs;
+  std::vector<Value*> vrs;
+  for (int n = 0; n < 4; ++n) {
+    gprs.push_back(LoadGPR(b, 3 + random(8)));
+    vrs.push_back(LoadVR(b, random(32)));
+  }
+  auto gpr = [&]() { return gprs[random(uint32_t(gprs.size()))]; };
+  auto vr = [&]() { return vrs[random(uint32_t(vrs.size()))]; };
+  auto address = [&]() {
+    auto ea = b.ZeroExtend(b.Truncate(gpr(), INT32_TYPE), INT64_TYPE);
+    return b.Add(ea, b.LoadConstantUint64(random(0x100) * 4));
+  };
+
+  uint32_t block_count = 2 + random(12);
+  for (uint32_t block = 0; block < block_count; ++block) {
+    Label* skip_label = nullptr;
+    if (block && random(2)) {
+      skip_label = b.NewLabel();
+      b.BranchTrue(b.CompareSLT(gpr(), gpr()), skip_label);
+    }
+    uint32_t op_count = 4 + random(24);
+    for (uint32_t op = 0; op < op_count; ++op) {
+      switch (random(10)) {
+        case 0:
+          gprs.push_back(b.Add(gpr(), gpr()));
+          break;
+        case 1:
+          gprs.push_back(b.Sub(gpr(), b.LoadConstantUint64(random(64))));
+          break;
+        case 2:
+          gprs.push_back(b.And(gpr(), b.LoadConstantUint64(0xFFFF)));
+          break;
+        case 3:
+          gprs.push_back(b.Xor(gpr(), gpr()));
+          break;
+        case 4:
+          gprs.push_back(b.Shl(gpr(), int8_t(random(32))));
+          break;
+        case 5:
+          gprs.push_back(b.ZeroExtend(
+              b.Load(address(), INT32_TYPE, LOAD_STORE_BYTE_SWAP),
+              INT64_TYPE));
+          break;
+        case 6:
+          b.Store(address(), b.Truncate(gpr(), INT32_TYPE),
+                  LOAD_STORE_BYTE_SWAP);
+          break;
+        case 7:
+          StoreGPR(b, 3 + random(8), gpr());
+          break;
+        case 8:
+          vrs.push_back(b.VectorAdd(vr(), vr(), INT32_TYPE));
+          break;
+        case 9:
+          StoreVR(b, random(32), vr());
+          break;
+      }
+    }
+    if (skip_label) {
+      b.MarkLabel(skip_label);
+    }
+  }
+  StoreGPR(b, 3, gpr());
+  b.Return();
+}
+
+// The corpus function the current thread is about to compile.
+static thread_local uint32_t current_function_index = 0;
+
+struct CompileBenchmarkResult {
+  double functions_per_second;
+  double p50_us;
+  double p99_us;
+};
+
+// Compiles function_count corpus functions through the TestModule pipeline
+// on thread_count threads, each with its own module (and so its own compiler
+// and assembler).
+static CompileBenchmarkResult RunCompileBenchmark(uint32_t function_count,
+                                                  uint32_t thread_count) {
+  const uint32_t kBaseAddress = 0x80000000;
+  auto memory = std::make_unique<Memory>();
+  memory->Initialize();
+  auto processor = std::make_unique<Processor>(memory.get(), nullptr);
+  processor->Setup(std::make_unique<backend::x64::X64Backend>());
+  processor->backend()->CommitExecutableRange(
+      kBaseAddress, kBaseAddress + function_count * 4);
+
+  std::vector<TestModule*> modules;
+  for (uint32_t t = 0; t < thread_count; ++t) {
+    auto module = std::make_unique<TestModule>(
+        processor.get(), "CompileBenchmark",
+        [t, thread_count, function_count](uint32_t address) {
+          uint32_t index = (address - kBaseAddress) / 4;
+          return index < function_count && index % thread_count == t;
+        },
+        [](HIRBuilder& b) {
+          GenerateCorpusFunction(b, current_function_index);
+          return true;
+        });
+    modules.push_back(module.get());
+    processor->AddModule(std::move(module));
+  }
+
+  std::vector<std::vector<uint64_t>> latencies(thread_count);
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (uint32_t t = 0; t < thread_count; ++t) {
+    threads.emplace_back([&, t]() {
+      for (uint32_t index = t; index < function_count;
+           index += thread_count) {
+        uint32_t address = kBaseAddress + index * 4;
+        Function* function;
+        current_function_index = index;
+        auto function_start = std::chrono::steady_clock::now();
+        CompileProfiler::BeginFunction();
+        auto status = modules[t]->DeclareFunction(address, &function);
+        CompileProfiler::EndFunction(address,
+                                     status == Symbol::Status::kDefined);
+        latencies[t].push_back(
+            uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         std::chrono::steady_clock::now() - function_start)
+                         .count()));
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  double elapsed_s = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+
+  std::vector<uint64_t> all_latencies;
+  for (auto& thread_latencies : latencies) {
+    all_latencies.insert(all_latencies.end(), thread_latencies.begin(),
+                         thread_latencies.end());
+  }
+  std::sort(all_latencies.begin(), all_latencies.end());
+  CompileBenchmarkResult result;
+  result.functions_per_second = function_count / elapsed_s;
+  result.p50_us = all_latencies[all_latencies.size() / 2] / 1000.0;
+  result.p99_us = all_latencies[all_latencies.size() * 99 / 100] / 1000.0;
+
+  processor.reset();
+  memory.reset();
+  return result;
+}
+
+// This lives in the test suite rather than its own executable because it
+// compiles through the TestModule pipeline in util.h and needs the same
+// links as xenia-cpu-tests.
+// Hidden by default; run with `xenia-cpu-tests [.benchmark]`.
+TEST_CASE("COMPILE_THROUGHPUT", "[.benchmark][compile]") {
+  const uint32_t kFunctionCount = 4096;
+  uint32_t max_thread_count =
+      std::max(std::thread::hardware_concurrency(), 1u);
+  for (uint32_t thread_count : {1u, max_thread_count}) {
+    auto result = RunCompileBenchmark(kFunctionCount, thread_count);
+    WARN(thread_count << " thread(s): " << result.functions_per_second
+                      << " functions/s, p50 " << result.p50_us << " us, p99 "
+                      << result.p99_us << " us");
+    if (max_thread_count == 1) {
+      break;
+    }
+  }
+}
+
+TEST_CASE("COMPILE_STAGE_BREAKDOWN", "[.benchmark][compile]") {
+  CompileProfiler::Reset();
+  CompileProfiler::set_enabled(true);
+  RunCompileBenchmark(4096, 1);
+  CompileProfiler::set_enabled(false);
+  uint64_t total_ns = 0;
+  auto stages = CompileProfiler::stage_totals();
+  for (const auto& stage : stages) {
+    total_ns += stage.total_ns;
+  }
+  for (const auto& stage : stages) {
+    WARN(stage.name << ": "
+                    << stage.total_ns * 100.0 / std::max(total_ns, uint64_t(1))
+                    << "% of compile time, "
+                    << double(stage.instrs_before) / stage.run_count
+                    << " -> " << double(stage.instrs_after) / stage.run_count
+                    << " instrs");
+  }
+  CompileProfiler::Reset();
+}
@@ -0,0 +1,228 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "xenia/cpu/entry_table.h"
+
+#include "third_party/catch/include/catch.hpp"
+
+using namespace xe;
+using namespace xe::cpu;
+
+TEST_CASE("ENTRY_TABLE_GET_OR_CREATE", "[entry_table]") {
+  EntryTable table;
+  REQUIRE(table.Get(0x82000000) == nullptr);
+
+  Entry* entry = nullptr;
+  REQUIRE(table.GetOrCreate(0x82000000, &entry) == Entry::STATUS_NEW);
+  REQUIRE(entry != nullptr);
+  REQUIRE(entry->address == 0x82000000);
+  // Not visible until published.
+  REQUIRE(table.Get(0x82000000) == nullptr);
+
+  entry->end_address = 0x82000010;
+  table.Publish(entry, Entry::STATUS_READY);
+  REQUIRE(table.Get(0x82000000) == entry);
+
+  Entry* again = nullptr;
+  REQUIRE(table.GetOrCreate(0x82000000, &again) == Entry::STATUS_READY);
+  REQUIRE(again == entry);
+
+  // Neighbouring slots and distant leaves are independent.
+  REQUIRE(table.Get(0x82000004) == nullptr);
+  REQUIRE(table.Get(0xFFFF0000) == nullptr);
+  REQUIRE(table.GetOrCreate(0xFFFF0000, &again) == Entry::STATUS_NEW);
+  table.Publish(again, Entry::STATUS_FAILED);
+  REQUIRE(table.Get(0xFFFF0000) == nullptr);
+  REQUIRE(table.GetOrCreate(0xFFFF0000, &again) == Entry::STATUS_FAILED);
+}
+
+TEST_CASE("ENTRY_TABLE_COMPILE_RACE", "[entry_table]") {
+  EntryTable table;
+  const uint32_t kAddressCount = 1024;
+  const uint32_t kThreadCount = 8;
+  std::atomic<uint32_t> owners(0);
+  std::atomic<uint32_t> not_ready(0);
+
+  std::vector<std::thread> threads;
+  for (uint32_t t = 0; t < kThreadCount; ++t) {
+    threads.emplace_back([&]() {
+      for (uint32_t i = 0; i < kAddressCount; ++i) {
+        Entry* entry;
+        auto status = table.GetOrCreate(0x82000000 + i * 4, &entry);
+        if (status == Entry::STATUS_NEW) {
+          owners.fetch_add(1);
+          std::this_thread::yield();
+          entry->end_address = entry->address + 4;
+          table.Publish(entry, Entry::STATUS_READY);
+        } else if (status != Entry::STATUS_READY) {
+          not_ready.fetch_add(1);
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  // Exactly one thread compiled each entry and nobody saw it half-done.
+  REQUIRE(owners.load() == kAddressCount);
+  REQUIRE(not_ready.load() == 0);
+}
+
+TEST_CASE("ENTRY_TABLE_FIND_WITH_ADDRESS", "[entry_table]") {
+  EntryTable table;
+  auto define = [&](uint32_t address, uint32_t end_address) {
+    Entry* entry;
+    table.GetOrCreate(address, &entry);
+    entry->end_address = end_address;
+    entry->function = reinterpret_cast<Function*>(uintptr_t(address));
+    table.Publish(entry, Entry::STATUS_READY);
+    return entry->function;
+  };
+  auto outer = define(0x82000000, 0x82000100);
+  auto inner = define(0x82000040, 0x82000080);
+  auto after = define(0x82000200, 0x82000210);
+
+  REQUIRE(table.FindWithAddress(0x81FFFFFC).empty());
+  REQUIRE(table.FindWithAddress(0x82000000) == std::vector<Function*>{outer});
+  auto both = table.FindWithAddress(0x82000060);
+  REQUIRE(both.size() == 2);
+  REQUIRE(std::find(both.begin(), both.end(), outer) != both.end());
+  REQUIRE(std::find(both.begin(), both.end(), inner) != both.end());
+  REQUIRE(table.FindWithAddress(0x82000100) == std::vector<Function*>{outer});
+  REQUIRE(table.FindWithAddress(0x82000104).empty());
+
+  // Functions published after a query show up in the next one.
+  auto late = define(0x82000180, 0x82000190);
+  REQUIRE(table.FindWithAddress(0x82000184) == std::vector<Function*>{late});
+  REQUIRE(table.FindWithAddress(0x82000210) == std::vector<Function*>{after});
+
+  // Entries that are not ready are never returned.
+  Entry* pending;
+  table.GetOrCreate(0x82000300, &pending);
+  pending->end_address = 0x82000310;
+  REQUIRE(table.FindWithAddress(0x82000300).empty());
+  table.Publish(pending, Entry::STATUS_FAILED);
+  REQUIRE(table.FindWithAddress(0x82000300).empty());
+}
+
+TEST_CASE("ENTRY_TABLE_FIND_WITH_ADDRESS_NESTED", "[entry_table]") {
+  EntryTable table;
+  auto define = [&](uint32_t address, uint32_t end_address) {
+    Entry* entry;
+    table.GetOrCreate(address, &entry);
+    entry->end_address = end_address;
+    entry->function = reinterpret_cast<Function*>(uintptr_t(address));
+    table.Publish(entry, Entry::STATUS_READY);
+    return entry->function;
+  };
+  // One long function spanning many short ones, with more past its end.
+  auto outer = define(0x82000000, 0x82003FFC);
+  std::vector<Function*> inner;
+  for (uint32_t address = 0x82000010; address < 0x82008000; address += 0x20) {
+    inner.push_back(define(address, address + 0xC));
+  }
+
+  for (size_t n = 0; n < inner.size(); ++n) {
+    uint32_t address = 0x82000010 + uint32_t(n) * 0x20;
+    auto fns = table.FindWithAddress(address + 4);
+    if (address < 0x82004000) {
+      REQUIRE(fns.size() == 2);
+      REQUIRE(std::find(fns.begin(), fns.end(), outer) != fns.end());
+    } else {
+      REQUIRE(fns.size() == 1);
+    }
+    REQUIRE(std::find(fns.begin(), fns.end(), inner[n]) != fns.end());
+    // The gaps between the short functions only hit the long one.
+    auto gap = table.FindWithAddress(address + 0x10);
+    REQUIRE(gap.size() == (address + 0x10 <= 0x82003FFC ? 1 : 0));
+  }
+
+  // Invalidation reindexes what is left.
+  REQUIRE(table.Invalidate(0x82000000, 0x82000000).size() == 1);
+  REQUIRE(table.FindWithAddress(0x82000014) ==
+          std::vector<Function*>{inner[0]});
+  REQUIRE(table.FindWithAddress(0x82000020).empty());
+}
+
+// Hidden by default; run with `xenia-cpu-tests [.benchmark]`.
+TEST_CASE("ENTRY_TABLE_RESOLVE_THROUGHPUT", "[.benchmark][entry_table]") {
+  EntryTable table;
+  const uint32_t kAddressCount = 64 * 1024;
+  for (uint32_t i = 0; i < kAddressCount; ++i) {
+    Entry* entry;
+    table.GetOrCreate(0x82000000 + i * 4, &entry);
+    entry->end_address = entry->address + 4;
+    table.Publish(entry, Entry::STATUS_READY);
+  }
+
+  const uint32_t kResolvesPerThread = 4 * 1024 * 1024;
+  for (uint32_t thread_count = 1; thread_count <= 16; thread_count *= 2) {
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t t = 0; t < thread_count; ++t) {
+      threads.emplace_back([&, t]() {
+        uint32_t index = t * 7919;
+        for (uint32_t i = 0; i < kResolvesPerThread; ++i) {
+          Entry* entry;
+          table.GetOrCreate(0x82000000 + (index % kAddressCount) * 4, &entry);
+          index += 4099;
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    auto elapsed = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+    double resolves_per_sec =
+        double(kResolvesPerThread) * thread_count / elapsed;
+    WARN(thread_count << " threads: " << resolves_per_sec / 1000000.0
+                      << " M resolves/sec");
+  }
+}
+
+TEST_CASE("ENTRY_TABLE_FIND_WITH_ADDRESS_THROUGHPUT",
+          "[.benchmark][entry_table]") {
+  EntryTable table;
+  const uint32_t kFunctionCount = 100000;
+  uint32_t address = 0x82000000;
+  std::mt19937 rng(1234);
+  for (uint32_t i = 0; i < kFunctionCount; ++i) {
+    uint32_t size = 16 + (rng() % 64) * 4;
+    Entry* entry;
+    table.GetOrCreate(address, &entry);
+    entry->end_address = address + size - 4;
+    entry->function = reinterpret_cast<Function*>(uintptr_t(address));
+    table.Publish(entry, Entry::STATUS_READY);
+    address += size;
+  }
+  const uint32_t end_address = address;
+
+  // First query pays for building the index.
+  auto start = std::chrono::steady_clock::now();
+  REQUIRE(table.FindWithAddress(0x82000000).size() == 1);
+  auto build_elapsed = std::chrono::duration<double, std::micro>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+  WARN("index build over " << kFunctionCount
+                           << " functions: " << build_elapsed << " us");
+
+  const uint32_t kQueryCount = 1000000;
+  size_t found = 0;
+  start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < kQueryCount; ++i) {
+    uint32_t query = 0x82000000 + (rng() % (end_address - 0x82000000));
+    found += table.FindWithAddress(query & ~0x3u).size();
+  }
+  auto elapsed = std::chrono::duration<double>(
+                     std::chrono::steady_clock::now() - start)
+                     .count();
+  REQUIRE(found == kQueryCount);
+  WARN(kQueryCount / elapsed / 1000000.0 << " M queries/sec");
+}
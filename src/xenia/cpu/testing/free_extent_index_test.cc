@@ -0,0 +1,135 @@
+#include <random>
+#include <vector>
+
+#include "xenia/cpu/testing/util.h"
+#include "xenia/memory.h"
+
+using namespace xe;
+using namespace xe::cpu::testing;
+
+TEST_CASE("FREE_EXTENT_INDEX_FIND", "[free_extent_index]") {
+  FreeExtentIndex index;
+  index.Reset(64);
+  uint32_t start = 0;
+  REQUIRE(index.Find(0, 64, 8, 1, false, &start));
+  REQUIRE(start == 0);
+  REQUIRE(index.Find(0, 64, 8, 1, true, &start));
+  REQUIRE(start == 56);
+  REQUIRE_FALSE(index.Find(0, 64, 65, 1, false, &start));
+
+  // Free: 0-9, 20-39, 50-63.
+  index.Take(10, 10);
+  index.Take(40, 10);
+  REQUIRE(index.Find(0, 64, 16, 1, false, &start));
+  REQUIRE(start == 20);
+  REQUIRE(index.Find(0, 64, 16, 1, true, &start));
+  REQUIRE(start == 24);
+  // Aligned to 16 pages, 16 and 48 are cut short.
+  REQUIRE(index.Find(0, 64, 8, 16, false, &start));
+  REQUIRE(start == 0);
+  REQUIRE(index.Find(0, 64, 8, 16, true, &start));
+  REQUIRE(start == 32);
+  // Bounds cut the runs they fall in.
+  REQUIRE(index.Find(25, 64, 10, 1, false, &start));
+  REQUIRE(start == 25);
+  REQUIRE(index.Find(0, 36, 10, 1, true, &start));
+  REQUIRE(start == 26);
+  REQUIRE_FALSE(index.Find(25, 36, 12, 1, false, &start));
+}
+
+TEST_CASE("FREE_EXTENT_INDEX_COALESCE", "[free_extent_index]") {
+  FreeExtentIndex index;
+  index.Reset(64);
+  index.Take(0, 64);
+  uint32_t start = 0;
+  REQUIRE_FALSE(index.Find(0, 64, 1, 1, false, &start));
+
+  // Neighbouring and overlapping frees merge into one run.
+  index.Free(8, 8);
+  index.Free(24, 8);
+  index.Free(16, 8);
+  index.Free(12, 16);
+  REQUIRE(index.Find(0, 64, 24, 1, false, &start));
+  REQUIRE(start == 8);
+  REQUIRE_FALSE(index.Find(0, 64, 25, 1, false, &start));
+
+  // Taking part of a run, or pages already taken, leaves the rest.
+  index.Take(4, 8);
+  index.Take(30, 10);
+  REQUIRE(index.Find(0, 64, 18, 1, false, &start));
+  REQUIRE(start == 12);
+  REQUIRE_FALSE(index.Find(0, 64, 19, 1, false, &start));
+}
+
+// One step of an allocation trace: an allocation into a slot, or the release
+// of whatever the slot holds.
+struct HeapTraceOp {
+  bool release;
+  uint32_t slot;
+  uint32_t size;
+  uint32_t alignment;
+  bool top_down;
+};
+
+// Streaming-like trace: many short-lived buffers of a few dozen KB to a few
+// MB, some long-lived ones, and occasional top-down and aligned allocations,
+// so the heap fragments as it would in a title that streams assets.
+static std::vector<HeapTraceOp> GenerateHeapTrace(uint32_t op_count,
+                                                  uint32_t slot_count) {
+  std::mt19937 rng(0x58454E);
+  std::vector<HeapTraceOp> trace;
+  std::vector<bool> live(slot_count);
+  for (uint32_t i = 0; i < op_count; ++i) {
+    uint32_t slot = rng() % slot_count;
+    if (live[slot]) {
+      trace.push_back({true, slot, 0, 0, false});
+      live[slot] = false;
+      continue;
+    }
+    uint32_t size = 4096u << (rng() % 10);
+    size += (rng() % 16) * 4096;
+    uint32_t alignment = (rng() % 8) ? 4096 : 64 * 1024;
+    trace.push_back({false, slot, size, alignment, (rng() % 4) == 0});
+    live[slot] = true;
+  }
+  return trace;
+}
+
+static double ReplayHeapTraceNs(BaseHeap* heap,
+                                const std::vector<HeapTraceOp>& trace,
+                                uint32_t slot_count) {
+  std::vector<uint32_t> addresses(slot_count);
+  double elapsed = MeasureAverageNs(1, [&]() {
+    for (const auto& op : trace) {
+      if (op.release) {
+        heap->Release(addresses[op.slot]);
+        addresses[op.slot] = 0;
+      } else {
+        // Reserving alone doesn't go to the host, so this times placement.
+        heap->Alloc(op.size, op.alignment, kMemoryAllocationReserve,
+                    kMemoryProtectRead | kMemoryProtectWrite, op.top_down,
+                    &addresses[op.slot]);
+      }
+    }
+  });
+  for (uint32_t address : addresses) {
+    if (address) {
+      heap->Release(address);
+    }
+  }
+  return elapsed / double(trace.size());
+}
+
+// Hidden by default; run with `xenia-cpu-tests [.benchmark]`.
+TEST_CASE("FREE_EXTENT_INDEX_HEAP_TRACE",
+          "[.benchmark][free_extent_index]") {
+  const uint32_t kSlotCount = 2048;
+  Memory memory;
+  REQUIRE(memory.Initialize());
+  auto trace = GenerateHeapTrace(200000, kSlotCount);
+  // The 4 KB page heap NtAllocateVirtualMemory uses for small sizes.
+  double virtual_ns =
+      ReplayHeapTraceNs(memory.LookupHeap(0x10000000), trace, kSlotCount);
+  WARN("Heap trace: " << trace.size() << " ops, " << virtual_ns
+                      << " ns/op in the 4 KB page virtual heap");
+}
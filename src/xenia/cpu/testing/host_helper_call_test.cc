@@ -0,0 +1,167 @@
+#include <functional>
+
+#include "xenia/cpu/backend/x64/x64_emitter.h"
+#include "xenia/cpu/mmio_handler.h"
+#include "xenia/cpu/testing/util.h"
+
+using namespace xe;
+using namespace xe::cpu;
+using namespace xe::cpu::hir;
+using namespace xe::cpu::testing;
+using xe::cpu::ppc::PPCContext;
+
+static uint32_t last_mmio_write = 0;
+
+static uint32_t TestMmioRead(void* ppc_context, void* callback_context,
+                             uint32_t addr) {
+  return 0x11223344;
+}
+static void TestMmioWrite(void* ppc_context, void* callback_context,
+                          uint32_t addr, uint32_t value) {
+  last_mmio_write = value;
+}
+
+static MMIORange test_mmio_range = {
+    0x7FC80000, 0xFFFF0000, 0x10000, nullptr, TestMmioRead, TestMmioWrite,
+};
+
+// Keeps more integer and vector values live across the call than there are
+// non-volatile registers on either host ABI, so some of them end up in
+// registers the helper may clobber.
+static const int kLiveValueCount = 12;
+
+// Emits a helper call with kLiveValueCount GPRs and VRs live across it.
+// emit_call gets the loaded r3 and returns a 32-bit value stored to r31.
+static void GenerateLiveAcrossCall(
+    HIRBuilder& b, std::function<Value*(HIRBuilder& b, Value* r3)> emit_call) {
+  Value* gprs[kLiveValueCount];
+  Value* vrs[kLiveValueCount];
+  for (int n = 0; n < kLiveValueCount; ++n) {
+    gprs[n] = LoadGPR(b, 3 + n);
+    vrs[n] = LoadVR(b, 3 + n);
+  }
+  auto result = emit_call(b, gprs[0]);
+  for (int n = 0; n < kLiveValueCount; ++n) {
+    StoreGPR(b, 3 + n, b.Add(gprs[n], gprs[(n + 1) % kLiveValueCount]));
+    StoreVR(b, 3 + n,
+            b.VectorAdd(vrs[n], vrs[(n + 1) % kLiveValueCount], INT32_TYPE));
+  }
+  StoreGPR(b, 31, b.ZeroExtend(result, INT64_TYPE));
+  b.Return();
+}
+
+static void CheckLiveAcrossCall(
+    bool lean_helper_calls,
+    std::function<Value*(HIRBuilder& b, Value* r3)> emit_call,
+    uint32_t expected_result) {
+  // Read when the function is emitted, on its first run.
+  cvars::x64_lean_helper_calls = lean_helper_calls;
+  TestFunction test(
+      [&](HIRBuilder& b) { GenerateLiveAcrossCall(b, emit_call); });
+  test.Run(
+      [](PPCContext* ctx) {
+        for (int n = 0; n < kLiveValueCount; ++n) {
+          ctx->r[3 + n] = 0x0101010101010101ull * (n + 1);
+          ctx->v[3 + n] = vec128i(n, n * 2, n * 3, n * 4);
+        }
+      },
+      [expected_result](PPCContext* ctx) {
+        for (int n = 0; n < kLiveValueCount; ++n) {
+          int m = (n + 1) % kLiveValueCount;
+          REQUIRE(ctx->r[3 + n] == 0x0101010101010101ull * (n + 1 + m + 1));
+          REQUIRE(ctx->v[3 + n] ==
+                  vec128i(n + m, (n + m) * 2, (n + m) * 3, (n + m) * 4));
+        }
+        REQUIRE(ctx->r[31] == expected_result);
+      });
+  cvars::x64_lean_helper_calls = true;
+}
+
+TEST_CASE("HOST_HELPER_CALL_LOAD_CLOCK_KEEPS_LIVE_VALUES", "[host_helper]") {
+  auto emit_call = [](HIRBuilder& b, Value* r3) {
+    // Stored so the clock read isn't dead.
+    StoreGPR(b, 30, b.LoadClock());
+    return b.LoadZeroInt32();
+  };
+  CheckLiveAcrossCall(false, emit_call, 0);
+  CheckLiveAcrossCall(true, emit_call, 0);
+}
+
+TEST_CASE("HOST_HELPER_CALL_MMIO_KEEPS_LIVE_VALUES", "[host_helper]") {
+  auto emit_call = [](HIRBuilder& b, Value* r3) {
+    auto value =
+        b.LoadMmio(&test_mmio_range, b.LoadConstantUint64(0x7FC80010),
+                   INT32_TYPE, LOAD_STORE_BYTE_SWAP);
+    b.StoreMmio(&test_mmio_range, b.LoadConstantUint64(0x7FC80014),
+                b.Truncate(r3, INT32_TYPE), LOAD_STORE_BYTE_SWAP);
+    return value;
+  };
+  for (bool lean_helper_calls : {false, true}) {
+    last_mmio_write = 0;
+    CheckLiveAcrossCall(lean_helper_calls, emit_call, 0x11223344);
+    REQUIRE(last_mmio_write == 0x01010101);
+  }
+}
+
+// Emits calls_per_run helper calls with a few integer and vector values live
+// across them, so the calls have registers to keep.
+static void GenerateHelperCallLoop(
+    HIRBuilder& b, uint32_t calls_per_run,
+    std::function<Value*(HIRBuilder& b, Value* last)> emit_call) {
+  Value* gprs[4];
+  Value* vrs[4];
+  for (int n = 0; n < 4; ++n) {
+    gprs[n] = LoadGPR(b, 3 + n);
+    vrs[n] = LoadVR(b, 3 + n);
+  }
+  Value* last = b.LoadZeroInt32();
+  for (uint32_t i = 0; i < calls_per_run; ++i) {
+    last = emit_call(b, last);
+  }
+  for (int n = 0; n < 4; ++n) {
+    StoreGPR(b, 3 + n, b.Add(gprs[n], gprs[(n + 1) % 4]));
+    StoreVR(b, 3 + n, b.VectorAdd(vrs[n], vrs[(n + 1) % 4], INT32_TYPE));
+  }
+  StoreGPR(b, 10, b.ZeroExtend(last, INT64_TYPE));
+  b.Return();
+}
+
+static double MeasureHelperCallNs(
+    bool lean_helper_calls,
+    std::function<Value*(HIRBuilder& b, Value* last)> emit_call) {
+  const uint32_t kCallsPerRun = 256;
+  cvars::x64_lean_helper_calls = lean_helper_calls;
+  TestFunction test([&](HIRBuilder& b) {
+    GenerateHelperCallLoop(b, kCallsPerRun, emit_call);
+  });
+  auto run = [&test]() {
+    test.Run([](PPCContext* ctx) {}, [](PPCContext* ctx) {});
+  };
+  run();
+  double run_ns = MeasureAverageNs(4096, run);
+  cvars::x64_lean_helper_calls = true;
+  return run_ns / kCallsPerRun;
+}
+
+TEST_CASE("HOST_HELPER_CALL_LOAD_CLOCK", "[.benchmark][host_helper]") {
+  auto emit_call = [](HIRBuilder& b, Value* last) {
+    return b.Add(last, b.Truncate(b.LoadClock(), INT32_TYPE));
+  };
+  double thunk_ns = MeasureHelperCallNs(false, emit_call);
+  double lean_ns = MeasureHelperCallNs(true, emit_call);
+  WARN("LOAD_CLOCK: " << thunk_ns << " ns/call through the thunk, " << lean_ns
+                      << " ns/call direct");
+}
+
+TEST_CASE("HOST_HELPER_CALL_MMIO", "[.benchmark][host_helper]") {
+  auto emit_call = [](HIRBuilder& b, Value* last) {
+    auto value = b.LoadMmio(&test_mmio_range,
+                            b.LoadConstantUint64(0x7FC80010), INT32_TYPE);
+    b.StoreMmio(&test_mmio_range, b.LoadConstantUint64(0x7FC80014), last);
+    return b.Add(last, value);
+  };
+  double thunk_ns = MeasureHelperCallNs(false, emit_call);
+  double lean_ns = MeasureHelperCallNs(true, emit_call);
+  WARN("LOAD_MMIO+STORE_MMIO: " << thunk_ns << " ns/pair through the thunk, "
+                                << lean_ns << " ns/pair direct");
+}
@@ -0,0 +1,177 @@
+#include "xenia/cpu/compiler/compiler_passes.h"
+#include "xenia/cpu/testing/util.h"
+
+using namespace xe;
+using namespace xe::cpu;
+using namespace xe::cpu::hir;
+using namespace xe::cpu::testing;
+using xe::cpu::compiler::passes::LoopInvariantCodeMotionPass;
+using xe::cpu::ppc::PPCContext;
+
+// Decrements r3 and branches back to header while it is not zero.
+static void EmitLoopLatch(HIRBuilder& b, Label* header) {
+  auto count = b.Sub(LoadGPR(b, 3), b.LoadConstantUint64(1));
+  StoreGPR(b, 3, count);
+  b.BranchTrue(b.CompareNE(count, b.LoadZeroInt64()), header);
+}
+
+static bool HoistInvariants(HIRBuilder& b) {
+  return RunPasses(b, std::make_unique<LoopInvariantCodeMotionPass>());
+}
+
+// r6 += r4 + r5, r3 times. The header is reached by a branch over the exit.
+static Value* GenerateInvariantAdd(HIRBuilder& b, Label* header) {
+  auto exit = b.NewLabel();
+  auto a = LoadGPR(b, 4);
+  auto c = LoadGPR(b, 5);
+  b.Branch(header);
+  b.MarkLabel(exit);
+  b.Return();
+  b.MarkLabel(header);
+  auto sum = b.Add(a, c);
+  StoreGPR(b, 6, b.Add(LoadGPR(b, 6), sum));
+  EmitLoopLatch(b, header);
+  b.Branch(exit);
+  return sum;
+}
+
+TEST_CASE("LICM_HOISTS_INVARIANT_ADD", "[licm]") {
+  HIRBuilder builder;
+  auto header = builder.NewLabel();
+  auto sum = GenerateInvariantAdd(builder, header);
+  REQUIRE(HoistInvariants(builder));
+  REQUIRE(sum->def->block != header->block);
+  REQUIRE(sum->def->block->next == header->block);
+
+  TestFunction test([](HIRBuilder& b) {
+    GenerateInvariantAdd(b, b.NewLabel());
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->r[3] = 5;
+        ctx->r[4] = 10;
+        ctx->r[5] = 3;
+        ctx->r[6] = 1;
+      },
+      [](PPCContext* ctx) {
+        REQUIRE(ctx->r[3] == 0);
+        REQUIRE(ctx->r[6] == 1 + 5 * 13);
+      });
+}
+
+// r6 += r4, then the low word of r4 is incremented, r3 times.
+static Value* GenerateOverlappingContextStore(HIRBuilder& b, Label* header) {
+  b.MarkLabel(header);
+  auto value = LoadGPR(b, 4);
+  StoreGPR(b, 6, b.Add(LoadGPR(b, 6), value));
+  b.StoreContext(offsetof(PPCContext, r) + 4 * 8,
+                 b.Truncate(b.Add(value, b.LoadConstantUint64(1)),
+                            INT32_TYPE));
+  EmitLoopLatch(b, header);
+  b.Return();
+  return value;
+}
+
+TEST_CASE("LICM_KEEPS_LOAD_OF_STORED_CONTEXT", "[licm]") {
+  HIRBuilder builder;
+  auto header = builder.NewLabel();
+  auto value = GenerateOverlappingContextStore(builder, header);
+  REQUIRE(HoistInvariants(builder));
+  REQUIRE(value->def->block == header->block);
+
+  TestFunction test([](HIRBuilder& b) {
+    GenerateOverlappingContextStore(b, b.NewLabel());
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->r[3] = 3;
+        ctx->r[4] = 10;
+        ctx->r[6] = 0;
+      },
+      [](PPCContext* ctx) {
+        REQUIRE(ctx->r[4] == 13);
+        REQUIRE(ctx->r[6] == 10 + 11 + 12);
+      });
+}
+
+// r6 += r4 / r5, r3 times, skipped when r5 is zero.
+static Value* GenerateGuardedDiv(HIRBuilder& b, Label* header) {
+  auto exit = b.NewLabel();
+  auto dividend = LoadGPR(b, 4);
+  auto divisor = LoadGPR(b, 5);
+  b.BranchTrue(b.CompareEQ(divisor, b.LoadZeroInt64()), exit);
+  b.MarkLabel(header);
+  auto quotient = b.Div(dividend, divisor);
+  StoreGPR(b, 6, b.Add(LoadGPR(b, 6), quotient));
+  EmitLoopLatch(b, header);
+  b.MarkLabel(exit);
+  b.Return();
+  return quotient;
+}
+
+TEST_CASE("LICM_KEEPS_DIV_IN_LOOP", "[licm]") {
+  HIRBuilder builder;
+  auto header = builder.NewLabel();
+  auto quotient = GenerateGuardedDiv(builder, header);
+  REQUIRE(HoistInvariants(builder));
+  // Hoisted, it would divide by zero when the loop is skipped.
+  REQUIRE(quotient->def->block == header->block);
+
+  TestFunction test([](HIRBuilder& b) {
+    GenerateGuardedDiv(b, b.NewLabel());
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->r[3] = 4;
+        ctx->r[4] = 100;
+        ctx->r[5] = 0;
+        ctx->r[6] = 7;
+      },
+      [](PPCContext* ctx) { REQUIRE(ctx->r[6] == 7); });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->r[3] = 4;
+        ctx->r[4] = 100;
+        ctx->r[5] = 5;
+        ctx->r[6] = 7;
+      },
+      [](PPCContext* ctx) { REQUIRE(ctx->r[6] == 7 + 4 * 20); });
+}
+
+// r6 += r4 * r5, r3 times. The entry falls through into the header.
+static Value* GenerateFallThroughEntry(HIRBuilder& b, Label* header) {
+  auto a = LoadGPR(b, 4);
+  auto c = LoadGPR(b, 5);
+  b.MarkLabel(header);
+  auto product = b.Mul(a, c);
+  StoreGPR(b, 6, b.Add(LoadGPR(b, 6), product));
+  EmitLoopLatch(b, header);
+  b.Return();
+  return product;
+}
+
+TEST_CASE("LICM_FALL_THROUGH_ENTRY", "[licm]") {
+  HIRBuilder builder;
+  auto header = builder.NewLabel();
+  auto product = GenerateFallThroughEntry(builder, header);
+  auto entry = builder.first_block();
+  REQUIRE(HoistInvariants(builder));
+  // The entry now falls through into the preheader.
+  REQUIRE(entry->next == product->def->block);
+  REQUIRE(product->def->block->next == header->block);
+
+  TestFunction test([](HIRBuilder& b) {
+    GenerateFallThroughEntry(b, b.NewLabel());
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->r[3] = 3;
+        ctx->r[4] = 6;
+        ctx->r[5] = 7;
+        ctx->r[6] = 0;
+      },
+      [](PPCContext* ctx) {
+        REQUIRE(ctx->r[3] == 0);
+        REQUIRE(ctx->r[6] == 3 * 42);
+      });
+}
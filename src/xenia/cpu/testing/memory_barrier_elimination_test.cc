@@ -0,0 +1,68 @@
+#include "xenia/cpu/compiler/compiler_passes.h"
+#include "xenia/cpu/testing/util.h"
+
+using namespace xe;
+using namespace xe::cpu;
+using namespace xe::cpu::hir;
+using namespace xe::cpu::testing;
+using xe::cpu::compiler::passes::MemoryBarrierEliminationPass;
+
+static bool EliminateBarriers(HIRBuilder& b) {
+  return RunPasses(b, std::make_unique<MemoryBarrierEliminationPass>());
+}
+
+TEST_CASE("MEMORY_BARRIER_SYNC_BETWEEN_STORE_AND_LOAD", "[barrier]") {
+  HIRBuilder b;
+  auto address = LoadGPR(b, 3);
+  b.Store(address, b.Truncate(LoadGPR(b, 4), INT32_TYPE));
+  b.MemoryBarrier(MEMORY_BARRIER_TYPE_SYNC);
+  StoreGPR(b, 5, b.ZeroExtend(b.Load(address, INT32_TYPE), INT64_TYPE));
+  b.Return();
+  REQUIRE(EliminateBarriers(b));
+  // x86 may still move the load ahead of the store.
+  REQUIRE(CountInstrs(b, OPCODE_MEMORY_BARRIER_info) == 1);
+}
+
+TEST_CASE("MEMORY_BARRIER_LWSYNC_AND_EIEIO", "[barrier]") {
+  HIRBuilder b;
+  auto address = LoadGPR(b, 3);
+  b.Store(address, b.Truncate(LoadGPR(b, 4), INT32_TYPE));
+  b.MemoryBarrier(MEMORY_BARRIER_TYPE_LWSYNC);
+  StoreGPR(b, 5, b.ZeroExtend(b.Load(address, INT32_TYPE), INT64_TYPE));
+  b.MemoryBarrier(MEMORY_BARRIER_TYPE_EIEIO);
+  b.Store(address, b.Truncate(LoadGPR(b, 6), INT32_TYPE));
+  b.Return();
+  REQUIRE(EliminateBarriers(b));
+  REQUIRE(CountInstrs(b, OPCODE_MEMORY_BARRIER_info) == 0);
+}
+
+TEST_CASE("MEMORY_BARRIER_REDUNDANT_SYNC", "[barrier]") {
+  HIRBuilder b;
+  auto address = LoadGPR(b, 3);
+  b.Store(address, b.Truncate(LoadGPR(b, 4), INT32_TYPE));
+  b.MemoryBarrier(MEMORY_BARRIER_TYPE_SYNC);
+  // Nothing stored since the first one.
+  b.MemoryBarrier(MEMORY_BARRIER_TYPE_SYNC);
+  StoreGPR(b, 5, b.ZeroExtend(b.Load(address, INT32_TYPE), INT64_TYPE));
+  b.MemoryBarrier(MEMORY_BARRIER_TYPE_SYNC);
+  StoreGPR(b, 6, b.ZeroExtend(b.Load(address, INT32_TYPE), INT64_TYPE));
+  b.Return();
+  REQUIRE(EliminateBarriers(b));
+  REQUIRE(CountInstrs(b, OPCODE_MEMORY_BARRIER_info) == 1);
+}
+
+TEST_CASE("MEMORY_BARRIER_SYNC_BEFORE_ATOMIC", "[barrier]") {
+  HIRBuilder b;
+  auto address = LoadGPR(b, 3);
+  b.Store(address, b.Truncate(LoadGPR(b, 4), INT32_TYPE));
+  b.MemoryBarrier(MEMORY_BARRIER_TYPE_SYNC);
+  // The lock prefix drains the store buffer as well.
+  StoreGPR(b, 5,
+           b.ZeroExtend(b.AtomicExchange(address, b.Truncate(LoadGPR(b, 6),
+                                                             INT32_TYPE)),
+                        INT64_TYPE));
+  StoreGPR(b, 7, b.ZeroExtend(b.Load(address, INT32_TYPE), INT64_TYPE));
+  b.Return();
+  REQUIRE(EliminateBarriers(b));
+  REQUIRE(CountInstrs(b, OPCODE_MEMORY_BARRIER_info) == 0);
+}
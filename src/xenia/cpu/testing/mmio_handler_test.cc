@@ -0,0 +1,149 @@
+#include "xenia/cpu/mmio_handler.h"
+#include "xenia/cpu/testing/util.h"
+#include "xenia/memory.h"
+
+using namespace xe;
+using namespace xe::cpu;
+using namespace xe::cpu::hir;
+using namespace xe::cpu::testing;
+using xe::cpu::ppc::PPCContext;
+
+static uint32_t TestMmioRead(void* ppc_context, void* callback_context,
+                             uint32_t addr) {
+  return addr;
+}
+static uint32_t last_write_address = 0;
+static uint32_t last_write_value = 0;
+static void TestMmioWrite(void* ppc_context, void* callback_context,
+                          uint32_t addr, uint32_t value) {
+  last_write_address = addr;
+  last_write_value = value;
+}
+
+TEST_CASE("MMIO_LOOKUP_RANGE", "[mmio]") {
+  Memory memory;
+  REQUIRE(memory.Initialize());
+  REQUIRE(memory.AddVirtualMappedRange(0x7FC80000, 0xFFFF0000, 0x10000,
+                                       nullptr, TestMmioRead, TestMmioWrite));
+  // Smaller than a page.
+  REQUIRE(memory.AddVirtualMappedRange(0x7FD00000, 0xFFFFFF00, 0x1000,
+                                       nullptr, TestMmioRead, TestMmioWrite));
+  // The first page of every 64 KB from 0x7FE00000 to 0x7FEF0000.
+  REQUIRE(memory.AddVirtualMappedRange(0x7FE00000, 0xFFF0F000, 0x1000,
+                                       nullptr, TestMmioRead, TestMmioWrite));
+
+  auto gpu = memory.LookupVirtualMappedRange(0x7FC80000);
+  REQUIRE(gpu != nullptr);
+  REQUIRE(gpu->address == 0x7FC80000);
+  REQUIRE(memory.LookupVirtualMappedRange(0x7FC8FFFC) == gpu);
+  REQUIRE(memory.LookupVirtualMappedRange(0x7FC7FFFC) == nullptr);
+  REQUIRE(memory.LookupVirtualMappedRange(0x7FC90000) == nullptr);
+
+  auto small = memory.LookupVirtualMappedRange(0x7FD000FC);
+  REQUIRE(small != nullptr);
+  REQUIRE(small->address == 0x7FD00000);
+  REQUIRE(memory.LookupVirtualMappedRange(0x7FD00100) == nullptr);
+
+  auto mirrored = memory.LookupVirtualMappedRange(0x7FE00010);
+  REQUIRE(mirrored != nullptr);
+  REQUIRE(mirrored->address == 0x7FE00000);
+  REQUIRE(memory.LookupVirtualMappedRange(0x7FE30010) == mirrored);
+  REQUIRE(memory.LookupVirtualMappedRange(0x7FEF0FFC) == mirrored);
+  REQUIRE(memory.LookupVirtualMappedRange(0x7FE31000) == nullptr);
+  REQUIRE(memory.LookupVirtualMappedRange(0x7FF00000) == nullptr);
+}
+
+static MMIORange test_mmio_range = {
+    0x7FC80000, 0xFFFF0000, 0x10000, nullptr, TestMmioRead, TestMmioWrite,
+};
+
+// Loads the word at r3 into r5 and stores r4 at r3 + 4, through
+// test_mmio_range if r3 is in it and to guest memory if not.
+static void GenerateMmioAccess(HIRBuilder& b, uint32_t flags) {
+  auto address = LoadGPR(b, 3);
+  StoreGPR(b, 5,
+           b.ZeroExtend(b.LoadMmio(&test_mmio_range, address, INT32_TYPE,
+                                   flags),
+                        INT64_TYPE));
+  b.StoreMmio(&test_mmio_range, b.Add(address, b.LoadConstantUint64(4)),
+              b.Truncate(LoadGPR(b, 4), INT32_TYPE), flags);
+  b.Return();
+}
+
+TEST_CASE("MMIO_RUNTIME_ADDRESS", "[mmio]") {
+  for (uint32_t flags : {0u, uint32_t(LOAD_STORE_BYTE_SWAP)}) {
+    bool swapped = flags != 0;
+    TestFunction test([flags](HIRBuilder& b) { GenerateMmioAccess(b, flags); });
+
+    // Registers hold guest memory as loaded without the swap flag, and the
+    // range reads and writes values as the guest sees them.
+    last_write_address = 0;
+    test.Run(
+        [](PPCContext* ctx) {
+          ctx->r[3] = 0x7FC80010;
+          ctx->r[4] = 0xAABBCCDD;
+        },
+        [swapped](PPCContext* ctx) {
+          REQUIRE(ctx->r[5] ==
+                  (swapped ? 0x7FC80010 : xe::byte_swap(0x7FC80010u)));
+        });
+    REQUIRE(last_write_address == 0x7FC80014);
+    REQUIRE(last_write_value ==
+            (swapped ? 0xAABBCCDD : xe::byte_swap(0xAABBCCDDu)));
+
+    uint32_t address = test.memory->SystemHeapAlloc(16);
+    REQUIRE(address);
+    auto host_address = test.memory->TranslateVirtual(address);
+    xe::store_and_swap<uint32_t>(host_address, 0x11223344);
+    last_write_address = 0;
+    test.Run(
+        [address](PPCContext* ctx) {
+          ctx->r[3] = address;
+          ctx->r[4] = 0xAABBCCDD;
+        },
+        [swapped](PPCContext* ctx) {
+          REQUIRE(ctx->r[5] ==
+                  (swapped ? 0x11223344 : xe::byte_swap(0x11223344u)));
+        });
+    REQUIRE(last_write_address == 0);
+    REQUIRE(xe::load_and_swap<uint32_t>(host_address + 4) ==
+            (swapped ? 0xAABBCCDD : xe::byte_swap(0xAABBCCDDu)));
+  }
+}
+
+// Runs guest loads that all fault into MMIOHandler, hitting the last of
+// range_count registered ranges.
+static double MeasureMmioFaultNs(uint32_t range_count) {
+  const uint32_t kLoadsPerRun = 64;
+  const uint32_t kRunCount = 256;
+  TestFunction test([&](HIRBuilder& b) {
+    auto address = LoadGPR(b, 3);
+    Value* last = b.LoadZeroInt32();
+    for (uint32_t i = 0; i < kLoadsPerRun; ++i) {
+      auto load_address = b.Add(address, b.LoadConstantUint64(i * 4));
+      last = b.Add(last, b.Load(load_address, INT32_TYPE));
+    }
+    StoreGPR(b, 4, b.ZeroExtend(last, INT64_TYPE));
+    b.Return();
+  });
+  for (uint32_t n = 0; n < range_count; ++n) {
+    test.memory->AddVirtualMappedRange(0x7F000000 + n * 0x10000, 0xFFFF0000,
+                                       0x10000, nullptr, TestMmioRead,
+                                       TestMmioWrite);
+  }
+  uint32_t address = 0x7F000000 + (range_count - 1) * 0x10000;
+  auto run = [&test, address]() {
+    test.Run([address](PPCContext* ctx) { ctx->r[3] = address; },
+             [](PPCContext* ctx) {});
+  };
+  run();
+  return MeasureAverageNs(kRunCount, run) / kLoadsPerRun;
+}
+
+// Hidden by default; run with `xenia-cpu-tests [.benchmark]`.
+TEST_CASE("MMIO_FAULT_ROUND_TRIP", "[.benchmark][mmio]") {
+  double one_range_ns = MeasureMmioFaultNs(1);
+  double many_ranges_ns = MeasureMmioFaultNs(48);
+  WARN("MMIO fault: " << one_range_ns << " ns/access with 1 range, "
+                      << many_ranges_ns << " ns/access with 48 ranges");
+}
@@ -0,0 +1,42 @@
+#include "xenia/cpu/compiler/mmio_site_registry.h"
+
+#include "third_party/catch/include/catch.hpp"
+
+using namespace xe;
+using namespace xe::cpu;
+using namespace xe::cpu::compiler;
+
+TEST_CASE("MMIO_SITE_RECORD", "[mmio_site]") {
+  MMIORange gpu_range = {0x7FC80000, 0xFFFF0000, 0x10000};
+  MMIORange other_range = {0x7FEA0000, 0xFFFF0000, 0x10000};
+  MMIOSiteRegistry registry;
+  REQUIRE(registry.Lookup(0x82000010) == nullptr);
+
+  REQUIRE(registry.Record(0x82000010, &gpu_range));
+  REQUIRE(registry.Lookup(0x82000010) == &gpu_range);
+  // A site is only reported once, whatever it hits later.
+  REQUIRE_FALSE(registry.Record(0x82000010, &gpu_range));
+  REQUIRE_FALSE(registry.Record(0x82000010, &other_range));
+  REQUIRE(registry.Lookup(0x82000010) == &gpu_range);
+  REQUIRE(registry.Lookup(0x82000014) == nullptr);
+}
+
+TEST_CASE("MMIO_SITE_REMOVE", "[mmio_site]") {
+  MMIORange gpu_range = {0x7FC80000, 0xFFFF0000, 0x10000};
+  MMIOSiteRegistry registry;
+  REQUIRE(registry.Record(0x82000010, &gpu_range));
+  REQUIRE(registry.Record(0x82000020, &gpu_range));
+  REQUIRE(registry.Record(0x82001000, &gpu_range));
+
+  // Overwritten code forgets its sites; the end is exclusive.
+  registry.Remove(0x82000000, 0x20);
+  REQUIRE(registry.Lookup(0x82000010) == nullptr);
+  REQUIRE(registry.Lookup(0x82000020) == &gpu_range);
+  REQUIRE(registry.Lookup(0x82001000) == &gpu_range);
+
+  registry.Remove(0x82000000, 0x2000);
+  REQUIRE(registry.Lookup(0x82000020) == nullptr);
+  REQUIRE(registry.Lookup(0x82001000) == nullptr);
+  // Sites may be learned again.
+  REQUIRE(registry.Record(0x82000020, &gpu_range));
+}
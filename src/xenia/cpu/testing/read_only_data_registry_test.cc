@@ -0,0 +1,59 @@
+#include <algorithm>
+#include <vector>
+
+#include "xenia/cpu/compiler/read_only_data_registry.h"
+
+#include "third_party/catch/include/catch.hpp"
+
+using namespace xe;
+using namespace xe::cpu::compiler;
+
+TEST_CASE("READ_ONLY_DATA_ACQUIRE", "[read_only_data]") {
+  ReadOnlyDataRegistry registry;
+  REQUIRE_FALSE(registry.Acquire(0x82000000, 4, 0x82100000));
+
+  registry.AddRange(0x82000000, 0x2000);
+  REQUIRE(registry.Acquire(0x82000000, 4, 0x82100000));
+  REQUIRE(registry.Acquire(0x82001FF0, 16, 0x82100000));
+  // Straddling either end of the range.
+  REQUIRE_FALSE(registry.Acquire(0x81FFFFFC, 8, 0x82100000));
+  REQUIRE_FALSE(registry.Acquire(0x82001FFC, 8, 0x82100000));
+
+  registry.RemoveRange(0x82000000, 0x2000);
+  REQUIRE_FALSE(registry.Acquire(0x82000000, 4, 0x82100000));
+}
+
+TEST_CASE("READ_ONLY_DATA_REMOVE", "[read_only_data]") {
+  ReadOnlyDataRegistry registry;
+  registry.AddRange(0x82000000, 0x4000);
+  REQUIRE(registry.Acquire(0x82000010, 4, 0x82100000));
+  REQUIRE(registry.Acquire(0x82000020, 4, 0x82100000));
+  REQUIRE(registry.Acquire(0x82002000, 8, 0x82100100));
+  // A load straddling two pages depends on both.
+  REQUIRE(registry.Acquire(0x82000FFC, 8, 0x82100200));
+
+  // Nothing folded from the last page.
+  REQUIRE(registry.Remove(0x82003000, 0x1000).empty());
+
+  auto users = registry.Remove(0x82001000, 4);
+  REQUIRE(users == std::vector<uint32_t>{0x82100200});
+
+  users = registry.Remove(0x82000000, 0x4000);
+  std::sort(users.begin(), users.end());
+  REQUIRE(users == std::vector<uint32_t>{0x82100000, 0x82100100,
+                                         0x82100200});
+  // Each user is only handed out once.
+  REQUIRE(registry.Remove(0x82000000, 0x4000).empty());
+}
+
+TEST_CASE("READ_ONLY_DATA_TAKE_REMOVED", "[read_only_data]") {
+  ReadOnlyDataRegistry registry;
+  registry.AddRange(0x82000000, 0x1000);
+  REQUIRE(registry.Acquire(0x82000010, 4, 0x82100000));
+  REQUIRE_FALSE(registry.TakeRemoved(0x82100000));
+
+  // Removed while the function was still being compiled.
+  registry.Remove(0x82000000, 0x1000);
+  REQUIRE(registry.TakeRemoved(0x82100000));
+  REQUIRE_FALSE(registry.TakeRemoved(0x82100000));
+}
@@ -0,0 +1,271 @@
+#include <cstring>
+#include <functional>
+#include <unordered_map>
+
+#include "xenia/base/memory.h"
+#include "xenia/cpu/compiler/inline_registry.h"
+#include "xenia/cpu/testing/util.h"
+
+using namespace xe;
+using namespace xe::cpu;
+using namespace xe::cpu::hir;
+using namespace xe::cpu::testing;
+using xe::cpu::ppc::PPCContext;
+
+// A function under test and the guest functions it calls, all in one
+// TestModule. Functions are generated when first resolved, so callees are
+// defined before their callers.
+class CallTest {
+ public:
+  static const uint32_t kBaseAddress = 0x80000000;
+
+  CallTest() {
+    memory_.reset(new Memory());
+    memory_->Initialize();
+    processor_ = std::make_unique<Processor>(memory_.get(), nullptr);
+    processor_->Setup(std::make_unique<backend::x64::X64Backend>());
+    processor_->AddModule(std::make_unique<TestModule>(
+        processor_.get(), "CallTest",
+        [](uint32_t address) {
+          return address >= kBaseAddress && address < kBaseAddress + 0x10000;
+        },
+        [this](HIRBuilder& b) {
+          generators_[pending_address_](b);
+          return true;
+        }));
+    processor_->backend()->CommitExecutableRange(kBaseAddress,
+                                                 kBaseAddress + 0x10000);
+    stack_address_ = memory_->SystemHeapAlloc(0x2000);
+  }
+
+  ~CallTest() {
+    processor_.reset();
+    memory_.reset();
+  }
+
+  Function* Define(uint32_t address,
+                   std::function<void(HIRBuilder& b)> generator) {
+    generators_[address] = generator;
+    pending_address_ = address;
+    return processor_->ResolveFunction(address);
+  }
+
+  // A register save/restore helper as XexModule::FindSaveRest tags them.
+  // Calls to it are always expanded, so its body never runs.
+  Function* DefineSaveRest(uint32_t address, uint32_t flags,
+                           uint32_t first_register) {
+    auto function = Define(address, [](HIRBuilder& b) { b.Return(); });
+    function->set_save_rest(flags, first_register);
+    return function;
+  }
+
+  void Run(Function* function, std::function<void(PPCContext*)> pre_call,
+           std::function<void(PPCContext*)> post_call) {
+    auto thread_state = std::make_unique<ThreadState>(processor_.get(), 0x100);
+    auto ctx = thread_state->context();
+    ctx->lr = 0xBCBCBCBC;
+    // The stack grows down from the middle of the allocation.
+    ctx->r[1] = stack_top();
+    ctx->r[12] = stack_top();
+    pre_call(ctx);
+    function->Call(thread_state.get(), uint32_t(ctx->lr));
+    post_call(ctx);
+  }
+
+  uint32_t stack_top() const { return stack_address_ + 0x1000; }
+  uint8_t* TranslateVirtual(uint32_t address) {
+    return memory_->TranslateVirtual(address);
+  }
+  Processor* processor() const { return processor_.get(); }
+
+ private:
+  std::unique_ptr<Memory> memory_;
+  std::unique_ptr<Processor> processor_;
+  std::unordered_map<uint32_t, std::function<void(HIRBuilder& b)>>
+      generators_;
+  uint32_t pending_address_ = 0;
+  uint32_t stack_address_ = 0;
+};
+
+static const uint32_t kCallerAddress = CallTest::kBaseAddress;
+static const uint32_t kHelperAddress = CallTest::kBaseAddress + 0x1000;
+
+static uint32_t GprSlot(uint32_t sp, uint32_t n) {
+  return sp - (8 * (32 - n) + 8);
+}
+
+TEST_CASE("SAVE_REST_SAVEGPRLR", "[save_rest]") {
+  CallTest test;
+  auto helper =
+      test.DefineSaveRest(kHelperAddress, Function::kFlagSaveGprLr, 28);
+  auto caller = test.Define(kCallerAddress, [helper](HIRBuilder& b) {
+    b.Call(helper);
+    b.Return();
+  });
+  test.Run(
+      caller,
+      [](PPCContext* ctx) {
+        ctx->r[12] = 0x82001234;
+        for (uint32_t n = 27; n <= 31; ++n) {
+          ctx->r[n] = 0x0101010101010101ull * n;
+        }
+      },
+      [&test](PPCContext* ctx) {
+        uint32_t sp = test.stack_top();
+        for (uint32_t n = 28; n <= 31; ++n) {
+          REQUIRE(xe::load_and_swap<uint64_t>(
+                      test.TranslateVirtual(GprSlot(sp, n))) == ctx->r[n]);
+        }
+        // r27 is not the helper's to save.
+        REQUIRE(xe::load_and_swap<uint64_t>(
+                    test.TranslateVirtual(GprSlot(sp, 27))) == 0);
+        REQUIRE(xe::load_and_swap<uint32_t>(test.TranslateVirtual(sp - 8)) ==
+                0x82001234);
+      });
+}
+
+TEST_CASE("SAVE_REST_RESTGPRLR", "[save_rest]") {
+  CallTest test;
+  auto helper =
+      test.DefineSaveRest(kHelperAddress, Function::kFlagRestGprLr, 29);
+  auto caller = test.Define(kCallerAddress, [helper](HIRBuilder& b) {
+    // b __restgprlr_29
+    b.Call(helper, CALL_TAIL);
+  });
+  uint32_t sp = test.stack_top();
+  for (uint32_t n = 29; n <= 31; ++n) {
+    xe::store_and_swap<uint64_t>(test.TranslateVirtual(GprSlot(sp, n)),
+                                 0x1111111111111111ull * (n - 28));
+  }
+  // The helper returns to the restored LR, which is the caller's.
+  xe::store_and_swap<uint32_t>(test.TranslateVirtual(sp - 8), 0xBCBCBCBC);
+  test.Run(
+      caller, [](PPCContext* ctx) { ctx->r[28] = 0x28; },
+      [](PPCContext* ctx) {
+        REQUIRE(ctx->r[28] == 0x28);
+        for (uint32_t n = 29; n <= 31; ++n) {
+          REQUIRE(ctx->r[n] == 0x1111111111111111ull * (n - 28));
+        }
+        REQUIRE(ctx->r[12] == 0xBCBCBCBC);
+        REQUIRE(ctx->lr == 0xBCBCBCBC);
+      });
+}
+
+TEST_CASE("SAVE_REST_SAVEFPR_RESTFPR", "[save_rest]") {
+  CallTest test;
+  auto save = test.DefineSaveRest(kHelperAddress, Function::kFlagSaveFpr, 29);
+  auto rest =
+      test.DefineSaveRest(kHelperAddress + 4, Function::kFlagRestFpr, 29);
+  // Saves f29-f31, clears them and restores them.
+  auto caller = test.Define(kCallerAddress, [save, rest](HIRBuilder& b) {
+    b.Call(save);
+    for (int n = 29; n <= 31; ++n) {
+      StoreFPR(b, n, b.LoadZeroFloat64());
+    }
+    b.Call(rest);
+    b.Return();
+  });
+  test.Run(
+      caller,
+      [](PPCContext* ctx) {
+        for (int n = 29; n <= 31; ++n) {
+          ctx->f[n] = n * 1.5;
+        }
+      },
+      [&test](PPCContext* ctx) {
+        uint32_t base = test.stack_top();
+        for (uint32_t n = 29; n <= 31; ++n) {
+          REQUIRE(ctx->f[n] == n * 1.5);
+          uint64_t bits;
+          std::memcpy(&bits, &ctx->f[n], sizeof(bits));
+          REQUIRE(xe::load_and_swap<uint64_t>(
+                      test.TranslateVirtual(base - 8 * (32 - n))) == bits);
+        }
+      });
+}
+
+// Where stvx/lvx vN, r11, r12 put vN after li r11, -16 * (last + 1 - N).
+static uint32_t VmxSlot(uint32_t base, uint32_t last, uint32_t n) {
+  return (base - 16 * (last + 1 - n)) & ~0xFu;
+}
+
+TEST_CASE("SAVE_REST_SAVEVMX", "[save_rest]") {
+  CallTest test;
+  auto helper = test.DefineSaveRest(kHelperAddress, Function::kFlagSaveVmx, 30);
+  auto caller = test.Define(kCallerAddress, [helper](HIRBuilder& b) {
+    b.Call(helper);
+    b.Return();
+  });
+  test.Run(
+      caller,
+      [](PPCContext* ctx) {
+        for (int n = 30; n <= 31; ++n) {
+          ctx->v[n] = vec128i(n, n * 2, n * 3, n * 4);
+        }
+      },
+      [&test](PPCContext* ctx) {
+        for (uint32_t n = 30; n <= 31; ++n) {
+          auto slot = test.TranslateVirtual(VmxSlot(test.stack_top(), 31, n));
+          for (uint32_t lane = 0; lane < 4; ++lane) {
+            REQUIRE(xe::load_and_swap<uint32_t>(slot + lane * 4) ==
+                    ctx->v[n].u32[lane]);
+          }
+        }
+        REQUIRE(ctx->r[11] == uint64_t(-16));
+      });
+}
+
+TEST_CASE("SAVE_REST_RESTVMX128", "[save_rest]") {
+  CallTest test;
+  // __restvmx_126, in the v64-v127 bank.
+  auto helper =
+      test.DefineSaveRest(kHelperAddress, Function::kFlagRestVmx, 126);
+  auto caller = test.Define(kCallerAddress, [helper](HIRBuilder& b) {
+    b.Call(helper);
+    b.Return();
+  });
+  for (uint32_t n = 126; n <= 127; ++n) {
+    auto slot = test.TranslateVirtual(VmxSlot(test.stack_top(), 127, n));
+    for (uint32_t lane = 0; lane < 4; ++lane) {
+      xe::store_and_swap<uint32_t>(slot + lane * 4, n * 0x100 + lane);
+    }
+  }
+  test.Run(
+      caller, [](PPCContext* ctx) {},
+      [](PPCContext* ctx) {
+        for (uint32_t n = 126; n <= 127; ++n) {
+          for (uint32_t lane = 0; lane < 4; ++lane) {
+            REQUIRE(ctx->v[n].u32[lane] == n * 0x100 + lane);
+          }
+        }
+        REQUIRE(ctx->r[11] == uint64_t(-16));
+      });
+}
+
+TEST_CASE("LEAF_INLINING_RESULT", "[inlining]") {
+  CallTest test;
+  // r3 = r3 * r4 + 7
+  auto leaf = test.Define(kHelperAddress, [](HIRBuilder& b) {
+    StoreGPR(b, 3,
+             b.Add(b.Mul(LoadGPR(b, 3), LoadGPR(b, 4)),
+                   b.LoadConstantUint64(7)));
+    b.Return();
+  });
+  auto caller = test.Define(kCallerAddress, [leaf](HIRBuilder& b) {
+    b.Call(leaf);
+    StoreGPR(b, 5, b.Add(LoadGPR(b, 3), b.LoadConstantUint64(1)));
+    b.Return();
+  });
+  REQUIRE(test.processor()->inline_registry()->stats().inlined_call_count ==
+          1);
+  test.Run(
+      caller,
+      [](PPCContext* ctx) {
+        ctx->r[3] = 6;
+        ctx->r[4] = 7;
+      },
+      [](PPCContext* ctx) {
+        REQUIRE(ctx->r[3] == 49);
+        REQUIRE(ctx->r[5] == 50);
+      });
+}
@@ -102,3 +102,49 @@ TEST_CASE("PACK_SHORT_2", "[instr]") {
         REQUIRE(result == vec128i(0, 0, 0, 0x80018001));
       });
 }
+
+TEST_CASE("PACK_8_IN_16_UN_UN", "[instr]") {
+  TestFunction test([](HIRBuilder& b) {
+    StoreVR(b, 3,
+            b.Pack(LoadVR(b, 4), LoadVR(b, 5),
+                   PACK_TYPE_8_IN_16 | PACK_TYPE_IN_UNSIGNED |
+                       PACK_TYPE_OUT_UNSIGNED));
+    b.Return();
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->v[4] = vec128s(0x0000, 0x00FF, 0x0100, 0x01FF, 0x7FFF, 0x8000,
+                            0xFFFF, 0x1234);
+        ctx->v[5] = vec128s(0x0001, 0x0080, 0x00FF, 0x0100, 0x8001, 0xABCD,
+                            0x00FE, 0xFF00);
+      },
+      [](PPCContext* ctx) {
+        auto result = ctx->v[3];
+        REQUIRE(result == vec128b(0x00, 0xFF, 0x00, 0xFF, 0xFF, 0x00, 0xFF,
+                                  0x34, 0x01, 0x80, 0xFF, 0x00, 0x01, 0xCD,
+                                  0xFE, 0x00));
+      });
+}
+
+TEST_CASE("PACK_8_IN_16_UN_UN_SAT", "[instr]") {
+  TestFunction test([](HIRBuilder& b) {
+    StoreVR(b, 3,
+            b.Pack(LoadVR(b, 4), LoadVR(b, 5),
+                   PACK_TYPE_8_IN_16 | PACK_TYPE_IN_UNSIGNED |
+                       PACK_TYPE_OUT_UNSIGNED | PACK_TYPE_OUT_SATURATE));
+    b.Return();
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->v[4] = vec128s(0x0000, 0x00FF, 0x0100, 0x01FF, 0x7FFF, 0x8000,
+                            0xFFFF, 0x1234);
+        ctx->v[5] = vec128s(0x0001, 0x0080, 0x00FF, 0x0100, 0x8001, 0xABCD,
+                            0x00FE, 0xFF00);
+      },
+      [](PPCContext* ctx) {
+        auto result = ctx->v[3];
+        REQUIRE(result == vec128b(0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                                  0xFF, 0x01, 0x80, 0xFF, 0xFF, 0xFF, 0xFF,
+                                  0xFE, 0xFF));
+      });
+}
@@ -1,5 +1,6 @@
 #include "xenia/cpu/testing/util.h"
 
+using namespace xe;
 using namespace xe::cpu::hir;
 using namespace xe::cpu;
 using namespace xe::cpu::testing;
@@ -223,3 +224,71 @@ TEST_CASE("SHL_I64", "[instr]") {
         REQUIRE(result == 0x8000000000000000ull);
       });
 }
+
+TEST_CASE("SHL_V128", "[instr]") {
+  TestFunction test([](HIRBuilder& b) {
+    StoreVR(b, 3, b.Shl(LoadVR(b, 4), b.Truncate(LoadGPR(b, 1), INT8_TYPE)));
+    b.Return();
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->r[1] = 0;
+        ctx->v[4] = vec128i(0x12345678, 0x9ABCDEF0, 0x0F0F0F0F, 0x80000001);
+      },
+      [](PPCContext* ctx) {
+        auto result1 = ctx->v[3];
+        REQUIRE(result1 ==
+                vec128i(0x12345678, 0x9ABCDEF0, 0x0F0F0F0F, 0x80000001));
+      });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->r[1] = 1;
+        ctx->v[4] = vec128i(0x00000000, 0x80000000, 0x00000001, 0x80000000);
+      },
+      [](PPCContext* ctx) {
+        auto result1 = ctx->v[3];
+        REQUIRE(result1 ==
+                vec128i(0x00000001, 0x00000000, 0x00000003, 0x00000000));
+      });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->r[1] = 4;
+        ctx->v[4] = vec128i(0x00000000, 0xF0000000, 0x0000000F, 0xABCDEF01);
+      },
+      [](PPCContext* ctx) {
+        auto result1 = ctx->v[3];
+        REQUIRE(result1 ==
+                vec128i(0x0000000F, 0x00000000, 0x000000FA, 0xBCDEF010));
+      });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->r[1] = 7;
+        ctx->v[4] = vec128i(0x01FFFFFF, 0xFE000000, 0x00000000, 0x000000FF);
+      },
+      [](PPCContext* ctx) {
+        auto result1 = ctx->v[3];
+        REQUIRE(result1 ==
+                vec128i(0xFFFFFFFF, 0x00000000, 0x00000000, 0x00007F80));
+      });
+}
+
+TEST_CASE("SHL_V128_CONSTANT", "[instr]") {
+  TestFunction test([](HIRBuilder& b) {
+    StoreVR(b, 3, b.Shl(LoadVR(b, 4), int8_t(1)));
+    StoreVR(b, 4, b.Shl(LoadVR(b, 5), int8_t(7)));
+    b.Return();
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->v[4] = vec128i(0x00000000, 0x80000000, 0x00000001, 0x80000000);
+        ctx->v[5] = vec128i(0x01FFFFFF, 0xFE000000, 0x00000000, 0x000000FF);
+      },
+      [](PPCContext* ctx) {
+        auto result1 = ctx->v[3];
+        REQUIRE(result1 ==
+                vec128i(0x00000001, 0x00000000, 0x00000003, 0x00000000));
+        auto result2 = ctx->v[4];
+        REQUIRE(result2 ==
+                vec128i(0xFFFFFFFF, 0x00000000, 0x00000000, 0x00007F80));
+      });
+}
@@ -270,4 +270,45 @@ TEST_CASE("SHR_V128", "[instr]") {
         REQUIRE(result1 ==
                 vec128i(0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF));
       });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->r[1] = 4;
+        ctx->v[4] = vec128i(0x0000000A, 0x12345678, 0x0000000F, 0x00000000);
+      },
+      [](PPCContext* ctx) {
+        auto result1 = ctx->v[3];
+        REQUIRE(result1 ==
+                vec128i(0x00000000, 0xA1234567, 0x80000000, 0xF0000000));
+      });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->r[1] = 7;
+        ctx->v[4] = vec128i(0x000000FF, 0x00000001, 0x80000000, 0x0000007F);
+      },
+      [](PPCContext* ctx) {
+        auto result1 = ctx->v[3];
+        REQUIRE(result1 ==
+                vec128i(0x00000001, 0xFE000000, 0x03000000, 0x00000000));
+      });
+}
+
+TEST_CASE("SHR_V128_CONSTANT", "[instr]") {
+  TestFunction test([](HIRBuilder& b) {
+    StoreVR(b, 3, b.Shr(LoadVR(b, 4), int8_t(1)));
+    StoreVR(b, 4, b.Shr(LoadVR(b, 5), int8_t(7)));
+    b.Return();
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->v[4] = vec128i(0x00000001, 0x00000000, 0x00000003, 0x80000000);
+        ctx->v[5] = vec128i(0x000000FF, 0x00000001, 0x80000000, 0x0000007F);
+      },
+      [](PPCContext* ctx) {
+        auto result1 = ctx->v[3];
+        REQUIRE(result1 ==
+                vec128i(0x00000000, 0x80000000, 0x00000001, 0xC0000000));
+        auto result2 = ctx->v[4];
+        REQUIRE(result2 ==
+                vec128i(0x00000001, 0xFE000000, 0x03000000, 0x00000000));
+      });
 }
@@ -2,10 +2,15 @@
 #ifndef XENIA_CPU_TESTING_UTIL_H_
 #define XENIA_CPU_TESTING_UTIL_H_
 
+#include <chrono>
+#include <functional>
+#include <memory>
 #include <vector>
 
 #include "xenia/base/platform.h"
 #include "xenia/cpu/backend/x64/x64_backend.h"
+#include "xenia/cpu/compiler/compiler.h"
+#include "xenia/cpu/compiler/compiler_pass.h"
 #include "xenia/cpu/hir/hir_builder.h"
 #include "xenia/cpu/ppc/ppc_context.h"
 #include "xenia/cpu/ppc/ppc_frontend.h"
@@ -83,6 +88,45 @@ class TestFunction {
   std::vector<std::unique_ptr<Processor>> processors;
 };
 
+// Benchmarks are tagged [.benchmark] so they are hidden by default; run them
+// with `xenia-cpu-tests [.benchmark]`. They report their numbers with WARN.
+//
+// Returns the average wall time of one call of run over run_count calls, in
+// nanoseconds.
+inline double MeasureAverageNs(uint32_t run_count,
+                               const std::function<void()>& run) {
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < run_count; ++i) {
+    run();
+  }
+  auto elapsed = std::chrono::duration<double, std::nano>(
+                     std::chrono::steady_clock::now() - start)
+                     .count();
+  return elapsed / run_count;
+}
+
+// Runs the given passes over HIR built by the test, for checking what they
+// did to it rather than how the generated code behaves.
+template <typename... Passes>
+inline bool RunPasses(hir::HIRBuilder& b, std::unique_ptr<Passes>... passes) {
+  compiler::Compiler compiler(nullptr);
+  (compiler.AddPass(std::move(passes)), ...);
+  return compiler.Compile(&b);
+}
+
+// Number of instructions with the given opcode left in the function.
+inline size_t CountInstrs(hir::HIRBuilder& b, const hir::OpcodeInfo& opcode) {
+  size_t count = 0;
+  for (auto block = b.first_block(); block; block = block->next) {
+    for (auto i = block->instr_head; i; i = i->next) {
+      if (i->opcode == &opcode) {
+        ++count;
+      }
+    }
+  }
+  return count;
+}
+
 inline hir::Value* LoadGPR(hir::HIRBuilder& b, int reg) {
   return b.LoadContext(offsetof(PPCContext, r) + reg * 8, hir::INT64_TYPE);
 }
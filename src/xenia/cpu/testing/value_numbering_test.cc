@@ -0,0 +1,53 @@
+#include "xenia/cpu/compiler/compiler_passes.h"
+#include "xenia/cpu/testing/util.h"
+
+using namespace xe;
+using namespace xe::cpu;
+using namespace xe::cpu::hir;
+using namespace xe::cpu::testing;
+using xe::cpu::compiler::passes::ValueNumberingPass;
+using xe::cpu::ppc::PPCContext;
+
+// Loads a word at base + 0, stores r4 at base + store_offset and loads the
+// word at base + 0 again into r6.
+static void GenerateLoadStoreLoad(HIRBuilder& b, uint64_t store_offset) {
+  auto base = LoadGPR(b, 3);
+  StoreGPR(b, 5, b.ZeroExtend(b.Load(base, INT32_TYPE), INT64_TYPE));
+  b.Store(b.Add(base, b.LoadConstantUint64(store_offset)),
+          b.Truncate(LoadGPR(b, 4), INT32_TYPE));
+  StoreGPR(b, 6, b.ZeroExtend(b.Load(base, INT32_TYPE), INT64_TYPE));
+  b.Return();
+}
+
+TEST_CASE("VALUE_NUMBERING_LOAD_AFTER_ALIASING_STORE", "[value_numbering]") {
+  HIRBuilder b;
+  // Overlaps the upper half of the loaded word.
+  GenerateLoadStoreLoad(b, 2);
+  REQUIRE(RunPasses(b, std::make_unique<ValueNumberingPass>()));
+  REQUIRE(CountInstrs(b, OPCODE_LOAD_info) == 2);
+}
+
+TEST_CASE("VALUE_NUMBERING_LOAD_AFTER_DISJOINT_STORE", "[value_numbering]") {
+  HIRBuilder b;
+  GenerateLoadStoreLoad(b, 4);
+  REQUIRE(RunPasses(b, std::make_unique<ValueNumberingPass>()));
+  REQUIRE(CountInstrs(b, OPCODE_LOAD_info) == 1);
+}
+
+TEST_CASE("VALUE_NUMBERING_LOAD_AFTER_STORE_RESULT", "[value_numbering]") {
+  // Same through the whole pipeline: the second load sees the store.
+  TestFunction test([](HIRBuilder& b) { GenerateLoadStoreLoad(b, 0); });
+  uint32_t address = test.memory->SystemHeapAlloc(16);
+  REQUIRE(address);
+  xe::store_and_swap<uint32_t>(test.memory->TranslateVirtual(address),
+                               0x11223344);
+  test.Run(
+      [address](PPCContext* ctx) {
+        ctx->r[3] = address;
+        ctx->r[4] = 0xAABBCCDD;
+      },
+      [](PPCContext* ctx) {
+        REQUIRE(ctx->r[5] == 0x44332211);
+        REQUIRE(ctx->r[6] == 0xAABBCCDD);
+      });
+}
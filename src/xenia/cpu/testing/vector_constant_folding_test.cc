@@ -0,0 +1,246 @@
+#include "xenia/cpu/testing/util.h"
+
+#include <functional>
+
+using namespace xe;
+using namespace xe::cpu;
+using namespace xe::cpu::hir;
+using namespace xe::cpu::testing;
+using xe::cpu::ppc::PPCContext;
+
+namespace {
+
+// Loads operand n (0-2) as the given type.
+using OperandLoader = std::function<Value*(int n, TypeName type)>;
+
+struct FoldingCase {
+  const char* name;
+  std::function<Value*(HIRBuilder& b, const OperandLoader& load)> emit;
+  vec128_t operands[3];
+};
+
+// Every case is compiled twice: once with its operands as constants, which
+// ConstantPropagationPass folds away, and once with them loaded from the
+// context, which leaves the op to the backend. Both have to agree.
+vec128_t RunCase(const FoldingCase& c, bool constant) {
+  vec128_t result = vec128i(0);
+  TestFunction test([&c, constant](HIRBuilder& b) {
+    OperandLoader load = [&b, &c, constant](int n, TypeName type) {
+      const vec128_t& operand = c.operands[n];
+      if (type == VEC128_TYPE) {
+        return constant ? b.LoadConstantVec128(operand) : LoadVR(b, 4 + n);
+      }
+      if (!constant) {
+        return b.Truncate(LoadGPR(b, 4 + n), type);
+      }
+      switch (type) {
+        case INT8_TYPE:
+          return b.LoadConstantUint8(operand.u8[0]);
+        case INT16_TYPE:
+          return b.LoadConstantUint16(operand.u16[0]);
+        default:
+          return b.LoadConstantUint32(operand.u32[0]);
+      }
+    };
+    StoreVR(b, 3, c.emit(b, load));
+    b.Return();
+  });
+  test.Run(
+      [&c](PPCContext* ctx) {
+        for (int n = 0; n < 3; ++n) {
+          ctx->v[4 + n] = c.operands[n];
+          ctx->r[4 + n] = c.operands[n].u32[0];
+        }
+      },
+      [&result](PPCContext* ctx) { result = ctx->v[3]; });
+  return result;
+}
+
+const FoldingCase kFoldingCases[] = {
+    {"LOAD_VECTOR_SHL",
+     [](HIRBuilder& b, const OperandLoader& load) {
+       return b.LoadVectorShl(load(0, INT8_TYPE));
+     },
+     {vec128i(0x13)}},
+    {"LOAD_VECTOR_SHR",
+     [](HIRBuilder& b, const OperandLoader& load) {
+       return b.LoadVectorShr(load(0, INT8_TYPE));
+     },
+     {vec128i(0x07)}},
+    {"PERMUTE_I8",
+     [](HIRBuilder& b, const OperandLoader& load) {
+       return b.Permute(load(0, VEC128_TYPE), load(1, VEC128_TYPE),
+                        load(2, VEC128_TYPE), INT8_TYPE);
+     },
+     {vec128b(0x1F, 0x00, 0x10, 0x0F, 0x23, 0xE1, 0x07, 0x18, 0x05, 0x14,
+              0x0A, 0x1B, 0x3C, 0x02, 0x11, 0x09),
+      vec128b(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15),
+      vec128b(16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30,
+              31)}},
+    {"PERMUTE_I32",
+     [](HIRBuilder& b, const OperandLoader& load) {
+       // The backend only takes constant word controls.
+       return b.Permute(
+           b.LoadConstantUint32(MakePermuteMask(1, 3, 0, 0, 1, 1, 0, 2)),
+           load(0, VEC128_TYPE), load(1, VEC128_TYPE), INT32_TYPE);
+     },
+     {vec128i(0x10, 0x11, 0x12, 0x13), vec128i(0x20, 0x21, 0x22, 0x23)}},
+    {"SWIZZLE",
+     [](HIRBuilder& b, const OperandLoader& load) {
+       return b.Swizzle(load(0, VEC128_TYPE), INT32_TYPE,
+                        MakeSwizzleMask(3, 0, 2, 2));
+     },
+     {vec128i(0x10, 0x11, 0x12, 0x13)}},
+    {"INSERT_I16",
+     [](HIRBuilder& b, const OperandLoader& load) {
+       return b.Insert(load(0, VEC128_TYPE), uint64_t(5),
+                       load(1, INT16_TYPE));
+     },
+     {vec128s(0, 1, 2, 3, 4, 5, 6, 7), vec128i(0xBEEF)}},
+    {"INSERT_I8",
+     [](HIRBuilder& b, const OperandLoader& load) {
+       return b.Insert(load(0, VEC128_TYPE), uint64_t(14),
+                       load(1, INT8_TYPE));
+     },
+     {vec128b(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15),
+      vec128i(0xA5)}},
+    {"EXTRACT_SPLAT_I32",
+     [](HIRBuilder& b, const OperandLoader& load) {
+       auto splat = b.Splat(load(0, INT32_TYPE), VEC128_TYPE);
+       return b.Splat(b.Extract(splat, uint8_t(2), INT32_TYPE), VEC128_TYPE);
+     },
+     {vec128i(0x12345678)}},
+    {"EXTRACT_SPLAT_I16_AS_I8",
+     [](HIRBuilder& b, const OperandLoader& load) {
+       auto splat = b.Splat(load(0, INT16_TYPE), VEC128_TYPE);
+       return b.Splat(b.Extract(splat, uint8_t(3), INT8_TYPE), VEC128_TYPE);
+     },
+     {vec128i(0xA1B2)}},
+    {"VECTOR_MAX_I8_UNSIGNED",
+     [](HIRBuilder& b, const OperandLoader& load) {
+       return b.VectorMax(load(0, VEC128_TYPE), load(1, VEC128_TYPE),
+                          INT8_TYPE, ARITHMETIC_UNSIGNED);
+     },
+     {vec128b(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15),
+      vec128b(-100, 1, 100, -3, 4, -5, 60, 7, -80, 9, 10, -128, 127, 13, 2,
+              0)}},
+    {"VECTOR_MIN_I16_SIGNED",
+     [](HIRBuilder& b, const OperandLoader& load) {
+       return b.VectorMin(load(0, VEC128_TYPE), load(1, VEC128_TYPE),
+                          INT16_TYPE);
+     },
+     {vec128s(0, 1, 2, 3, 4, 5, -6000, 7),
+      vec128s(-1000, 1, -2000, 3, 4, 32767, 6, 0)}},
+    {"VECTOR_MIN_I32_UNSIGNED",
+     [](HIRBuilder& b, const OperandLoader& load) {
+       return b.VectorMin(load(0, VEC128_TYPE), load(1, VEC128_TYPE),
+                          INT32_TYPE, ARITHMETIC_UNSIGNED);
+     },
+     {vec128i(0, 0xFFFFFFFF, 7, 0x80000000), vec128i(1, 2, 0xFFFFFFF0, 3)}},
+    {"VECTOR_SUB_I8_UNSIGNED_SATURATE",
+     [](HIRBuilder& b, const OperandLoader& load) {
+       return b.VectorSub(load(0, VEC128_TYPE), load(1, VEC128_TYPE),
+                          INT8_TYPE,
+                          ARITHMETIC_UNSIGNED | ARITHMETIC_SATURATE);
+     },
+     {vec128b(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15),
+      vec128b(1, 1, 1, 1, 9, 9, 9, 9, 0, 0, 0, 0, 200, 200, 200, 200)}},
+    {"VECTOR_SUB_I16_SIGNED_SATURATE",
+     [](HIRBuilder& b, const OperandLoader& load) {
+       return b.VectorSub(load(0, VEC128_TYPE), load(1, VEC128_TYPE),
+                          INT16_TYPE, ARITHMETIC_SATURATE);
+     },
+     {vec128s(-32768, 32767, 0, 100, -100, 5, 6, 7),
+      vec128s(1, -1, -32768, 200, 32767, 5, -6, 0)}},
+    {"VECTOR_SHA_I16",
+     [](HIRBuilder& b, const OperandLoader& load) {
+       return b.VectorSha(load(0, VEC128_TYPE), load(1, VEC128_TYPE),
+                          INT16_TYPE);
+     },
+     {vec128s(0x7FFE, 0x8000, 0xFFFF, 0x1234, 0x8001, 1, 2, 3),
+      vec128s(0, 1, 15, 16, 17, 3, 31, 4)}},
+    {"VECTOR_SHA_I32",
+     [](HIRBuilder& b, const OperandLoader& load) {
+       return b.VectorSha(load(0, VEC128_TYPE), load(1, VEC128_TYPE),
+                          INT32_TYPE);
+     },
+     {vec128i(0x80000000, 0x7FFFFFFF, 0xF0000000, 1),
+      vec128i(31, 4, 33, 0)}},
+    {"PACK_D3DCOLOR",
+     [](HIRBuilder& b, const OperandLoader& load) {
+       return b.Pack(load(0, VEC128_TYPE), PACK_TYPE_D3DCOLOR);
+     },
+     {vec128i(0x40400012, 0x40400034, 0x3F800000, 0x40410000)}},
+    {"PACK_FLOAT16_4",
+     [](HIRBuilder& b, const OperandLoader& load) {
+       return b.Pack(load(0, VEC128_TYPE), PACK_TYPE_FLOAT16_4);
+     },
+     {vec128f(1.5f, -2.25f, 65504.0f, 0.001f)}},
+    {"PACK_SHORT_4",
+     [](HIRBuilder& b, const OperandLoader& load) {
+       return b.Pack(load(0, VEC128_TYPE), PACK_TYPE_SHORT_4);
+     },
+     {vec128i(0x40400000, 0x403F8001, 0x40407FFF, 0x40500000)}},
+    {"PACK_UINT_2101010",
+     [](HIRBuilder& b, const OperandLoader& load) {
+       return b.Pack(load(0, VEC128_TYPE), PACK_TYPE_UINT_2101010);
+     },
+     {vec128i(0x40400123, 0x404001FF, 0x403FFE01, 0x3F800002)}},
+    {"PACK_8_IN_16_SIGNED_TO_UNSIGNED_SATURATE",
+     [](HIRBuilder& b, const OperandLoader& load) {
+       return b.Pack(load(0, VEC128_TYPE), load(1, VEC128_TYPE),
+                     PACK_TYPE_8_IN_16 | PACK_TYPE_IN_SIGNED |
+                         PACK_TYPE_OUT_UNSIGNED | PACK_TYPE_OUT_SATURATE);
+     },
+     {vec128s(-1, 0, 1, 255, 256, 0x7FFF, -0x8000, 128),
+      vec128s(7, 6, 5, 4, 3, 2, 1, 0)}},
+    {"PACK_16_IN_32_SIGNED_SATURATE",
+     [](HIRBuilder& b, const OperandLoader& load) {
+       return b.Pack(load(0, VEC128_TYPE), load(1, VEC128_TYPE),
+                     PACK_TYPE_16_IN_32 | PACK_TYPE_IN_SIGNED |
+                         PACK_TYPE_OUT_SIGNED | PACK_TYPE_OUT_SATURATE);
+     },
+     {vec128i(0x7FFFFFFF, 0x80000000, 0x00008000, 0xFFFF7FFF),
+      vec128i(1, 0xFFFFFFFF, 0x7FFF, 0xFFFF8000)}},
+    {"UNPACK_D3DCOLOR",
+     [](HIRBuilder& b, const OperandLoader& load) {
+       return b.Unpack(load(0, VEC128_TYPE), PACK_TYPE_D3DCOLOR);
+     },
+     {vec128i(0, 0, 0, 0x80FF0120)}},
+    {"UNPACK_FLOAT16_4",
+     [](HIRBuilder& b, const OperandLoader& load) {
+       return b.Unpack(load(0, VEC128_TYPE), PACK_TYPE_FLOAT16_4);
+     },
+     {vec128i(0, 0, 0x3E00C080, 0x7BFF1400)}},
+    {"UNPACK_SHORT_2",
+     [](HIRBuilder& b, const OperandLoader& load) {
+       return b.Unpack(load(0, VEC128_TYPE), PACK_TYPE_SHORT_2);
+     },
+     {vec128i(0, 0, 0, 0x80017FFF)}},
+    {"UNPACK_UINT_2101010",
+     [](HIRBuilder& b, const OperandLoader& load) {
+       return b.Unpack(load(0, VEC128_TYPE), PACK_TYPE_UINT_2101010);
+     },
+     {vec128i(0, 0, 0, 0xC0080201)}},
+    {"UNPACK_8_IN_16_LO",
+     [](HIRBuilder& b, const OperandLoader& load) {
+       return b.Unpack(load(0, VEC128_TYPE),
+                       PACK_TYPE_8_IN_16 | PACK_TYPE_TO_LO);
+     },
+     {vec128b(0, 1, 2, 3, 4, 5, 6, 7, -8, 9, -10, 11, 12, -13, 127, -128)}},
+    {"UNPACK_16_IN_32_HI",
+     [](HIRBuilder& b, const OperandLoader& load) {
+       return b.Unpack(load(0, VEC128_TYPE),
+                       PACK_TYPE_16_IN_32 | PACK_TYPE_TO_HI);
+     },
+     {vec128s(-1, 2, -32768, 32767, 4, 5, 6, 7)}},
+};
+
+}  // namespace
+
+TEST_CASE("VECTOR_CONSTANT_FOLDING", "[instr]") {
+  for (const auto& c : kFoldingCases) {
+    INFO(c.name);
+    REQUIRE(RunCase(c, true) == RunCase(c, false));
+  }
+}
@@ -110,6 +110,67 @@ TEST_CASE("VECTOR_SHA_I16_CONSTANT", "[instr]") {
       });
 }
 
+TEST_CASE("VECTOR_SHA_I8_MIXED", "[instr]") {
+  TestFunction test([](HIRBuilder& b) {
+    StoreVR(b, 3, b.VectorSha(LoadVR(b, 4), LoadVR(b, 5), INT8_TYPE));
+    b.Return();
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->v[4] = vec128b(0x81, 0x12, 0xFF, 0x7F, 0x01, 0xAB, 0x80, 0xC3,
+                            0x5A, 0xF0, 0x0F, 0x96, 0x80, 0x01, 0xFE, 0x69);
+        ctx->v[5] = vec128b(0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+                            0x08, 0x09, 0x13, 0x2A, 0x87, 0xFF, 0x44, 0xF9);
+      },
+      [](PPCContext* ctx) {
+        auto result = ctx->v[3];
+        REQUIRE(result == vec128b(0x81, 0x09, 0xFF, 0x0F, 0x00, 0xFD, 0xFE,
+                                  0xFF, 0x5A, 0xF8, 0x01, 0xE5, 0xFF, 0x00,
+                                  0xFF, 0x34));
+      });
+}
+
+TEST_CASE("VECTOR_SHA_I16_MIXED", "[instr]") {
+  TestFunction test([](HIRBuilder& b) {
+    StoreVR(b, 3, b.VectorSha(LoadVR(b, 4), LoadVR(b, 5), INT16_TYPE));
+    b.Return();
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->v[4] = vec128s(0x8001, 0x1234, 0xFFFF, 0x7FFF, 0x0001, 0xABCD,
+                            0x00FF, 0x8000);
+        ctx->v[5] = vec128s(0x0000, 0x0001, 0x000F, 0x0010, 0x0011, 0x00F3,
+                            0xFFF8, 0x001F);
+      },
+      [](PPCContext* ctx) {
+        auto result = ctx->v[3];
+        REQUIRE(result == vec128s(0x8001, 0x091A, 0xFFFF, 0x7FFF, 0x0000,
+                                  0xF579, 0x0000, 0xFFFF));
+      });
+}
+
+TEST_CASE("VECTOR_SHA_I16_MIXED_CONSTANT", "[instr]") {
+  TestFunction test([](HIRBuilder& b) {
+    StoreVR(b, 3,
+            b.VectorSha(LoadVR(b, 4),
+                        b.LoadConstantVec128(vec128s(0x0000, 0x0001, 0x000F,
+                                                     0x0010, 0x0011, 0x00F3,
+                                                     0xFFF8, 0x001F)),
+                        INT16_TYPE));
+    b.Return();
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->v[4] = vec128s(0x8001, 0x1234, 0xFFFF, 0x7FFF, 0x0001, 0xABCD,
+                            0x00FF, 0x8000);
+      },
+      [](PPCContext* ctx) {
+        auto result = ctx->v[3];
+        REQUIRE(result == vec128s(0x8001, 0x091A, 0xFFFF, 0x7FFF, 0x0000,
+                                  0xF579, 0x0000, 0xFFFF));
+      });
+}
+
 TEST_CASE("VECTOR_SHA_I32", "[instr]") {
   TestFunction test([](HIRBuilder& b) {
     StoreVR(b, 3, b.VectorSha(LoadVR(b, 4), LoadVR(b, 5), INT32_TYPE));
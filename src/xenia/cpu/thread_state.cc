@@ -27,7 +27,7 @@ ThreadState::ThreadState(Processor* processor, uint32_t thread_id,
     uint32_t system_thread_handle = xe::threading::current_thread_system_id();
     thread_id_ = 0x80000000 | system_thread_handle;
   }
-  backend_data_ = processor->backend()->AllocThreadData();
+  backend_data_ = processor->backend()->AllocThreadData(thread_id_);
 
   // Allocate with 64b alignment.
   context_ = memory::AlignedAlloc<ppc::PPCContext>(64);
@@ -2,6 +2,7 @@
 #ifndef XENIA_CPU_THREAD_STATE_H_
 #define XENIA_CPU_THREAD_STATE_H_
 
+#include <cstddef>
 #include <string>
 
 #include "xenia/cpu/ppc/ppc_context.h"
@@ -25,6 +26,12 @@ class ThreadState {
   ppc::PPCContext* context() const { return context_; }
   uint32_t thread_id() const { return thread_id_; }
 
+  // Where backend_data() is in a ThreadState, for generated code loading it
+  // through PPCContext::thread_state.
+  static size_t backend_data_offset() {
+    return offsetof(ThreadState, backend_data_);
+  }
+
   static void Bind(ThreadState* thread_state);
   static ThreadState* Get();
   static uint32_t GetThreadID();
@@ -4,6 +4,7 @@
 #include <algorithm>
 
 #include "third_party/fmt/include/fmt/format.h"
+#include "third_party/xxhash/xxhash.h"
 
 #include "xenia/base/byte_order.h"
 #include "xenia/base/logging.h"
@@ -58,6 +59,10 @@ XexModule::XexModule(Processor* processor, KernelState* kernel_state)
 
 XexModule::~XexModule() {}
 
+uint64_t XexModule::hash() const {
+  return XXH3_64bits(xex_header_mem_.data(), xex_header_mem_.size());
+}
+
 bool XexModule::GetOptHeader(const xex2_header* header, xex2_header_keys key,
                              void** out_ptr) {
   assert_not_null(header);
@@ -189,6 +194,43 @@ uint32_t XexModule::GetProcAddress(const std::string_view name) const {
   return 0;
 }
 
+std::vector<uint32_t> XexModule::GetExportedFunctions() const {
+  std::vector<uint32_t> addresses;
+  if (xex_security_info()->export_table) {
+    auto export_table = memory()->TranslateVirtual<const xex2_export_table*>(
+        xex_security_info()->export_table);
+    for (uint32_t i = 0; i < export_table->count; ++i) {
+      uint32_t ordinal_offset = export_table->ordOffset[i];
+      if (ordinal_offset) {
+        addresses.push_back(ordinal_offset +
+                            (export_table->imagebaseaddr << 16));
+      }
+    }
+  } else {
+    xex2_opt_data_directory* pe_export_directory = 0;
+    if (GetOptHeader(XEX_HEADER_EXPORTS_BY_NAME, &pe_export_directory)) {
+      auto e = memory()->TranslateVirtual<const X_IMAGE_EXPORT_DIRECTORY*>(
+          base_address_ + pe_export_directory->offset);
+      uint32_t* function_table =
+          reinterpret_cast<uint32_t*>(uintptr_t(e) + e->AddressOfFunctions);
+      for (uint32_t i = 0; i < e->NumberOfFunctions; ++i) {
+        if (function_table[i]) {
+          addresses.push_back(base_address_ + function_table[i]);
+        }
+      }
+    }
+  }
+
+  // Exported variables live in the data sections.
+  addresses.erase(std::remove_if(addresses.begin(), addresses.end(),
+                                 [this](uint32_t address) {
+                                   return address < low_address_ ||
+                                          address >= high_address_;
+                                 }),
+                  addresses.end());
+  return addresses;
+}
+
 int XexModule::ApplyPatch(XexModule* module) {
   if (!is_patch()) {
     // This isn't a XEX2 patch.
@@ -423,6 +465,11 @@ int XexModule::ApplyPatch(XexModule* module) {
     cur_block = next_block;
   }
 
+  // Code translated from the old image is stale now, even if the patch
+  // failed halfway.
+  processor_->InvalidateCodeRange(
+      module->base_address_, std::max(original_image_size, new_image_size));
+
   if (!result_code) {
     // Decommit unused pages if new image size is smaller than original
     if (original_image_size > new_image_size) {
@@ -1074,6 +1121,15 @@ bool XexModule::LoadContinue() {
     page += desc.page_count;
   }
 
+  // Loads from sections without write access can be folded into the code
+  // reading them.
+  for (const auto& section : pe_sections_) {
+    if ((section.flags & kXEPESectionMemoryRead) &&
+        !(section.flags & kXEPESectionMemoryWrite)) {
+      processor_->read_only_data()->AddRange(section.address, section.size);
+    }
+  }
+
   return true;
 }
 
@@ -1087,6 +1143,9 @@ bool XexModule::Unload() {
   if (!is_patch()) {
     assert_not_zero(base_address_);
 
+    // The range may get reused for another module.
+    processor_->read_only_data()->RemoveRange(base_address_, image_size());
+    processor_->InvalidateCodeRange(base_address_, image_size());
     memory()->LookupHeap(base_address_)->Release(base_address_);
   }
 
@@ -1499,7 +1558,7 @@ bool XexModule::FindSaveRest() {
       function->set_end_address(address + (31 - n) * 4 + 2 * 4);
       function->set_name(std::string_view(name, format_result.size));
       // TODO(benvanik): set type  fn->type = FunctionSymbol::User;
-      // TODO(benvanik): set flags fn->flags |= FunctionSymbol::kFlagSaveGprLr;
+      function->set_save_rest(Function::kFlagSaveGprLr, n);
       function->set_behavior(Function::Behavior::kProlog);
       function->set_status(Symbol::Status::kDeclared);
       address += 4;
@@ -1513,7 +1572,7 @@ bool XexModule::FindSaveRest() {
       function->set_end_address(address + (31 - n) * 4 + 3 * 4);
       function->set_name(std::string_view(name, format_result.size));
       // TODO(benvanik): set type  fn->type = FunctionSymbol::User;
-      // TODO(benvanik): set flags fn->flags |= FunctionSymbol::kFlagRestGprLr;
+      function->set_save_rest(Function::kFlagRestGprLr, n);
       function->set_behavior(Function::Behavior::kEpilogReturn);
       function->set_status(Symbol::Status::kDeclared);
       address += 4;
@@ -1529,7 +1588,7 @@ bool XexModule::FindSaveRest() {
       function->set_end_address(address + (31 - n) * 4 + 1 * 4);
       function->set_name(std::string_view(name, format_result.size));
       // TODO(benvanik): set type  fn->type = FunctionSymbol::User;
-      // TODO(benvanik): set flags fn->flags |= FunctionSymbol::kFlagSaveFpr;
+      function->set_save_rest(Function::kFlagSaveFpr, n);
       function->set_behavior(Function::Behavior::kProlog);
       function->set_status(Symbol::Status::kDeclared);
       address += 4;
@@ -1543,7 +1602,7 @@ bool XexModule::FindSaveRest() {
       function->set_end_address(address + (31 - n) * 4 + 1 * 4);
       function->set_name(std::string_view(name, format_result.size));
       // TODO(benvanik): set type  fn->type = FunctionSymbol::User;
-      // TODO(benvanik): set flags fn->flags |= FunctionSymbol::kFlagRestFpr;
+      function->set_save_rest(Function::kFlagRestFpr, n);
       function->set_behavior(Function::Behavior::kEpilog);
       function->set_status(Symbol::Status::kDeclared);
       address += 4;
@@ -1563,7 +1622,7 @@ bool XexModule::FindSaveRest() {
       DeclareFunction(address, &function);
       function->set_name(std::string_view(name, format_result.size));
       // TODO(benvanik): set type  fn->type = FunctionSymbol::User;
-      // TODO(benvanik): set flags fn->flags |= FunctionSymbol::kFlagSaveVmx;
+      function->set_save_rest(Function::kFlagSaveVmx, n);
       function->set_behavior(Function::Behavior::kProlog);
       function->set_status(Symbol::Status::kDeclared);
       address += 2 * 4;
@@ -1576,7 +1635,7 @@ bool XexModule::FindSaveRest() {
       DeclareFunction(address, &function);
       function->set_name(std::string_view(name, format_result.size));
       // TODO(benvanik): set type  fn->type = FunctionSymbol::User;
-      // TODO(benvanik): set flags fn->flags |= FunctionSymbol::kFlagSaveVmx;
+      function->set_save_rest(Function::kFlagSaveVmx, n);
       function->set_behavior(Function::Behavior::kProlog);
       function->set_status(Symbol::Status::kDeclared);
       address += 2 * 4;
@@ -1589,7 +1648,7 @@ bool XexModule::FindSaveRest() {
       DeclareFunction(address, &function);
       function->set_name(std::string_view(name, format_result.size));
       // TODO(benvanik): set type  fn->type = FunctionSymbol::User;
-      // TODO(benvanik): set flags fn->flags |= FunctionSymbol::kFlagRestVmx;
+      function->set_save_rest(Function::kFlagRestVmx, n);
       function->set_behavior(Function::Behavior::kEpilog);
       function->set_status(Symbol::Status::kDeclared);
       address += 2 * 4;
@@ -1602,7 +1661,7 @@ bool XexModule::FindSaveRest() {
       DeclareFunction(address, &function);
       function->set_name(std::string_view(name, format_result.size));
       // TODO(benvanik): set type  fn->type = FunctionSymbol::User;
-      // TODO(benvanik): set flags fn->flags |= FunctionSymbol::kFlagRestVmx;
+      function->set_save_rest(Function::kFlagRestVmx, n);
       function->set_behavior(Function::Behavior::kEpilog);
       function->set_status(Symbol::Status::kDeclared);
       address += 2 * 4;
@@ -61,6 +61,8 @@ class XexModule : public xe::cpu::Module {
   const xex2_header* xex_header() const {
     return reinterpret_cast<const xex2_header*>(xex_header_mem_.data());
   }
+  // Hash of the raw XEX headers, identifying this exact build of the title.
+  uint64_t hash() const;
   const SecurityInfoContext* xex_security_info() const {
     return &security_info_;
   }
@@ -103,6 +105,10 @@ class XexModule : public xe::cpu::Module {
   }
 
   const uint32_t base_address() const { return base_address_; }
+  // Bounds of the code sections, as committed to the backend.
+  uint32_t low_address() const { return low_address_; }
+  uint32_t high_address() const { return high_address_; }
+  const std::vector<PESection>& pe_sections() const { return pe_sections_; }
   const bool is_dev_kit() const { return is_dev_kit_; }
 
   // Gets an optional header. Returns NULL if not found.
@@ -132,6 +138,8 @@ class XexModule : public xe::cpu::Module {
 
   uint32_t GetProcAddress(uint16_t ordinal) const;
   uint32_t GetProcAddress(const std::string_view name) const;
+  // Addresses of all exports that fall within the code sections.
+  std::vector<uint32_t> GetExportedFunctions() const;
 
   int ApplyPatch(XexModule* module);
   bool Load(const std::string_view name, const std::string_view path,
@@ -758,6 +758,11 @@ X_STATUS Emulator::CompleteLaunch(const std::filesystem::path& path,
     return X_STATUS_NOT_FOUND;
   }
 
+  if (cvars::jit_persistent_cache) {
+    processor_->backend()->OpenPersistentCache(
+        cache_root_ / "jit", module->xex_module()->hash());
+  }
+
   // Grab the current title ID.
   xex2_opt_execution_info* info = nullptr;
   module->GetOptHeader(XEX_HEADER_EXECUTION_INFO, &info);
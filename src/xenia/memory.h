@@ -2,6 +2,7 @@
 #define XENIA_MEMORY_H_
 
 #include <cstdint>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <string>
@@ -89,6 +90,38 @@ union PageEntry {
   };
 };
 
+// The free runs of pages in a heap, so allocations can be placed without
+// walking the page table. Runs are kept in page order for coalescing, and
+// again per power of two size class so a search only looks at runs that may
+// be big enough.
+class FreeExtentIndex {
+ public:
+  // Makes pages [0, page_count) one free run.
+  void Reset(uint32_t page_count);
+
+  // Marks pages free or allocated. The range may overlap runs already in
+  // that state.
+  void Free(uint32_t start_page, uint32_t page_count);
+  void Take(uint32_t start_page, uint32_t page_count);
+
+  // Finds page_count free pages starting at a multiple of page_stride, at or
+  // after low_page and ending at or before limit_page (exclusive). Bottom-up
+  // this is the lowest such start, top-down the highest.
+  bool Find(uint32_t low_page, uint32_t limit_page, uint32_t page_count,
+            uint32_t page_stride, bool top_down,
+            uint32_t* out_start_page) const;
+
+ private:
+  static uint32_t GetSizeClass(uint32_t page_count);
+  void Insert(uint32_t start_page, uint32_t page_count);
+  std::map<uint32_t, uint32_t>::iterator Erase(
+      std::map<uint32_t, uint32_t>::iterator it);
+
+  // Start page to page count.
+  std::map<uint32_t, uint32_t> runs_;
+  std::map<uint32_t, uint32_t> size_classes_[32];
+};
+
 // Heap abstraction for page-based allocation.
 class BaseHeap {
  public:
@@ -199,6 +232,8 @@ class BaseHeap {
   uint32_t host_address_offset_;
   xe::global_critical_region global_critical_region_;
   std::vector<PageEntry> page_table_;
+  // Pages with no state in page_table_.
+  FreeExtentIndex free_extents_;
 };
 
 // Normal heap allowing allocations from guest virtual address ranges.
@@ -362,6 +397,11 @@ class Memory {
   // Gets the defined MMIO range for the given virtual address, if any.
   cpu::MMIORange* LookupVirtualMappedRange(uint32_t virtual_address);
 
+  // Sets the function told about the host code behind each MMIO access that
+  // had to be serviced by the fault handler.
+  void SetMMIOAccessSiteCallback(cpu::MMIOHandler::AccessSiteCallback callback,
+                                 void* context);
+
   // Physical memory access callbacks, two types of them.
   //
   // This is simple per-system-page protection without reference counting or
@@ -423,6 +463,16 @@ class Memory {
   // RegisterPhysicalMemoryInvalidationCallback.
   void UnregisterPhysicalMemoryInvalidationCallback(void* callback_handle);
 
+  // Called after BaseHeap::Protect gives guest pages write access, with the
+  // range of the request. Anything relying on them being read-only, like
+  // code folding loads from them, has to be thrown away.
+  typedef void (*WriteAccessCallback)(void* context_ptr, uint32_t address,
+                                      uint32_t length);
+  // Returns a handle for unregistering.
+  void* RegisterWriteAccessCallback(WriteAccessCallback callback,
+                                    void* callback_context);
+  void UnregisterWriteAccessCallback(void* callback_handle);
+
   // Enables physical memory access callbacks for the specified memory range,
   // snapped to system page boundaries.
   void EnablePhysicalMemoryAccessCallbacks(
@@ -527,6 +577,7 @@ class Memory {
   xe::global_critical_region global_critical_region_;
   std::vector<std::pair<PhysicalMemoryInvalidationCallback, void*>*>
       physical_memory_invalidation_callbacks_;
+  std::vector<std::pair<WriteAccessCallback, void*>*> write_access_callbacks_;
 };
 
 }  // namespace xe
@@ -0,0 +1,161 @@
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <string>
+#include <vector>
+
+#include "xenia/base/console_app_main.h"
+#include "xenia/base/cvar.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/threading.h"
+#include "xenia/cpu/cpu_flags.h"
+#include "xenia/cpu/processor.h"
+#include "xenia/cpu/xex_module.h"
+#include "xenia/emulator.h"
+#include "xenia/gpu/null/null_graphics_system.h"
+#include "xenia/kernel/kernel_state.h"
+#include "xenia/kernel/user_module.h"
+#include "xenia/vfs/devices/host_path_device.h"
+#include "xenia/vfs/virtual_file_system.h"
+
+namespace xe {
+namespace tools {
+
+DEFINE_transient_path(target, "", "XEX file to precompile.", "General");
+DEFINE_transient_path(aot_cache_root, "",
+                      "Cache root to write the precompiled code to (the "
+                      "emulator reads it from <cache_root>/jit).",
+                      "General");
+
+// Instruction words that commonly sit right before a function start.
+static bool IsFunctionBoundary(const xe::be<uint32_t>* code) {
+  uint32_t previous = code[-1];
+  uint32_t first = code[0];
+  return previous == 0x4E800020 ||                 // blr
+         previous == 0x00000000 ||                 // padding
+         (previous & 0xFC000003) == 0x48000000 ||  // b
+         first == 0x7D8802A6;                      // mflr r12
+}
+
+// Words in the data sections that point at plausible function starts: vtables,
+// callback tables and other function pointers only ever reached indirectly.
+static std::vector<uint32_t> FindIndirectCallCandidates(
+    Memory* memory, const cpu::XexModule* module) {
+  std::vector<uint32_t> candidates;
+  uint32_t low_address = module->low_address();
+  uint32_t high_address = module->high_address();
+  for (const auto& section : module->pe_sections()) {
+    if (section.address >= low_address && section.address < high_address) {
+      continue;
+    }
+    auto words = memory->TranslateVirtual<const xe::be<uint32_t>*>(
+        section.address);
+    for (uint32_t i = 0; i < section.size / 4; ++i) {
+      uint32_t value = words[i];
+      if (value <= low_address || value >= high_address || (value & 3)) {
+        continue;
+      }
+      if (IsFunctionBoundary(
+              memory->TranslateVirtual<const xe::be<uint32_t>*>(value))) {
+        candidates.push_back(value);
+      }
+    }
+  }
+  std::sort(candidates.begin(), candidates.end());
+  candidates.erase(std::unique(candidates.begin(), candidates.end()),
+                   candidates.end());
+  return candidates;
+}
+
+int aot_compiler_main(const std::vector<std::string>& args) {
+  if (cvars::target.empty() || cvars::aot_cache_root.empty()) {
+    XELOGE("Usage: {} [target] [aot_cache_root]", xe::path_to_utf8(args[0]));
+    return 1;
+  }
+
+  // Use every core, and chase direct calls all the way down rather than the
+  // few levels that pay off while a title is running.
+  cvars::jit_compile_threads =
+      int32_t(std::max(1u, xe::threading::logical_processor_count()));
+  cvars::jit_speculative_depth = INT_MAX;
+  // Baseline tier functions are never persisted, so with tiering on the cache
+  // would come out empty.
+  cvars::jit_tiered_compilation = false;
+
+  auto emulator = std::make_unique<Emulator>("", "", "", cvars::aot_cache_root);
+  X_STATUS result = emulator->Setup(
+      nullptr, nullptr, true, nullptr,
+      []() { return std::make_unique<gpu::null::NullGraphicsSystem>(); },
+      nullptr);
+  if (XFAILED(result)) {
+    XELOGE("Failed to set up the emulator: {:08X}", result);
+    return 1;
+  }
+
+  // Same layout as Emulator::LaunchXexFile, minus launching.
+  auto mount_path = "\\Device\\Harddisk0\\Partition1";
+  auto device = std::make_unique<vfs::HostPathDevice>(
+      mount_path, std::filesystem::absolute(cvars::target).parent_path(),
+      true);
+  if (!device->Initialize() ||
+      !emulator->file_system()->RegisterDevice(std::move(device))) {
+    XELOGE("Unable to mount {}", xe::path_to_utf8(cvars::target));
+    return 1;
+  }
+  emulator->file_system()->RegisterSymbolicLink("game:", mount_path);
+  emulator->file_system()->RegisterSymbolicLink("d:", mount_path);
+
+  auto module = emulator->kernel_state()->LoadUserModule(
+      "game:\\" + xe::path_to_utf8(cvars::target.filename()), false);
+  if (!module) {
+    XELOGE("Failed to load {}", xe::path_to_utf8(cvars::target));
+    return 1;
+  }
+  auto xex_module = module->xex_module();
+
+  auto processor = emulator->processor();
+  if (!processor->backend()->OpenPersistentCache(
+          cvars::aot_cache_root / "jit", xex_module->hash(), true)) {
+    XELOGE("The {} backend cannot write a code cache", cvars::cpu);
+    return 1;
+  }
+
+  std::vector<uint32_t> roots;
+  if (module->entry_point()) {
+    roots.push_back(module->entry_point());
+  }
+  auto exports = xex_module->GetExportedFunctions();
+  roots.insert(roots.end(), exports.begin(), exports.end());
+  auto candidates =
+      FindIndirectCallCandidates(emulator->memory(), xex_module);
+  roots.insert(roots.end(), candidates.begin(), candidates.end());
+  XELOGI("{}: {} exports, {} indirect call candidates",
+         xe::path_to_utf8(cvars::target), exports.size(), candidates.size());
+
+  auto start_time = std::chrono::steady_clock::now();
+  uint64_t compiled_count = 0;
+  auto compile_queue = processor->compile_queue();
+  if (compile_queue && compile_queue->worker_count()) {
+    // Callees discovered while emitting are queued by the workers themselves.
+    compile_queue->Enqueue(roots);
+    compile_queue->WaitForIdle();
+    compiled_count = compile_queue->compiled_count();
+  } else {
+    XELOGW("No compile workers; only compiling the roots");
+    for (uint32_t address : roots) {
+      compiled_count += processor->PrecompileFunction(address) ? 1 : 0;
+    }
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start_time;
+
+  XELOGI("Compiled {} functions in {:.2f}s into {}", compiled_count,
+         elapsed.count(), xe::path_to_utf8(cvars::aot_cache_root / "jit"));
+  return 0;
+}
+
+}  // namespace tools
+}  // namespace xe
+
+XE_DEFINE_CONSOLE_APP("xenia-aot-compiler", xe::tools::aot_compiler_main,
+                      "[target] [aot_cache_root]", "target", "aot_cache_root");
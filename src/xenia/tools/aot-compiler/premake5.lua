@@ -0,0 +1,49 @@
+project_root = "../../../.."
+include(project_root.."/tools/build")
+
+group("src")
+project("xenia-aot-compiler")
+  uuid("5b0c6a0e-93a4-4d3f-8f3e-6f2d1c7a9b41")
+  kind("ConsoleApp")
+  language("C++")
+  links({
+    "xenia-apu",
+    "xenia-base",
+    "xenia-core",
+    "xenia-cpu",
+    "xenia-gpu",
+    "xenia-gpu-null",
+    "xenia-hid",
+    "xenia-kernel",
+    "xenia-ui",
+    "xenia-vfs",
+  })
+  links({
+    "aes_128",
+    "capstone",
+    "fmt",
+    "dxbc",
+    "glslang-spirv",
+    "imgui",
+    "libavcodec",
+    "libavutil",
+    "mspack",
+    "snappy",
+    "xxhash",
+  })
+  defines({
+    "XBYAK_NO_OP_NAMES",
+    "XBYAK_ENABLE_OMITTED_OPERAND",
+  })
+  files({
+    "aot_compiler_main.cc",
+    project_root.."/src/xenia/base/console_app_main_"..platform_suffix..".cc",
+  })
+  resincludedirs({
+    project_root,
+  })
+
+  filter("architecture:x86_64")
+    links({
+      "xenia-cpu-backend-x64",
+    })
@@ -0,0 +1,24 @@
+project_root = "../../../.."
+include(project_root.."/tools/build")
+
+group("src")
+project("xenia-trace-decoder")
+  uuid("c3e1f0a4-2b7d-4e59-9a8c-5d6f1b2e7a30")
+  kind("ConsoleApp")
+  language("C++")
+  -- The record formatting lives in the backend, which needs xenia-base after
+  -- it for single-pass linkers.
+  links({
+    "xenia-cpu-backend-x64",
+    "xenia-base",
+  })
+  links({
+    "fmt",
+  })
+  files({
+    "trace_decoder_main.cc",
+    project_root.."/src/xenia/base/console_app_main_"..platform_suffix..".cc",
+  })
+  resincludedirs({
+    project_root,
+  })
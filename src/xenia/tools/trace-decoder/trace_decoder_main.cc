@@ -0,0 +1,118 @@
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "third_party/fmt/include/fmt/format.h"
+#include "xenia/base/console_app_main.h"
+#include "xenia/base/cvar.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/logging.h"
+#include "xenia/cpu/backend/x64/x64_tracers.h"
+
+namespace xe {
+namespace tools {
+
+using namespace xe::cpu::backend::x64;
+
+DEFINE_transient_path(trace_file, "",
+                      "Binary trace written with --trace_binary_path.",
+                      "General");
+DEFINE_transient_string(thread, "",
+                        "Only print the records of this thread ID (hex).",
+                        "General");
+
+// Prints the records the way the tracers in x64_tracers.cc log them, with the
+// thread ID the log would show. Records of different threads are interleaved
+// in the order they were drained, not the order they were written.
+int trace_decoder_main(const std::vector<std::string>& args) {
+  if (cvars::trace_file.empty()) {
+    XELOGE("Usage: {} [trace_file] [--thread=ID]", xe::path_to_utf8(args[0]));
+    return 1;
+  }
+  uint32_t thread_filter =
+      cvars::thread.empty()
+          ? 0
+          : uint32_t(std::strtoul(cvars::thread.c_str(), nullptr, 16));
+
+  FILE* file = xe::filesystem::OpenFile(cvars::trace_file, "rb");
+  if (!file) {
+    XELOGE("Unable to open {}", xe::path_to_utf8(cvars::trace_file));
+    return 1;
+  }
+  TraceFileHeader header;
+  if (fread(&header, sizeof(header), 1, file) != 1 ||
+      header.signature != kTraceFileSignature ||
+      header.version != kTraceFileVersion) {
+    XELOGE("{} is not a binary trace of this version",
+           xe::path_to_utf8(cvars::trace_file));
+    fclose(file);
+    return 1;
+  }
+
+  std::unordered_map<uint32_t, std::string> strings;
+  std::vector<TraceRecord> records;
+  uint64_t record_count = 0;
+  uint64_t dropped_count = 0;
+  TraceChunkHeader chunk;
+  while (fread(&chunk, sizeof(chunk), 1, file) == 1) {
+    switch (chunk.type) {
+      case TraceChunkType::kString: {
+        std::string str(chunk.count, '\0');
+        if (chunk.count && fread(&str[0], chunk.count, 1, file) != 1) {
+          break;
+        }
+        strings[chunk.id] = std::move(str);
+        break;
+      }
+      case TraceChunkType::kRecords: {
+        records.resize(chunk.count);
+        if (chunk.count &&
+            fread(records.data(), sizeof(TraceRecord), chunk.count, file) !=
+                chunk.count) {
+          XELOGW("Trace ends in the middle of a chunk");
+          break;
+        }
+        record_count += chunk.count;
+        if (thread_filter && chunk.id != thread_filter) {
+          break;
+        }
+        for (const auto& record : records) {
+          std::string line = FormatTraceRecord(
+              record, record.type == TraceRecordType::kString
+                          ? strings[record.key]
+                          : std::string());
+          // Comments usually end in a line break of their own.
+          while (!line.empty() && line.back() == '\n') {
+            line.pop_back();
+          }
+          fmt::print("t> {:08X} {}\n", chunk.id, line);
+        }
+        break;
+      }
+      case TraceChunkType::kDropped:
+        dropped_count += chunk.count;
+        if (!thread_filter || chunk.id == thread_filter) {
+          fmt::print("t> {:08X} <{} records dropped>\n", chunk.id,
+                     chunk.count);
+        }
+        break;
+      default:
+        XELOGE("Unknown chunk type {}; the trace is corrupt",
+               uint32_t(chunk.type));
+        fclose(file);
+        return 1;
+    }
+  }
+  fclose(file);
+
+  XELOGI("{} records, {} dropped", record_count, dropped_count);
+  return 0;
+}
+
+}  // namespace tools
+}  // namespace xe
+
+XE_DEFINE_CONSOLE_APP("xenia-trace-decoder", xe::tools::trace_decoder_main,
+                      "[trace_file]", "trace_file");